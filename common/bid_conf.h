@@ -856,8 +856,8 @@
 #else
 #if !defined(__APPLE__) //Linux, FreeBSD
 #define BID_THREAD __thread
-#else //Mac OSX, TBD
-#define BID_THREAD
+#else //Mac OSX
+#define BID_THREAD __thread
 #endif //Linux or Mac
 #endif //Windows
 #endif //BID_THREAD
@@ -20,6 +20,7 @@
 
 #include "core_commands1.h"
 #include "core_commands2.h"
+#include "core_commands5.h"
 #include "core_display.h"
 #include "core_helpers.h"
 #include "core_main.h"
@@ -659,12 +660,16 @@ int docmd_clsigma(arg_struct *arg) {
     size = r->rows * r->columns;
     if (last > size)
         return ERR_SIZE_ERROR;
+    if (!disentangle(regs))
+        return ERR_INSUFFICIENT_MEMORY;
     for (i = first; i < last; i++) {
-        if (r->array->is_string[i] == 2)
+        if (r->array->str_type(i) == 2)
             free(*(void **) &r->array->data[i]);
-        r->array->is_string[i] = 0;
+        if (r->array->is_string != NULL)
+            r->array->is_string[i] = 0;
         r->array->data[i] = 0;
     }
+    clear_sigma_acc();
     flags.f.log_fit_invalid = 0;
     flags.f.exp_fit_invalid = 0;
     flags.f.pwr_fit_invalid = 0;
@@ -733,11 +738,9 @@ int docmd_clrg(arg_struct *arg) {
             return ERR_INSUFFICIENT_MEMORY;
         rm = (vartype_realmatrix *) regs;
         sz = rm->rows * rm->columns;
-        free_long_strings(rm->array->is_string, rm->array->data, sz);
+        rm->array->drop_strings(sz);
         for (i = 0; i < sz; i++)
             rm->array->data[i] = 0;
-        for (i = 0; i < sz; i++)
-            rm->array->is_string[i] = 0;
         return ERR_NONE;
     } else if (regs->type == TYPE_COMPLEXMATRIX) {
         vartype_complexmatrix *cm;
@@ -1265,7 +1268,7 @@ int docmd_sign(arg_struct *arg) {
                 return ERR_INSUFFICIENT_MEMORY;
             size = src->rows * src->columns;
             for (i = 0; i < size; i++) {
-                if (src->array->is_string[i] != 0)
+                if (src->array->str_type(i) != 0)
                     dst->array->data[i] = 0;
                 else
                     dst->array->data[i] = src->array->data[i] < 0 ? -1 : 1;
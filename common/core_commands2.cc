@@ -286,6 +286,41 @@ int docmd_ran(arg_struct *arg) {
     return recall_result(v);
 }
 
+int docmd_ranm(arg_struct *arg) {
+    /* Returns a matrix or list with the same dimensions as X, filled with
+     * random numbers, in the same sequence as RAN would produce them, going
+     * row by row. For lists, all the elements are allocated before any
+     * numbers are generated, so that running out of memory doesn't advance
+     * the generator.
+     */
+    vartype *v;
+    if (stack[sp]->type == TYPE_REALMATRIX) {
+        vartype_realmatrix *src = (vartype_realmatrix *) stack[sp];
+        v = new_realmatrix(src->rows, src->columns);
+        if (v == NULL)
+            return ERR_INSUFFICIENT_MEMORY;
+        math_random_fill(((vartype_realmatrix *) v)->array->data,
+                         src->rows * src->columns);
+    } else {
+        int4 n = ((vartype_list *) stack[sp])->size;
+        v = new_list(n);
+        if (v == NULL)
+            return ERR_INSUFFICIENT_MEMORY;
+        vartype **data = ((vartype_list *) v)->array->data;
+        for (int4 i = 0; i < n; i++) {
+            data[i] = new_real(0);
+            if (data[i] == NULL) {
+                free_vartype(v);
+                return ERR_INSUFFICIENT_MEMORY;
+            }
+        }
+        for (int4 i = 0; i < n; i++)
+            ((vartype_real *) data[i])->x = math_random();
+    }
+    unary_result(v);
+    return ERR_NONE;
+}
+
 int docmd_seed(arg_struct *arg) {
     phloat x = ((vartype_real *) stack[sp])->x;
     if (x == 0) {
@@ -674,7 +709,7 @@ static int generic_loop(arg_struct *arg, bool isg) {
                 int4 index = arg->val.num;
                 if (index >= size)
                     return ERR_SIZE_ERROR;
-                if (rm->array->is_string[index] != 0)
+                if (rm->array->str_type(index) != 0)
                     return ERR_ALPHA_DATA_IS_INVALID;
                 else {
                     if (!disentangle(regs))
@@ -768,7 +803,7 @@ int docmd_xtoa(arg_struct *arg) {
         char buf[44];
         int buflen = 0;
         for (i = size - 1; i >= 0; i--) {
-            if (m->array->is_string[i] != 0) {
+            if (m->array->str_type(i) != 0) {
                 int4 len;
                 char *text;
                 get_matrix_string(m, i, &text, &len);
@@ -1077,7 +1112,7 @@ int docmd_prsigma(arg_struct *arg) {
     print_text(NULL, 0, true);
     for (i = 0; i < nr; i++) {
         int4 j = i + mode_sigma_reg;
-        if (rm->array->is_string[j] != 0) {
+        if (rm->array->str_type(j) != 0) {
             char *text;
             int4 len;
             get_matrix_string(rm, j, &text, &len);
@@ -1208,7 +1243,7 @@ static int prv_worker(bool interrupted) {
             llen += int2string(j + 1, lbuf + llen, 32 - llen);
             char2buf(lbuf, 32, &llen, '=');
         }
-        if (rm->array->is_string[prv_index] != 0) {
+        if (rm->array->str_type(prv_index) != 0) {
             char *text;
             int4 len;
             get_matrix_string(rm, prv_index, &text, &len);
@@ -1813,7 +1848,8 @@ int docmd_str_t(arg_struct *arg) {
 
 int docmd_mat_t(arg_struct *arg) {
     return stack[sp]->type == TYPE_REALMATRIX
-            || stack[sp]->type == TYPE_COMPLEXMATRIX ? ERR_YES : ERR_NO;
+            || stack[sp]->type == TYPE_COMPLEXMATRIX
+            || stack[sp]->type == TYPE_SPARSE ? ERR_YES : ERR_NO;
 }
 
 int docmd_dim_t(arg_struct *arg) {
@@ -1821,6 +1857,9 @@ int docmd_dim_t(arg_struct *arg) {
     if (stack[sp]->type == TYPE_REALMATRIX) {
         rows = ((vartype_realmatrix *) stack[sp])->rows;
         columns = ((vartype_realmatrix *) stack[sp])->columns;
+    } else if (stack[sp]->type == TYPE_SPARSE) {
+        rows = ((vartype_sparse *) stack[sp])->rows;
+        columns = ((vartype_sparse *) stack[sp])->columns;
     } else {
         rows = ((vartype_complexmatrix *) stack[sp])->rows;
         columns = ((vartype_complexmatrix *) stack[sp])->columns;
@@ -32,6 +32,7 @@ int docmd_perm(arg_struct *arg);
 int docmd_fact(arg_struct *arg);
 int docmd_gamma(arg_struct *arg);
 int docmd_ran(arg_struct *arg);
+int docmd_ranm(arg_struct *arg);
 int docmd_seed(arg_struct *arg);
 int docmd_lbl(arg_struct *arg);
 int docmd_rtn(arg_struct *arg);
@@ -292,10 +292,10 @@ int docmd_cross(arg_struct *arg) {
         if (ls > 3 || rs > 3)
             return ERR_DIMENSION_ERROR;
         for (i = 0; i < ls; i++)
-            if (left->array->is_string[i] != 0)
+            if (left->array->str_type(i) != 0)
                 return ERR_ALPHA_DATA_IS_INVALID;
         for (i = 0; i < rs; i++)
-            if (right->array->is_string[i] != 0)
+            if (right->array->str_type(i) != 0)
                 return ERR_ALPHA_DATA_IS_INVALID;
         switch (ls) {
             case 3: zl = left->array->data[2];
@@ -401,7 +401,7 @@ int docmd_delr(arg_struct *arg) {
     interactive = matedit_mode == 2 || matedit_mode == 3;
     if (interactive) {
         if (m->type == TYPE_REALMATRIX) {
-            if (rm->array->is_string[n] != 0) {
+            if (rm->array->str_type(n) != 0) {
                 char *text;
                 int4 len;
                 get_matrix_string(rm, n, &text, &len);
@@ -432,15 +432,17 @@ int docmd_delr(arg_struct *arg) {
         if (m->type == TYPE_REALMATRIX) {
             for (j = 0; j < columns; j++) {
                 phloat tempd = rm->array->data[matedit_i * columns + j];
-                char tempc = rm->array->is_string[matedit_i * columns + j];
+                char tempc = rm->array->str_type(matedit_i * columns + j);
                 for (i = matedit_i; i < rows - 1; i++) {
                     rm->array->data[i * columns + j] =
                                 rm->array->data[(i + 1) * columns + j];
-                    rm->array->is_string[i * columns + j] =
+                    if (rm->array->is_string != NULL)
+                        rm->array->is_string[i * columns + j] =
                                 rm->array->is_string[(i + 1) * columns + j];
                 }
                 rm->array->data[(rows - 1) * columns + j] = tempd;
-                rm->array->is_string[(rows - 1) * columns + j] = tempc;
+                if (rm->array->is_string != NULL)
+                    rm->array->is_string[(rows - 1) * columns + j] = tempc;
             }
             err = dimension_array_ref(m, rows - 1, columns);
             if (err != ERR_NONE) {
@@ -448,15 +450,17 @@ int docmd_delr(arg_struct *arg) {
                  * it was before. */
                 for (j = 0; j < columns; j++) {
                     phloat tempd = rm->array->data[(rows - 1) * columns + j];
-                    char tempc = rm->array->is_string[(rows - 1) * columns + j];
+                    char tempc = rm->array->str_type((rows - 1) * columns + j);
                     for (i = rows - 1; i > matedit_i; i--) {
                         rm->array->data[i * columns + j] =
                                     rm->array->data[(i - 1) * columns + j];
-                        rm->array->is_string[i * columns + j] =
+                        if (rm->array->is_string != NULL)
+                            rm->array->is_string[i * columns + j] =
                                     rm->array->is_string[(i - 1) * columns + j];
                     }
                     rm->array->data[matedit_i * columns + j] = tempd;
-                    rm->array->is_string[matedit_i * columns + j] = tempc;
+                    if (rm->array->is_string != NULL)
+                        rm->array->is_string[matedit_i * columns + j] = tempc;
                 }
                 if (interactive)
                     free_vartype(newx);
@@ -512,25 +516,26 @@ int docmd_delr(arg_struct *arg) {
                 free(array);
                 return ERR_INSUFFICIENT_MEMORY;
             }
-            array->is_string = (char *) malloc(newsize);
-            if (array->is_string == NULL) {
-                if (interactive)
-                    free_vartype(newx);
-                free(array->data);
-                free(array);
-                return ERR_INSUFFICIENT_MEMORY;
+            if (rm->array->is_string == NULL)
+                array->is_string = NULL;
+            else {
+                array->is_string = (char *) malloc(newsize);
+                if (array->is_string == NULL) {
+                    if (interactive)
+                        free_vartype(newx);
+                    free(array->data);
+                    free(array);
+                    return ERR_INSUFFICIENT_MEMORY;
+                }
+                for (i = 0; i < matedit_i * columns; i++)
+                    array->is_string[i] = rm->array->is_string[i];
+                for (i = matedit_i * columns; i < newsize; i++)
+                    array->is_string[i] = rm->array->is_string[i + columns];
             }
-            for (i = 0; i < matedit_i * columns; i++) {
-                array->is_string[i] = rm->array->is_string[i];
+            for (i = 0; i < matedit_i * columns; i++)
                 array->data[i] = rm->array->data[i];
-            }
-            for (i = matedit_i * columns; i < (matedit_i + 1) * columns; i++)
-                if (array->is_string[i] == 2)
-                    free(*(void **) &array->data[i]);
-            for (i = matedit_i * columns; i < newsize; i++) {
-                array->is_string[i] = rm->array->is_string[i + columns];
+            for (i = matedit_i * columns; i < newsize; i++)
                 array->data[i] = rm->array->data[i + columns];
-            }
             array->refcount = 1;
             rm->array->refcount--;
             rm->array = array;
@@ -585,7 +590,9 @@ int docmd_delr(arg_struct *arg) {
                 }
             }
             array->refcount = 1;
-            list->array->refcount--;
+            array->capacity = newsize;
+            array->used = -1;
+            detach_list_data(list->array, list->size);
             list->array = array;
             list->size--;
         }
@@ -655,15 +662,13 @@ int docmd_dot(arg_struct *arg) {
         vartype_realmatrix *rm1 = (vartype_realmatrix *) stack[sp];
         vartype_realmatrix *rm2 = (vartype_realmatrix *) stack[sp - 1];
         int4 size = rm1->rows * rm1->columns;
-        int4 i;
-        phloat dot = 0;
+        phloat dot;
         int inf;
         if (size != rm2->rows * rm2->columns)
             return ERR_DIMENSION_ERROR;
         if (contains_strings(rm1) || contains_strings(rm2))
             return ERR_ALPHA_DATA_IS_INVALID;
-        for (i = 0; i < size; i++)
-            dot += rm1->array->data[i] * rm2->array->data[i];
+        dot = vector_dot(rm1->array->data, 1, rm2->array->data, 1, size);
         if ((inf = p_isinf(dot)) != 0) {
             if (flags.f.range_error_ignore)
                 dot = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
@@ -678,8 +683,8 @@ int docmd_dot(arg_struct *arg) {
                     && stack[sp - 1]->type == TYPE_REALMATRIX)) {
         vartype_realmatrix *rm;
         vartype_complexmatrix *cm;
-        int4 size, i;
-        phloat dot_re = 0, dot_im = 0;
+        int4 size;
+        phloat dot_re, dot_im;
         int inf;
         if (stack[sp]->type == TYPE_REALMATRIX) {
             rm = (vartype_realmatrix *) stack[sp];
@@ -693,10 +698,8 @@ int docmd_dot(arg_struct *arg) {
             return ERR_DIMENSION_ERROR;
         if (contains_strings(rm))
             return ERR_ALPHA_DATA_IS_INVALID;
-        for (i = 0; i < size; i++) {
-            dot_re += rm->array->data[i] * cm->array->data[2 * i];
-            dot_im += rm->array->data[i] * cm->array->data[2 * i + 1];
-        }
+        dot_re = vector_dot(rm->array->data, 1, cm->array->data, 2, size);
+        dot_im = vector_dot(rm->array->data, 1, cm->array->data + 1, 2, size);
         if ((inf = p_isinf(dot_re)) != 0) {
             if (flags.f.range_error_ignore)
                 dot_re = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
@@ -881,7 +884,7 @@ int docmd_edit(arg_struct *arg) {
     vartype *v;
     if (stack[sp]->type == TYPE_REALMATRIX) {
         vartype_realmatrix *rm = (vartype_realmatrix *) stack[sp];
-        if (rm->array->is_string[0] != 0) {
+        if (rm->array->str_type(0) != 0) {
             char *text;
             int4 len;
             get_matrix_string(rm, 0, &text, &len);
@@ -954,7 +957,7 @@ int docmd_editn(arg_struct *arg) {
     vartype *v;
     if (m->type == TYPE_REALMATRIX) {
         vartype_realmatrix *rm = (vartype_realmatrix *) m;
-        if (rm->array->is_string[0] != 0) {
+        if (rm->array->str_type(0) != 0) {
             char *text;
             int4 len;
             get_matrix_string(rm , 0, &text, &len);
@@ -1084,15 +1087,29 @@ static int fnrm(vartype *m, phloat *norm) {
         data = cm->array->data;
     }
     int max_exp = INT_MIN;
-    for (int4 i = 0; i < size; i++) {
-        int s = ilogb(data[i]);
-        if (s > max_exp)
-            max_exp = s;
-    }
     phloat nrm = 0;
-    for (int4 i = 0; i < size; i++) {
-        phloat x = scalbn(data[i], -max_exp);
-        nrm += x * x;
+    bool scaled = false;
+#ifndef BCD_MATH
+    // The largest exponent is that of the largest magnitude, and when it is
+    // in the normal range, scaling by multiplying with a power of two gives
+    // the same results as scalbn(), only much faster.
+    int e = ilogb(vector_max_abs(data, size));
+    if (e >= -1021 && e <= 1021) {
+        max_exp = e;
+        nrm = vector_scaled_sum_squares(data, size, scalbn(1.0, -max_exp));
+        scaled = true;
+    }
+#endif
+    if (!scaled) {
+        for (int4 i = 0; i < size; i++) {
+            int s = ilogb(data[i]);
+            if (s > max_exp)
+                max_exp = s;
+        }
+        for (int4 i = 0; i < size; i++) {
+            phloat x = scalbn(data[i], -max_exp);
+            nrm += x * x;
+        }
     }
     nrm = scalbn(sqrt(nrm), max_exp);
     if (p_isinf(nrm)) {
@@ -1156,6 +1173,26 @@ int docmd_getm(arg_struct *arg) {
     if (y < 0)
         y = -y;
 
+    /* Getting the whole matrix doesn't require a copy; the result can
+     * share the data with the original until one of them is modified.
+     */
+    if (matedit_i == 0 && matedit_j == 0) {
+        int4 rows, columns;
+        if (m->type == TYPE_REALMATRIX) {
+            rows = ((vartype_realmatrix *) m)->rows;
+            columns = ((vartype_realmatrix *) m)->columns;
+        } else {
+            rows = ((vartype_complexmatrix *) m)->rows;
+            columns = ((vartype_complexmatrix *) m)->columns;
+        }
+        if (y == rows && x == columns) {
+            vartype *v = dup_vartype(m);
+            if (v == NULL)
+                return ERR_INSUFFICIENT_MEMORY;
+            return binary_result(v);
+        }
+    }
+
     if (m->type == TYPE_REALMATRIX) {
         vartype_realmatrix *src, *dst;
         int4 i, j;
@@ -1165,11 +1202,16 @@ int docmd_getm(arg_struct *arg) {
         dst = (vartype_realmatrix *) new_realmatrix(y, x);
         if (dst == NULL)
             return ERR_INSUFFICIENT_MEMORY;
+        if (src->array->is_string != NULL
+                && !dst->array->make_is_string(y * x)) {
+            free_vartype((vartype *) dst);
+            return ERR_INSUFFICIENT_MEMORY;
+        }
         for (i = 0; i < y; i++)
             for (j = 0; j < x; j++) {
                 int4 n1 = (i + matedit_i) * src->columns + j + matedit_j;
                 int4 n2 = i * dst->columns + j;
-                if (src->array->is_string[n1] == 2) {
+                if (src->array->str_type(n1) == 2) {
                     int4 *sp = *(int4 **) &src->array->data[n1];
                     int4 *dp = (int4 *) malloc(*sp + 4);
                     if (dp == NULL) {
@@ -1181,7 +1223,8 @@ int docmd_getm(arg_struct *arg) {
                 } else {
                     dst->array->data[n2] = src->array->data[n1];
                 }
-                dst->array->is_string[n2] = src->array->is_string[n1];
+                if (dst->array->is_string != NULL)
+                    dst->array->is_string[n2] = src->array->is_string[n1];
             }
         return binary_result((vartype *) dst);
     } else /* m->type == TYPE_COMPLEXMATRIX */ {
@@ -101,12 +101,15 @@ int docmd_insr(arg_struct *arg) {
         }
         rows++;
         if (m->type == TYPE_REALMATRIX) {
+            char *is_string = rm->array->is_string;
             for (i = rows * columns - 1; i >= (matedit_i + 1) * columns; i--) {
-                rm->array->is_string[i] = rm->array->is_string[i - columns];
+                if (is_string != NULL)
+                    is_string[i] = is_string[i - columns];
                 rm->array->data[i] = rm->array->data[i - columns];
             }
             for (i = matedit_i * columns; i < (matedit_i + 1) * columns; i++) {
-                rm->array->is_string[i] = 0;
+                if (is_string != NULL)
+                    is_string[i] = 0;
                 rm->array->data[i] = 0;
             }
         } else if (m->type == TYPE_COMPLEXMATRIX) {
@@ -157,26 +160,30 @@ int docmd_insr(arg_struct *arg) {
                 free(array);
                 return ERR_INSUFFICIENT_MEMORY;
             }
-            array->is_string = (char *) malloc(newsize);
-            if (array->is_string == NULL) {
-                if (interactive)
-                    free_vartype(newx);
-                free(array->data);
-                free(array);
-                return ERR_INSUFFICIENT_MEMORY;
+            if (rm->array->is_string == NULL)
+                array->is_string = NULL;
+            else {
+                array->is_string = (char *) malloc(newsize);
+                if (array->is_string == NULL) {
+                    if (interactive)
+                        free_vartype(newx);
+                    free(array->data);
+                    free(array);
+                    return ERR_INSUFFICIENT_MEMORY;
+                }
+                for (i = 0; i < matedit_i * columns; i++)
+                    array->is_string[i] = rm->array->is_string[i];
+                for (i = matedit_i * columns; i < (matedit_i + 1) * columns; i++)
+                    array->is_string[i] = 0;
+                for (i = (matedit_i + 1) * columns; i < newsize; i++)
+                    array->is_string[i] = rm->array->is_string[i - columns];
             }
-            for (i = 0; i < matedit_i * columns; i++) {
-                array->is_string[i] = rm->array->is_string[i];
+            for (i = 0; i < matedit_i * columns; i++)
                 array->data[i] = rm->array->data[i];
-            }
-            for (i = matedit_i * columns; i < (matedit_i + 1) * columns; i++) {
-                array->is_string[i] = 0;
+            for (i = matedit_i * columns; i < (matedit_i + 1) * columns; i++)
                 array->data[i] = 0;
-            }
-            for (i = (matedit_i + 1) * columns; i < newsize; i++) {
-                array->is_string[i] = rm->array->is_string[i - columns];
+            for (i = (matedit_i + 1) * columns; i < newsize; i++)
                 array->data[i] = rm->array->data[i - columns];
-            }
             array->refcount = 1;
             rm->array->refcount--;
             rm->array = array;
@@ -236,7 +243,9 @@ int docmd_insr(arg_struct *arg) {
                 }
             }
             array->refcount = 1;
-            list->array->refcount--;
+            array->capacity = newsize;
+            array->used = -1;
+            detach_list_data(list->array, list->size);
             list->array = array;
             list->size++;
         }
@@ -278,11 +287,8 @@ int docmd_j_add(arg_struct *arg) {
             if (matedit_i == list->size - 1 && flags.f.grow) {
                 if (!disentangle((vartype *) list))
                     return ERR_INSUFFICIENT_MEMORY;
-                int4 newsize = list->size + 1;
-                vartype **newdata = (vartype **) realloc(list->array->data, newsize * sizeof(vartype *));
-                if (newdata == NULL)
+                if (!grow_list(list, list->size + 1))
                     return ERR_INSUFFICIENT_MEMORY;
-                list->array->data = newdata;
                 vartype *zero = new_real(0);
                 if (zero == NULL)
                     return ERR_INSUFFICIENT_MEMORY;
@@ -457,7 +463,7 @@ int docmd_putm(arg_struct *arg) {
 
     if (stack[sp]->type == TYPE_STRING)
         return ERR_ALPHA_DATA_IS_INVALID;
-    else if (stack[sp]->type == TYPE_REAL || stack[sp]->type == TYPE_COMPLEX)
+    else if (stack[sp]->type != TYPE_REALMATRIX && stack[sp]->type != TYPE_COMPLEXMATRIX)
         return ERR_INVALID_TYPE;
 
     if (m->type == TYPE_REALMATRIX) {
@@ -483,13 +489,21 @@ int docmd_putm(arg_struct *arg) {
             return ERR_INSUFFICIENT_MEMORY;
         }
         src = (vartype_realmatrix *) v;
+        if ((src->array->is_string != NULL || dst->array->is_string != NULL)
+                && (!src->array->make_is_string(src->rows * src->columns)
+                 || !dst->array->make_is_string(dst->rows * dst->columns))) {
+            free_vartype(v);
+            return ERR_INSUFFICIENT_MEMORY;
+        }
         for (i = 0; i < src->rows; i++)
             for (j = 0; j < src->columns; j++) {
                 int4 n1 = i * src->columns + j;
                 int4 n2 = (i + matedit_i) * dst->columns + j + matedit_j;
-                char tc = dst->array->is_string[n2];
-                dst->array->is_string[n2] = src->array->is_string[n1];
-                src->array->is_string[n1] = tc;
+                if (dst->array->is_string != NULL) {
+                    char tc = dst->array->is_string[n2];
+                    dst->array->is_string[n2] = src->array->is_string[n1];
+                    src->array->is_string[n1] = tc;
+                }
                 phloat tp = dst->array->data[n2];
                 dst->array->data[n2] = src->array->data[n1];
                 src->array->data[n1] = tp;
@@ -542,7 +556,7 @@ int docmd_rclel(arg_struct *arg) {
     if (m->type == TYPE_REALMATRIX) {
         vartype_realmatrix *rm = (vartype_realmatrix *) m;
         int4 n = matedit_i * rm->columns + matedit_j;
-        if (rm->array->is_string[n] != 0) {
+        if (rm->array->str_type(n) != 0) {
             char *text;
             int4 length;
             get_matrix_string(rm, n, &text, &length);
@@ -586,14 +600,7 @@ int docmd_rnrm(arg_struct *arg) {
             return ERR_ALPHA_DATA_IS_INVALID;
         phloat max = 0;
         for (int4 i = 0; i < rm->rows; i++) {
-            phloat nrm = 0;
-            for (int4 j = 0; j < rm->columns; j++) {
-                phloat x = rm->array->data[i * rm->columns + j];
-                if (x >= 0)
-                    nrm += x;
-                else
-                    nrm -= x;
-            }
+            phloat nrm = vector_abs_sum(rm->array->data + i * rm->columns, rm->columns);
             if (p_isinf(nrm)) {
                 if (flags.f.range_error_ignore)
                     max = POS_HUGE_PHLOAT;
@@ -649,10 +656,8 @@ int docmd_rsum(arg_struct *arg) {
         if (res == NULL)
             return ERR_INSUFFICIENT_MEMORY;
         for (int4 i = 0; i < rm->rows; i++) {
-            phloat sum = 0;
+            phloat sum = vector_sum(rm->array->data + i * rm->columns, 1, rm->columns);
             int inf;
-            for (int4 j = 0; j < rm->columns; j++)
-                sum += rm->array->data[i * rm->columns + j];
             if ((inf = p_isinf(sum)) != 0) {
                 if (flags.f.range_error_ignore)
                     sum = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
@@ -668,17 +673,15 @@ int docmd_rsum(arg_struct *arg) {
     } else if (stack[sp]->type == TYPE_COMPLEXMATRIX) {
         vartype_complexmatrix *cm = (vartype_complexmatrix *) stack[sp];
         vartype_complexmatrix *res;
-        int4 i, j;
+        int4 i;
         res = (vartype_complexmatrix *) new_complexmatrix(cm->rows, 1);
         if (res == NULL)
             return ERR_INSUFFICIENT_MEMORY;
         for (i = 0; i < cm->rows; i++) {
-            phloat sum_re = 0, sum_im = 0;
+            phloat *row = cm->array->data + 2 * i * cm->columns;
+            phloat sum_re = vector_sum(row, 2, cm->columns);
+            phloat sum_im = vector_sum(row + 1, 2, cm->columns);
             int inf;
-            for (j = 0; j < cm->columns; j++) {
-                sum_re += cm->array->data[2 * (i * cm->columns + j)];
-                sum_im += cm->array->data[2 * (i * cm->columns + j) + 1];
-            }
             if ((inf = p_isinf(sum_re)) != 0) {
                 if (flags.f.range_error_ignore)
                     sum_re = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
@@ -757,11 +760,13 @@ int docmd_swap_r(arg_struct *arg) {
         for (i = 0; i < rm->columns; i++) {
             int4 n1 = x * rm->columns + i;
             int4 n2 = y * rm->columns + i;
-            char tempc = rm->array->is_string[n1];
+            if (rm->array->is_string != NULL) {
+                char tempc = rm->array->is_string[n1];
+                rm->array->is_string[n1] = rm->array->is_string[n2];
+                rm->array->is_string[n2] = tempc;
+            }
             phloat tempds = rm->array->data[n1];
-            rm->array->is_string[n1] = rm->array->is_string[n2];
             rm->array->data[n1] = rm->array->data[n2];
-            rm->array->is_string[n2] = tempc;
             rm->array->data[n2] = tempds;
         }
         return ERR_NONE;
@@ -850,9 +855,10 @@ int docmd_stoel(arg_struct *arg) {
         vartype_realmatrix *rm = (vartype_realmatrix *) m;
         int4 n = matedit_i * rm->columns + matedit_j;
         if (stack[sp]->type == TYPE_REAL) {
-            if (rm->array->is_string[n] == 2)
+            if (rm->array->str_type(n) == 2)
                 free(*(void **) &rm->array->data[n]);
-            rm->array->is_string[n] = 0;
+            if (rm->array->is_string != NULL)
+                rm->array->is_string[n] = 0;
             rm->array->data[n] = ((vartype_real *) stack[sp])->x;
             return ERR_NONE;
         } else if (stack[sp]->type == TYPE_STRING) {
@@ -995,33 +1001,73 @@ int docmd_tanh(arg_struct *arg) {
     return err;
 }
 
+/* The transpose is copied in square tiles, so that both the reads and the
+ * strided writes stay within a few cache lines at a time, instead of
+ * touching a new line for every element written once the matrix gets large.
+ * It can't be done in place, even when the matrix isn't shared, since the
+ * original has to be kept for LASTX.
+ */
+#define TRANS_BLOCK 16
+
 int docmd_trans(arg_struct *arg) {
+    /* Row and column vectors are laid out the same way in memory, so
+     * transposing one is just a matter of swapping its dimensions. The
+     * result shares its data with the original, until one of them is
+     * modified and disentangled.
+     */
     if (stack[sp]->type == TYPE_REALMATRIX) {
         vartype_realmatrix *src = (vartype_realmatrix *) stack[sp];
         vartype_realmatrix *dst;
         int4 rows = src->rows;
         int4 columns = src->columns;
-        int4 i, j;
+        int4 i, j, ib, jb;
+        if (rows == 1 || columns == 1) {
+            dst = (vartype_realmatrix *) dup_vartype(stack[sp]);
+            if (dst == NULL)
+                return ERR_INSUFFICIENT_MEMORY;
+            dst->rows = columns;
+            dst->columns = rows;
+            unary_result((vartype *) dst);
+            return ERR_NONE;
+        }
         dst = (vartype_realmatrix *) new_realmatrix(columns, rows);
         if (dst == NULL)
             return ERR_INSUFFICIENT_MEMORY;
-        for (i = 0; i < rows; i++)
-            for (j = 0; j < columns; j++) {
-                int4 n1 = i * columns + j;
-                int4 n2 = j * rows + i;
-                dst->array->is_string[n2] = src->array->is_string[n1];
-                if (dst->array->is_string[n2] == 2) {
-                    int4 *sp = *(int4 **) &src->array->data[n1];
-                    int4 *dp = (int4 *) malloc(*sp + 4);
-                    if (dp == NULL) {
-                        free_vartype((vartype *) dst);
-                        return ERR_INSUFFICIENT_MEMORY;
+        if (src->array->is_string != NULL
+                && !dst->array->make_is_string(rows * columns)) {
+            free_vartype((vartype *) dst);
+            return ERR_INSUFFICIENT_MEMORY;
+        }
+        for (ib = 0; ib < rows; ib += TRANS_BLOCK) {
+            int4 iend = ib + TRANS_BLOCK < rows ? ib + TRANS_BLOCK : rows;
+            for (jb = 0; jb < columns; jb += TRANS_BLOCK) {
+                int4 jend = jb + TRANS_BLOCK < columns ? jb + TRANS_BLOCK : columns;
+                if (dst->array->is_string == NULL) {
+                    for (i = ib; i < iend; i++)
+                        for (j = jb; j < jend; j++)
+                            dst->array->data[j * rows + i] = src->array->data[i * columns + j];
+                    continue;
+                }
+                for (i = ib; i < iend; i++)
+                    for (j = jb; j < jend; j++) {
+                        int4 n1 = i * columns + j;
+                        int4 n2 = j * rows + i;
+                        dst->array->is_string[n2] = src->array->is_string[n1];
+                        if (dst->array->is_string[n2] == 2) {
+                            int4 *sp = *(int4 **) &src->array->data[n1];
+                            int4 *dp = (int4 *) malloc(*sp + 4);
+                            if (dp == NULL) {
+                                dst->array->is_string[n2] = 0;
+                                free_vartype((vartype *) dst);
+                                return ERR_INSUFFICIENT_MEMORY;
+                            }
+                            memcpy(dp, sp, *sp + 4);
+                            *(int4 **) &dst->array->data[n2] = dp;
+                        } else
+                            dst->array->data[n2] = src->array->data[n1];
                     }
-                    memcpy(dp, sp, *sp + 4);
-                    *(int4 **) &dst->array->data[n2] = dp;
-                } else
-                    dst->array->data[n2] = src->array->data[n1];
             }
+        }
         unary_result((vartype *) dst);
         return ERR_NONE;
     } else {
@@ -1029,17 +1075,32 @@ int docmd_trans(arg_struct *arg) {
         vartype_complexmatrix *dst;
         int4 rows = src->rows;
         int4 columns = src->columns;
-        int4 i, j;
+        int4 i, j, ib, jb;
+        if (rows == 1 || columns == 1) {
+            dst = (vartype_complexmatrix *) dup_vartype(stack[sp]);
+            if (dst == NULL)
+                return ERR_INSUFFICIENT_MEMORY;
+            dst->rows = columns;
+            dst->columns = rows;
+            unary_result((vartype *) dst);
+            return ERR_NONE;
+        }
         dst = (vartype_complexmatrix *) new_complexmatrix(columns, rows);
         if (dst == NULL)
             return ERR_INSUFFICIENT_MEMORY;
-        for (i = 0; i < rows; i++)
-            for (j = 0; j < columns; j++) {
-                int4 n1 = 2 * (i * columns + j);
-                int4 n2 = 2 * (j * rows + i);
-                dst->array->data[n2] = src->array->data[n1];
-                dst->array->data[n2 + 1] = src->array->data[n1 + 1];
+        for (ib = 0; ib < rows; ib += TRANS_BLOCK) {
+            int4 iend = ib + TRANS_BLOCK < rows ? ib + TRANS_BLOCK : rows;
+            for (jb = 0; jb < columns; jb += TRANS_BLOCK) {
+                int4 jend = jb + TRANS_BLOCK < columns ? jb + TRANS_BLOCK : columns;
+                for (i = ib; i < iend; i++)
+                    for (j = jb; j < jend; j++) {
+                        int4 n1 = 2 * (i * columns + j);
+                        int4 n2 = 2 * (j * rows + i);
+                        dst->array->data[n2] = src->array->data[n1];
+                        dst->array->data[n2 + 1] = src->array->data[n1 + 1];
+                    }
             }
+        }
         unary_result((vartype *) dst);
         return ERR_NONE;
     }
@@ -1149,7 +1210,7 @@ static int matedit_move_list(vartype_list *list, int direction) {
             new_i = 0;
             if (m->type == TYPE_REALMATRIX) {
                 vartype_realmatrix *rm = (vartype_realmatrix *) m;
-                if (rm->array->is_string[0] != 0) {
+                if (rm->array->str_type(0) != 0) {
                     char *text;
                     int4 len;
                     get_matrix_string(rm, 0, &text, &len);
@@ -1187,12 +1248,9 @@ static int matedit_move_list(vartype_list *list, int direction) {
             }
             if (!disentangle((vartype *) list))
                 goto nomem2;
-            int4 newsize = list->size + 1;
-            vartype **newdata = (vartype **) realloc(list->array->data, newsize * sizeof(vartype *));
-            if (newdata == NULL)
+            if (!grow_list(list, list->size + 1))
                 goto nomem2;
-            newdata[list->size] = zero1;
-            list->array->data = newdata;
+            list->array->data[list->size] = zero1;
             new_i = list->size++;
             new_x = zero2;
         } else {
@@ -1254,12 +1312,12 @@ static int matedit_move(int direction) {
         if (reg_x == NULL) {
             changed = false;
         } else if (reg_x->type == TYPE_REAL) {
-            if (rm->array->is_string[old_n] != 0)
+            if (rm->array->str_type(old_n) != 0)
                 changed = true;
             else
                 changed = rm->array->data[old_n] != ((vartype_real *) reg_x)->x;
         } else if (reg_x->type == TYPE_STRING) {
-            if (rm->array->is_string[old_n] == 0)
+            if (rm->array->str_type(old_n) == 0)
                 changed = true;
             else {
                 char *text;
@@ -1348,7 +1406,7 @@ static int matedit_move(int direction) {
 
     if (m->type == TYPE_REALMATRIX) {
         if (old_n != new_n) {
-            if (rm->array->is_string[new_n] != 0) {
+            if (rm->array->str_type(new_n) != 0) {
                 char *text;
                 int4 len;
                 get_matrix_string(rm, new_n, &text, &len);
@@ -1361,9 +1419,10 @@ static int matedit_move(int direction) {
         if (!changed) {
             /* There's nothing to store, so leave cell unchanged */
         } else if (stack[sp]->type == TYPE_REAL) {
-            if (rm->array->is_string[old_n] == 2)
+            if (rm->array->str_type(old_n) == 2)
                 free(*(void **) &rm->array->data[old_n]);
-            rm->array->is_string[old_n] = 0;
+            if (rm->array->is_string != NULL)
+                rm->array->is_string[old_n] = 0;
             rm->array->data[old_n] = ((vartype_real *) stack[sp])->x;
         } else {
             vartype_string *s = (vartype_string *) stack[sp];
@@ -1525,12 +1584,16 @@ static int matabx(int which) {
                 return ERR_NONEXISTENT;
             if (mata->type == TYPE_STRING)
                 return ERR_ALPHA_DATA_IS_INVALID;
-            if (mata->type != TYPE_REALMATRIX && mata->type != TYPE_COMPLEXMATRIX)
+            if (mata->type == TYPE_SPARSE) {
+                /* Sparse systems are solved for real right-hand sides only */
+                if (matb->type != TYPE_REALMATRIX)
+                    return ERR_INVALID_TYPE;
+            } else if (mata->type != TYPE_REALMATRIX && mata->type != TYPE_COMPLEXMATRIX)
                 return ERR_INVALID_TYPE;
 
             if (!ensure_var_space(1))
                 return ERR_INSUFFICIENT_MEMORY;
-            if (mata->type == TYPE_REALMATRIX && matb->type == TYPE_REALMATRIX)
+            if (mata->type != TYPE_COMPLEXMATRIX && matb->type == TYPE_REALMATRIX)
                 matx_v = new_real(0);
             else
                 matx_v = new_complex(0, 0);
@@ -1542,7 +1605,7 @@ static int matabx(int which) {
 
     if (mat->type == TYPE_REALMATRIX) {
         vartype_realmatrix *rm = (vartype_realmatrix *) mat;
-        if (rm->array->is_string[0] != 0) {
+        if (rm->array->str_type(0) != 0) {
             char *text;
             int4 length;
             get_matrix_string(rm, 0, &text, &length);
@@ -1616,6 +1679,14 @@ int docmd_simq(arg_struct *arg) {
         err = dimension_array_ref(mata, dim, dim);
         if (err != ERR_NONE)
             goto abort_and_free_a;
+    } else if (m != NULL && m->type == TYPE_SPARSE) {
+        /* Sparse matrices can't be redimensioned, so it has to fit already */
+        vartype_sparse *sm = (vartype_sparse *) m;
+        if (sm->rows != dim || sm->columns != dim)
+            return ERR_DIMENSION_ERROR;
+        mata = dup_vartype(m);
+        if (mata == NULL)
+            return ERR_INSUFFICIENT_MEMORY;
     } else {
         mata = new_realmatrix(dim, dim);
         if (mata == NULL)
@@ -1711,7 +1782,7 @@ static int max_min_helper(int do_max) {
     for (i = matedit_i; i < rm->rows; i++) {
         int4 index = i * rm->columns + matedit_j;
         phloat e;
-        if (rm->array->is_string[index] != 0)
+        if (rm->array->str_type(index) != 0)
             return ERR_ALPHA_DATA_IS_INVALID;
         e = rm->array->data[index];
         if (do_max ? e >= max_or_min_value : e <= max_or_min_value) {
@@ -1740,7 +1811,8 @@ int docmd_min(arg_struct *arg) {
 
 int docmd_find(arg_struct *arg) {
     vartype *m;
-    if (stack[sp]->type == TYPE_REALMATRIX || stack[sp]->type == TYPE_COMPLEXMATRIX)
+    if (stack[sp]->type != TYPE_REAL && stack[sp]->type != TYPE_COMPLEX
+            && stack[sp]->type != TYPE_STRING)
         return ERR_INVALID_TYPE;
     int err = matedit_get(&m);
     if (err != ERR_NONE)
@@ -1757,7 +1829,7 @@ int docmd_find(arg_struct *arg) {
             phloat d = ((vartype_real *) stack[sp])->x;
             for (i = 0; i < rm->rows; i++)
                 for (j = 0; j < rm->columns; j++)
-                    if (rm->array->is_string[p] == 0 && rm->array->data[p] == d) {
+                    if (rm->array->str_type(p) == 0 && rm->array->data[p] == d) {
                         matedit_i = i;
                         matedit_j = j;
                         return ERR_YES;
@@ -1769,7 +1841,7 @@ int docmd_find(arg_struct *arg) {
             int4 len = s->length;
             for (i = 0; i < rm->rows; i++)
                 for (j = 0; j < rm->columns; j++) {
-                    if (rm->array->is_string[p] != 0) {
+                    if (rm->array->str_type(p) != 0) {
                         char *mtext;
                         int4 mlen;
                         get_matrix_string(rm, p, &mtext, &mlen);
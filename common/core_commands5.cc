@@ -414,8 +414,10 @@ static int get_summation() {
     if (last > size)
         return ERR_SIZE_ERROR;
     for (i = first; i < last; i++)
-        if (r->array->is_string[i] != 0)
+        if (r->array->str_type(i) != 0)
             return ERR_ALPHA_DATA_IS_INVALID;
+    if (!disentangle(regs))
+        return ERR_INSUFFICIENT_MEMORY;
     sigmaregs = r->array->data + first;
     sum.x = sigmaregs[0];
     sum.x2 = sigmaregs[1];
@@ -435,6 +437,181 @@ static int get_summation() {
     return ERR_NONE;
 }
 
+/* Optional streaming accumulator. While a variable named "ΣACC" exists (the
+ * ΣACC command creates it), Σ+ and Σ- also maintain running means and sums of
+ * squared deviations of x and y, using Welford's updates, and a P² estimate
+ * (Jain & Chlamtac) of one quantile of x. MEAN and SDEV use the running values
+ * as long as they cover the same data points as the summation registers; they
+ * do not suffer from the cancellation in Σx² - (Σx)²/n, which becomes severe
+ * for large samples with a large mean. QUANT returns the quantile estimate.
+ * The P² markers cannot be rolled back, so Σ- disables QUANT until the next
+ * CLΣ or ΣACC.
+ */
+#define ACC_N      0
+#define ACC_MEANX  1
+#define ACC_M2X    2
+#define ACC_MEANY  3
+#define ACC_M2Y    4
+#define ACC_P      5
+#define ACC_QN     6 /* observations seen by the sketch; -1 if invalidated */
+#define ACC_Q      7 /* 5 marker heights */
+#define ACC_POS   12 /* 5 marker positions, 1-based */
+#define ACC_SIZE  17
+
+static int get_acc(vartype_realmatrix **acc) {
+    vartype *v = recall_var("\005ACC", 4);
+    *acc = NULL;
+    if (v == NULL)
+        return ERR_NONE;
+    if (v->type != TYPE_REALMATRIX)
+        return ERR_INVALID_TYPE;
+    vartype_realmatrix *rm = (vartype_realmatrix *) v;
+    if (rm->rows * rm->columns != ACC_SIZE)
+        return ERR_DIMENSION_ERROR;
+    for (int4 i = 0; i < ACC_SIZE; i++)
+        if (rm->array->str_type(i) != 0)
+            return ERR_ALPHA_DATA_IS_INVALID;
+    *acc = rm;
+    return ERR_NONE;
+}
+
+/* Returns the accumulator data if it is in sync with 'sum', NULL otherwise */
+static phloat *acc_for_sum() {
+    vartype_realmatrix *acc;
+    if (get_acc(&acc) != ERR_NONE || acc == NULL)
+        return NULL;
+    phloat *a = acc->array->data;
+    return a[ACC_N] == sum.n ? a : NULL;
+}
+
+/* 'n' is the number of points after adding or removing 'x' */
+static void welford(phloat *mean, phloat *m2, phloat n, phloat x, int weight) {
+    if (n == 0) {
+        *mean = 0;
+        *m2 = 0;
+        return;
+    }
+    phloat d = x - *mean;
+    phloat m;
+    if (weight == 1) {
+        m = *mean + d / n;
+        *m2 += d * (x - m);
+    } else {
+        m = *mean - d / n;
+        *m2 -= d * (x - m);
+    }
+    *mean = m;
+    if (p_isinf(*m2))
+        *m2 = POS_HUGE_PHLOAT;
+}
+
+static void sort5(phloat *v, int n) {
+    for (int i = 1; i < n; i++) {
+        phloat t = v[i];
+        int j = i;
+        while (j > 0 && v[j - 1] > t) {
+            v[j] = v[j - 1];
+            j--;
+        }
+        v[j] = t;
+    }
+}
+
+static void p2_add(phloat *a, phloat x) {
+    phloat *q = a + ACC_Q;
+    phloat *pos = a + ACC_POS;
+    int4 n = to_int4(a[ACC_QN]);
+    if (n < 0)
+        return;
+    if (n < 5) {
+        q[n] = x;
+        a[ACC_QN] = n + 1;
+        if (n == 4) {
+            sort5(q, 5);
+            for (int i = 0; i < 5; i++)
+                pos[i] = i + 1;
+        }
+        return;
+    }
+
+    int k;
+    if (x < q[0]) {
+        q[0] = x;
+        k = 0;
+    } else if (x >= q[4]) {
+        q[4] = x;
+        k = 3;
+    } else {
+        for (k = 0; k < 3 && x >= q[k + 1]; k++);
+    }
+    for (int i = k + 1; i < 5; i++)
+        pos[i] += 1;
+    n++;
+    a[ACC_QN] = n;
+
+    phloat p = a[ACC_P];
+    phloat nm1 = n - 1;
+    phloat want[3];
+    want[0] = 1 + nm1 * p / 2;
+    want[1] = 1 + nm1 * p;
+    want[2] = 1 + nm1 * (1 + p) / 2;
+    for (int i = 1; i <= 3; i++) {
+        phloat d = want[i - 1] - pos[i];
+        if (d >= 1 && pos[i + 1] - pos[i] > 1
+                || d <= -1 && pos[i - 1] - pos[i] < -1) {
+            int s = d > 0 ? 1 : -1;
+            phloat ds = s;
+            phloat qp = q[i] + ds / (pos[i + 1] - pos[i - 1])
+                    * ((pos[i] - pos[i - 1] + ds) * (q[i + 1] - q[i])
+                                / (pos[i + 1] - pos[i])
+                        + (pos[i + 1] - pos[i] - ds) * (q[i] - q[i - 1])
+                                / (pos[i] - pos[i - 1]));
+            if (q[i - 1] < qp && qp < q[i + 1])
+                q[i] = qp;
+            else
+                q[i] += ds * (q[i + s] - q[i]) / (pos[i + s] - pos[i]);
+            pos[i] += ds;
+        }
+    }
+}
+
+static phloat p2_quantile(phloat *a) {
+    int4 n = to_int4(a[ACC_QN]);
+    if (n >= 5)
+        return a[ACC_Q + 2];
+    /* Fewer than five points: interpolate between the order statistics */
+    phloat v[4];
+    for (int i = 0; i < n; i++)
+        v[i] = a[ACC_Q + i];
+    sort5(v, n);
+    phloat h = (n - 1) * a[ACC_P];
+    int lo = to_int(floor(h));
+    if (lo >= n - 1)
+        return v[n - 1];
+    return v[lo] + (h - lo) * (v[lo + 1] - v[lo]);
+}
+
+static void acc_update(phloat *a, phloat x, phloat y, int weight) {
+    phloat n = a[ACC_N] + weight;
+    a[ACC_N] = n;
+    welford(&a[ACC_MEANX], &a[ACC_M2X], n, x, weight);
+    welford(&a[ACC_MEANY], &a[ACC_M2Y], n, y, weight);
+    if (weight == 1)
+        p2_add(a, x);
+    else
+        a[ACC_QN] = -1;
+}
+
+void clear_sigma_acc() {
+    vartype_realmatrix *acc;
+    if (get_acc(&acc) != ERR_NONE || acc == NULL
+            || !disentangle((vartype *) acc))
+        return;
+    for (int i = 0; i < ACC_SIZE; i++)
+        if (i != ACC_P)
+            acc->array->data[i] = 0;
+}
+
 static struct model_struct {
     phloat x;
     phloat x2;
@@ -704,13 +881,14 @@ int docmd_mean(arg_struct *arg) {
         return err;
     if (sum.n == 0)
         return ERR_STAT_MATH_ERROR;
-    m = sum.x / sum.n;
+    phloat *acc = acc_for_sum();
+    m = acc != NULL ? acc[ACC_MEANX] : sum.x / sum.n;
     if ((inf = p_isinf(m)) != 0)
         m = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
     mx = new_real(m);
     if (mx == NULL)
         return ERR_INSUFFICIENT_MEMORY;
-    m = sum.y / sum.n;
+    m = acc != NULL ? acc[ACC_MEANY] : sum.y / sum.n;
     if ((inf = p_isinf(m)) != 0)
         m = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
     my = new_real(m);
@@ -734,7 +912,11 @@ int docmd_sdev(arg_struct *arg) {
         return err;
     if (sum.n == 0 || sum.n == 1)
         return ERR_STAT_MATH_ERROR;
-    var = (sum.x2 - (sum.x * sum.x / sum.n)) / (sum.n - 1);
+    phloat *acc = acc_for_sum();
+    if (acc != NULL)
+        var = acc[ACC_M2X] / (sum.n - 1);
+    else
+        var = (sum.x2 - (sum.x * sum.x / sum.n)) / (sum.n - 1);
     if (var < 0)
         return ERR_STAT_MATH_ERROR;
     if (p_isinf(var))
@@ -743,7 +925,10 @@ int docmd_sdev(arg_struct *arg) {
         sx = new_real(sqrt(var));
     if (sx == NULL)
         return ERR_INSUFFICIENT_MEMORY;
-    var = (sum.y2 - (sum.y * sum.y / sum.n)) / (sum.n - 1);
+    if (acc != NULL)
+        var = acc[ACC_M2Y] / (sum.n - 1);
+    else
+        var = (sum.y2 - (sum.y * sum.y / sum.n)) / (sum.n - 1);
     if (var < 0)
         return ERR_STAT_MATH_ERROR;
     if (p_isinf(var))
@@ -1202,52 +1387,256 @@ static void accum(phloat *sum, phloat term, int weight) {
     *sum = s;
 }
 
-static phloat sigma_helper_2(phloat *sigmaregs,
-                             phloat x, phloat y, int weight) {
-
-    accum(&sigmaregs[0], x, weight);
-    accum(&sigmaregs[1], x * x, weight);
-    accum(&sigmaregs[2], y, weight);
-    accum(&sigmaregs[3], y * y, weight);
-    accum(&sigmaregs[4], x * y, weight);
-    accum(&sigmaregs[5], 1, weight);
-
-    if (flags.f.all_sigma) {
-        if (x > 0) {
-            phloat lnx = log(x);
-            if (y > 0) {
-                phloat lny = log(y);
-                accum(&sigmaregs[8], lny, weight);
-                accum(&sigmaregs[9], lny * lny, weight);
-                accum(&sigmaregs[10], lnx * lny, weight);
-                accum(&sigmaregs[11], x * lny, weight);
-            } else {
-                flags.f.exp_fit_invalid = 1;
-                flags.f.pwr_fit_invalid = 1;
-            }
-            accum(&sigmaregs[6], lnx, weight);
-            accum(&sigmaregs[7], lnx * lnx, weight);
-            accum(&sigmaregs[12], lnx * y, weight);
-        } else {
-            if (y > 0) {
-                phloat lny = log(y);
-                accum(&sigmaregs[8], lny, weight);
-                accum(&sigmaregs[9], lny * lny, weight);
-                accum(&sigmaregs[11], x * lny, weight);
-            } else
-                flags.f.exp_fit_invalid = 1;
-            flags.f.log_fit_invalid = 1;
-            flags.f.pwr_fit_invalid = 1;
-        }
+#define SIGMA_LOG_INVALID 1
+#define SIGMA_EXP_INVALID 2
+#define SIGMA_PWR_INVALID 4
+
+/* Computes the terms Σ+ adds to the first 'nregs' summation registers for
+ * the point (x, y). Terms that do not apply are set to zero. Returns the
+ * fits that the point makes invalid, as a SIGMA_*_INVALID mask.
+ */
+static int sigma_terms(phloat *t, phloat x, phloat y, int nregs) {
+    t[0] = x;
+    t[1] = x * x;
+    t[2] = y;
+    t[3] = y * y;
+    t[4] = x * y;
+    t[5] = 1;
+    if (nregs == 6)
+        return SIGMA_LOG_INVALID | SIGMA_EXP_INVALID | SIGMA_PWR_INVALID;
+
+    int invalid = 0;
+    for (int i = 6; i < 13; i++)
+        t[i] = 0;
+    if (x > 0) {
+        phloat lnx = log(x);
+        if (y > 0) {
+            phloat lny = log(y);
+            t[8] = lny;
+            t[9] = lny * lny;
+            t[10] = lnx * lny;
+            t[11] = x * lny;
+        } else
+            invalid |= SIGMA_EXP_INVALID | SIGMA_PWR_INVALID;
+        t[6] = lnx;
+        t[7] = lnx * lnx;
+        t[12] = lnx * y;
     } else {
+        if (y > 0) {
+            phloat lny = log(y);
+            t[8] = lny;
+            t[9] = lny * lny;
+            t[11] = x * lny;
+        } else
+            invalid |= SIGMA_EXP_INVALID;
+        invalid |= SIGMA_LOG_INVALID | SIGMA_PWR_INVALID;
+    }
+    return invalid;
+}
+
+static void sigma_invalidate(int invalid) {
+    if ((invalid & SIGMA_LOG_INVALID) != 0)
         flags.f.log_fit_invalid = 1;
+    if ((invalid & SIGMA_EXP_INVALID) != 0)
         flags.f.exp_fit_invalid = 1;
+    if ((invalid & SIGMA_PWR_INVALID) != 0)
         flags.f.pwr_fit_invalid = 1;
-    }
+}
+
+static phloat sigma_helper_2(phloat *sigmaregs, phloat *acc,
+                             phloat x, phloat y, int weight) {
+    int nregs = flags.f.all_sigma ? 13 : 6;
+    phloat t[13];
+    int invalid = sigma_terms(t, x, y, nregs);
+    for (int i = 0; i < nregs; i++)
+        accum(&sigmaregs[i], t[i], weight);
+    sigma_invalidate(invalid);
+
+    if (acc != NULL)
+        acc_update(acc, x, y, weight);
 
     return sigmaregs[5];
 }
 
+/* Σ+ and Σ- with a matrix or list of points. The terms are added up in
+ * local partial sums, SIGMA_BLOCK points at a time, and the block sums are
+ * combined pairwise, the way a binary counter carries, so the order of the
+ * additions depends only on the number of points, and the rounding error
+ * grows with log(n) instead of n. The summation registers are only touched
+ * once, at the end.
+ * Each block is summed starting from zero, independently of the others, so
+ * the blocks can be summed in parallel (see map_elements()); only the
+ * carries are done in sequence. The results are the same either way.
+ * The partial sums are not clamped the way accum() clamps the registers, so
+ * when any of them overflows, the points are added one at a time instead,
+ * giving the same results as Σ+ on each point separately.
+ */
+#define SIGMA_BLOCK 64
+#define SIGMA_LEVELS 32
+/* Number of blocks above which the block sums are computed in parallel */
+#define SIGMA_PARALLEL_THRESHOLD 64
+
+struct sigma_block {
+    int invalid;
+    bool overflow;
+    phloat sum[13];
+};
+
+/* Adds up the terms for points begin..end-1. get(i, &x, &y) returns point i;
+ * it is called concurrently, so it must not modify anything.
+ */
+template <typename G>
+static void sigma_sum(G &get, int4 begin, int4 end, int nregs, sigma_block *b) {
+    b->invalid = 0;
+    for (int i = 0; i < nregs; i++)
+        b->sum[i] = 0;
+    for (int4 j = begin; j < end; j++) {
+        phloat x, y, t[13];
+        get(j, &x, &y);
+        b->invalid |= sigma_terms(t, x, y, nregs);
+        for (int i = 0; i < nregs; i++)
+            b->sum[i] += t[i];
+    }
+    b->overflow = false;
+    for (int i = 0; i < nregs; i++)
+        if (p_isinf(b->sum[i]) || p_isnan(b->sum[i]))
+            b->overflow = true;
+}
+
+/* Adds points 0..n-1 to the summation registers one at a time, clamping
+ * after every addition, like sigma_helper_2().
+ */
+template <typename G>
+static void sigma_rows(G &get, int4 n, phloat *sigmaregs, int nregs, int weight) {
+    int invalid = 0;
+    for (int4 j = 0; j < n; j++) {
+        phloat x, y, t[13];
+        get(j, &x, &y);
+        invalid |= sigma_terms(t, x, y, nregs);
+        for (int i = 0; i < nregs; i++)
+            accum(&sigmaregs[i], t[i], weight);
+    }
+    sigma_invalidate(invalid);
+}
+
+struct sigma_bulk {
+    int nregs;
+    int invalid;
+    bool overflow;
+    int4 blocks;
+    phloat block[13];
+    phloat level[SIGMA_LEVELS][13];
+
+    void init(int n) {
+        nregs = n;
+        invalid = 0;
+        overflow = false;
+        blocks = 0;
+    }
+
+    void check(const phloat *sum) {
+        for (int i = 0; i < nregs; i++)
+            if (p_isinf(sum[i]) || p_isnan(sum[i]))
+                overflow = true;
+    }
+
+    void add(const sigma_block *b) {
+        invalid |= b->invalid;
+        overflow |= b->overflow;
+        for (int i = 0; i < nregs; i++)
+            block[i] = b->sum[i];
+        int lv;
+        for (lv = 0; (blocks & (1 << lv)) != 0; lv++)
+            for (int i = 0; i < nregs; i++)
+                block[i] = level[lv][i] + block[i];
+        check(block);
+        for (int i = 0; i < nregs; i++)
+            level[lv][i] = block[i];
+        blocks++;
+    }
+
+    /* Adds the total to the summation registers, unless any of the partial
+     * sums overflowed; returns false, without touching the registers, if
+     * they did.
+     */
+    bool finish(const sigma_block *tail, phloat *sigmaregs, int weight) {
+        invalid |= tail->invalid;
+        overflow |= tail->overflow;
+        for (int i = 0; i < nregs; i++)
+            block[i] = tail->sum[i];
+        for (int lv = 0; lv < SIGMA_LEVELS; lv++)
+            if ((blocks & (1 << lv)) != 0)
+                for (int i = 0; i < nregs; i++)
+                    block[i] = level[lv][i] + block[i];
+        check(block);
+        if (overflow)
+            return false;
+        for (int i = 0; i < nregs; i++)
+            accum(&sigmaregs[i], block[i], weight);
+        sigma_invalidate(invalid);
+        return true;
+    }
+};
+
+/* Adds n points to the summation registers; see sigma_bulk. */
+template <typename G>
+static int sigma_bulk_add(G get, int4 n, phloat *sigmaregs, int nregs, int weight) {
+    int4 nblocks = n / SIGMA_BLOCK;
+    sigma_bulk *bulk = (sigma_bulk *) malloc(sizeof(sigma_bulk));
+    sigma_block *sums = (sigma_block *) malloc((nblocks + 1) * sizeof(sigma_block));
+    if (bulk == NULL || sums == NULL) {
+        free(bulk);
+        free(sums);
+        return ERR_INSUFFICIENT_MEMORY;
+    }
+    bulk->init(nregs);
+    map_elements(nblocks + 1, [&](int4 b) {
+        int4 end = b == nblocks ? n : (b + 1) * SIGMA_BLOCK;
+        sigma_sum(get, b * SIGMA_BLOCK, end, nregs, sums + b);
+        return ERR_NONE;
+    }, SIGMA_PARALLEL_THRESHOLD);
+    for (int4 b = 0; b < nblocks; b++)
+        bulk->add(sums + b);
+    if (!bulk->finish(sums + nblocks, sigmaregs, weight))
+        sigma_rows(get, n, sigmaregs, nregs, weight);
+    free(sums);
+    free(bulk);
+    return ERR_NONE;
+}
+
+static int sigma_pair(vartype *v, phloat *x, phloat *y) {
+    if (v->type == TYPE_LIST) {
+        vartype_list *l = (vartype_list *) v;
+        if (l->size != 2)
+            return ERR_DIMENSION_ERROR;
+        vartype *vx = l->array->data[0];
+        vartype *vy = l->array->data[1];
+        if (vx->type == TYPE_STRING || vy->type == TYPE_STRING)
+            return ERR_ALPHA_DATA_IS_INVALID;
+        if (vx->type != TYPE_REAL || vy->type != TYPE_REAL)
+            return ERR_INVALID_TYPE;
+        if (x != NULL) {
+            *x = ((vartype_real *) vx)->x;
+            *y = ((vartype_real *) vy)->x;
+        }
+        return ERR_NONE;
+    } else if (v->type == TYPE_REALMATRIX) {
+        vartype_realmatrix *rm = (vartype_realmatrix *) v;
+        if (rm->rows * rm->columns != 2)
+            return ERR_DIMENSION_ERROR;
+        if (rm->array->str_type(0) != 0 || rm->array->str_type(1) != 0)
+            return ERR_ALPHA_DATA_IS_INVALID;
+        if (x != NULL) {
+            *x = rm->array->data[0];
+            *y = rm->array->data[1];
+        }
+        return ERR_NONE;
+    } else if (v->type == TYPE_STRING)
+        return ERR_ALPHA_DATA_IS_INVALID;
+    else
+        return ERR_INVALID_TYPE;
+}
+
 static int sigma_helper_1(int weight) {
     /* Check if summation registers are OK */
     int4 first = mode_sigma_reg;
@@ -1265,55 +1654,86 @@ static int sigma_helper_1(int weight) {
     if (last > size)
         return ERR_SIZE_ERROR;
     for (i = first; i < last; i++)
-        if (r->array->is_string[i] != 0)
+        if (r->array->str_type(i) != 0)
             return ERR_ALPHA_DATA_IS_INVALID;
-    sigmaregs = r->array->data + first;
+    vartype_realmatrix *accm;
+    int err = get_acc(&accm);
+    if (err != ERR_NONE)
+        return err;
 
-    /* All summation registers present, real-valued, non-string. */
-    if (stack[sp]->type == TYPE_REALMATRIX) {
-        vartype_realmatrix *rm = (vartype_realmatrix *) stack[sp];
-        vartype_real *x;
-        int4 i;
+    /* Check the data before touching anything */
+    vartype *data = stack[sp];
+    if (data->type == TYPE_REALMATRIX) {
+        vartype_realmatrix *rm = (vartype_realmatrix *) data;
         if (rm->columns != 2)
             return ERR_DIMENSION_ERROR;
         for (i = 0; i < rm->rows * 2; i++)
-            if (rm->array->is_string[i] != 0)
+            if (rm->array->str_type(i) != 0)
                 return ERR_ALPHA_DATA_IS_INVALID;
-        x = (vartype_real *) new_real(0);
-        if (x == NULL)
-            return ERR_INSUFFICIENT_MEMORY;
-        for (i = 0; i < rm->rows; i++)
-            x->x = sigma_helper_2(sigmaregs,
-                                    rm->array->data[i * 2],
-                                    rm->array->data[i * 2 + 1],
-                                    weight);
-        free_vartype(lastx);
-        lastx = stack[sp];
-        stack[sp] = (vartype *) x;
-        mode_disable_stack_lift = true;
-        return ERR_NONE;
+    } else if (data->type == TYPE_LIST) {
+        vartype_list *list = (vartype_list *) data;
+        for (i = 0; i < list->size; i++)
+            if ((err = sigma_pair(list->array->data[i], NULL, NULL)) != ERR_NONE)
+                return err;
     } else {
-        // stack[sp]->type == TYPE_REAL
-        if (sp == 0 || stack[sp - 1]->type == TYPE_REAL) {
-            vartype_real *x = (vartype_real *) new_real(0);
-            if (x == NULL)
-                return ERR_INSUFFICIENT_MEMORY;
-            phloat y = sp == 0 ? 0 : ((vartype_real *) stack[sp - 1])->x;
-            x->x = sigma_helper_2(sigmaregs,
-                                    ((vartype_real *) stack[sp])->x,
-                                    y,
-                                    weight);
-            free_vartype(lastx);
-            lastx = stack[sp];
-            stack[sp] = (vartype *) x;
-            mode_disable_stack_lift = true;
-            return ERR_NONE;
-        } else if (stack[sp - 1]->type == TYPE_STRING) {
-            return ERR_ALPHA_DATA_IS_INVALID;
+        // data->type == TYPE_REAL
+        if (sp > 0 && stack[sp - 1]->type != TYPE_REAL)
+            return stack[sp - 1]->type == TYPE_STRING
+                    ? ERR_ALPHA_DATA_IS_INVALID : ERR_INVALID_TYPE;
+    }
+
+    if (!disentangle(regs))
+        return ERR_INSUFFICIENT_MEMORY;
+    if (accm != NULL && !disentangle((vartype *) accm))
+        return ERR_INSUFFICIENT_MEMORY;
+    sigmaregs = r->array->data + first;
+    phloat *acc = accm == NULL ? NULL : accm->array->data;
+    vartype_real *x = (vartype_real *) new_real(0);
+    if (x == NULL)
+        return ERR_INSUFFICIENT_MEMORY;
+
+    /* All summation registers present, real-valued, non-string. */
+    if (data->type == TYPE_REAL) {
+        phloat y = sp == 0 ? 0 : ((vartype_real *) stack[sp - 1])->x;
+        x->x = sigma_helper_2(sigmaregs, acc,
+                                ((vartype_real *) data)->x,
+                                y,
+                                weight);
+    } else {
+        if (data->type == TYPE_REALMATRIX) {
+            vartype_realmatrix *rm = (vartype_realmatrix *) data;
+            phloat *d = rm->array->data;
+            err = sigma_bulk_add([d](int4 i, phloat *px, phloat *py) {
+                *px = d[i * 2];
+                *py = d[i * 2 + 1];
+            }, rm->rows, sigmaregs, (int) (last - first), weight);
+            if (err == ERR_NONE && acc != NULL)
+                for (i = 0; i < rm->rows; i++)
+                    acc_update(acc, d[i * 2], d[i * 2 + 1], weight);
         } else {
-            return ERR_INVALID_TYPE;
+            vartype_list *list = (vartype_list *) data;
+            vartype **d = list->array->data;
+            err = sigma_bulk_add([d](int4 i, phloat *px, phloat *py) {
+                sigma_pair(d[i], px, py);
+            }, list->size, sigmaregs, (int) (last - first), weight);
+            if (err == ERR_NONE && acc != NULL)
+                for (i = 0; i < list->size; i++) {
+                    phloat px, py;
+                    sigma_pair(d[i], &px, &py);
+                    acc_update(acc, px, py, weight);
+                }
+        }
+        if (err != ERR_NONE) {
+            free_vartype((vartype *) x);
+            return err;
         }
+        x->x = sigmaregs[5];
     }
+    free_vartype(lastx);
+    lastx = stack[sp];
+    stack[sp] = (vartype *) x;
+    mode_disable_stack_lift = true;
+    return ERR_NONE;
 }
 
 int docmd_sigmaadd(arg_struct *arg) {
@@ -1329,3 +1749,33 @@ int docmd_sigmasub(arg_struct *arg) {
         print_trace();
     return err;
 }
+
+int docmd_sigma_acc(arg_struct *arg) {
+    phloat p = ((vartype_real *) stack[sp])->x;
+    if (p <= 0 || p >= 1)
+        return ERR_INVALID_DATA;
+    vartype *v = new_realmatrix(ACC_SIZE, 1);
+    if (v == NULL)
+        return ERR_INSUFFICIENT_MEMORY;
+    ((vartype_realmatrix *) v)->array->data[ACC_P] = p;
+    int err = store_var("\005ACC", 4, v);
+    if (err != ERR_NONE)
+        free_vartype(v);
+    return err;
+}
+
+int docmd_quant(arg_struct *arg) {
+    vartype_realmatrix *acc;
+    int err = get_acc(&acc);
+    if (err != ERR_NONE)
+        return err;
+    if (acc == NULL)
+        return ERR_NONEXISTENT;
+    phloat *a = acc->array->data;
+    if (a[ACC_QN] <= 0)
+        return ERR_STAT_MATH_ERROR;
+    vartype *v = new_real(p2_quantile(a));
+    if (v == NULL)
+        return ERR_INSUFFICIENT_MEMORY;
+    return recall_result(v);
+}
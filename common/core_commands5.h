@@ -65,5 +65,8 @@ int docmd_to_dec(arg_struct *arg);
 int docmd_to_oct(arg_struct *arg);
 int docmd_sigmaadd(arg_struct *arg);
 int docmd_sigmasub(arg_struct *arg);
+int docmd_sigma_acc(arg_struct *arg);
+int docmd_quant(arg_struct *arg);
+void clear_sigma_acc();
 
 #endif
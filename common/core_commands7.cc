@@ -1479,6 +1479,48 @@ int docmd_xstr(arg_struct *arg) {
     return recall_result(v);
 }
 
+/* Used by concat() when it appends to Y in place, and by DPUT and DDEL,
+ * which update the dictionary in Z or Y in place. This does what
+ * binary_result() (levels = 1) or ternary_result() (levels = 2) does, except
+ * that the object in Y or Z stays where it is, and becomes the new X. The
+ * only step that can fail is the duplication of T, and that is done before
+ * anything is changed, so callers can allocate everything they need, call
+ * this, and only then do the actual update, without having to roll anything
+ * back. The caller is responsible for calling print_trace() when it is done.
+ */
+static int in_place_result(int levels = 1) {
+    vartype *t = NULL, *tt = NULL;
+    if (!flags.f.big_stack) {
+        t = dup_vartype(stack[REG_T]);
+        if (t == NULL)
+            return ERR_INSUFFICIENT_MEMORY;
+        if (levels == 2) {
+            tt = dup_vartype(stack[REG_T]);
+            if (tt == NULL) {
+                free_vartype(t);
+                return ERR_INSUFFICIENT_MEMORY;
+            }
+        }
+    }
+    free_vartype(lastx);
+    lastx = stack[sp];
+    if (flags.f.big_stack) {
+        if (levels == 2)
+            free_vartype(stack[sp - 1]);
+        sp -= levels;
+    } else if (levels == 1) {
+        stack[REG_X] = stack[REG_Y];
+        stack[REG_Y] = stack[REG_Z];
+        stack[REG_Z] = t;
+    } else {
+        free_vartype(stack[REG_Y]);
+        stack[REG_X] = stack[REG_Z];
+        stack[REG_Y] = t;
+        stack[REG_Z] = tt;
+    }
+    return ERR_NONE;
+}
+
 static int concat(bool extend) {
     if (stack[sp - 1]->type == TYPE_STRING) {
         char *text = NULL;
@@ -1501,25 +1543,48 @@ static int concat(bool extend) {
             len = reg_alpha_length;
         }
         vartype_string *s = (vartype_string *) stack[sp - 1];
-        vartype *v = new_string(NULL, s->length + len);
-        if (v != NULL) {
-            vartype_string *s2 = (vartype_string *) v;
-            memcpy(s2->txt(), s->txt(), s->length);
-            memcpy(s2->txt() + s->length, text, len);
+        vartype *v = NULL;
+        int err = ERR_NONE;
+        if (s->length > SSLENV) {
+            // Long string in Y: append to it in place, growing its buffer
+            // geometrically. Strings are never shared, so this is safe.
+            // Note that in_place_result() moves X to LASTX, without freeing
+            // it, so 'text' is still valid after that call.
+            if (!s->reserve(s->length + len))
+                err = ERR_INSUFFICIENT_MEMORY;
+            else if ((err = in_place_result()) == ERR_NONE) {
+                memcpy(s->t.ptr + s->length, text, len);
+                s->length += len;
+            }
+        } else {
+            v = new_string(NULL, s->length + len);
+            if (v == NULL)
+                err = ERR_INSUFFICIENT_MEMORY;
+            else {
+                vartype_string *s2 = (vartype_string *) v;
+                memcpy(s2->txt(), s->txt(), s->length);
+                memcpy(s2->txt() + s->length, text, len);
+            }
         }
         if (text == reg_alpha) {
             memcpy(reg_alpha, buf, templen);
             reg_alpha_length = templen;
         }
-        if (v == NULL)
-            return ERR_INSUFFICIENT_MEMORY;
-        return binary_result(v);
+        if (err != ERR_NONE)
+            return err;
+        if (v != NULL)
+            return binary_result(v);
+        print_trace();
+        return ERR_NONE;
     } else if (stack[sp - 1]->type == TYPE_LIST) {
         vartype *v = dup_vartype(stack[sp]);
         if (v == NULL)
             return ERR_INSUFFICIENT_MEMORY;
         vartype_list *list = (vartype_list *) stack[sp - 1];
-        if (!disentangle((vartype *) list)) {
+        // If the list in Y is shared, this makes a private copy, unless the
+        // other lists sharing it don't extend beyond its end; otherwise,
+        // we append to it in place.
+        if (!list_can_append_shared(list, v) && !disentangle((vartype *) list)) {
             nomem:
             free_vartype(v);
             return ERR_INSUFFICIENT_MEMORY;
@@ -1528,66 +1593,43 @@ static int concat(bool extend) {
             if (!disentangle(v))
                 goto nomem;
             vartype_list *list2 = (vartype_list *) v;
-            if (list2->size > 0) {
-                vartype **new_data = (vartype **) realloc(list->array->data, (list->size + list2->size) * sizeof(vartype *));
-                if (new_data == NULL)
-                    goto nomem;
-                list->array->data = new_data;
-                // Call binary_result() before doing the actual data transfer.
-                // The reason is that binary_result() can fail, because of the
-                // T duplication, and we don't want to have to roll back all this.
-                stack[sp - 1] = NULL;
-                int err = binary_result((vartype *) list);
-                if (err != ERR_NONE) {
-                    // Try to shrink the data array back down. No worries if this
-                    // fails, we just hold on to the resized one in that case.
-                    new_data = (vartype **) realloc(list->array->data, list->size * sizeof(vartype *));
-                    if (new_data != NULL || list->size == 0)
-                        list->array->data = new_data;
-                    stack[sp - 1] = (vartype *) list;
-                    goto nomem;
-                }
-                memcpy(list->array->data + list->size, list2->array->data, list2->size * sizeof(vartype *));
-                list->size += list2->size;
-                // At this point we're done with list2. Since it's a disentangled
-                // copy, the refcount is 1 and it is going to be completely deleted.
-                // We're doing it manually rather than through free_vartype(), so
-                // we don't have to zero out the data array first.
-                free(list2->array->data);
-                free(list2->array);
-                free(list2);
-            } else {
-                // Joining an empty list to the list in Y. This is not quite a
-                // no-op, since the binary_result() causes T duplication, which
-                // can fail.
-                stack[sp - 1] = NULL;
-                int err = binary_result((vartype *) list);
-                if (err != ERR_NONE) {
-                    stack[sp - 1] = (vartype *) list;
-                    goto nomem;
-                }
-                free_vartype(v);
+            if (!grow_list(list, list->size + list2->size))
+                goto nomem;
+            // Call in_place_result() before doing the actual data transfer.
+            // The reason is that it can fail, because of the T duplication,
+            // and we don't want to have to roll back all this.
+            if (in_place_result() != ERR_NONE)
+                goto nomem;
+            memcpy(list->array->data + list->size, list2->array->data, list2->size * sizeof(vartype *));
+            list->size += list2->size;
+            if (list->array->used != -1) {
+                list->array->used = list->size;
+                list->array->total += list2->size;
             }
+            // At this point we're done with list2. Since it's a disentangled
+            // copy, the refcount is 1 and it is going to be completely deleted.
+            // We're doing it manually rather than through free_vartype(), so
+            // we don't have to zero out the data array first.
+            free(list2->array->data);
+            free(list2->array);
+            free(list2);
+            print_trace();
             return ERR_NONE;
         }
-        vartype **new_data = (vartype **) realloc(list->array->data, (list->size + 1) * sizeof(vartype *));
-        if (new_data == NULL)
+        if (!grow_list(list, list->size + 1))
             goto nomem;
-        list->array->data = new_data;
-        // Call binary_result() before doing the actual data transfer.
-        // The reason is that binary_result() can fail, because of the
-        // T duplication, and we don't want to have to roll back all this.
-        stack[sp - 1] = NULL;
-        int err = binary_result((vartype *) list);
-        if (err != ERR_NONE) {
-            // Unlike the 'extend' case, we don't try to shrink the data array
-            // back down here. We're only wasting the space of one pointer,
-            // so, *shrug*.
-            stack[sp - 1] = (vartype *) list;
+        // Call in_place_result() before doing the actual data transfer.
+        // The reason is that it can fail, because of the T duplication,
+        // and we don't want to have to roll back all this.
+        if (in_place_result() != ERR_NONE)
             goto nomem;
-        }
         list->array->data[list->size++] = v;
+        if (list->array->used != -1) {
+            list->array->used = list->size;
+            list->array->total++;
+        }
         // Not freeing v because it is now owned by the target list.
+        print_trace();
         return ERR_NONE;
     } else {
         return ERR_INVALID_TYPE;
@@ -1689,10 +1731,13 @@ int docmd_substr(arg_struct *arg) {
 }
 
 int docmd_length(arg_struct *arg) {
-    // LENGTH: returns the length of the string or list in X.
+    // LENGTH: returns the length of the string or list in X, or the number
+    // of entries in the dictionary in X.
     int4 len;
     if (stack[sp]->type == TYPE_STRING)
         len = ((vartype_string *) stack[sp])->length;
+    else if (stack[sp]->type == TYPE_DICT)
+        len = ((vartype_dict *) stack[sp])->size;
     else
         len = ((vartype_list *) stack[sp])->size;
     vartype *v = new_real(len);
@@ -1729,7 +1774,7 @@ int docmd_head(arg_struct *arg) {
             int4 n = arg->val.num;
             if (n >= sz)
                 return ERR_SIZE_ERROR;
-            if (rm->array->is_string[n] == 0)
+            if (rm->array->str_type(n) == 0)
                 return ERR_INVALID_TYPE;
             char *text;
             int len;
@@ -1893,6 +1938,293 @@ int docmd_pos(arg_struct *arg) {
         return binary_result(v);
 }
 
+/* Ordering used by SORT, RSORT, and BSRCH: reals before strings, reals by
+ * value, and strings by character code, like the HP-42S string comparisons,
+ * with a string coming before any longer string it is a prefix of.
+ */
+struct sort_item {
+    bool is_string;
+    phloat x;
+    const char *text;
+    int4 length;
+};
+
+static int sort_compare(const sort_item *a, const sort_item *b) {
+    if (a->is_string != b->is_string)
+        return a->is_string ? 1 : -1;
+    if (!a->is_string)
+        return a->x < b->x ? -1 : a->x > b->x ? 1 : 0;
+    int4 n = a->length < b->length ? a->length : b->length;
+    for (int4 i = 0; i < n; i++) {
+        unsigned char ca = a->text[i];
+        unsigned char cb = b->text[i];
+        if (ca != cb)
+            return ca < cb ? -1 : 1;
+    }
+    return a->length < b->length ? -1 : a->length > b->length ? 1 : 0;
+}
+
+static void matrix_sort_item(const vartype_realmatrix *rm, int4 i, sort_item *item) {
+    item->x = 0;
+    item->text = NULL;
+    item->length = 0;
+    item->is_string = rm->array->str_type(i) != 0;
+    if (item->is_string)
+        get_matrix_string(rm, i, &item->text, &item->length);
+    else
+        item->x = rm->array->data[i];
+}
+
+static int list_sort_item(const vartype *v, sort_item *item) {
+    item->x = 0;
+    item->text = NULL;
+    item->length = 0;
+    if (v->type == TYPE_REAL) {
+        item->is_string = false;
+        item->x = ((vartype_real *) v)->x;
+        return ERR_NONE;
+    } else if (v->type == TYPE_STRING) {
+        vartype_string *s = (vartype_string *) v;
+        item->is_string = true;
+        item->text = s->txt();
+        item->length = s->length;
+        return ERR_NONE;
+    } else
+        return ERR_INVALID_TYPE;
+}
+
+/* Stable bottom-up merge sort. On return, perm[0..n-1] holds the indexes of
+ * 'keys' in sorted order, or in reverse order if 'descending' is set; equal
+ * keys keep their original order either way. 'tmp' must have room for n
+ * entries.
+ */
+static void sort_perm(const sort_item *keys, int4 *perm, int4 *tmp, int4 n,
+                      bool descending) {
+    int4 *src = perm, *dst = tmp;
+    for (int4 i = 0; i < n; i++)
+        perm[i] = i;
+    for (int4 w = 1; w < n; w *= 2) {
+        for (int4 lo = 0; lo < n; lo += 2 * w) {
+            int4 mid = n - lo > w ? lo + w : n;
+            int4 hi = n - mid > w ? mid + w : n;
+            int4 a = lo, b = mid, k = lo;
+            while (a < mid && b < hi) {
+                int c = sort_compare(keys + src[b], keys + src[a]);
+                if (descending ? c > 0 : c < 0)
+                    dst[k++] = src[b++];
+                else
+                    dst[k++] = src[a++];
+            }
+            while (a < mid)
+                dst[k++] = src[a++];
+            while (b < hi)
+                dst[k++] = src[b++];
+        }
+        int4 *t = src;
+        src = dst;
+        dst = t;
+    }
+    if (src != perm)
+        memcpy(perm, src, n * sizeof(int4));
+}
+
+/* Reorders the n elements at start, start + stride, start + 2 * stride, ...
+ * according to 'perm'. Moving the raw cells moves long string pointers along
+ * with them, so the matrix must not share its array.
+ */
+static void permute_matrix(vartype_realmatrix *rm, const int4 *perm, int4 n,
+                           int4 start, int4 stride, phloat *tmp, char *stmp) {
+    phloat *data = rm->array->data;
+    char *is_string = rm->array->is_string;
+    for (int4 k = 0; k < n; k++) {
+        int4 i = start + perm[k] * stride;
+        tmp[k] = data[i];
+        if (is_string != NULL)
+            stmp[k] = is_string[i];
+    }
+    for (int4 k = 0; k < n; k++) {
+        int4 i = start + k * stride;
+        data[i] = tmp[k];
+        if (is_string != NULL)
+            is_string[i] = stmp[k];
+    }
+}
+
+/* Sorts a disentangled real matrix in place. With keycol == -1, vectors are
+ * sorted as a whole and other matrices column by column; otherwise, whole
+ * rows are sorted by column 'keycol', in descending order if 'descending'
+ * is set.
+ */
+static int sort_matrix(vartype_realmatrix *rm, int4 keycol, bool descending) {
+    int4 rows = rm->rows;
+    int4 cols = rm->columns;
+    int4 n, stride, nseq;
+    if (keycol == -1 && (rows == 1 || cols == 1)) {
+        n = rows * cols;
+        stride = 1;
+        nseq = 1;
+    } else {
+        n = rows;
+        stride = cols;
+        nseq = cols;
+    }
+    sort_item *keys = (sort_item *) malloc(n * sizeof(sort_item));
+    int4 *perm = (int4 *) malloc(2 * n * sizeof(int4));
+    phloat *tmp = (phloat *) malloc(n * sizeof(phloat));
+    char *stmp = (char *) malloc(n);
+    if (keys == NULL || perm == NULL || tmp == NULL || stmp == NULL) {
+        free(keys);
+        free(perm);
+        free(tmp);
+        free(stmp);
+        return ERR_INSUFFICIENT_MEMORY;
+    }
+    if (keycol != -1) {
+        for (int4 k = 0; k < n; k++)
+            matrix_sort_item(rm, k * stride + keycol, keys + k);
+        sort_perm(keys, perm, perm + n, n, descending);
+        for (int4 c = 0; c < cols; c++)
+            permute_matrix(rm, perm, n, c, stride, tmp, stmp);
+    } else {
+        for (int4 c = 0; c < nseq; c++) {
+            for (int4 k = 0; k < n; k++)
+                matrix_sort_item(rm, c + k * stride, keys + k);
+            sort_perm(keys, perm, perm + n, n, false);
+            permute_matrix(rm, perm, n, c, stride, tmp, stmp);
+        }
+    }
+    free(keys);
+    free(perm);
+    free(tmp);
+    free(stmp);
+    return ERR_NONE;
+}
+
+int docmd_sort(arg_struct *arg) {
+    // SORT: sort the list or real matrix in X. Vectors are sorted as a whole,
+    // other matrices column by column.
+    vartype *v;
+    if (stack[sp]->type == TYPE_REALMATRIX) {
+        v = dup_vartype(stack[sp]);
+        if (v == NULL)
+            return ERR_INSUFFICIENT_MEMORY;
+        int err = disentangle(v) ? sort_matrix((vartype_realmatrix *) v, -1, false)
+                                 : ERR_INSUFFICIENT_MEMORY;
+        if (err != ERR_NONE) {
+            free_vartype(v);
+            return err;
+        }
+    } else {
+        vartype_list *src = (vartype_list *) stack[sp];
+        int4 n = src->size;
+        sort_item *keys = (sort_item *) calloc(n, sizeof(sort_item));
+        int4 *perm = (int4 *) malloc(2 * n * sizeof(int4));
+        if (n > 0 && (keys == NULL || perm == NULL)) {
+            free(keys);
+            free(perm);
+            return ERR_INSUFFICIENT_MEMORY;
+        }
+        int err = ERR_NONE;
+        for (int4 i = 0; i < n && err == ERR_NONE; i++)
+            err = list_sort_item(src->array->data[i], keys + i);
+        if (err != ERR_NONE) {
+            free(keys);
+            free(perm);
+            return err;
+        }
+        sort_perm(keys, perm, perm + n, n, false);
+        free(keys);
+        v = new_list(n);
+        if (v == NULL) {
+            free(perm);
+            return ERR_INSUFFICIENT_MEMORY;
+        }
+        vartype **d = ((vartype_list *) v)->array->data;
+        for (int4 i = 0; i < n; i++) {
+            d[i] = dup_vartype(src->array->data[perm[i]]);
+            if (d[i] == NULL) {
+                free(perm);
+                free_vartype(v);
+                return ERR_INSUFFICIENT_MEMORY;
+            }
+        }
+        free(perm);
+    }
+    unary_result(v);
+    return ERR_NONE;
+}
+
+int docmd_rsort(arg_struct *arg) {
+    // RSORT: sort the rows of the real matrix in Y by column X; if X is
+    // negative, by column -X, in descending order.
+    if (stack[sp - 1]->type != TYPE_REALMATRIX || stack[sp]->type != TYPE_REAL)
+        return ERR_INVALID_TYPE;
+    vartype_realmatrix *rm = (vartype_realmatrix *) stack[sp - 1];
+    phloat col = ((vartype_real *) stack[sp])->x;
+    bool descending = col < 0;
+    if (descending)
+        col = -col;
+    if (col < 1 || col >= (phloat) rm->columns + 1)
+        return ERR_DIMENSION_ERROR;
+    vartype *v = dup_vartype((vartype *) rm);
+    if (v == NULL)
+        return ERR_INSUFFICIENT_MEMORY;
+    int err = disentangle(v) ? sort_matrix((vartype_realmatrix *) v, to_int4(col) - 1, descending)
+                             : ERR_INSUFFICIENT_MEMORY;
+    if (err != ERR_NONE) {
+        free_vartype(v);
+        return err;
+    }
+    return binary_result(v);
+}
+
+int docmd_bsrch(arg_struct *arg) {
+    // BSRCH: binary search for X in the sorted list or real vector Y. Returns
+    // the position of the first match, counting from 0, like POS; if there
+    // is no match, returns -1 - the position where X would be inserted.
+    sort_item key, item;
+    int err = list_sort_item(stack[sp], &key);
+    if (err != ERR_NONE)
+        return err;
+    vartype *data = stack[sp - 1];
+    int4 n;
+    if (data->type == TYPE_REALMATRIX) {
+        vartype_realmatrix *rm = (vartype_realmatrix *) data;
+        if (rm->rows != 1 && rm->columns != 1)
+            return ERR_DIMENSION_ERROR;
+        n = rm->rows * rm->columns;
+    } else if (data->type == TYPE_LIST) {
+        n = ((vartype_list *) data)->size;
+    } else
+        return ERR_INVALID_TYPE;
+    int4 lo = 0, hi = n;
+    int c = 1;
+    while (lo < hi) {
+        int4 mid = lo + (hi - lo) / 2;
+        if (data->type == TYPE_REALMATRIX)
+            matrix_sort_item((vartype_realmatrix *) data, mid, &item);
+        else if ((err = list_sort_item(((vartype_list *) data)->array->data[mid], &item)) != ERR_NONE)
+            return err;
+        c = sort_compare(&item, &key);
+        if (c < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo < n) {
+        if (data->type == TYPE_REALMATRIX)
+            matrix_sort_item((vartype_realmatrix *) data, lo, &item);
+        else if ((err = list_sort_item(((vartype_list *) data)->array->data[lo], &item)) != ERR_NONE)
+            return err;
+        c = sort_compare(&item, &key);
+    } else
+        c = 1;
+    vartype *v = new_real(c == 0 ? lo : -1 - lo);
+    if (v == NULL)
+        return ERR_INSUFFICIENT_MEMORY;
+    return binary_result(v);
+}
+
 int docmd_s_to_n(arg_struct *arg) {
     // S->N: convert string to number, like ANUM
     phloat res;
@@ -2070,6 +2402,277 @@ int docmd_from_list(arg_struct *arg) {
     return ERR_NONE;
 }
 
+int docmd_newdict(arg_struct *arg) {
+    vartype *v = new_dict();
+    if (v == NULL)
+        return ERR_INSUFFICIENT_MEMORY;
+    return recall_result(v);
+}
+
+int docmd_dput(arg_struct *arg) {
+    // DPUT: stores the object in X under the key in Y, in the dictionary in Z,
+    // replacing the existing entry with that key, if any. Keys are reals or
+    // strings. Returns the updated dictionary.
+    if (stack[sp - 2]->type != TYPE_DICT || !dict_key_ok(stack[sp - 1]))
+        return ERR_INVALID_TYPE;
+    vartype *key = dup_vartype(stack[sp - 1]);
+    vartype *value = dup_vartype(stack[sp]);
+    vartype_dict *dict = (vartype_dict *) stack[sp - 2];
+    // If the dictionary in Z is shared, this makes a private copy; otherwise,
+    // we update it in place. As in concat(), everything that can fail is done
+    // before in_place_result(), and the update itself can't fail.
+    if (key == NULL || value == NULL || !disentangle((vartype *) dict)
+            || !dict_reserve(dict, 1) || in_place_result(2) != ERR_NONE) {
+        free_vartype(key);
+        free_vartype(value);
+        return ERR_INSUFFICIENT_MEMORY;
+    }
+    dict_put(dict, key, value);
+    print_trace();
+    return ERR_NONE;
+}
+
+int docmd_dget(arg_struct *arg) {
+    // DGET: returns the object stored under the key in X, in the dictionary
+    // in Y.
+    if (stack[sp - 1]->type != TYPE_DICT)
+        return ERR_INVALID_TYPE;
+    if (!dict_key_ok(stack[sp]))
+        return ERR_INVALID_TYPE;
+    vartype_dict *dict = (vartype_dict *) stack[sp - 1];
+    int4 e = dict_find(dict, stack[sp]);
+    if (e == -1)
+        return ERR_NONEXISTENT;
+    vartype *v = dup_vartype(dict->array->values[e]);
+    if (v == NULL)
+        return ERR_INSUFFICIENT_MEMORY;
+    return binary_result(v);
+}
+
+int docmd_ddel(arg_struct *arg) {
+    // DDEL: removes the entry with the key in X from the dictionary in Y, and
+    // returns the updated dictionary. Removing a key that isn't there is not
+    // an error.
+    if (stack[sp - 1]->type != TYPE_DICT)
+        return ERR_INVALID_TYPE;
+    if (!dict_key_ok(stack[sp]))
+        return ERR_INVALID_TYPE;
+    vartype_dict *dict = (vartype_dict *) stack[sp - 1];
+    if (!disentangle((vartype *) dict))
+        return ERR_INSUFFICIENT_MEMORY;
+    int4 e = dict_find(dict, stack[sp]);
+    if (in_place_result() != ERR_NONE)
+        return ERR_INSUFFICIENT_MEMORY;
+    if (e != -1)
+        dict_delete(dict, e);
+    print_trace();
+    return ERR_NONE;
+}
+
+int docmd_dkeys(arg_struct *arg) {
+    // DKEYS: returns a list of the keys of the dictionary in X, in the order
+    // in which they were added.
+    vartype_dict *dict = (vartype_dict *) stack[sp];
+    dict_data *dd = dict->array;
+    vartype_list *list = (vartype_list *) new_list(dict->size);
+    if (list == NULL)
+        return ERR_INSUFFICIENT_MEMORY;
+    int4 n = 0;
+    for (int4 i = 0; i < dd->used; i++) {
+        if (dd->keys[i] == NULL)
+            continue;
+        vartype *k = dup_vartype(dd->keys[i]);
+        if (k == NULL) {
+            free_vartype((vartype *) list);
+            return ERR_INSUFFICIENT_MEMORY;
+        }
+        list->array->data[n++] = k;
+    }
+    unary_result((vartype *) list);
+    return ERR_NONE;
+}
+
+int docmd_dkey_t(arg_struct *arg) {
+    // DKEY?: tests whether the dictionary in Y has an entry with the key in X.
+    if (stack[sp - 1]->type != TYPE_DICT)
+        return ERR_INVALID_TYPE;
+    if (!dict_key_ok(stack[sp]))
+        return ERR_INVALID_TYPE;
+    return dict_find((vartype_dict *) stack[sp - 1], stack[sp]) == -1 ? ERR_NO : ERR_YES;
+}
+
+///////////////////////////
+///// Sparse matrices /////
+///////////////////////////
+
+int docmd_sparse(arg_struct *arg) {
+    // SPARSE: converts the real matrix in X to a sparse matrix.
+    vartype_realmatrix *rm = (vartype_realmatrix *) stack[sp];
+    if (contains_strings(rm))
+        return ERR_ALPHA_DATA_IS_INVALID;
+    int4 rows = rm->rows;
+    int4 columns = rm->columns;
+    phloat *data = rm->array->data;
+    int4 sz = rows * columns;
+    int4 nnz = 0;
+    for (int4 i = 0; i < sz; i++)
+        if (data[i] != 0)
+            nnz++;
+    vartype_sparse *sm = (vartype_sparse *) new_sparse(rows, columns, nnz);
+    if (sm == NULL)
+        return ERR_INSUFFICIENT_MEMORY;
+    sparse_data *sd = sm->array;
+    int4 k = 0;
+    for (int4 i = 0; i < rows; i++) {
+        for (int4 j = 0; j < columns; j++) {
+            phloat x = data[i * columns + j];
+            if (x != 0) {
+                sd->column[k] = j;
+                sd->data[k++] = x;
+            }
+        }
+        sd->rowstart[i + 1] = k;
+    }
+    unary_result((vartype *) sm);
+    return ERR_NONE;
+}
+
+int docmd_dense(arg_struct *arg) {
+    // DENSE: converts the sparse matrix in X to a real matrix.
+    vartype_sparse *sm = (vartype_sparse *) stack[sp];
+    sparse_data *sd = sm->array;
+    vartype_realmatrix *rm = (vartype_realmatrix *) new_realmatrix(sm->rows, sm->columns);
+    if (rm == NULL)
+        return ERR_INSUFFICIENT_MEMORY;
+    for (int4 i = 0; i < sm->rows; i++) {
+        phloat *row = rm->array->data + i * sm->columns;
+        for (int4 k = sd->rowstart[i]; k < sd->rowstart[i + 1]; k++)
+            row[sd->column[k]] = sd->data[k];
+    }
+    unary_result((vartype *) rm);
+    return ERR_NONE;
+}
+
+/* Stable counting sort of the indices in src by key[], which is in 0..m-1 */
+static void sp_count_sort(const int4 *key, const int4 *src, int4 *dst, int4 n,
+                          int4 *count, int4 m) {
+    for (int4 i = 0; i <= m; i++)
+        count[i] = 0;
+    for (int4 k = 0; k < n; k++)
+        count[key[src[k]] + 1]++;
+    for (int4 i = 0; i < m; i++)
+        count[i + 1] += count[i];
+    for (int4 k = 0; k < n; k++)
+        dst[count[key[src[k]]]++] = src[k];
+}
+
+int docmd_newsp(arg_struct *arg) {
+    // NEWSP: creates a sparse matrix with the number of rows in Z and the
+    // number of columns in Y. X is a real matrix with three columns, each
+    // row of which holds the row number, column number, and value of one
+    // element. Values given for the same element are added up.
+    if (stack[sp]->type == TYPE_STRING || stack[sp - 1]->type == TYPE_STRING
+            || stack[sp - 2]->type == TYPE_STRING)
+        return ERR_ALPHA_DATA_IS_INVALID;
+    if (stack[sp]->type != TYPE_REALMATRIX || stack[sp - 1]->type != TYPE_REAL
+            || stack[sp - 2]->type != TYPE_REAL)
+        return ERR_INVALID_TYPE;
+    int4 dim[2];
+    for (int i = 0; i < 2; i++) {
+        phloat x = ((vartype_real *) stack[sp - 2 + i])->x;
+        if (x < 0)
+            x = -x;
+        if (x >= 2147483647.0)
+            return ERR_DIMENSION_ERROR;
+        dim[i] = to_int4(x);
+        if (dim[i] == 0)
+            return ERR_DIMENSION_ERROR;
+    }
+    int4 rows = dim[0];
+    int4 columns = dim[1];
+
+    vartype_realmatrix *tm = (vartype_realmatrix *) stack[sp];
+    if (tm->columns != 3)
+        return ERR_DIMENSION_ERROR;
+    if (contains_strings(tm))
+        return ERR_ALPHA_DATA_IS_INVALID;
+    int4 n = tm->rows;
+    phloat *t = tm->array->data;
+
+    int4 maxdim = rows > columns ? rows : columns;
+    int4 *buf = (int4 *) calloc((size_t) 4 * n + maxdim + 1, sizeof(int4));
+    if (buf == NULL)
+        return ERR_INSUFFICIENT_MEMORY;
+    int4 *row = buf;
+    int4 *col = row + n;
+    int4 *perm = col + n;
+    int4 *tmp = perm + n;
+    int4 *count = tmp + n;
+
+    // Validate the positions, and leave out the zeros
+    int4 nz = 0;
+    for (int4 k = 0; k < n; k++) {
+        phloat r = t[3 * k];
+        phloat c = t[3 * k + 1];
+        if (r < 1 || r >= rows + 1.0 || c < 1 || c >= columns + 1.0) {
+            free(buf);
+            return ERR_DIMENSION_ERROR;
+        }
+        row[k] = to_int4(r) - 1;
+        col[k] = to_int4(c) - 1;
+        if (t[3 * k + 2] != 0)
+            tmp[nz++] = k;
+    }
+
+    // Order by row, then by column, then by position in X
+    sp_count_sort(col, tmp, perm, nz, count, columns);
+    sp_count_sort(row, perm, tmp, nz, count, rows);
+
+    vartype_sparse *sm = (vartype_sparse *) new_sparse(rows, columns, nz);
+    if (sm == NULL) {
+        free(buf);
+        return ERR_INSUFFICIENT_MEMORY;
+    }
+    sparse_data *sd = sm->array;
+    int4 m = 0;
+    for (int4 k = 0; k < nz; ) {
+        int4 r = row[tmp[k]];
+        int4 c = col[tmp[k]];
+        phloat sum = 0;
+        while (k < nz && row[tmp[k]] == r && col[tmp[k]] == c)
+            sum += t[3 * tmp[k++] + 2];
+        if (sum == 0)
+            continue;
+        int inf = p_isinf(sum);
+        if (inf != 0) {
+            if (flags.f.range_error_ignore)
+                sum = inf == 1 ? POS_HUGE_PHLOAT : NEG_HUGE_PHLOAT;
+            else {
+                free(buf);
+                free_vartype((vartype *) sm);
+                return ERR_OUT_OF_RANGE;
+            }
+        }
+        sd->column[m] = c;
+        sd->data[m++] = sum;
+        sd->rowstart[r + 1]++;
+    }
+    free(buf);
+    for (int4 i = 0; i < rows; i++)
+        sd->rowstart[i + 1] += sd->rowstart[i];
+    if (m < nz) {
+        // Duplicates were merged; give back the space they took
+        int4 *c2 = (int4 *) realloc(sd->column, (m == 0 ? 1 : m) * sizeof(int4));
+        if (c2 != NULL)
+            sd->column = c2;
+        phloat *d2 = (phloat *) realloc(sd->data, (m == 0 ? 1 : m) * sizeof(phloat));
+        if (d2 != NULL)
+            sd->data = d2;
+        sd->nnz = m;
+    }
+    return ternary_result((vartype *) sm);
+}
+
 int docmd_width(arg_struct *arg) {
     vartype *v = new_real(131);
     if (v == NULL)
@@ -112,6 +112,9 @@ int docmd_length(arg_struct *arg);
 int docmd_head(arg_struct *arg);
 int docmd_rev(arg_struct *arg);
 int docmd_pos(arg_struct *arg);
+int docmd_sort(arg_struct *arg);
+int docmd_rsort(arg_struct *arg);
+int docmd_bsrch(arg_struct *arg);
 int docmd_s_to_n(arg_struct *arg);
 int docmd_n_to_s(arg_struct *arg);
 int docmd_nn_to_s(arg_struct *arg);
@@ -121,6 +124,15 @@ int docmd_list_t(arg_struct *arg);
 int docmd_newlist(arg_struct *arg);
 int docmd_to_list(arg_struct *arg);
 int docmd_from_list(arg_struct *arg);
+int docmd_newdict(arg_struct *arg);
+int docmd_dput(arg_struct *arg);
+int docmd_dget(arg_struct *arg);
+int docmd_ddel(arg_struct *arg);
+int docmd_dkeys(arg_struct *arg);
+int docmd_dkey_t(arg_struct *arg);
+int docmd_sparse(arg_struct *arg);
+int docmd_dense(arg_struct *arg);
+int docmd_newsp(arg_struct *arg);
 
 int docmd_width(arg_struct *arg);
 int docmd_height(arg_struct *arg);
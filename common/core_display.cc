@@ -1455,6 +1455,23 @@ static int set_appmenu(int menuid, bool exitall) {
     }
 }
 
+/* The layout of the variable menu: the program and pc of its first MVAR, and
+ * the number of MVARs. Finding those takes a label search and a walk through
+ * the program, and the menu is redrawn after every keystroke, so the layout
+ * is kept until the menu switches to a different label, or until a program is
+ * edited, cleared, or loaded, at which point invalidate_varmenu_cache() is
+ * called.
+ */
+static char varmenu_cache_name[7];
+static int varmenu_cache_length = -1;
+static int varmenu_cache_prgm;
+static int4 varmenu_cache_pc;
+static int varmenu_cache_mvars;
+
+void invalidate_varmenu_cache() {
+    varmenu_cache_length = -1;
+}
+
 void draw_varmenu() {
     arg_struct arg;
     int saved_prgm, prgm;
@@ -1464,26 +1481,39 @@ void draw_varmenu() {
 
     if (mode_appmenu != MENU_VARMENU)
         return;
-    arg.type = ARGTYPE_STR;
-    arg.length = varmenu_length;
-    for (i = 0; i < arg.length; i++)
-        arg.val.text[i] = varmenu[i];
-    if (!find_global_label(&arg, &prgm, &pc)) {
-        set_appmenu(MENU_NONE, false);
-        varmenu_length = 0;
-        return;
-    }
     saved_prgm = current_prgm;
-    current_prgm = prgm;
-    pc += get_command_length(prgm, pc);
-    pc2 = pc;
-    while (get_next_command(&pc, &command, &arg, 0, NULL), command == CMD_MVAR)
-        num_mvars++;
-    if (num_mvars == 0) {
-        current_prgm = saved_prgm;
-        set_appmenu(MENU_NONE, false);
-        varmenu_length = 0;
-        return;
+    if (string_equals(varmenu_cache_name, varmenu_cache_length,
+                      varmenu, varmenu_length)) {
+        prgm = varmenu_cache_prgm;
+        pc2 = varmenu_cache_pc;
+        num_mvars = varmenu_cache_mvars;
+        current_prgm = prgm;
+    } else {
+        arg.type = ARGTYPE_STR;
+        arg.length = varmenu_length;
+        for (i = 0; i < arg.length; i++)
+            arg.val.text[i] = varmenu[i];
+        if (!find_global_label(&arg, &prgm, &pc)) {
+            set_appmenu(MENU_NONE, false);
+            varmenu_length = 0;
+            return;
+        }
+        current_prgm = prgm;
+        pc += get_command_length(prgm, pc);
+        pc2 = pc;
+        while (get_next_command(&pc, &command, &arg, 0, NULL), command == CMD_MVAR)
+            num_mvars++;
+        if (num_mvars == 0) {
+            current_prgm = saved_prgm;
+            set_appmenu(MENU_NONE, false);
+            varmenu_length = 0;
+            return;
+        }
+        string_copy(varmenu_cache_name, &varmenu_cache_length,
+                    varmenu, varmenu_length);
+        varmenu_cache_prgm = prgm;
+        varmenu_cache_pc = pc2;
+        varmenu_cache_mvars = num_mvars;
     }
 
     varmenu_rows = (num_mvars + 5) / 6;
@@ -1583,10 +1613,11 @@ static int ext_prgm_cat[] = {
 };
 
 static int ext_str_cat[] = {
-    CMD_APPEND,    CMD_C_TO_N, CMD_EXTEND, CMD_HEAD,    CMD_LENGTH, CMD_TO_LIST,
-    CMD_FROM_LIST, CMD_LIST_T, CMD_LXASTO, CMD_NEWLIST, CMD_N_TO_C, CMD_N_TO_S,
-    CMD_NN_TO_S,   CMD_POS,    CMD_REV,    CMD_SUBSTR,  CMD_S_TO_N, CMD_XASTO,
-    CMD_XSTR,      CMD_XVIEW,  CMD_NULL,   CMD_NULL,    CMD_NULL,   CMD_NULL
+    CMD_APPEND,    CMD_BSRCH,   CMD_C_TO_N, CMD_DDEL,    CMD_DGET,    CMD_DKEY_T,
+    CMD_DKEYS,     CMD_DPUT,    CMD_EXTEND, CMD_HEAD,    CMD_LENGTH,  CMD_TO_LIST,
+    CMD_FROM_LIST, CMD_LIST_T,  CMD_LXASTO, CMD_NEWDICT, CMD_NEWLIST, CMD_N_TO_C,
+    CMD_N_TO_S,    CMD_NN_TO_S, CMD_POS,    CMD_REV,     CMD_RSORT,   CMD_SORT,
+    CMD_SUBSTR,    CMD_S_TO_N,  CMD_XASTO,  CMD_XSTR,    CMD_XVIEW,   CMD_NULL
 };
 
 static int ext_stk_cat[] = {
@@ -1598,34 +1629,38 @@ static int ext_stk_cat[] = {
 #if defined(ANDROID) || defined(IPHONE)
 #ifdef FREE42_FPTEST
 static int ext_misc_cat[] = {
-    CMD_A2LINE, CMD_A2PLINE, CMD_CAPS,    CMD_C_LN_1_X, CMD_C_E_POW_X_1, CMD_FMA,
-    CMD_HEIGHT, CMD_MIXED,   CMD_PCOMPLX, CMD_PRREG,    CMD_RCOMPLX,     CMD_STRACE,
-    CMD_WIDTH,  CMD_X2LINE,  CMD_ACCEL,   CMD_LOCAT,    CMD_HEADING,     CMD_FPTEST
+    CMD_A2LINE,  CMD_A2PLINE, CMD_CAPS,    CMD_C_LN_1_X, CMD_C_E_POW_X_1, CMD_FMA,
+    CMD_HEIGHT,  CMD_MIXED,   CMD_PCOMPLX, CMD_PRREG,    CMD_QUANT,       CMD_RANM,
+    CMD_RCOMPLX, CMD_STRACE,  CMD_WIDTH,   CMD_X2LINE,   CMD_SIGMA_ACC,   CMD_DENSE,
+    CMD_NEWSP,   CMD_SPARSE,  CMD_ACCEL,   CMD_LOCAT,    CMD_HEADING,     CMD_FPTEST
 };
-#define MISC_CAT_ROWS 3
+#define MISC_CAT_ROWS 4
 #else
 static int ext_misc_cat[] = {
-    CMD_A2LINE, CMD_A2PLINE, CMD_CAPS,    CMD_C_LN_1_X, CMD_C_E_POW_X_1, CMD_FMA,
-    CMD_HEIGHT, CMD_MIXED,   CMD_PCOMPLX, CMD_PRREG,    CMD_RCOMPLX,     CMD_STRACE,
-    CMD_WIDTH,  CMD_X2LINE,  CMD_ACCEL,   CMD_LOCAT,    CMD_HEADING,     CMD_NULL
+    CMD_A2LINE,  CMD_A2PLINE, CMD_CAPS,    CMD_C_LN_1_X, CMD_C_E_POW_X_1, CMD_FMA,
+    CMD_HEIGHT,  CMD_MIXED,   CMD_PCOMPLX, CMD_PRREG,    CMD_QUANT,       CMD_RANM,
+    CMD_RCOMPLX, CMD_STRACE,  CMD_WIDTH,   CMD_X2LINE,   CMD_SIGMA_ACC,   CMD_DENSE,
+    CMD_NEWSP,   CMD_SPARSE,  CMD_ACCEL,   CMD_LOCAT,    CMD_HEADING,     CMD_NULL
 };
-#define MISC_CAT_ROWS 3
+#define MISC_CAT_ROWS 4
 #endif
 #else
 #ifdef FREE42_FPTEST
 static int ext_misc_cat[] = {
-    CMD_A2LINE, CMD_A2PLINE, CMD_CAPS,    CMD_C_LN_1_X, CMD_C_E_POW_X_1, CMD_FMA,
-    CMD_HEIGHT, CMD_MIXED,   CMD_PCOMPLX, CMD_PRREG,    CMD_RCOMPLX,     CMD_STRACE,
-    CMD_WIDTH,  CMD_X2LINE,  CMD_FPTEST,  CMD_NULL,     CMD_NULL,        CMD_NULL
+    CMD_A2LINE,  CMD_A2PLINE, CMD_CAPS,    CMD_C_LN_1_X, CMD_C_E_POW_X_1, CMD_FMA,
+    CMD_HEIGHT,  CMD_MIXED,   CMD_PCOMPLX, CMD_PRREG,    CMD_QUANT,       CMD_RANM,
+    CMD_RCOMPLX, CMD_STRACE,  CMD_WIDTH,   CMD_X2LINE,   CMD_SIGMA_ACC,   CMD_DENSE,
+    CMD_NEWSP,   CMD_SPARSE,  CMD_FPTEST,  CMD_NULL,     CMD_NULL,        CMD_NULL
 };
-#define MISC_CAT_ROWS 3
+#define MISC_CAT_ROWS 4
 #else
 static int ext_misc_cat[] = {
-    CMD_A2LINE, CMD_A2PLINE, CMD_CAPS,    CMD_C_LN_1_X, CMD_C_E_POW_X_1, CMD_FMA,
-    CMD_HEIGHT, CMD_MIXED,   CMD_PCOMPLX, CMD_PRREG,    CMD_RCOMPLX,     CMD_STRACE,
-    CMD_WIDTH,  CMD_X2LINE,  CMD_NULL,    CMD_NULL,     CMD_NULL,        CMD_NULL
+    CMD_A2LINE,  CMD_A2PLINE, CMD_CAPS,    CMD_C_LN_1_X, CMD_C_E_POW_X_1, CMD_FMA,
+    CMD_HEIGHT,  CMD_MIXED,   CMD_PCOMPLX, CMD_PRREG,    CMD_QUANT,       CMD_RANM,
+    CMD_RCOMPLX, CMD_STRACE,  CMD_WIDTH,   CMD_X2LINE,   CMD_SIGMA_ACC,   CMD_DENSE,
+    CMD_NEWSP,   CMD_SPARSE,  CMD_NULL,    CMD_NULL,     CMD_NULL,        CMD_NULL
 };
-#define MISC_CAT_ROWS 3
+#define MISC_CAT_ROWS 4
 #endif
 #endif
 
@@ -1734,7 +1769,7 @@ static void draw_catalog() {
             case CATSECT_EXT_XFCN: subcat = ext_xfcn_cat; subcat_rows = 1; break;
             case CATSECT_EXT_BASE: subcat = ext_base_cat; subcat_rows = 1; break;
             case CATSECT_EXT_PRGM: subcat = ext_prgm_cat; subcat_rows = 4; break;
-            case CATSECT_EXT_STR: subcat = ext_str_cat; subcat_rows = 4; break;
+            case CATSECT_EXT_STR: subcat = ext_str_cat; subcat_rows = 5; break;
             case CATSECT_EXT_STK: subcat = ext_stk_cat; subcat_rows = 3; break;
             case CATSECT_EXT_MISC: subcat = ext_misc_cat; subcat_rows = MISC_CAT_ROWS; break;
             case CATSECT_EXT_0_CMP: subcat = ext_0_cmp_cat; subcat_rows = 1; break;
@@ -1801,9 +1836,11 @@ static void draw_catalog() {
                     break;
                 case TYPE_REALMATRIX:
                 case TYPE_COMPLEXMATRIX:
+                case TYPE_SPARSE:
                     if (show_mat) vcount++;
                     break;
                 case TYPE_LIST:
+                case TYPE_DICT:
                     if (show_list) vcount++;
                     break;
             }
@@ -1842,8 +1879,10 @@ static void draw_catalog() {
                     if (show_cpx) break; else continue;
                 case TYPE_REALMATRIX:
                 case TYPE_COMPLEXMATRIX:
+                case TYPE_SPARSE:
                     if (show_mat) break; else continue;
                 case TYPE_LIST:
+                case TYPE_DICT:
                     if (show_list) break; else continue;
                 default:
                     continue;
@@ -2019,7 +2058,7 @@ void show() {
                 draw_string(0, 0, buf, bufptr);
                 draw_string(0, 1, "1:1=", 4);
                 bufptr = 0;
-                if (rm->array->is_string[0] != 0) {
+                if (rm->array->str_type(0) != 0) {
                     char *text;
                     int4 len;
                     get_matrix_string(rm, 0, &text, &len);
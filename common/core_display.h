@@ -46,6 +46,7 @@ void display_y(int row);
 void display_incomplete_command(int row);
 void display_error(int error, bool print);
 void display_command(int row);
+void invalidate_varmenu_cache();
 void draw_varmenu();
 void display_mem();
 void show();
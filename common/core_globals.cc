@@ -24,6 +24,7 @@
 #include "core_commands7.h"
 #include "core_display.h"
 #include "core_helpers.h"
+#include "core_linalg1.h"
 #include "core_main.h"
 #include "core_math1.h"
 #include "core_tables.h"
@@ -690,6 +691,9 @@ int8 random_number_low, random_number_high;
 /* NORM & TRACE mode: number waiting to be printed */
 int deferred_print = 0;
 
+/* TRACE mode: writing a binary trace instead of printing */
+bool trace_to_file = false;
+
 /* Keystroke buffer - holds keystrokes received while
  * there is a program running.
  */
@@ -740,8 +744,12 @@ bool no_keystrokes_yet;
  * Version 46: 3.1    CSLD?
  * Version 47: 3.1    Back-port of Plus42 RTN stack; FUNC stack hiding
  * Version 48: 3.1    Matrix editor nested lists
+ * Version 49: 3.1    INTEG methods and evaluation count
+ * Version 50: 3.1    SOLVE root scan
+ * Version 51: 3.1    Dictionary type
+ * Version 52: 3.1    Sparse matrix type
  */
-#define FREE42_VERSION 48
+#define FREE42_VERSION 52
 
 
 /*******************/
@@ -819,7 +827,7 @@ static void **array_list;
 
 
 static bool array_list_grow();
-static int array_list_search(void *array);
+static int array_list_search(const vartype *v);
 static bool persist_vartype(vartype *v);
 static bool unpersist_vartype(vartype **v);
 static void update_label_table(int prgm, int4 pc, int inserted);
@@ -846,6 +854,32 @@ void vartype_string::trim1() {
     }
 }
 
+/* Makes sure a long string's buffer has room for at least 'newlength'
+ * characters, growing it geometrically, so that appending to a string
+ * repeatedly takes amortized linear time. Only for strings with
+ * length > SSLENV; shorter strings live in 'buf' and are simply copied into
+ * a new string when they grow.
+ */
+bool vartype_string::reserve(int4 newlength) {
+    if (newlength <= capacity)
+        return true;
+    int4 newcapacity = capacity;
+    while (newcapacity < newlength && newcapacity < 0x40000000)
+        newcapacity *= 2;
+    if (newcapacity < newlength)
+        newcapacity = newlength;
+    char *newptr = (char *) realloc(t.ptr, newcapacity);
+    if (newptr == NULL) {
+        newcapacity = newlength;
+        newptr = (char *) realloc(t.ptr, newcapacity);
+        if (newptr == NULL)
+            return false;
+    }
+    t.ptr = newptr;
+    capacity = newcapacity;
+    return true;
+}
+
 static bool array_list_grow() {
     if (array_count < array_list_capacity)
         return true;
@@ -858,10 +892,54 @@ static bool array_list_grow() {
     return true;
 }
 
-static int array_list_search(void *array) {
-    for (int i = 0; i < array_count; i++)
-        if (array_list[i] == array)
-            return i;
+/* Looks for a previously written matrix or list that shares its data with
+ * 'v'. Matrices only count as shared if they have the same dimensions, too;
+ * for example, a vector and its transpose share their data, but the state
+ * file format can't express that, so they're written separately.
+ */
+static int array_list_search(const vartype *v) {
+    for (int i = 0; i < array_count; i++) {
+        const vartype *w = (const vartype *) array_list[i];
+        if (w->type != v->type)
+            continue;
+        switch (v->type) {
+            case TYPE_REALMATRIX: {
+                const vartype_realmatrix *a = (const vartype_realmatrix *) v;
+                const vartype_realmatrix *b = (const vartype_realmatrix *) w;
+                if (a->array == b->array && a->rows == b->rows
+                                         && a->columns == b->columns)
+                    return i;
+                break;
+            }
+            case TYPE_COMPLEXMATRIX: {
+                const vartype_complexmatrix *a = (const vartype_complexmatrix *) v;
+                const vartype_complexmatrix *b = (const vartype_complexmatrix *) w;
+                if (a->array == b->array && a->rows == b->rows
+                                         && a->columns == b->columns)
+                    return i;
+                break;
+            }
+            case TYPE_LIST: {
+                const vartype_list *a = (const vartype_list *) v;
+                const vartype_list *b = (const vartype_list *) w;
+                if (a->array == b->array && a->size == b->size)
+                    return i;
+                break;
+            }
+            case TYPE_DICT: {
+                if (((const vartype_dict *) v)->array
+                        == ((const vartype_dict *) w)->array)
+                    return i;
+                break;
+            }
+            case TYPE_SPARSE: {
+                if (((const vartype_sparse *) v)->array
+                        == ((const vartype_sparse *) w)->array)
+                    return i;
+                break;
+            }
+        }
+    }
     return -1;
 }
 
@@ -890,13 +968,13 @@ static bool persist_vartype(vartype *v) {
             int4 columns = rm->columns;
             bool must_write = true;
             if (rm->array->refcount > 1) {
-                int n = array_list_search(rm->array);
+                int n = array_list_search(v);
                 if (n == -1) {
                     // A negative row count signals a new shared matrix
                     rows = -rows;
                     if (!array_list_grow())
                         return false;
-                    array_list[array_count++] = rm->array;
+                    array_list[array_count++] = v;
                 } else {
                     // A zero row count means this matrix shares its data
                     // with a previously written matrix
@@ -909,10 +987,21 @@ static bool persist_vartype(vartype *v) {
             write_int4(columns);
             if (must_write) {
                 int size = rm->rows * rm->columns;
-                if (fwrite(rm->array->is_string, 1, size, gfile) != size)
-                    return false;
+                if (rm->array->is_string != NULL) {
+                    if (fwrite(rm->array->is_string, 1, size, gfile) != size)
+                        return false;
+                } else {
+                    // No strings; the file format still wants the map
+                    char zeros[256];
+                    memset(zeros, 0, 256);
+                    for (int done = 0; done < size; done += 256) {
+                        int n = size - done < 256 ? size - done : 256;
+                        if (fwrite(zeros, 1, n, gfile) != n)
+                            return false;
+                    }
+                }
                 for (int i = 0; i < size; i++) {
-                    if (rm->array->is_string[i] == 0) {
+                    if (rm->array->str_type(i) == 0) {
                         if (!write_phloat(rm->array->data[i]))
                             return false;
                     } else {
@@ -934,13 +1023,13 @@ static bool persist_vartype(vartype *v) {
             int4 columns = cm->columns;
             bool must_write = true;
             if (cm->array->refcount > 1) {
-                int n = array_list_search(cm->array);
+                int n = array_list_search(v);
                 if (n == -1) {
                     // A negative row count signals a new shared matrix
                     rows = -rows;
                     if (!array_list_grow())
                         return false;
-                    array_list[array_count++] = cm->array;
+                    array_list[array_count++] = v;
                 } else {
                     // A zero row count means this matrix shares its data
                     // with a previously written matrix
@@ -965,13 +1054,13 @@ static bool persist_vartype(vartype *v) {
             int data_index = -1;
             bool must_write = true;
             if (list->array->refcount > 1) {
-                int n = array_list_search(list->array);
+                int n = array_list_search(v);
                 if (n == -1) {
                     // data_index == -2 indicates a new shared list
                     data_index = -2;
                     if (!array_list_grow())
                         return false;
-                    array_list[array_count++] = list->array;
+                    array_list[array_count++] = v;
                 } else {
                     // data_index >= 0 refers to a previously shared list
                     data_index = n;
@@ -987,6 +1076,70 @@ static bool persist_vartype(vartype *v) {
             }
             return true;
         }
+        case TYPE_DICT: {
+            vartype_dict *dict = (vartype_dict *) v;
+            dict_data *dd = dict->array;
+            int data_index = -1;
+            bool must_write = true;
+            if (dd->refcount > 1) {
+                int n = array_list_search(v);
+                if (n == -1) {
+                    // data_index == -2 indicates a new shared dictionary
+                    data_index = -2;
+                    if (!array_list_grow())
+                        return false;
+                    array_list[array_count++] = v;
+                } else {
+                    // data_index >= 0 refers to a previously shared dictionary
+                    data_index = n;
+                    must_write = false;
+                }
+            }
+            write_int4(dict->size);
+            write_int(data_index);
+            if (must_write) {
+                for (int4 i = 0; i < dd->used; i++)
+                    if (dd->keys[i] != NULL)
+                        if (!persist_vartype(dd->keys[i])
+                                || !persist_vartype(dd->values[i]))
+                            return false;
+            }
+            return true;
+        }
+        case TYPE_SPARSE: {
+            vartype_sparse *sm = (vartype_sparse *) v;
+            sparse_data *sd = sm->array;
+            int data_index = -1;
+            bool must_write = true;
+            if (sd->refcount > 1) {
+                int n = array_list_search(v);
+                if (n == -1) {
+                    // data_index == -2 indicates a new shared sparse matrix
+                    data_index = -2;
+                    if (!array_list_grow())
+                        return false;
+                    array_list[array_count++] = v;
+                } else {
+                    // data_index >= 0 refers to a previously shared one
+                    data_index = n;
+                    must_write = false;
+                }
+            }
+            write_int4(sm->rows);
+            write_int4(sm->columns);
+            write_int4(sd->nnz);
+            write_int(data_index);
+            if (must_write) {
+                // Row lengths, then (column, value) pairs in row order
+                for (int4 i = 0; i < sm->rows; i++)
+                    if (!write_int4(sd->rowstart[i + 1] - sd->rowstart[i]))
+                        return false;
+                for (int4 k = 0; k < sd->nnz; k++)
+                    if (!write_int4(sd->column[k]) || !write_phloat(sd->data[k]))
+                        return false;
+            }
+            return true;
+        }
         default:
             /* Should not happen */
             return false;
@@ -1094,7 +1247,8 @@ static bool unpersist_vartype(vartype **v) {
             if (rm == NULL)
                 return false;
             int4 size = rows * columns;
-            if (fread(rm->array->is_string, 1, size, gfile) != size) {
+            if (!rm->array->make_is_string(size)
+                    || fread(rm->array->is_string, 1, size, gfile) != size) {
                 free_vartype((vartype *) rm);
                 return false;
             }
@@ -1102,7 +1256,7 @@ static bool unpersist_vartype(vartype **v) {
             int4 i;
             for (i = 0; i < size; i++) {
                 success = false;
-                if (rm->array->is_string[i] == 0) {
+                if (rm->array->str_type(i) == 0) {
                     if (!read_phloat(&rm->array->data[i]))
                         break;
                 } else {
@@ -1176,6 +1330,8 @@ static bool unpersist_vartype(vartype **v) {
                 free_vartype((vartype *) rm);
                 return false;
             }
+            if (!contains_strings(rm))
+                rm->array->drop_strings(size);
             if (shared) {
                 if (!array_list_grow()) {
                     free_vartype((vartype *) rm);
@@ -1258,6 +1414,107 @@ static bool unpersist_vartype(vartype **v) {
             *v = (vartype *) list;
             return true;
         }
+        case TYPE_DICT: {
+            int4 size;
+            int data_index;
+            if (!read_int4(&size) || !read_int(&data_index))
+                return false;
+            if (data_index >= 0) {
+                // Shared dictionary
+                vartype *m = dup_vartype((vartype *) array_list[data_index]);
+                if (m == NULL)
+                    return false;
+                else {
+                    *v = m;
+                    return true;
+                }
+            }
+            bool shared = data_index == -2;
+            vartype_dict *dict = (vartype_dict *) new_dict();
+            if (dict == NULL)
+                return false;
+            if (!dict_reserve(dict, size)) {
+                free_vartype((vartype *) dict);
+                return false;
+            }
+            if (shared) {
+                if (!array_list_grow()) {
+                    free_vartype((vartype *) dict);
+                    return false;
+                }
+                array_list[array_count++] = dict;
+            }
+            for (int4 i = 0; i < size; i++) {
+                vartype *key, *value;
+                if (!unpersist_vartype(&key))
+                    goto dict_fail;
+                if (key == NULL || !dict_key_ok(key)) {
+                    free_vartype(key);
+                    goto dict_fail;
+                }
+                if (!unpersist_vartype(&value)) {
+                    free_vartype(key);
+                    goto dict_fail;
+                }
+                dict_put(dict, key, value);
+            }
+            *v = (vartype *) dict;
+            return true;
+            dict_fail:
+            free_vartype((vartype *) dict);
+            return false;
+        }
+        case TYPE_SPARSE: {
+            int4 rows, columns, nnz;
+            int data_index;
+            if (!read_int4(&rows) || !read_int4(&columns)
+                    || !read_int4(&nnz) || !read_int(&data_index))
+                return false;
+            if (data_index >= 0) {
+                // Shared sparse matrix
+                vartype *m = dup_vartype((vartype *) array_list[data_index]);
+                if (m == NULL)
+                    return false;
+                else {
+                    *v = m;
+                    return true;
+                }
+            }
+            if (rows < 1 || columns < 1 || nnz < 0)
+                return false;
+            vartype_sparse *sm = (vartype_sparse *) new_sparse(rows, columns, nnz);
+            if (sm == NULL)
+                return false;
+            sparse_data *sd = sm->array;
+            for (int4 i = 1; i <= rows; i++) {
+                int4 n;
+                if (!read_int4(&n) || n < 0 || n > nnz - sd->rowstart[i - 1])
+                    goto sparse_fail;
+                sd->rowstart[i] = sd->rowstart[i - 1] + n;
+            }
+            if (sd->rowstart[rows] != nnz)
+                goto sparse_fail;
+            for (int4 i = 0; i < rows; i++) {
+                int4 prev = -1;
+                for (int4 k = sd->rowstart[i]; k < sd->rowstart[i + 1]; k++) {
+                    if (!read_int4(&sd->column[k])
+                            || sd->column[k] <= prev || sd->column[k] >= columns
+                            || !read_phloat(&sd->data[k]) || sd->data[k] == 0)
+                        goto sparse_fail;
+                    prev = sd->column[k];
+                }
+            }
+            if (data_index == -2) {
+                if (!array_list_grow())
+                    goto sparse_fail;
+                array_list[array_count++] = sm;
+            }
+            *v = (vartype *) sm;
+            return true;
+            sparse_fail:
+            free_vartype((vartype *) sm);
+            return false;
+        }
         default:
             return false;
     }
@@ -1669,6 +1926,7 @@ static bool unpersist_globals() {
 }
 
 void clear_all_prgms() {
+    invalidate_varmenu_cache();
     if (prgms != NULL) {
         int i;
         for (i = 0; i < prgms_count; i++)
@@ -1718,6 +1976,7 @@ int clear_prgm_by_index(int prgm_index) {
         pc = -1;
     else if (current_prgm > prgm_index)
         current_prgm--;
+    invalidate_varmenu_cache();
     free(prgms[prgm_index].text);
     for (i = prgm_index; i < prgms_count - 1; i++)
         prgms[i] = prgms[i + 1];
@@ -2023,6 +2282,8 @@ void rebuild_label_table() {
      */
     int prgm_index;
     int4 pc;
+    clear_fn_memo();
+    invalidate_varmenu_cache();
     labels_count = 0;
     for (prgm_index = 0; prgm_index < prgms_count; prgm_index++) {
         prgm_struct *prgm = prgms + prgm_index;
@@ -2078,6 +2339,8 @@ static void update_label_table(int prgm, int4 pc, int inserted) {
 
 static void invalidate_lclbls(int prgm_index, bool force) {
     prgm_struct *prgm = prgms + prgm_index;
+    clear_fn_memo();
+    invalidate_varmenu_cache();
     if (force || !prgm->lclbl_invalid) {
         int4 pc2 = 0;
         while (pc2 < prgm->size) {
@@ -2811,6 +3074,7 @@ int push_func_state(int n) {
     vartype **tmpstk = tlist->array->data;
     int4 tmpdepth = tlist->size;
     tlist->array->data = stack;
+    tlist->array->capacity = stack_capacity;
     tlist->size = sp + 1;
     stack = tmpstk;
     stack_capacity = 4;
@@ -2903,6 +3167,7 @@ int push_stack_state(bool big) {
             vartype **tmpstk = tlist->array->data;
             int4 tmpdepth = tlist->size;
             tlist->array->data = stack;
+            tlist->array->capacity = stack_capacity;
             tlist->size = sp + 1;
             stack = tmpstk;
             stack_capacity = tmpdepth;
@@ -2929,14 +3194,7 @@ int push_stack_state(bool big) {
  * capacity.
  */
 static bool ensure_list_capacity_4(vartype_list *list) {
-    int4 size = list->size;
-    if (size < 4) {
-        vartype **newdata = (vartype **) realloc(list->array->data, 4 * sizeof(vartype *));
-        if (newdata == NULL)
-            return false;
-        list->array->data = newdata;
-    }
-    return true;
+    return grow_list(list, 4);
 }
 
 int pop_func_state(bool error) {
@@ -2988,11 +3246,13 @@ int pop_func_state(bool error) {
                 stack[sp - i] = NULL;
             }
             vartype **tmpstk = stack;
+            int4 tmpcapacity = stack_capacity;
             int tmpsize = sp + 1;
             stack = tlist->array->data;
             stack_capacity = tlist->size;
             sp = stack_capacity - 1;
             tlist->array->data = tmpstk;
+            tlist->array->capacity = tmpcapacity;
             tlist->size = tmpsize;
         } else if (!big && flags.f.big_stack) {
             if (sp < 3) {
@@ -3032,6 +3292,7 @@ int pop_func_state(bool error) {
         }
 
         vartype **tmpstk = stack;
+        int4 tmpcapacity = stack_capacity;
         int tmpsize = sp + 1;
         stack = tlist->array->data;
         stack_capacity = tlist->size;
@@ -3039,6 +3300,7 @@ int pop_func_state(bool error) {
         if (stack_capacity < 4)
             stack_capacity = 4;
         tlist->array->data = tmpstk;
+        tlist->array->capacity = tmpcapacity;
         tlist->size = tmpsize;
 
         if (error)
@@ -4041,6 +4303,7 @@ void hard_reset(int reason) {
     reg_alpha_length = 0;
 
     /* Clear variables */
+    linalg_clear_cache();
     purge_all_vars();
     regs = new_realmatrix(25, 1);
     store_var("REGS", 4, regs);
@@ -495,6 +495,11 @@ extern int8 random_number_low, random_number_high;
 /* NORM & TRACE mode: number waiting to be printed */
 extern int deferred_print;
 
+/* TRACE mode: writing a binary trace instead of printing; see
+ * core_trace_open()
+ */
+extern bool trace_to_file;
+
 /* Keystroke buffer - holds keystrokes received while
  * there is a program running.
  */
@@ -43,7 +43,7 @@ int resolve_ind_arg(arg_struct *arg, char *buf, int *buflen) {
                 int4 num = arg->val.num;
                 if (num >= size)
                     return ERR_SIZE_ERROR;
-                if (rm->array->is_string[num] == 0) {
+                if (rm->array->str_type(num) == 0) {
                     phloat x = rm->array->data[num];
                     if (x < 0)
                         x = -x;
@@ -390,44 +390,68 @@ void string_copy(char *dst, int *dstlen, const char *src, int srclen) {
 }
 
 bool string_equals(const char *s1, int s1len, const char *s2, int s2len) {
-    int i;
-    if (s1len != s2len)
-        return false;
-    for (i = 0; i < s1len; i++)
-        if (s1[i] != s2[i])
-            return false;
-    return true;
+    return s1len == s2len && memcmp(s1, s2, s1len) == 0;
+}
+
+/* Finds the first occurrence of 'needle' in 'hay'; returns its position, or
+ * -1 if not found. Short needles and haystacks are handled by letting
+ * memchr() skip to the candidate positions, which is fast unless the first
+ * character of the needle is very common; longer needles use Horspool's
+ * algorithm, which can skip ahead by up to the length of the needle after
+ * each mismatch, regardless of what the text looks like.
+ */
+static int string_find(const char *hay, int hlen, const char *needle, int nlen) {
+    if (nlen > hlen)
+        return -1;
+    if (nlen < 4 || hlen < 256) {
+        const char *p = hay;
+        const char *end = hay + hlen - nlen + 1;
+        char first = needle[0];
+        while (p < end) {
+            p = (const char *) memchr(p, first, end - p);
+            if (p == NULL)
+                return -1;
+            if (memcmp(p + 1, needle + 1, nlen - 1) == 0)
+                return (int) (p - hay);
+            p++;
+        }
+        return -1;
+    }
+    int skip[256];
+    for (int i = 0; i < 256; i++)
+        skip[i] = nlen;
+    for (int i = 0; i < nlen - 1; i++)
+        skip[(unsigned char) needle[i]] = nlen - 1 - i;
+    unsigned char last = needle[nlen - 1];
+    for (int i = 0; i <= hlen - nlen;) {
+        unsigned char c = hay[i + nlen - 1];
+        if (c == last && memcmp(hay + i, needle, nlen - 1) == 0)
+            return i;
+        i += skip[c];
+    }
+    return -1;
 }
 
 int string_pos(const char *ntext, int nlen, const vartype *hs, int startpos) {
     int pos = -1;
     if (hs->type == TYPE_REAL) {
         phloat x = ((const vartype_real *) hs)->x;
-        char c;
-        int i;
         if (x < 0)
             x = -x;
         if (x >= 256)
             return -2;
-        c = to_char(x);
-        for (i = startpos; i < nlen; i++)
-            if (ntext[i] == c) {
-                pos = i;
-                break;
-            }
+        char c = to_char(x);
+        if (startpos < nlen) {
+            const char *p = (const char *) memchr(ntext + startpos, c, nlen - startpos);
+            if (p != NULL)
+                pos = (int) (p - ntext);
+        }
     } else {
         const vartype_string *s = (const vartype_string *) hs;
-        if (s->length != 0) {
-            int i, j;
-            const char *text = s->txt();
-            for (i = startpos; i < nlen - s->length + 1; i++) {
-                for (j = 0; j < s->length; j++)
-                    if (ntext[i + j] != text[j])
-                        goto notfound;
-                pos = i;
-                break;
-                notfound:;
-            }
+        if (s->length != 0 && startpos < nlen) {
+            pos = string_find(ntext + startpos, nlen - startpos, s->txt(), s->length);
+            if (pos != -1)
+                pos += startpos;
         }
     }
     return pos;
@@ -450,15 +474,15 @@ bool vartype_equals(const vartype *v1, const vartype *v2) {
         case TYPE_REALMATRIX: {
             const vartype_realmatrix *x = (const vartype_realmatrix *) v1;
             const vartype_realmatrix *y = (const vartype_realmatrix *) v2;
-            if (x->array == y->array)
-                return true;
             int4 sz, i;
             if (x->rows != y->rows || x->columns != y->columns)
                 return false;
+            if (x->array == y->array)
+                return true;
             sz = x->rows * x->columns;
             for (i = 0; i < sz; i++) {
-                int xstr = x->array->is_string[i];
-                int ystr = y->array->is_string[i];
+                int xstr = x->array->str_type(i);
+                int ystr = y->array->str_type(i);
                 if (xstr != ystr)
                     return false;
                 if (xstr == 0) {
@@ -478,11 +502,11 @@ bool vartype_equals(const vartype *v1, const vartype *v2) {
         case TYPE_COMPLEXMATRIX: {
             const vartype_complexmatrix *x = (const vartype_complexmatrix *) v1;
             const vartype_complexmatrix *y = (const vartype_complexmatrix *) v2;
-            if (x->array == y->array)
-                return true;
             int4 sz, i;
             if (x->rows != y->rows || x->columns != y->columns)
                 return false;
+            if (x->array == y->array)
+                return true;
             sz = 2 * x->rows * x->columns;
             for (i = 0; i < sz; i++)
                 if (x->array->data[i] != y->array->data[i])
@@ -497,10 +521,11 @@ bool vartype_equals(const vartype *v1, const vartype *v2) {
         case TYPE_LIST: {
             const vartype_list *x = (const vartype_list *) v1;
             const vartype_list *y = (const vartype_list *) v2;
-            if (x->array == y->array)
-                return true;
+            // Lists sharing an array can still differ in size
             if (x->size != y->size)
                 return false;
+            if (x->array == y->array)
+                return true;
             int4 sz = x->size;
             const vartype **data1 = (const vartype **) x->array->data;
             const vartype **data2 = (const vartype **) y->array->data;
@@ -509,6 +534,44 @@ bool vartype_equals(const vartype *v1, const vartype *v2) {
                     return false;
             return true;
         }
+        case TYPE_DICT: {
+            const vartype_dict *x = (const vartype_dict *) v1;
+            const vartype_dict *y = (const vartype_dict *) v2;
+            if (x->array == y->array)
+                return true;
+            if (x->size != y->size)
+                return false;
+            // Insertion order doesn't matter, only the mapping itself
+            const dict_data *dd = x->array;
+            for (int4 i = 0; i < dd->used; i++) {
+                if (dd->keys[i] == NULL)
+                    continue;
+                int4 e = dict_find(y, dd->keys[i]);
+                if (e == -1 || !vartype_equals(dd->values[i], y->array->values[e]))
+                    return false;
+            }
+            return true;
+        }
+        case TYPE_SPARSE: {
+            const vartype_sparse *x = (const vartype_sparse *) v1;
+            const vartype_sparse *y = (const vartype_sparse *) v2;
+            if (x->rows != y->rows || x->columns != y->columns)
+                return false;
+            if (x->array == y->array)
+                return true;
+            // Zeros are never stored, so equal matrices have equal arrays
+            const sparse_data *xd = x->array;
+            const sparse_data *yd = y->array;
+            if (xd->nnz != yd->nnz)
+                return false;
+            for (int4 i = 0; i <= x->rows; i++)
+                if (xd->rowstart[i] != yd->rowstart[i])
+                    return false;
+            for (int4 k = 0; k < xd->nnz; k++)
+                if (xd->column[k] != yd->column[k] || xd->data[k] != yd->data[k])
+                    return false;
+            return true;
+        }
         default:
             /* Looks like someone added a type that we're not handling yet! */
             return false;
@@ -1106,7 +1169,7 @@ void print_command(int cmd, const arg_struct *arg) {
 }
 
 void print_trace() {
-    if (flags.f.trace_print && flags.f.printer_exists)
+    if (flags.f.trace_print && flags.f.printer_exists && !trace_to_file)
         if (flags.f.normal_print || sp == -1)
             docmd_prstk(NULL);
         else
@@ -1114,7 +1177,8 @@ void print_trace() {
 }
 
 void print_stack_trace() {
-    if (flags.f.trace_print && flags.f.normal_print && flags.f.printer_exists)
+    if (flags.f.trace_print && flags.f.normal_print && flags.f.printer_exists
+            && !trace_to_file)
         docmd_prstk(NULL);
 }
 
@@ -1327,10 +1391,12 @@ int dimension_array_ref(vartype *matrix, int4 rows, int4 columns) {
                  * shrinking, but that is easy to handle by simply hanging onto
                  * the existing block.
                  */
-                free_long_strings(oldmatrix->array->is_string + size, oldmatrix->array->data + size, oldsize - size);
-                char *new_is_string = (char *) realloc(oldmatrix->array->is_string, size);
-                if (new_is_string != NULL)
-                    oldmatrix->array->is_string = new_is_string;
+                if (oldmatrix->array->is_string != NULL) {
+                    free_long_strings(oldmatrix->array->is_string + size, oldmatrix->array->data + size, oldsize - size);
+                    char *new_is_string = (char *) realloc(oldmatrix->array->is_string, size);
+                    if (new_is_string != NULL)
+                        oldmatrix->array->is_string = new_is_string;
+                }
                 phloat *new_data = (phloat *) realloc(oldmatrix->array->data, size * sizeof(phloat));
                 if (new_data != NULL)
                     oldmatrix->array->data = new_data;
@@ -1339,29 +1405,30 @@ int dimension_array_ref(vartype *matrix, int4 rows, int4 columns) {
                 return ERR_NONE;
             }
             /* Since there are no shared references to this array,
-             * I can modify it in place using a realloc(). However, I
-             * only use realloc() on the 'data' array, not on the
-             * 'is_string' array -- if I used it on both, and the second
-             * call fails, I might be unable to roll back the first.
-             * So, playing safe -- shouldn't be too big a handicap since
-             * 'is_string' is a lot smaller than 'data', so the transient
-             * memory overhead is only about 12.5%.
+             * I can modify it in place using realloc(), on both the
+             * 'is_string' and the 'data' arrays. The 'is_string' array is
+             * grown first; if the second realloc() fails, the matrix is
+             * simply left with an 'is_string' array that is larger than it
+             * needs to be, which is harmless, so there's nothing to roll
+             * back. Since the data are stored row by row, a matrix keeps
+             * all its existing elements in place when it grows, so neither
+             * array needs to be copied, unless realloc() decides to move
+             * the block.
+             * Matrices without strings don't have an 'is_string' array at
+             * all, so for them, there's only the one realloc().
              */
-            char *new_is_string = (char *) malloc(size);
-            if (new_is_string == NULL)
-                return ERR_INSUFFICIENT_MEMORY;
+            if (oldmatrix->array->is_string != NULL) {
+                char *new_is_string = (char *) realloc(oldmatrix->array->is_string, size);
+                if (new_is_string == NULL)
+                    return ERR_INSUFFICIENT_MEMORY;
+                memset(new_is_string + oldsize, 0, size - oldsize);
+                oldmatrix->array->is_string = new_is_string;
+            }
             phloat *new_data = (phloat *) realloc(oldmatrix->array->data, size * sizeof(phloat));
-            if (new_data == NULL) {
-                free(new_is_string);
+            if (new_data == NULL)
                 return ERR_INSUFFICIENT_MEMORY;
-            }
-            memcpy(new_is_string, oldmatrix->array->is_string, oldsize);
-            for (int4 i = oldsize; i < size; i++) {
-                new_is_string[i] = 0;
+            for (int4 i = oldsize; i < size; i++)
                 new_data[i] = 0;
-            }
-            free(oldmatrix->array->is_string);
-            oldmatrix->array->is_string = new_is_string;
             oldmatrix->array->data = new_data;
             oldmatrix->rows = rows;
             oldmatrix->columns = columns;
@@ -1383,6 +1450,15 @@ int dimension_array_ref(vartype *matrix, int4 rows, int4 columns) {
                 free(new_array);
                 return ERR_INSUFFICIENT_MEMORY;
             }
+            oldsize = oldmatrix->rows * oldmatrix->columns;
+            s = oldsize < size ? oldsize : size;
+            if (oldmatrix->array->is_string == NULL) {
+                new_array->is_string = NULL;
+                memcpy(new_array->data, oldmatrix->array->data, s * sizeof(phloat));
+                for (i = s; i < size; i++)
+                    new_array->data[i] = 0;
+                goto finish;
+            }
             new_array->is_string = (char *) malloc(size);
             if (new_array->is_string == NULL) {
                 nomem:
@@ -1390,8 +1466,6 @@ int dimension_array_ref(vartype *matrix, int4 rows, int4 columns) {
                 free(new_array);
                 return ERR_INSUFFICIENT_MEMORY;
             }
-            oldsize = oldmatrix->rows * oldmatrix->columns;
-            s = oldsize < size ? oldsize : size;
             for (i = 0; i < s; i++) {
                 new_array->is_string[i] = oldmatrix->array->is_string[i];
                 if (oldmatrix->array->is_string[i] == 2) {
@@ -1412,6 +1486,7 @@ int dimension_array_ref(vartype *matrix, int4 rows, int4 columns) {
                 new_array->is_string[i] = 0;
                 new_array->data[i] = 0;
             }
+            finish:
             new_array->refcount = 1;
             oldmatrix->array->refcount--;
             oldmatrix->array = new_array;
@@ -1425,14 +1500,19 @@ int dimension_array_ref(vartype *matrix, int4 rows, int4 columns) {
             return ERR_NONE;
         if (oldmatrix->array->refcount == 1) {
             /* Since there are no shared references to this array,
-             * I can modify it in place using a realloc().
+             * I can modify it in place using a realloc(). When shrinking,
+             * a realloc() failure is handled by hanging onto the existing
+             * block, as with real matrices.
              */
             int4 i, oldsize;
+            oldsize = oldmatrix->rows * oldmatrix->columns;
             phloat *new_data = (phloat *)
                     realloc(oldmatrix->array->data, 2 * size * sizeof(phloat));
-            if (new_data == NULL)
-                return ERR_INSUFFICIENT_MEMORY;
-            oldsize = oldmatrix->rows * oldmatrix->columns;
+            if (new_data == NULL) {
+                if (size > oldsize)
+                    return ERR_INSUFFICIENT_MEMORY;
+                new_data = oldmatrix->array->data;
+            }
             for (i = 2 * oldsize; i < 2 * size; i++)
                 new_data[i] = 0;
             oldmatrix->array->data = new_data;
@@ -1489,8 +1569,10 @@ int dimension_array_ref(vartype *matrix, int4 rows, int4 columns) {
                 /* Note: If the realloc() fails to shrink the array, we just keep
                  * using the existing one, basically pretending that it succeeded.
                  */
-                if (new_data != NULL)
+                if (new_data != NULL) {
                     oldlist->array->data = new_data;
+                    oldlist->array->capacity = size;
+                }
                 oldlist->size = size;
                 return ERR_NONE;
             } else {
@@ -1506,11 +1588,18 @@ int dimension_array_ref(vartype *matrix, int4 rows, int4 columns) {
                             new_data[j] = NULL;
                         }
                         vartype **reverted_data = (vartype **) realloc(new_data, oldlist->size * sizeof(vartype *));
-                        oldlist->array->data = reverted_data == NULL ? new_data : reverted_data;
+                        if (reverted_data == NULL) {
+                            oldlist->array->data = new_data;
+                            oldlist->array->capacity = size;
+                        } else {
+                            oldlist->array->data = reverted_data;
+                            oldlist->array->capacity = oldlist->size;
+                        }
                         return ERR_INSUFFICIENT_MEMORY;
                     }
                 }
                 oldlist->array->data = new_data;
+                oldlist->array->capacity = size;
                 oldlist->size = size;
                 return ERR_NONE;
             }
@@ -1540,7 +1629,9 @@ int dimension_array_ref(vartype *matrix, int4 rows, int4 columns) {
                 }
             }
             new_array->refcount = 1;
-            oldlist->array->refcount--;
+            new_array->capacity = size;
+            new_array->used = -1;
+            detach_list_data(oldlist->array, oldlist->size);
             oldlist->array = new_array;
             oldlist->size = size;
             return ERR_NONE;
@@ -1548,6 +1639,110 @@ int dimension_array_ref(vartype *matrix, int4 rows, int4 columns) {
     }
 }
 
+phloat vector_sum(const phloat *x, int xstep, int4 n) {
+#ifdef BCD_MATH
+    phloat sum = 0;
+    for (int4 i = 0; i < n; i++)
+        sum += x[i * xstep];
+    return sum;
+#else
+    phloat s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    int4 i = 0;
+    for (; i + 4 <= n; i += 4) {
+        s0 += x[i * xstep];
+        s1 += x[(i + 1) * xstep];
+        s2 += x[(i + 2) * xstep];
+        s3 += x[(i + 3) * xstep];
+    }
+    for (; i < n; i++)
+        s0 += x[i * xstep];
+    return (s0 + s1) + (s2 + s3);
+#endif
+}
+
+phloat vector_abs_sum(const phloat *x, int4 n) {
+#ifdef BCD_MATH
+    phloat sum = 0;
+    for (int4 i = 0; i < n; i++)
+        if (x[i] >= 0)
+            sum += x[i];
+        else
+            sum -= x[i];
+    return sum;
+#else
+    phloat s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    int4 i = 0;
+    for (; i + 4 <= n; i += 4) {
+        s0 += fabs(x[i]);
+        s1 += fabs(x[i + 1]);
+        s2 += fabs(x[i + 2]);
+        s3 += fabs(x[i + 3]);
+    }
+    for (; i < n; i++)
+        s0 += fabs(x[i]);
+    return (s0 + s1) + (s2 + s3);
+#endif
+}
+
+phloat vector_dot(const phloat *x, int xstep, const phloat *y, int ystep, int4 n) {
+#ifdef BCD_MATH
+    phloat dot = 0;
+    for (int4 i = 0; i < n; i++)
+        dot += x[i * xstep] * y[i * ystep];
+    return dot;
+#else
+    phloat s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    int4 i = 0;
+    for (; i + 4 <= n; i += 4) {
+        s0 += x[i * xstep] * y[i * ystep];
+        s1 += x[(i + 1) * xstep] * y[(i + 1) * ystep];
+        s2 += x[(i + 2) * xstep] * y[(i + 2) * ystep];
+        s3 += x[(i + 3) * xstep] * y[(i + 3) * ystep];
+    }
+    for (; i < n; i++)
+        s0 += x[i * xstep] * y[i * ystep];
+    return (s0 + s1) + (s2 + s3);
+#endif
+}
+
+#ifndef BCD_MATH
+phloat vector_max_abs(const phloat *x, int4 n) {
+    phloat m0 = 0, m1 = 0;
+    int4 i = 0;
+    for (; i + 2 <= n; i += 2) {
+        phloat a0 = fabs(x[i]);
+        phloat a1 = fabs(x[i + 1]);
+        m0 = a0 > m0 ? a0 : m0;
+        m1 = a1 > m1 ? a1 : m1;
+    }
+    if (i < n) {
+        phloat a = fabs(x[i]);
+        m0 = a > m0 ? a : m0;
+    }
+    return m0 > m1 ? m0 : m1;
+}
+
+phloat vector_scaled_sum_squares(const phloat *x, int4 n, phloat scale) {
+    phloat s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    int4 i = 0;
+    for (; i + 4 <= n; i += 4) {
+        phloat a0 = x[i] * scale;
+        phloat a1 = x[i + 1] * scale;
+        phloat a2 = x[i + 2] * scale;
+        phloat a3 = x[i + 3] * scale;
+        s0 += a0 * a0;
+        s1 += a1 * a1;
+        s2 += a2 * a2;
+        s3 += a3 * a3;
+    }
+    for (; i < n; i++) {
+        phloat a = x[i] * scale;
+        s0 += a * a;
+    }
+    return (s0 + s1) + (s2 + s3);
+}
+#endif
+
 phloat fix_hms(phloat x) {
 #ifdef BCD_MATH
     const phloat sec_corr(4, 1000);
@@ -1749,6 +1944,20 @@ int vartype2string(const vartype *v, char *buf, int buflen, int max_mant_digits)
             return chars_so_far;
         }
 
+        case TYPE_SPARSE: {
+            vartype_sparse *m = (vartype_sparse *) v;
+            int i;
+            int chars_so_far = 0;
+            string2buf(buf, buflen, &chars_so_far, "[ ", 2);
+            i = int2string(m->rows, buf + chars_so_far, buflen - chars_so_far);
+            chars_so_far += i;
+            char2buf(buf, buflen, &chars_so_far, 'x');
+            i = int2string(m->columns, buf + chars_so_far, buflen - chars_so_far);
+            chars_so_far += i;
+            string2buf(buf, buflen, &chars_so_far, " Sparse ]", 9);
+            return chars_so_far;
+        }
+
         case TYPE_STRING: {
             vartype_string *s = (vartype_string *) v;
             int i;
@@ -1772,6 +1981,17 @@ int vartype2string(const vartype *v, char *buf, int buflen, int max_mant_digits)
             return chars_so_far;
         }
 
+        case TYPE_DICT: {
+            vartype_dict *dict = (vartype_dict *) v;
+            int i;
+            int chars_so_far = 0;
+            string2buf(buf, buflen, &chars_so_far, "{ ", 2);
+            i = int2string(dict->size, buf + chars_so_far, buflen - chars_so_far);
+            chars_so_far += i;
+            string2buf(buf, buflen, &chars_so_far, "-Elem Dict }", 12);
+            return chars_so_far;
+        }
+
         default: {
             const char *msg = "UnsuppVarType";
             int msglen = 13;
@@ -94,6 +94,20 @@ phloat cos_grad(phloat x);
 int dimension_array(const char *name, int namelen, int4 rows, int4 columns, bool check_matedit);
 int dimension_array_ref(vartype *matrix, int4 rows, int4 columns);
 
+/* Reductions over runs of phloats, with a stride in elements, for DOT, RSUM,
+ * RNRM, and FNRM. In the binary build, these use four independent
+ * accumulators, which lets the compiler use SIMD instructions and keep the
+ * FPU pipelines full; note that this changes the order of the additions. In
+ * the decimal build, they simply add in order.
+ */
+phloat vector_sum(const phloat *x, int xstep, int4 n);
+phloat vector_abs_sum(const phloat *x, int4 n);
+phloat vector_dot(const phloat *x, int xstep, const phloat *y, int ystep, int4 n);
+#ifndef BCD_MATH
+phloat vector_max_abs(const phloat *x, int4 n);
+phloat vector_scaled_sum_squares(const phloat *x, int4 n, phloat scale);
+#endif
+
 phloat fix_hms(phloat x);
 
 void char2buf(char *buf, int buflen, int *bufptr, char c);
@@ -24,6 +24,105 @@
 #include "core_variables.h"
 
 
+/************************************/
+/***** Cached LU decompositions *****/
+/************************************/
+
+/* The most recent successful LU decomposition is kept around, together with
+ * a reference to the matrix it was computed from, so that solving several
+ * systems with the same coefficient matrix, or finding its inverse and
+ * determinant as well, only requires one decomposition.
+ * Holding the reference is what keeps the cache honest: it means the data
+ * array is shared, so anything that wants to modify the matrix has to call
+ * disentangle() first, and after that, the matrix no longer has the array
+ * the cache was computed from. Checking that the array pointer is the same
+ * is therefore enough to know the contents are the same, too.
+ * The decomposition depends on the 'singular matrix' error mode when a zero
+ * pivot is encountered; that mode is recorded as well. A decomposition done
+ * in error mode succeeded without fudging any pivots, so it is also valid
+ * in the other mode, but not vice versa.
+ */
+
+static vartype *lu_cache_src = NULL;
+static vartype *lu_cache_lu;
+static int4 *lu_cache_perm;
+static phloat lu_cache_det_re, lu_cache_det_im;
+static bool lu_cache_sm;
+
+/* Reference to the matrix currently being decomposed, or NULL */
+static vartype *lu_pending_src = NULL;
+
+void linalg_clear_cache() {
+    free_vartype(lu_pending_src);
+    lu_pending_src = NULL;
+    if (lu_cache_src == NULL)
+        return;
+    free_vartype(lu_cache_src);
+    free_vartype(lu_cache_lu);
+    free(lu_cache_perm);
+    lu_cache_src = NULL;
+}
+
+static bool lu_cache_lookup(const vartype *src, bool sm) {
+    if (lu_cache_src == NULL || lu_cache_src->type != src->type)
+        return false;
+    if (!lu_cache_sm && sm)
+        return false;
+    bool hit;
+    if (src->type == TYPE_REALMATRIX) {
+        vartype_realmatrix *a = (vartype_realmatrix *) src;
+        vartype_realmatrix *b = (vartype_realmatrix *) lu_cache_src;
+        hit = a->array == b->array && a->rows == b->rows
+                                   && a->columns == b->columns;
+    } else {
+        vartype_complexmatrix *a = (vartype_complexmatrix *) src;
+        vartype_complexmatrix *b = (vartype_complexmatrix *) lu_cache_src;
+        hit = a->array == b->array && a->rows == b->rows
+                                   && a->columns == b->columns;
+    }
+    if (hit) {
+        free_vartype(lu_pending_src);
+        lu_pending_src = NULL;
+    }
+    return hit;
+}
+
+static void lu_cache_begin(const vartype *src) {
+    free_vartype(lu_pending_src);
+    /* If this fails, we just don't cache the result */
+    lu_pending_src = dup_vartype(src);
+}
+
+/* Called when a decomposition started by lu_cache_begin() has finished.
+ * On success, the cache takes ownership of 'a' and 'perm'.
+ */
+static void lu_cache_end(int error, vartype *a, int4 *perm,
+                                    phloat det_re, phloat det_im) {
+    if (error != ERR_NONE || lu_pending_src == NULL) {
+        free_vartype(lu_pending_src);
+        lu_pending_src = NULL;
+        return;
+    }
+    vartype *src = lu_pending_src;
+    lu_pending_src = NULL;
+    linalg_clear_cache();
+    lu_cache_src = src;
+    lu_cache_lu = a;
+    lu_cache_perm = perm;
+    lu_cache_det_re = det_re;
+    lu_cache_det_im = det_im;
+    lu_cache_sm = core_settings.matrix_singularmatrix;
+}
+
+/* Frees a decomposition, unless it is the one in the cache */
+static void lu_release(vartype *a, int4 *perm) {
+    if (lu_cache_src != NULL && a == lu_cache_lu)
+        return;
+    free_vartype(a);
+    free(perm);
+}
+
+
 /**********************************/
 /***** Matrix-matrix division *****/
 /**********************************/
@@ -51,6 +150,15 @@ static int div_cc_completion2(int error, vartype_complexmatrix *a, int4 *perm,
 
 int linalg_div(const vartype *left, const vartype *right,
                                     int (*completion)(int, vartype *)) {
+    if (right->type == TYPE_SPARSE) {
+        vartype_realmatrix *num = (vartype_realmatrix *) left;
+        vartype_sparse *denom = (vartype_sparse *) right;
+        if (denom->rows != num->rows || denom->columns != num->rows)
+            return completion(ERR_DIMENSION_ERROR, NULL);
+        if (contains_strings(num))
+            return completion(ERR_ALPHA_DATA_IS_INVALID, NULL);
+        return sparse_solve(denom, num, completion);
+    }
     if (left->type == TYPE_REALMATRIX) {
         if (right->type == TYPE_REALMATRIX) {
             vartype_realmatrix *num = (vartype_realmatrix *) left;
@@ -61,26 +169,30 @@ int linalg_div(const vartype *left, const vartype *right,
             int4 *perm;
             if (denom->rows != rows || denom->columns != rows)
                 return completion(ERR_DIMENSION_ERROR, NULL);
+            res = new_realmatrix(rows, columns);
+            if (res == NULL)
+                return completion(ERR_INSUFFICIENT_MEMORY, NULL);
+            linalg_div_completion = completion;
+            linalg_div_left = left;
+            linalg_div_result = res;
+            if (lu_cache_lookup(right, core_settings.matrix_singularmatrix))
+                return div_rr_completion1(ERR_NONE,
+                                    (vartype_realmatrix *) lu_cache_lu, lu_cache_perm,
+                                    lu_cache_det_re);
             perm = (int4 *) malloc(rows * sizeof(int4));
-            if (perm == NULL)
+            if (perm == NULL) {
+                free_vartype(res);
                 return completion(ERR_INSUFFICIENT_MEMORY, NULL);
+            }
             lu = new_realmatrix(rows, rows);
             if (lu == NULL) {
                 free(perm);
-                return completion(ERR_INSUFFICIENT_MEMORY, NULL);
-            }
-            res = new_realmatrix(rows, columns);
-            if (res == NULL) {
-                free(perm);
-                free_vartype(lu);
+                free_vartype(res);
                 return completion(ERR_INSUFFICIENT_MEMORY, NULL);
             }
             matrix_copy(lu, right);
-            linalg_div_completion = completion;
-            linalg_div_left = left;
-            linalg_div_result = res;
-            return lu_decomp_r((vartype_realmatrix *) lu, perm,
-                                                div_rr_completion1);
+            lu_cache_begin(right);
+            return lu_decomp_r((vartype_realmatrix *) lu, perm, div_rr_completion1);
         } else {
             vartype_realmatrix *num = (vartype_realmatrix *) left;
             vartype_complexmatrix *denom = (vartype_complexmatrix *) right;
@@ -90,26 +202,31 @@ int linalg_div(const vartype *left, const vartype *right,
             int4 *perm;
             if (denom->rows != rows || denom->columns != rows)
                 return completion(ERR_DIMENSION_ERROR, NULL);
+            res = new_complexmatrix(rows, columns);
+            if (res == NULL)
+                return completion(ERR_INSUFFICIENT_MEMORY, NULL);
+            linalg_div_completion = completion;
+            linalg_div_left = left;
+            linalg_div_result = res;
+            if (lu_cache_lookup(right, core_settings.matrix_singularmatrix))
+                return div_rc_completion1(ERR_NONE,
+                                    (vartype_complexmatrix *) lu_cache_lu, lu_cache_perm,
+                                    lu_cache_det_re,
+                                    lu_cache_det_im);
             perm = (int4 *) malloc(rows * sizeof(int4));
-            if (perm == NULL)
+            if (perm == NULL) {
+                free_vartype(res);
                 return completion(ERR_INSUFFICIENT_MEMORY, NULL);
+            }
             lu = new_complexmatrix(rows, rows);
             if (lu == NULL) {
                 free(perm);
-                return completion(ERR_INSUFFICIENT_MEMORY, NULL);
-            }
-            res = new_complexmatrix(rows, columns);
-            if (res == NULL) {
-                free(perm);
-                free_vartype(lu);
+                free_vartype(res);
                 return completion(ERR_INSUFFICIENT_MEMORY, NULL);
             }
             matrix_copy(lu, right);
-            linalg_div_completion = completion;
-            linalg_div_left = left;
-            linalg_div_result = res;
-            return lu_decomp_c((vartype_complexmatrix *) lu, perm,
-                                                div_rc_completion1);
+            lu_cache_begin(right);
+            return lu_decomp_c((vartype_complexmatrix *) lu, perm, div_rc_completion1);
         }
     } else {
         if (right->type == TYPE_REALMATRIX) {
@@ -121,26 +238,30 @@ int linalg_div(const vartype *left, const vartype *right,
             int4 *perm;
             if (denom->rows != rows || denom->columns != rows)
                 return completion(ERR_DIMENSION_ERROR, 0);
+            res = new_complexmatrix(rows, columns);
+            if (res == NULL)
+                return completion(ERR_INSUFFICIENT_MEMORY, NULL);
+            linalg_div_completion = completion;
+            linalg_div_left = left;
+            linalg_div_result = res;
+            if (lu_cache_lookup(right, core_settings.matrix_singularmatrix))
+                return div_cr_completion1(ERR_NONE,
+                                    (vartype_realmatrix *) lu_cache_lu, lu_cache_perm,
+                                    lu_cache_det_re);
             perm = (int4 *) malloc(rows * sizeof(int4));
-            if (perm == NULL)
+            if (perm == NULL) {
+                free_vartype(res);
                 return completion(ERR_INSUFFICIENT_MEMORY, NULL);
+            }
             lu = new_realmatrix(rows, rows);
             if (lu == NULL) {
                 free(perm);
-                return completion(ERR_INSUFFICIENT_MEMORY, NULL);
-            }
-            res = new_complexmatrix(rows, columns);
-            if (res == NULL) {
-                free(perm);
-                free_vartype(lu);
+                free_vartype(res);
                 return completion(ERR_INSUFFICIENT_MEMORY, NULL);
             }
             matrix_copy(lu, right);
-            linalg_div_completion = completion;
-            linalg_div_left = left;
-            linalg_div_result = res;
-            return lu_decomp_r((vartype_realmatrix *) lu, perm,
-                                                    div_cr_completion1);
+            lu_cache_begin(right);
+            return lu_decomp_r((vartype_realmatrix *) lu, perm, div_cr_completion1);
         } else {
             vartype_complexmatrix *num = (vartype_complexmatrix *) left;
             vartype_complexmatrix *denom = (vartype_complexmatrix *) right;
@@ -150,35 +271,40 @@ int linalg_div(const vartype *left, const vartype *right,
             int4 *perm;
             if (denom->rows != rows || denom->columns != rows)
                 return completion(ERR_DIMENSION_ERROR, NULL);
+            res = new_complexmatrix(rows, columns);
+            if (res == NULL)
+                return completion(ERR_INSUFFICIENT_MEMORY, NULL);
+            linalg_div_completion = completion;
+            linalg_div_left = left;
+            linalg_div_result = res;
+            if (lu_cache_lookup(right, core_settings.matrix_singularmatrix))
+                return div_cc_completion1(ERR_NONE,
+                                    (vartype_complexmatrix *) lu_cache_lu, lu_cache_perm,
+                                    lu_cache_det_re,
+                                    lu_cache_det_im);
             perm = (int4 *) malloc(rows * sizeof(int4));
-            if (perm == NULL)
+            if (perm == NULL) {
+                free_vartype(res);
                 return completion(ERR_INSUFFICIENT_MEMORY, NULL);
+            }
             lu = new_complexmatrix(rows, rows);
             if (lu == NULL) {
                 free(perm);
-                return completion(ERR_INSUFFICIENT_MEMORY, NULL);
-            }
-            res = new_complexmatrix(rows, columns);
-            if (res == NULL) {
-                free(perm);
-                free_vartype(lu);
+                free_vartype(res);
                 return completion(ERR_INSUFFICIENT_MEMORY, NULL);
             }
             matrix_copy(lu, right);
-            linalg_div_completion = completion;
-            linalg_div_left = left;
-            linalg_div_result = res;
-            return lu_decomp_c((vartype_complexmatrix *) lu, perm,
-                                                    div_cc_completion1);
+            lu_cache_begin(right);
+            return lu_decomp_c((vartype_complexmatrix *) lu, perm, div_cc_completion1);
         }
     }
 }
 
 static int div_rr_completion1(int error, vartype_realmatrix *a, int4 *perm,
                                          phloat det) {
+    lu_cache_end(error, (vartype *) a, perm, det, 0);
     if (error != ERR_NONE) {
-        free_vartype((vartype *) a);
-        free(perm);
+        lu_release((vartype *) a, perm);
         free_vartype(linalg_div_result);
         return error;
     } else {
@@ -193,16 +319,15 @@ static int div_rr_completion2(int error, vartype_realmatrix *a, int4 *perm,
                                           vartype_realmatrix *b) {
     if (error != ERR_NONE)
         free_vartype(linalg_div_result); /* Note: linalg_div_result == b */
-    free_vartype((vartype *) a);
-    free(perm);
+    lu_release((vartype *) a, perm);
     return linalg_div_completion(error, linalg_div_result);
 }
 
 static int div_rc_completion1(int error, vartype_complexmatrix *a, int4 *perm,
                                          phloat det_re, phloat det_im) {
+    lu_cache_end(error, (vartype *) a, perm, det_re, det_im);
     if (error != ERR_NONE) {
-        free_vartype((vartype *) a);
-        free(perm);
+        lu_release((vartype *) a, perm);
         free_vartype(linalg_div_result);
         return error;
     } else {
@@ -217,16 +342,15 @@ static int div_rc_completion2(int error, vartype_complexmatrix *a, int4 *perm,
                                           vartype_complexmatrix *b) {
     if (error != ERR_NONE)
         free_vartype(linalg_div_result); /* Note: linalg_div_result == b */
-    free_vartype((vartype *) a);
-    free(perm);
+    lu_release((vartype *) a, perm);
     return linalg_div_completion(error, linalg_div_result);
 }
 
 static int div_cr_completion1(int error, vartype_realmatrix *a, int4 *perm,
                                     phloat det) {
+    lu_cache_end(error, (vartype *) a, perm, det, 0);
     if (error != ERR_NONE) {
-        free_vartype((vartype *) a);
-        free(perm);
+        lu_release((vartype *) a, perm);
         free_vartype(linalg_div_result);
         return error;
     } else {
@@ -241,16 +365,15 @@ static int div_cr_completion2(int error, vartype_realmatrix *a, int4 *perm,
                                     vartype_complexmatrix *b) {
     if (error != ERR_NONE)
         free_vartype(linalg_div_result); /* Note: linalg_div_result == b */
-    free_vartype((vartype *) a);
-    free(perm);
+    lu_release((vartype *) a, perm);
     return linalg_div_completion(error, linalg_div_result);
 }
 
 static int div_cc_completion1(int error, vartype_complexmatrix *a, int4 *perm,
                                     phloat det_re, phloat det_im) {
+    lu_cache_end(error, (vartype *) a, perm, det_re, det_im);
     if (error != ERR_NONE) {
-        free_vartype((vartype *) a);
-        free(perm);
+        lu_release((vartype *) a, perm);
         free_vartype(linalg_div_result);
         return error;
     } else {
@@ -265,8 +388,7 @@ static int div_cc_completion2(int error, vartype_complexmatrix *a, int4 *perm,
                                     vartype_complexmatrix *b) {
     if (error != ERR_NONE)
         free_vartype(linalg_div_result); /* Note: linalg_div_result == b */
-    free_vartype((vartype *) a);
-    free(perm);
+    lu_release((vartype *) a, perm);
     return linalg_div_completion(error, linalg_div_result);
 }
 
@@ -279,8 +401,7 @@ struct mul_rr_data_struct {
     vartype_realmatrix *left;
     vartype_realmatrix *right;
     vartype *result;
-    int4 i, j, k;
-    phloat sum;
+    int4 i, k;
     int (*completion)(int error, vartype *result);
 };
 
@@ -320,9 +441,7 @@ static int matrix_mul_rr(vartype_realmatrix *left, vartype_realmatrix *right,
     dat->left = left;
     dat->right = right;
     dat->i = 0;
-    dat->j = 0;
     dat->k = 0;
-    dat->sum = 0;
     dat->completion = completion;
 
     mul_rr_data = dat;
@@ -342,12 +461,10 @@ static int matrix_mul_rr_worker(bool interrupted) {
     phloat *r = dat->right->array->data;
     phloat *p = ((vartype_realmatrix *) dat->result)->array->data;
     int4 i = dat->i;
-    int4 j = dat->j;
     int4 k = dat->k;
     int4 m = dat->left->rows;
     int4 n = dat->right->columns;
     int4 q = dat->left->columns;
-    phloat sum = dat->sum;
 
     if (interrupted) {
         int err = dat->completion(ERR_INTERRUPTED, NULL);
@@ -356,25 +473,155 @@ static int matrix_mul_rr_worker(bool interrupted) {
         return err;
     }
 
-    while (count++ < 1000) {
-        sum += l[i * q + k] * r[k * n + j];
+    /* The result is built one row at a time, by adding l[i][k] times row k
+     * of the right-hand matrix to row i of the result, for k = 0 .. q-1.
+     * The inner loop runs over contiguous memory, so it vectorizes well,
+     * and every element of the result still gets its terms added in the
+     * same order as in a straightforward dot product, so the results are
+     * the same, bit for bit.
+     * Terms with l[i][k] == 0 are skipped; adding zero doesn't change the
+     * sum, and for sparse matrices, this saves most of the work.
+     */
+    while (count < 1000) {
+        phloat lik = l[i * q + k];
+        phloat *pi = p + i * n;
+        if (lik != 0) {
+            phloat *rk = r + k * n;
+            for (int4 j = 0; j < n; j++)
+                pi[j] += lik * rk[j];
+            count += n;
+        } else
+            count++;
         if (++k < q)
             continue;
         k = 0;
-        if ((inf = p_isinf(sum)) != 0) {
-            if (core_settings.matrix_outofrange && !flags.f.range_error_ignore){
-                int err = dat->completion(ERR_OUT_OF_RANGE, NULL);
-                free_vartype(dat->result);
-                free(dat);
-                return err;
-            } else
-                sum = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
+        for (int4 j = 0; j < n; j++) {
+            if ((inf = p_isinf(pi[j])) != 0) {
+                if (core_settings.matrix_outofrange && !flags.f.range_error_ignore){
+                    int err = dat->completion(ERR_OUT_OF_RANGE, NULL);
+                    free_vartype(dat->result);
+                    free(dat);
+                    return err;
+                } else
+                    pi[j] = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
+            }
         }
-        p[i * n + j] = sum;
-        sum = 0;
-        if (++j < n)
+        if (++i < m)
             continue;
-        j = 0;
+        else {
+            int err = dat->completion(ERR_NONE, dat->result);
+            free(dat);
+            return err;
+        }
+    }
+
+    dat->i = i;
+    dat->k = k;
+    return ERR_INTERRUPTIBLE;
+}
+
+struct mul_sr_data_struct {
+    vartype_sparse *left;
+    vartype_realmatrix *right;
+    vartype *result;
+    int4 i, k;
+    int (*completion)(int error, vartype *result);
+};
+
+static mul_sr_data_struct *mul_sr_data;
+
+static int matrix_mul_sr_worker(bool interrupted);
+
+static int matrix_mul_sr(vartype_sparse *left, vartype_realmatrix *right,
+                         int (*completion)(int, vartype *)) {
+
+    mul_sr_data_struct *dat;
+    int error;
+
+    if (left->columns != right->rows) {
+        error = ERR_DIMENSION_ERROR;
+        goto finished;
+    }
+
+    if (contains_strings(right)) {
+        error = ERR_ALPHA_DATA_IS_INVALID;
+        goto finished;
+    }
+
+    dat = (mul_sr_data_struct *) malloc(sizeof(mul_sr_data_struct));
+    if (dat == NULL) {
+        error = ERR_INSUFFICIENT_MEMORY;
+        goto finished;
+    }
+
+    dat->result = new_realmatrix(left->rows, right->columns);
+    if (dat->result == NULL) {
+        free(dat);
+        error = ERR_INSUFFICIENT_MEMORY;
+        goto finished;
+    }
+
+    dat->left = left;
+    dat->right = right;
+    dat->i = 0;
+    dat->k = left->array->rowstart[0];
+    dat->completion = completion;
+
+    mul_sr_data = dat;
+    mode_interruptible = matrix_mul_sr_worker;
+    mode_stoppable = false;
+    return ERR_INTERRUPTIBLE;
+
+    finished:
+    return completion(error, NULL);
+}
+
+static int matrix_mul_sr_worker(bool interrupted) {
+    mul_sr_data_struct *dat = mul_sr_data;
+    int count = 0;
+    int inf;
+    sparse_data *l = dat->left->array;
+    phloat *r = dat->right->array->data;
+    phloat *p = ((vartype_realmatrix *) dat->result)->array->data;
+    int4 i = dat->i;
+    int4 k = dat->k;
+    int4 m = dat->left->rows;
+    int4 n = dat->right->columns;
+
+    if (interrupted) {
+        int err = dat->completion(ERR_INTERRUPTED, NULL);
+        free_vartype(dat->result);
+        free(dat);
+        return err;
+    }
+
+    /* Same as matrix_mul_rr_worker(), except that the nonzero elements of
+     * row i of the left-hand matrix are found directly, so the work is
+     * proportional to the number of nonzeros, not the size of the matrix.
+     */
+    while (count < 1000) {
+        phloat *pi = p + i * n;
+        if (k < l->rowstart[i + 1]) {
+            phloat lik = l->data[k];
+            phloat *rk = r + l->column[k] * n;
+            for (int4 j = 0; j < n; j++)
+                pi[j] += lik * rk[j];
+            count += n;
+            k++;
+            continue;
+        }
+        count++;
+        for (int4 j = 0; j < n; j++) {
+            if ((inf = p_isinf(pi[j])) != 0) {
+                if (core_settings.matrix_outofrange && !flags.f.range_error_ignore){
+                    int err = dat->completion(ERR_OUT_OF_RANGE, NULL);
+                    free_vartype(dat->result);
+                    free(dat);
+                    return err;
+                } else
+                    pi[j] = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
+            }
+        }
         if (++i < m)
             continue;
         else {
@@ -385,9 +632,7 @@ static int matrix_mul_rr_worker(bool interrupted) {
     }
 
     dat->i = i;
-    dat->j = j;
     dat->k = k;
-    dat->sum = sum;
     return ERR_INTERRUPTIBLE;
 }
 
@@ -924,6 +1169,10 @@ static int matrix_mul_cc_worker(bool interrupted) {
 
 int linalg_mul(const vartype *left, const vartype *right,
                                     int (*completion)(int, vartype *)) {
+    if (left->type == TYPE_SPARSE)
+        return matrix_mul_sr((vartype_sparse *) left,
+                             (vartype_realmatrix *) right,
+                             completion);
     if (left->type == TYPE_REALMATRIX) {
         if (right->type == TYPE_REALMATRIX)
             return matrix_mul_rr((vartype_realmatrix *) left,
@@ -973,12 +1222,17 @@ int linalg_inv(const vartype *src, void (*completion)(int, vartype *)) {
             return ERR_DIMENSION_ERROR;
         if (contains_strings(ma))
             return ERR_ALPHA_DATA_IS_INVALID;
-        lu = new_realmatrix(n, n);
-        if (lu == NULL)
-            return ERR_INSUFFICIENT_MEMORY;
         inv = new_realmatrix(n, n);
-        if (inv == NULL) {
-            free_vartype(lu);
+        if (inv == NULL)
+            return ERR_INSUFFICIENT_MEMORY;
+        linalg_inv_completion = completion;
+        linalg_inv_result = inv;
+        if (lu_cache_lookup(src, core_settings.matrix_singularmatrix))
+            return inv_r_completion1(ERR_NONE, (vartype_realmatrix *) lu_cache_lu,
+                                lu_cache_perm, lu_cache_det_re);
+        lu = new_realmatrix(n, n);
+        if (lu == NULL) {
+            free_vartype(inv);
             return ERR_INSUFFICIENT_MEMORY;
         }
         perm = (int4 *) malloc(n * sizeof(int4));
@@ -988,8 +1242,7 @@ int linalg_inv(const vartype *src, void (*completion)(int, vartype *)) {
             return ERR_INSUFFICIENT_MEMORY;
         }
         matrix_copy(lu, src);
-        linalg_inv_completion = completion;
-        linalg_inv_result = inv;
+        lu_cache_begin(src);
         return lu_decomp_r((vartype_realmatrix *) lu, perm, inv_r_completion1);
     } else {
         vartype_complexmatrix *ma = (vartype_complexmatrix *) src;
@@ -997,12 +1250,18 @@ int linalg_inv(const vartype *src, void (*completion)(int, vartype *)) {
         n = ma->rows;
         if (n != ma->columns)
             return ERR_DIMENSION_ERROR;
-        lu = new_complexmatrix(n, n);
-        if (lu == NULL)
-            return ERR_INSUFFICIENT_MEMORY;
         inv = new_complexmatrix(n, n);
-        if (inv == NULL) {
-            free_vartype(lu);
+        if (inv == NULL)
+            return ERR_INSUFFICIENT_MEMORY;
+        linalg_inv_completion = completion;
+        linalg_inv_result = inv;
+        if (lu_cache_lookup(src, core_settings.matrix_singularmatrix))
+            return inv_c_completion1(ERR_NONE, (vartype_complexmatrix *) lu_cache_lu,
+                                lu_cache_perm, lu_cache_det_re,
+                                lu_cache_det_im);
+        lu = new_complexmatrix(n, n);
+        if (lu == NULL) {
+            free_vartype(inv);
             return ERR_INSUFFICIENT_MEMORY;
         }
         perm = (int4 *) malloc(n * sizeof(int4));
@@ -1012,19 +1271,17 @@ int linalg_inv(const vartype *src, void (*completion)(int, vartype *)) {
             return ERR_INSUFFICIENT_MEMORY;
         }
         matrix_copy(lu, src);
-        linalg_inv_completion = completion;
-        linalg_inv_result = inv;
-        return lu_decomp_c((vartype_complexmatrix *) lu, perm,
-                                                    inv_c_completion1);
+        lu_cache_begin(src);
+        return lu_decomp_c((vartype_complexmatrix *) lu, perm, inv_c_completion1);
     }
 }
 
 static int inv_r_completion1(int error, vartype_realmatrix *a, int4 *perm,
                                 phloat det) {
+    lu_cache_end(error, (vartype *) a, perm, det, 0);
     if (error != ERR_NONE) {
         free_vartype(linalg_inv_result);
-        free_vartype((vartype *) a);
-        free(perm);
+        lu_release((vartype *) a, perm);
         linalg_inv_completion(error, NULL);
         return error;
     } else {
@@ -1040,18 +1297,17 @@ static int inv_r_completion2(int error, vartype_realmatrix *a, int4 *perm,
                                 vartype_realmatrix *b) {
     if (error != ERR_NONE)
         free_vartype(linalg_inv_result); /* Note: linalg_inv_result == b */
-    free_vartype((vartype *) a);
-    free(perm);
+    lu_release((vartype *) a, perm);
     linalg_inv_completion(error, linalg_inv_result);
     return error;
 }
 
 static int inv_c_completion1(int error, vartype_complexmatrix *a, int4 *perm,
                                 phloat det_re, phloat det_im) {
+    lu_cache_end(error, (vartype *) a, perm, det_re, det_im);
     if (error != ERR_NONE) {
         free_vartype(linalg_inv_result);
-        free_vartype((vartype *) a);
-        free(perm);
+        lu_release((vartype *) a, perm);
         linalg_inv_completion(error, NULL);
         return error;
     } else {
@@ -1068,8 +1324,7 @@ static int inv_c_completion2(int error, vartype_complexmatrix *a, int4 *perm,
                                 vartype_complexmatrix *b) {
     if (error != ERR_NONE)
         free_vartype(linalg_inv_result); /* Note: linalg_inv_result == b */
-    free_vartype((vartype *) a);
-    free(perm);
+    lu_release((vartype *) a, perm);
     linalg_inv_completion(error, linalg_inv_result);
     return error;
 }
@@ -1101,6 +1356,13 @@ int linalg_det(const vartype *src, void (*completion)(int, vartype *)) {
             completion(ERR_ALPHA_DATA_IS_INVALID, 0);
             return ERR_ALPHA_DATA_IS_INVALID;
         }
+        if (lu_cache_lookup(src, true)) {
+            linalg_det_prev_sm_err = core_settings.matrix_singularmatrix;
+            linalg_det_completion = completion;
+            return det_r_completion(ERR_NONE,
+                                    (vartype_realmatrix *) lu_cache_lu,
+                                    lu_cache_perm, lu_cache_det_re);
+        }
         ma = (vartype_realmatrix *) dup_vartype(src);
         if (ma == NULL) {
             completion(ERR_INSUFFICIENT_MEMORY, 0);
@@ -1129,12 +1391,21 @@ int linalg_det(const vartype *src, void (*completion)(int, vartype *)) {
         core_settings.matrix_singularmatrix = true;
 
         linalg_det_completion = completion;
+        lu_cache_begin(src);
         return lu_decomp_r(ma, perm, det_r_completion);
     } else /* src->type == TYPE_COMPLEXMATRIX */ {
         vartype_complexmatrix *ma = (vartype_complexmatrix *) src;
         n = ma->rows;
         if (n != ma->columns)
             return ERR_DIMENSION_ERROR;
+        if (lu_cache_lookup(src, true)) {
+            linalg_det_prev_sm_err = core_settings.matrix_singularmatrix;
+            linalg_det_completion = completion;
+            return det_c_completion(ERR_NONE,
+                                    (vartype_complexmatrix *) lu_cache_lu,
+                                    lu_cache_perm, lu_cache_det_re,
+                                    lu_cache_det_im);
+        }
         ma = (vartype_complexmatrix *) dup_vartype(src);
         if (ma == NULL)
             return ERR_INSUFFICIENT_MEMORY;
@@ -1160,6 +1431,7 @@ int linalg_det(const vartype *src, void (*completion)(int, vartype *)) {
         core_settings.matrix_singularmatrix = true;
 
         linalg_det_completion = completion;
+        lu_cache_begin(src);
         return lu_decomp_c(ma, perm, det_c_completion);
     }
 }
@@ -1168,10 +1440,9 @@ static int det_r_completion(int error, vartype_realmatrix *a, int4 *perm,
                                          phloat det) {
     vartype *det_v = NULL;
 
+    lu_cache_end(error, (vartype *) a, perm, det, 0);
+    lu_release((vartype *) a, perm);
     core_settings.matrix_singularmatrix = linalg_det_prev_sm_err;
-
-    free_vartype((vartype *) a);
-    free(perm);
     if (error == ERR_SINGULAR_MATRIX) {
         det = 0;
         error = ERR_NONE;
@@ -1199,10 +1470,9 @@ static int det_c_completion(int error, vartype_complexmatrix *a, int4 *perm,
                                     phloat det_re, phloat det_im) {
     vartype *det_v = NULL;
 
+    lu_cache_end(error, (vartype *) a, perm, det_re, det_im);
+    lu_release((vartype *) a, perm);
     core_settings.matrix_singularmatrix = linalg_det_prev_sm_err;
-
-    free_vartype((vartype *) a);
-    free(perm);
     if (error == ERR_SINGULAR_MATRIX) {
         det_re = 0;
         det_im = 0;
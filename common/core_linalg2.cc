@@ -41,6 +41,7 @@ struct lu_r_data_struct {
     phloat det;
     int4 i, imax, j, k;
     phloat max, tmp, sum, *scale;
+    int4 *ext;
     int state;
     int (*completion)(int, vartype_realmatrix *, int4 *, phloat);
 };
@@ -49,6 +50,90 @@ lu_r_data_struct *lu_r_data;
 
 static int lu_decomp_r_worker(bool interrupted);
 
+enum matrix_struct {
+    STRUCT_GENERAL,
+    STRUCT_UPPER,
+    STRUCT_LOWER,
+    STRUCT_SYMMETRIC
+};
+
+/* For a zero pivot, substitute a small positive number.
+ * I use a number that's about 10^-20 times the size of
+ * the maximum of the original column, with a minimum of
+ * 10^20 / POS_HUGE_PHLOAT.
+ */
+static phloat tiny_pivot(phloat scale) {
+    phloat tiniest = 1e20 / POS_HUGE_PHLOAT;
+    phloat tiny;
+    if (scale == 0)
+        tiny = tiniest;
+    else {
+        tiny = pow(10, floor(log10(scale)) - 20);
+        if (tiny < tiniest)
+            tiny = tiniest;
+    }
+    return tiny;
+}
+
+/* A matrix is eliminated using the sparse code if it is not tiny, at most
+ * a quarter of its elements are nonzero, and none of its rows are all zero;
+ * the latter is to make sure pivots are chosen exactly as in the general
+ * code.
+ */
+static bool is_sparse(const phloat *a, int4 n) {
+    if (n < 16)
+        return false;
+    double limit = (double) n * n / 4;
+    double nonzero = 0;
+    for (int4 i = 0; i < n; i++) {
+        const phloat *row = a + i * n;
+        double before = nonzero;
+        for (int4 j = 0; j < n; j++)
+            if (row[j] != 0)
+                nonzero++;
+        if (nonzero == before || nonzero > limit)
+            return false;
+    }
+    return true;
+}
+
+/* Classifies a square matrix. Triangular matrices are only reported as
+ * such if their diagonals are free of zeros, and symmetric ones only if
+ * their diagonals are positive, since those are necessary for the fast
+ * paths in lu_decomp_r_worker() to apply.
+ */
+static matrix_struct matrix_structure(const phloat *a, int4 n) {
+    int4 i, j;
+    bool upper = true, lower = true, symmetric = true;
+    for (i = 0; i < n; i++) {
+        if (a[i * n + i] == 0)
+            return STRUCT_GENERAL;
+        if (!(a[i * n + i] > 0))
+            symmetric = false;
+    }
+    for (i = 1; i < n; i++) {
+        for (j = 0; j < i; j++) {
+            phloat l = a[i * n + j];
+            phloat u = a[j * n + i];
+            if (l != 0)
+                upper = false;
+            if (u != 0)
+                lower = false;
+            if (l != u)
+                symmetric = false;
+            if (!upper && !lower && !symmetric)
+                return STRUCT_GENERAL;
+        }
+    }
+    if (upper)
+        return STRUCT_UPPER;
+    if (lower)
+        return STRUCT_LOWER;
+    if (symmetric)
+        return STRUCT_SYMMETRIC;
+    return STRUCT_GENERAL;
+}
+
 int lu_decomp_r(vartype_realmatrix *a, int4 *perm,
                 int (*completion)(int, vartype_realmatrix *, int4 *, phloat)) {
     lu_r_data_struct *dat =
@@ -57,11 +142,21 @@ int lu_decomp_r(vartype_realmatrix *a, int4 *perm,
     if (dat == NULL)
         return completion(ERR_INSUFFICIENT_MEMORY, a, perm, 0);
 
-    dat->scale = (phloat *) malloc(a->rows * sizeof(phloat));
+    /* Twice the size needed for the row scale factors, because the
+     * LDL^T decomposition needs two scratch vectors.
+     */
+    dat->scale = (phloat *) malloc(2 * a->rows * sizeof(phloat));
     if (dat->scale == NULL) {
         free(dat);
         return completion(ERR_INSUFFICIENT_MEMORY, a, perm, 0);
     }
+    /* Row and column extents, for the sparse elimination */
+    dat->ext = (int4 *) malloc(2 * a->rows * sizeof(int4));
+    if (dat->ext == NULL) {
+        free(dat->scale);
+        free(dat);
+        return completion(ERR_INSUFFICIENT_MEMORY, a, perm, 0);
+    }
 
     dat->a = a;
     dat->perm = perm;
@@ -82,6 +177,8 @@ static int lu_decomp_r_worker(bool interrupted) {
     phloat *a = dat->a->array->data;
     int4 n = dat->a->rows;
     phloat *scale = dat->scale;
+    int4 *rowend = dat->ext;
+    int4 *bottom = dat->ext + n;
     int4 *perm = dat->perm;
     int count = 1000;
     int err;
@@ -96,6 +193,7 @@ static int lu_decomp_r_worker(bool interrupted) {
 
     if (interrupted) {
         free(scale);
+        free(dat->ext);
         err = dat->completion(ERR_INTERRUPTED, dat->a, perm, 0);
         free(dat);
         return err;
@@ -108,10 +206,194 @@ static int lu_decomp_r_worker(bool interrupted) {
         case 3: goto state3;
         case 4: goto state4;
         case 5: goto state5;
+        case 6: goto state6;
+        case 7: goto state7;
+        case 8: goto state8;
+        case 9: goto state9;
+        case 10: goto state10;
+        case 11: goto state11;
     }
 
     dat->det = 1;
 
+    /* Before doing a general LU decomposition, check for structure that
+     * allows a cheaper one. Triangular matrices with nonzero diagonals
+     * need O(n^2) work; symmetric positive definite matrices can be
+     * decomposed without pivoting, using half the work of LU; and sparse
+     * matrices only need work where there are nonzeros.
+     * The results are stored in the same form as those of the LU
+     * decomposition, so lu_backsubst_*() can't tell the difference.
+     * Zero pivots, and matrices that turn out not to be positive definite,
+     * are left to the general code, so the 'singular matrix' error mode is
+     * handled the same way as before.
+     */
+    switch (matrix_structure(a, n)) {
+        case STRUCT_UPPER:
+            /* Partial pivoting would not swap any rows here, and the
+             * elimination has nothing to eliminate, so A is its own
+             * decomposition.
+             */
+            for (j = 0; j < n; j++) {
+                perm[j] = j;
+                dat->det *= a[j * n + j];
+            }
+            goto done;
+        case STRUCT_LOWER:
+            /* A = (A D^-1) D, with D the diagonal of A */
+            for (j = 0; j < n; j++) {
+                perm[j] = j;
+                tmp = 1 / a[j * n + j];
+                for (i = j + 1; i < n; i++) {
+                    a[i * n + j] *= tmp;
+                    STATE(6);
+                }
+                dat->det *= a[j * n + j];
+            }
+            goto done;
+        case STRUCT_SYMMETRIC:
+            if (is_sparse(a, n))
+                goto sparse;
+            goto ldlt;
+        default:
+            if (is_sparse(a, n))
+                goto sparse;
+            goto general;
+    }
+
+    /* LDL^T decomposition, a.k.a. square-root-free Cholesky. L is built
+     * in the strict lower triangle, and D in scale[0..n-1], leaving the
+     * diagonal and upper triangle alone, so the original matrix can be
+     * restored if a non-positive pivot shows up.
+     * For the backsubstitution, this is turned into A = L U with U = D L^T.
+     */
+    ldlt:
+    for (j = 0; j < n; j++) {
+        for (k = 0; k < j; k++) {
+            scale[n + k] = a[j * n + k] * scale[k];
+            STATE(7);
+        }
+        sum = a[j * n + j];
+        for (k = 0; k < j; k++)
+            sum -= a[j * n + k] * scale[n + k];
+        if (!(sum > 0)) {
+            /* Not positive definite; restore and do it the hard way */
+            for (i = 1; i < n; i++)
+                for (k = 0; k < i; k++)
+                    a[i * n + k] = a[k * n + i];
+            goto general;
+        }
+        scale[j] = sum;
+        for (i = j + 1; i < n; i++) {
+            sum = a[j * n + i];
+            for (k = 0; k < j; k++) {
+                sum -= a[i * n + k] * scale[n + k];
+                STATE(8);
+            }
+            a[i * n + j] = sum / scale[j];
+        }
+    }
+    for (j = 0; j < n; j++) {
+        perm[j] = j;
+        a[j * n + j] = scale[j];
+        for (i = j + 1; i < n; i++) {
+            a[j * n + i] = scale[j] * a[i * n + j];
+            STATE(9);
+        }
+        dat->det *= scale[j];
+    }
+    goto done;
+
+    /* Sparse elimination. This is the same computation as the general code
+     * below, but organized as right-looking Gaussian elimination, while
+     * keeping track of the rightmost nonzero in each row (rowend) and the
+     * lowest nonzero in each column (bottom). Fill-in can only occur within
+     * those bounds, so each elimination step only needs to visit the rows
+     * and columns that can actually be affected. The terms are subtracted
+     * in the same order as in the general code, and the pivots are chosen
+     * the same way, so the results are the same.
+     */
+    sparse:
+    for (j = 0; j < n; j++)
+        bottom[j] = -1;
+    for (i = 0; i < n; i++) {
+        max = 0;
+        rowend[i] = -1;
+        for (j = 0; j < n; j++) {
+            tmp = a[i * n + j];
+            if (tmp != 0) {
+                rowend[i] = j;
+                bottom[j] = i;
+            }
+            if (tmp < 0)
+                tmp = -tmp;
+            if (tmp > max)
+                max = tmp;
+            STATE(10);
+        }
+        scale[i] = max;
+    }
+
+    for (j = 0; j < n; j++) {
+        max = 0;
+        imax = j;
+        for (i = j; i <= bottom[j]; i++) {
+            sum = a[i * n + j];
+            tmp = (sum < 0 ? -sum : sum) / scale[i];
+            if (tmp > max) {
+                imax = i;
+                max = tmp;
+            }
+        }
+
+        if (j != imax) {
+            int4 last = rowend[j] > rowend[imax] ? rowend[j] : rowend[imax];
+            for (k = 0; k <= last; k++) {
+                tmp = a[imax * n + k];
+                a[imax * n + k] = a[j * n + k];
+                a[j * n + k] = tmp;
+            }
+            last = rowend[j];
+            rowend[j] = rowend[imax];
+            rowend[imax] = last;
+            for (k = j + 1; k <= last; k++)
+                if (bottom[k] < imax)
+                    bottom[k] = imax;
+            dat->det = -dat->det;
+            scale[imax] = scale[j];
+        }
+
+        perm[j] = imax;
+        if (a[j * n + j] == 0) {
+            if (core_settings.matrix_singularmatrix) {
+                free(scale);
+                free(dat->ext);
+                err = dat->completion(ERR_SINGULAR_MATRIX, dat->a, perm, 0);
+                free(dat);
+                return err;
+            } else
+                a[j * n + j] = tiny_pivot(scale[j]);
+        }
+        dat->det *= a[j * n + j];
+        tmp = 1 / a[j * n + j];
+        for (i = j + 1; i <= bottom[j]; i++) {
+            sum = a[i * n + j];
+            if (sum == 0)
+                continue;
+            sum *= tmp;
+            a[i * n + j] = sum;
+            for (k = j + 1; k <= rowend[j]; k++) {
+                a[i * n + k] -= sum * a[j * n + k];
+                if (bottom[k] < i)
+                    bottom[k] = i;
+                STATE(11);
+            }
+            if (rowend[i] < rowend[j])
+                rowend[i] = rowend[j];
+        }
+    }
+    goto done;
+
+    general:
     for (i = 0; i < n; i++) {
         max = 0;
         for (j = 0; j < n; j++) {
@@ -170,26 +452,12 @@ static int lu_decomp_r_worker(bool interrupted) {
         if (a[j * n + j] == 0) {
             if (core_settings.matrix_singularmatrix) {
                 free(scale);
+                free(dat->ext);
                 err = dat->completion(ERR_SINGULAR_MATRIX, dat->a, perm, 0);
                 free(dat);
                 return err;
-            } else {
-                /* For a zero pivot, substitute a small positive number.
-                 * I use a number that's about 10^-20 times the size of
-                 * the maximum of the original column, with a minimum of
-                 * 10^20 / POS_HUGE_PHLOAT.
-                 */
-                phloat tiniest = 1e20 / POS_HUGE_PHLOAT;
-                phloat tiny;
-                if (scale[j] == 0)
-                    tiny = tiniest;
-                else {
-                    tiny = pow(10, floor(log10(scale[j])) - 20);
-                    if (tiny < tiniest)
-                        tiny = tiniest;
-                }
-                a[j * n + j] = tiny;
-            }
+            } else
+                a[j * n + j] = tiny_pivot(scale[j]);
         }
         dat->det *= a[j * n + j];
         if (j != n - 1) {
@@ -201,7 +469,9 @@ static int lu_decomp_r_worker(bool interrupted) {
         }
     }
 
+    done:
     free(scale);
+    free(dat->ext);
     err = dat->completion(ERR_NONE, dat->a, perm, dat->det);
     free(dat);
     return err;
@@ -841,3 +1111,307 @@ static int lu_backsubst_cc_worker(bool interrupted) {
     dat->sum_im = sum_im;
     return ERR_INTERRUPTIBLE;
 }
+
+
+/***************************************/
+/***** Sparse Gaussian elimination *****/
+/***************************************/
+
+/* Solves A X = B for a sparse A, by Gaussian elimination on A stored as one
+ * sparse vector per row, so the memory used is proportional to the number of
+ * nonzeros plus the fill-in, rather than to the square of the size.
+ * Rows are kept in buckets by the column of their leading nonzero. Step c
+ * picks the pivot for column c from bucket c, using the same scaled partial
+ * pivoting as lu_decomp_r(), and eliminates column c from the other rows in
+ * that bucket, which then move to the bucket of their new leading column.
+ * The right-hand side is carried along, so no factorization is kept, and
+ * X is found by back-substitution with the pivot rows.
+ */
+
+struct sp_row {
+    int4 len, cap;
+    int4 *col;
+    phloat *val;
+};
+
+struct sparse_solve_data_struct {
+    int4 n, q;
+    sp_row *row;
+    phloat *scale, maxscale;
+    int4 *head, *next, *pivot;
+    int4 empty;
+    int4 *mcol;
+    phloat *mval;
+    phloat *b;
+    vartype_realmatrix *x;
+    int4 c;
+    int state;
+    int (*completion)(int, vartype *);
+};
+
+static sparse_solve_data_struct *sparse_solve_data;
+
+static int sparse_solve_worker(bool interrupted);
+
+static void sparse_solve_free(sparse_solve_data_struct *dat) {
+    if (dat->row != NULL)
+        for (int4 i = 0; i < dat->n; i++) {
+            free(dat->row[i].col);
+            free(dat->row[i].val);
+        }
+    free(dat->row);
+    free(dat->scale);
+    free(dat->head);
+    free(dat->mcol);
+    free(dat->mval);
+    free(dat->b);
+    free(dat);
+}
+
+static int sparse_solve_finish(sparse_solve_data_struct *dat, int error) {
+    vartype *x = (vartype *) dat->x;
+    int (*completion)(int, vartype *) = dat->completion;
+    sparse_solve_free(dat);
+    if (error != ERR_NONE) {
+        free_vartype(x);
+        x = NULL;
+    }
+    return completion(error, x);
+}
+
+static bool sp_row_reserve(sp_row *r, int4 n) {
+    if (r->cap >= n)
+        return true;
+    int4 *col = (int4 *) realloc(r->col, n * sizeof(int4));
+    if (col == NULL)
+        return false;
+    r->col = col;
+    phloat *val = (phloat *) realloc(r->val, n * sizeof(phloat));
+    if (val == NULL)
+        return false;
+    r->val = val;
+    r->cap = n;
+    return true;
+}
+
+/* Puts row r in the bucket for its leading column, or on the empty list */
+static void sp_file_row(sparse_solve_data_struct *dat, int4 r) {
+    if (dat->row[r].len == 0) {
+        dat->next[r] = dat->empty;
+        dat->empty = r;
+    } else {
+        int4 c = dat->row[r].col[0];
+        dat->next[r] = dat->head[c];
+        dat->head[c] = r;
+    }
+}
+
+int sparse_solve(const vartype_sparse *a, const vartype_realmatrix *b,
+                 int (*completion)(int, vartype *)) {
+    int4 n = a->rows;
+    int4 q = b->columns;
+    const sparse_data *sd = a->array;
+
+    sparse_solve_data_struct *dat =
+        (sparse_solve_data_struct *) calloc(1, sizeof(sparse_solve_data_struct));
+    if (dat == NULL)
+        return completion(ERR_INSUFFICIENT_MEMORY, NULL);
+    dat->n = n;
+    dat->q = q;
+    dat->completion = completion;
+    dat->row = (sp_row *) calloc(n, sizeof(sp_row));
+    dat->scale = (phloat *) malloc(n * sizeof(phloat));
+    dat->head = (int4 *) malloc(3 * (size_t) n * sizeof(int4));
+    dat->mcol = (int4 *) malloc(n * sizeof(int4));
+    dat->mval = (phloat *) malloc(n * sizeof(phloat));
+    dat->b = (phloat *) malloc((size_t) n * q * sizeof(phloat));
+    dat->x = (vartype_realmatrix *) new_realmatrix(n, q);
+    if (dat->row == NULL || dat->scale == NULL || dat->head == NULL
+            || dat->mcol == NULL || dat->mval == NULL || dat->b == NULL
+            || dat->x == NULL)
+        return sparse_solve_finish(dat, ERR_INSUFFICIENT_MEMORY);
+    dat->next = dat->head + n;
+    dat->pivot = dat->next + n;
+
+    for (int4 i = 0; i < n * q; i++)
+        dat->b[i] = b->array->data[i];
+    for (int4 c = 0; c < n; c++)
+        dat->head[c] = -1;
+    dat->empty = -1;
+    dat->maxscale = 0;
+    for (int4 i = n - 1; i >= 0; i--) {
+        sp_row *r = dat->row + i;
+        int4 len = sd->rowstart[i + 1] - sd->rowstart[i];
+        phloat max = 0;
+        if (len > 0) {
+            if (!sp_row_reserve(r, len))
+                return sparse_solve_finish(dat, ERR_INSUFFICIENT_MEMORY);
+            for (int4 k = 0; k < len; k++) {
+                phloat t = sd->data[sd->rowstart[i] + k];
+                r->col[k] = sd->column[sd->rowstart[i] + k];
+                r->val[k] = t;
+                if (t < 0)
+                    t = -t;
+                if (t > max)
+                    max = t;
+            }
+            r->len = len;
+        }
+        dat->scale[i] = max;
+        if (max > dat->maxscale)
+            dat->maxscale = max;
+        sp_file_row(dat, i);
+    }
+
+    dat->c = 0;
+    dat->state = 0;
+    sparse_solve_data = dat;
+    mode_interruptible = sparse_solve_worker;
+    mode_stoppable = false;
+    return ERR_INTERRUPTIBLE;
+}
+
+static int sparse_solve_worker(bool interrupted) {
+    sparse_solve_data_struct *dat = sparse_solve_data;
+    int4 n = dat->n;
+    int4 q = dat->q;
+    sp_row *row = dat->row;
+    phloat *b = dat->b;
+    int4 c = dat->c;
+    int count = 1000;
+
+    if (interrupted)
+        return sparse_solve_finish(dat, ERR_INTERRUPTED);
+
+    if (dat->state == 1)
+        goto backsubst;
+
+    for (; c < n; c++) {
+        int4 p = -1;
+        phloat max = -1;
+        for (int4 r = dat->head[c]; r != -1; r = dat->next[r]) {
+            phloat t = row[r].val[0];
+            t = (t < 0 ? -t : t) / dat->scale[r];
+            if (t > max) {
+                max = t;
+                p = r;
+            }
+        }
+
+        if (p == -1) {
+            if (core_settings.matrix_singularmatrix)
+                return sparse_solve_finish(dat, ERR_SINGULAR_MATRIX);
+            /* No row has its leading nonzero in this column; give one of
+             * the rows that haven't been used as pivots yet a tiny element
+             * here, the way lu_decomp_r() replaces a zero pivot. Rows that
+             * were all zero to begin with use the scale of the whole matrix.
+             */
+            if (dat->empty != -1) {
+                p = dat->empty;
+                dat->empty = dat->next[p];
+            } else {
+                int4 k = c + 1;
+                while (dat->head[k] == -1)
+                    k++;
+                p = dat->head[k];
+                dat->head[k] = dat->next[p];
+            }
+            sp_row *rp = row + p;
+            if (!sp_row_reserve(rp, rp->len + 1))
+                return sparse_solve_finish(dat, ERR_INSUFFICIENT_MEMORY);
+            for (int4 k = rp->len; k > 0; k--) {
+                rp->col[k] = rp->col[k - 1];
+                rp->val[k] = rp->val[k - 1];
+            }
+            rp->col[0] = c;
+            rp->val[0] = tiny_pivot(dat->scale[p] != 0 ? dat->scale[p] : dat->maxscale);
+            rp->len++;
+            dat->pivot[c] = p;
+            count -= rp->len;
+        } else {
+            dat->pivot[c] = p;
+            sp_row *rp = row + p;
+            phloat *bp = b + p * q;
+            int4 r = dat->head[c];
+            dat->head[c] = -1;
+            while (r != -1) {
+                int4 next = dat->next[r];
+                if (r == p) {
+                    r = next;
+                    continue;
+                }
+                sp_row *rr = row + r;
+                phloat f = rr->val[0] / rp->val[0];
+                /* rr -= f * rp, skipping the leading elements, which
+                 * cancel by construction. Exact zeros are dropped.
+                 */
+                int4 i = 1, j = 1, m = 0;
+                while (i < rr->len || j < rp->len) {
+                    int4 col;
+                    phloat v;
+                    if (j == rp->len || i < rr->len && rr->col[i] < rp->col[j]) {
+                        col = rr->col[i];
+                        v = rr->val[i++];
+                    } else if (i == rr->len || rp->col[j] < rr->col[i]) {
+                        col = rp->col[j];
+                        v = -f * rp->val[j++];
+                    } else {
+                        col = rr->col[i];
+                        v = rr->val[i++] - f * rp->val[j++];
+                    }
+                    if (v != 0) {
+                        dat->mcol[m] = col;
+                        dat->mval[m++] = v;
+                    }
+                }
+                if (!sp_row_reserve(rr, m))
+                    return sparse_solve_finish(dat, ERR_INSUFFICIENT_MEMORY);
+                for (int4 k = 0; k < m; k++) {
+                    rr->col[k] = dat->mcol[k];
+                    rr->val[k] = dat->mval[k];
+                }
+                rr->len = m;
+                phloat *br = b + r * q;
+                for (int4 k = 0; k < q; k++)
+                    br[k] -= f * bp[k];
+                sp_file_row(dat, r);
+                count -= rr->len + rp->len + q;
+                r = next;
+            }
+        }
+        if (--count <= 0) {
+            dat->c = c + 1;
+            return ERR_INTERRUPTIBLE;
+        }
+    }
+    dat->state = 1;
+    c = n - 1;
+
+    backsubst:
+    for (; c >= 0; c--) {
+        sp_row *rp = row + dat->pivot[c];
+        phloat *bp = b + dat->pivot[c] * q;
+        phloat *x = dat->x->array->data;
+        for (int4 k = 0; k < q; k++) {
+            phloat sum = bp[k];
+            for (int4 j = 1; j < rp->len; j++)
+                sum -= rp->val[j] * x[rp->col[j] * q + k];
+            phloat t = sum / rp->val[0];
+            if (p_isinf(t) || p_isnan(t)) {
+                if (core_settings.matrix_outofrange
+                                        && !flags.f.range_error_ignore)
+                    return sparse_solve_finish(dat, ERR_OUT_OF_RANGE);
+                else
+                    t = p_isinf(t) < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
+            }
+            x[c * q + k] = t;
+        }
+        count -= rp->len * q;
+        if (--count <= 0) {
+            dat->c = c - 1;
+            return ERR_INTERRUPTIBLE;
+        }
+    }
+
+    return sparse_solve_finish(dat, ERR_NONE);
+}
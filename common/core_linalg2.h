@@ -46,4 +46,7 @@ int lu_backsubst_cc(vartype_complexmatrix *a,
                             int (*completion)(int, vartype_complexmatrix *,
                                 int4 *, vartype_complexmatrix *));
 
+int sparse_solve(const vartype_sparse *a, const vartype_realmatrix *b,
+                            int (*completion)(int, vartype *));
+
 #endif
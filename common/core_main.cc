@@ -29,6 +29,7 @@
 #include "core_display.h"
 #include "core_helpers.h"
 #include "core_keydown.h"
+#include "core_linalg1.h"
 #include "core_math1.h"
 #include "core_sto_rcl.h"
 #include "core_tables.h"
@@ -61,6 +62,8 @@ static void set_shift(bool state) {
 }
 
 static void continue_running();
+static void trace_flush();
+static void trace_invalidate_programs();
 static void stop_interruptible();
 static int handle_error(int error);
 
@@ -170,6 +173,8 @@ void core_cleanup() {
     stack_capacity = 0;
     free_vartype(lastx);
     lastx = NULL;
+    linalg_clear_cache();
+    clear_fn_memo();
     purge_all_vars();
     clear_all_prgms();
     if (vars != NULL) {
@@ -2438,139 +2443,204 @@ static int complex2buf(char *buf, phloat re, phloat im, bool always_rect, const
     return bufptr;
 }
 
-static void serialize_list(textbuf *tb, vartype_list *list, int indent) {
+static void serialize_list(textbuf *tb, vartype_list *list, int indent);
+static void serialize_dict(textbuf *tb, vartype_dict *dict, int indent);
+
+static void serialize_elem(textbuf *tb, vartype *elem, int indent) {
     char buf[50];
-    tb_indent(tb, indent);
-    tb_write(tb, "{\n", 2);
-    indent += 2;
-    tb_indent(tb, indent);
-    int n = int2string(list->size, buf, 49);
-    tb_write(tb, buf, n);
-    tb_write(tb, "-Elem List\n", 11);
-    for (int i = 0; i < list->size; i++) {
-        vartype *elem = list->array->data[i];
-        switch (elem->type) {
-            case TYPE_NULL: {
-                tb_indent(tb, indent);
-                tb_write(tb, "null\n", 5);
-                break;
-            }
-            case TYPE_REAL: {
-                vartype_real *r = (vartype_real *) elem;
-                tb_indent(tb, indent);
-                n = real2buf(buf, r->x);
-                tb_write(tb, buf, n);
-                tb_write(tb, "\n", 1);
-                break;
-            }
-            case TYPE_COMPLEX: {
-                vartype_complex *c = (vartype_complex *) elem;
-                tb_indent(tb, indent);
-                n = complex2buf(buf, c->re, c->im, true);
-                tb_write(tb, buf, n);
-                tb_write(tb, "\n", 1);
-                break;
-            }
-            case TYPE_STRING: {
-                vartype_string *s = (vartype_string *) elem;
-                tb_indent(tb, indent);
-                tb_write(tb, "\"", 1);
-                const char *txt = s->txt();
-                char cbuf[5];
-                for (int j = 0; j < s->length; j++) {
-                    unsigned char c = txt[j];
-                    if (c == 10)
-                        c = 138;
-                    else if (c >= 130 && c != 138)
-                        c &= 127;
-                    if (c == '"') {
-                        tb_write(tb, "\\\"", 2);
-                    } else if (c == '\\') {
-                        tb_write(tb, "\\\\", 2);
-                    } else {
-                        n = hp2ascii(cbuf, (const char *) &c, 1);
-                        tb_write(tb, cbuf, n);
-                    }
+    int n;
+    switch (elem->type) {
+        case TYPE_NULL: {
+            tb_indent(tb, indent);
+            tb_write(tb, "null\n", 5);
+            break;
+        }
+        case TYPE_REAL: {
+            vartype_real *r = (vartype_real *) elem;
+            tb_indent(tb, indent);
+            n = real2buf(buf, r->x);
+            tb_write(tb, buf, n);
+            tb_write(tb, "\n", 1);
+            break;
+        }
+        case TYPE_COMPLEX: {
+            vartype_complex *c = (vartype_complex *) elem;
+            tb_indent(tb, indent);
+            n = complex2buf(buf, c->re, c->im, true);
+            tb_write(tb, buf, n);
+            tb_write(tb, "\n", 1);
+            break;
+        }
+        case TYPE_STRING: {
+            vartype_string *s = (vartype_string *) elem;
+            tb_indent(tb, indent);
+            tb_write(tb, "\"", 1);
+            const char *txt = s->txt();
+            char cbuf[5];
+            for (int j = 0; j < s->length; j++) {
+                unsigned char c = txt[j];
+                if (c == 10)
+                    c = 138;
+                else if (c >= 130 && c != 138)
+                    c &= 127;
+                if (c == '"') {
+                    tb_write(tb, "\\\"", 2);
+                } else if (c == '\\') {
+                    tb_write(tb, "\\\\", 2);
+                } else {
+                    n = hp2ascii(cbuf, (const char *) &c, 1);
+                    tb_write(tb, cbuf, n);
                 }
-                tb_write(tb, "\"\n", 2);
-                break;
             }
-            case TYPE_REALMATRIX: {
-                vartype_realmatrix *rm = (vartype_realmatrix *) elem;
-                tb_indent(tb, indent);
-                tb_write(tb, "[\n", 2);
-                indent += 2;
+            tb_write(tb, "\"\n", 2);
+            break;
+        }
+        case TYPE_REALMATRIX: {
+            vartype_realmatrix *rm = (vartype_realmatrix *) elem;
+            tb_indent(tb, indent);
+            tb_write(tb, "[\n", 2);
+            indent += 2;
+            tb_indent(tb, indent);
+            n = int2string(rm->rows, buf, 49);
+            tb_write(tb, buf, n);
+            tb_write(tb, "x", 1);
+            n = int2string(rm->columns, buf, 49);
+            tb_write(tb, buf, n);
+            tb_write(tb, " Matrix\n", 8);
+            for (int j = 0; j < rm->rows * rm->columns; j++) {
                 tb_indent(tb, indent);
-                n = int2string(rm->rows, buf, 49);
-                tb_write(tb, buf, n);
-                tb_write(tb, "x", 1);
-                n = int2string(rm->columns, buf, 49);
-                tb_write(tb, buf, n);
-                tb_write(tb, " Matrix\n", 8);
-                for (int j = 0; j < rm->rows * rm->columns; j++) {
-                    tb_indent(tb, indent);
-                    if (rm->array->is_string[j]) {
-                        tb_write(tb, "\"", 1);
-                        char *text;
-                        int4 len;
-                        get_matrix_string(rm, j, &text, &len);
-                        char cbuf[5];
-                        for (int k = 0; k < len; k++) {
-                            unsigned char c = text[k];
-                            if (c == 10)
-                                c = 138;
-                            else if (c >= 130 && c != 138)
-                                c &= 127;
-                            if (c == '"') {
-                                tb_write(tb, "\\\"", 2);
-                            } else if (c == '\\') {
-                                tb_write(tb, "\\\\", 2);
-                            } else {
-                                n = hp2ascii(cbuf, (const char *) &c, 1);
-                                tb_write(tb, cbuf, n);
-                            }
+                if (rm->array->str_type(j)) {
+                    tb_write(tb, "\"", 1);
+                    char *text;
+                    int4 len;
+                    get_matrix_string(rm, j, &text, &len);
+                    char cbuf[5];
+                    for (int k = 0; k < len; k++) {
+                        unsigned char c = text[k];
+                        if (c == 10)
+                            c = 138;
+                        else if (c >= 130 && c != 138)
+                            c &= 127;
+                        if (c == '"') {
+                            tb_write(tb, "\\\"", 2);
+                        } else if (c == '\\') {
+                            tb_write(tb, "\\\\", 2);
+                        } else {
+                            n = hp2ascii(cbuf, (const char *) &c, 1);
+                            tb_write(tb, cbuf, n);
                         }
-                        tb_write(tb, "\"\n", 2);
-                    } else {
-                        n = real2buf(buf, rm->array->data[j]);
-                        tb_write(tb, buf, n);
-                        tb_write(tb, "\n", 1);
                     }
+                    tb_write(tb, "\"\n", 2);
+                } else {
+                    n = real2buf(buf, rm->array->data[j]);
+                    tb_write(tb, buf, n);
+                    tb_write(tb, "\n", 1);
                 }
-                indent -= 2;
-                tb_indent(tb, indent);
-                tb_write(tb, "]\n", 2);
-                break;
             }
-            case TYPE_COMPLEXMATRIX: {
-                vartype_complexmatrix *cm = (vartype_complexmatrix *) elem;
-                tb_indent(tb, indent);
-                tb_write(tb, "[\n", 2);
-                indent += 2;
+            indent -= 2;
+            tb_indent(tb, indent);
+            tb_write(tb, "]\n", 2);
+            break;
+        }
+        case TYPE_COMPLEXMATRIX: {
+            vartype_complexmatrix *cm = (vartype_complexmatrix *) elem;
+            tb_indent(tb, indent);
+            tb_write(tb, "[\n", 2);
+            indent += 2;
+            tb_indent(tb, indent);
+            n = int2string(cm->rows, buf, 49);
+            tb_write(tb, buf, n);
+            tb_write(tb, "x", 1);
+            n = int2string(cm->columns, buf, 49);
+            tb_write(tb, buf, n);
+            tb_write(tb, " Cpx Matrix\n", 12);
+            for (int j = 0; j < cm->rows * cm->columns * 2; j += 2) {
                 tb_indent(tb, indent);
-                n = int2string(cm->rows, buf, 49);
-                tb_write(tb, buf, n);
-                tb_write(tb, "x", 1);
-                n = int2string(cm->columns, buf, 49);
+                n = complex2buf(buf, cm->array->data[j], cm->array->data[j + 1], true);
                 tb_write(tb, buf, n);
-                tb_write(tb, " Cpx Matrix\n", 12);
-                for (int j = 0; j < cm->rows * cm->columns * 2; j += 2) {
+                tb_write(tb, "\n", 1);
+            }
+            indent -= 2;
+            tb_indent(tb, indent);
+            tb_write(tb, "]\n", 2);
+            break;
+        }
+        case TYPE_SPARSE: {
+            vartype_sparse *sm = (vartype_sparse *) elem;
+            sparse_data *sd = sm->array;
+            tb_indent(tb, indent);
+            tb_write(tb, "[\n", 2);
+            indent += 2;
+            tb_indent(tb, indent);
+            n = int2string(sm->rows, buf, 49);
+            tb_write(tb, buf, n);
+            tb_write(tb, "x", 1);
+            n = int2string(sm->columns, buf, 49);
+            tb_write(tb, buf, n);
+            tb_write(tb, " Matrix\n", 8);
+            for (int4 r = 0; r < sm->rows; r++) {
+                int4 k = sd->rowstart[r];
+                for (int4 c = 0; c < sm->columns; c++) {
+                    phloat x = 0;
+                    if (k < sd->rowstart[r + 1] && sd->column[k] == c)
+                        x = sd->data[k++];
                     tb_indent(tb, indent);
-                    n = complex2buf(buf, cm->array->data[j], cm->array->data[j + 1], true);
+                    n = real2buf(buf, x);
                     tb_write(tb, buf, n);
                     tb_write(tb, "\n", 1);
                 }
-                indent -= 2;
-                tb_indent(tb, indent);
-                tb_write(tb, "]\n", 2);
-                break;
-            }
-            case TYPE_LIST: {
-                serialize_list(tb, (vartype_list *) elem, indent);
-                break;
             }
+            indent -= 2;
+            tb_indent(tb, indent);
+            tb_write(tb, "]\n", 2);
+            break;
+        }
+        case TYPE_LIST: {
+            serialize_list(tb, (vartype_list *) elem, indent);
+            break;
+        }
+        case TYPE_DICT: {
+            serialize_dict(tb, (vartype_dict *) elem, indent);
+            break;
         }
     }
+}
+
+static void serialize_list(textbuf *tb, vartype_list *list, int indent) {
+    char buf[50];
+    tb_indent(tb, indent);
+    tb_write(tb, "{\n", 2);
+    indent += 2;
+    tb_indent(tb, indent);
+    int n = int2string(list->size, buf, 49);
+    tb_write(tb, buf, n);
+    tb_write(tb, "-Elem List\n", 11);
+    for (int i = 0; i < list->size; i++)
+        serialize_elem(tb, list->array->data[i], indent);
+    indent -= 2;
+    tb_indent(tb, indent);
+    tb_write(tb, "}\n", 2);
+}
+
+/* Dictionaries are written like lists, with the keys and values
+ * alternating, in insertion order.
+ */
+static void serialize_dict(textbuf *tb, vartype_dict *dict, int indent) {
+    char buf[50];
+    tb_indent(tb, indent);
+    tb_write(tb, "{\n", 2);
+    indent += 2;
+    tb_indent(tb, indent);
+    int n = int2string(dict->size, buf, 49);
+    tb_write(tb, buf, n);
+    tb_write(tb, "-Elem Dict\n", 11);
+    dict_data *dd = dict->array;
+    for (int4 i = 0; i < dd->used; i++) {
+        if (dd->keys[i] == NULL)
+            continue;
+        serialize_elem(tb, dd->keys[i], indent);
+        serialize_elem(tb, dd->values[i], indent);
+    }
     indent -= 2;
     tb_indent(tb, indent);
     tb_write(tb, "}\n", 2);
@@ -2630,13 +2700,12 @@ char *core_copy() {
         const char *format = core_settings.localized_copy_paste ? number_format() : NULL;
         vartype_realmatrix *rm = (vartype_realmatrix *) stack[sp];
         phloat *data = rm->array->data;
-        char *is_string = rm->array->is_string;
         char buf[50];
         int n = 0;
         for (int r = 0; r < rm->rows; r++) {
             for (int c = 0; c < rm->columns; c++) {
                 int bufptr;
-                if (is_string[n] == 0) {
+                if (rm->array->str_type(n) == 0) {
                     bufptr = real2buf(buf, data[n], format);
                     tb_write(&tb, buf, bufptr);
                 } else {
@@ -2677,9 +2746,32 @@ char *core_copy() {
                 tb_write(&tb, "\n", 1);
         }
         goto textbuf_finish;
+    } else if (stack[sp]->type == TYPE_SPARSE) {
+        const char *format = core_settings.localized_copy_paste ? number_format() : NULL;
+        vartype_sparse *sm = (vartype_sparse *) stack[sp];
+        sparse_data *sd = sm->array;
+        char buf[50];
+        for (int4 r = 0; r < sm->rows; r++) {
+            int4 k = sd->rowstart[r];
+            for (int4 c = 0; c < sm->columns; c++) {
+                phloat x = 0;
+                if (k < sd->rowstart[r + 1] && sd->column[k] == c)
+                    x = sd->data[k++];
+                int bufptr = real2buf(buf, x, format);
+                tb_write(&tb, buf, bufptr);
+                if (c < sm->columns - 1)
+                    tb_write(&tb, "\t", 1);
+            }
+            if (r < sm->rows - 1)
+                tb_write(&tb, "\n", 1);
+        }
+        goto textbuf_finish;
     } else if (stack[sp]->type == TYPE_LIST) {
         serialize_list(&tb, (vartype_list *) stack[sp], 0);
         goto textbuf_finish;
+    } else if (stack[sp]->type == TYPE_DICT) {
+        serialize_dict(&tb, (vartype_dict *) stack[sp], 0);
+        goto textbuf_finish;
     } else {
         // Shouldn't happen: unrecognized data type
         return NULL;
@@ -4163,6 +4255,30 @@ static char *parse_string(const char *buf, int len, int *slen) {
     return s2;
 }
 
+/* Turns a list of alternating keys and values into a dictionary. The list
+ * is consumed, whether this succeeds or not.
+ */
+static vartype *list_to_dict(vartype_list *list) {
+    vartype_dict *dict = (vartype_dict *) new_dict();
+    if (dict == NULL || !dict_reserve(dict, list->size / 2))
+        goto failure;
+    for (int4 i = 0; i < list->size; i += 2) {
+        vartype *key = list->array->data[i];
+        if (!dict_key_ok(key))
+            goto failure;
+        dict_put(dict, key, list->array->data[i + 1]);
+        list->array->data[i] = NULL;
+        list->array->data[i + 1] = NULL;
+    }
+    free_vartype((vartype *) list);
+    return (vartype *) dict;
+
+    failure:
+    free_vartype((vartype *) dict);
+    free_vartype((vartype *) list);
+    return NULL;
+}
+
 static vartype *deserialize_list(const char *buf, int *pos) {
     int tstart;
     int tlen = get_token(buf, pos, &tstart);
@@ -4175,7 +4291,18 @@ static vartype *deserialize_list(const char *buf, int *pos) {
     if (len == -1)
         return NULL;
     tlen = get_token(buf, pos, &tstart);
-    if (tlen != 4 || strncmp(buf + tstart, "List", 4) != 0)
+    if (tlen != 4)
+        return NULL;
+    bool dict;
+    if (strncmp(buf + tstart, "List", 4) == 0)
+        dict = false;
+    else if (strncmp(buf + tstart, "Dict", 4) == 0) {
+        // Read the alternating keys and values as a list first
+        if (len > 0x3fffffff)
+            return NULL;
+        dict = true;
+        len *= 2;
+    } else
         return NULL;
     vartype_list *list = (vartype_list *) new_list(len);
     if (list == NULL)
@@ -4300,8 +4427,10 @@ static vartype *deserialize_list(const char *buf, int *pos) {
         failure:
         free_vartype((vartype *) list);
         return NULL;
-    } else
+    } else if (!dict)
         return (vartype *) list;
+    else
+        return list_to_dict(list);
 }
 
 void core_paste(const char *buf) {
@@ -4605,6 +4734,8 @@ void core_paste(const char *buf) {
                 rm->array->data = data;
                 rm->array->is_string = is_string;
                 rm->array->refcount = 1;
+                if (!contains_strings(rm))
+                    rm->array->drop_strings(n);
                 v = (vartype *) rm;
             } else {
                 vartype_complexmatrix *cm = (vartype_complexmatrix *)
@@ -4657,6 +4788,13 @@ void set_running(bool state) {
     if (mode_running != state) {
         mode_running = state;
         shell_annunciators(-1, -1, -1, state, -1, -1);
+        if (trace_to_file) {
+            // Programs may have been edited while we were stopped
+            if (state)
+                trace_invalidate_programs();
+            else
+                trace_flush();
+        }
     }
     if (state) {
         /* Cancel any pending INPUT command */
@@ -4761,6 +4899,147 @@ void do_interactive(int command) {
     }
 }
 
+/* Binary execution trace. Records are collected in trace_buf, and written
+ * when it fills up, when a program stops, and when the trace is closed.
+ * The file starts with TRACE_MAGIC, int4 TRACE_VERSION, and int4
+ * sizeof(phloat), followed by records:
+ *   'P', int4 prgm, int4 size, program text:
+ *       A snapshot of a program, written before the first instruction record
+ *       that refers to it, and again whenever it may have changed.
+ *   'I', int4 prgm, int4 pc, int2 cmd, int4 depth, char type [, phloat x]:
+ *       An executed instruction. The stack depth and the type of X are those
+ *       after the instruction was executed; x is only present if X is real.
+ */
+#define TRACE_MAGIC "F42TRACE"
+#define TRACE_VERSION 1
+#define TRACE_BUFSIZE 65536
+
+struct trace_prgm_info {
+    const unsigned char *text;
+    int4 size;
+};
+
+static FILE *trace_file = NULL;
+static char *trace_buf = NULL;
+static int trace_buf_len = 0;
+static trace_prgm_info *trace_prgms = NULL;
+static int trace_prgms_capacity = 0;
+
+static void trace_flush() {
+    if (trace_buf_len > 0 && fwrite(trace_buf, 1, trace_buf_len, trace_file) != (size_t) trace_buf_len)
+        // Give up on the trace, and fall back on printing
+        core_trace_close();
+    else
+        trace_buf_len = 0;
+}
+
+static void trace_write(const void *data, int4 length) {
+    if (trace_buf_len + length > TRACE_BUFSIZE) {
+        trace_flush();
+        if (!trace_to_file)
+            return;
+        if (length > TRACE_BUFSIZE) {
+            if (fwrite(data, 1, length, trace_file) != (size_t) length)
+                core_trace_close();
+            return;
+        }
+    }
+    memcpy(trace_buf + trace_buf_len, data, length);
+    trace_buf_len += length;
+}
+
+static void trace_invalidate_programs() {
+    for (int i = 0; i < trace_prgms_capacity; i++)
+        trace_prgms[i].text = NULL;
+}
+
+static void trace_program(int prgm) {
+    if (prgm >= trace_prgms_capacity) {
+        int newcap = prgm + 16;
+        trace_prgm_info *newprgms = (trace_prgm_info *) realloc(trace_prgms, newcap * sizeof(trace_prgm_info));
+        if (newprgms == NULL) {
+            core_trace_close();
+            return;
+        }
+        for (int i = trace_prgms_capacity; i < newcap; i++)
+            newprgms[i].text = NULL;
+        trace_prgms = newprgms;
+        trace_prgms_capacity = newcap;
+    }
+    trace_prgm_info *info = trace_prgms + prgm;
+    if (info->text == prgms[prgm].text && info->size == prgms[prgm].size)
+        return;
+    char rec[9];
+    rec[0] = 'P';
+    memcpy(rec + 1, &prgm, 4);
+    memcpy(rec + 5, &prgms[prgm].size, 4);
+    trace_write(rec, 9);
+    trace_write(prgms[prgm].text, prgms[prgm].size);
+    info->text = prgms[prgm].text;
+    info->size = prgms[prgm].size;
+}
+
+static void trace_instruction(int prgm, int4 instr_pc, int cmd) {
+    trace_program(prgm);
+    if (!trace_to_file)
+        return;
+    char rec[20 + sizeof(phloat)];
+    int2 cmd2 = cmd;
+    int4 depth = sp + 1;
+    rec[0] = 'I';
+    memcpy(rec + 1, &prgm, 4);
+    memcpy(rec + 5, &instr_pc, 4);
+    memcpy(rec + 9, &cmd2, 2);
+    memcpy(rec + 11, &depth, 4);
+    if (sp == -1) {
+        rec[15] = TYPE_NULL;
+        trace_write(rec, 16);
+    } else {
+        rec[15] = stack[sp]->type;
+        if (stack[sp]->type == TYPE_REAL) {
+            memcpy(rec + 16, &((vartype_real *) stack[sp])->x, sizeof(phloat));
+            trace_write(rec, 16 + sizeof(phloat));
+        } else
+            trace_write(rec, 16);
+    }
+}
+
+bool core_trace_open(const char *filename) {
+    core_trace_close();
+    trace_buf = (char *) malloc(TRACE_BUFSIZE);
+    if (trace_buf == NULL)
+        return false;
+    trace_file = fopen(filename, "wb");
+    if (trace_file == NULL) {
+        free(trace_buf);
+        trace_buf = NULL;
+        return false;
+    }
+    trace_to_file = true;
+    int4 header[2] = { TRACE_VERSION, sizeof(phloat) };
+    trace_write(TRACE_MAGIC, 8);
+    trace_write(header, 8);
+    return true;
+}
+
+void core_trace_close() {
+    if (trace_file == NULL)
+        return;
+    // Clear trace_to_file first, so a failure in trace_flush()
+    // doesn't bring us back here
+    trace_to_file = false;
+    if (trace_buf_len > 0)
+        fwrite(trace_buf, 1, trace_buf_len, trace_file);
+    fclose(trace_file);
+    trace_file = NULL;
+    free(trace_buf);
+    trace_buf = NULL;
+    trace_buf_len = 0;
+    free(trace_prgms);
+    trace_prgms = NULL;
+    trace_prgms_capacity = 0;
+}
+
 static void continue_running() {
     int error;
     do {
@@ -4774,14 +5053,18 @@ static void continue_running() {
             set_running(false);
             return;
         }
+        int prgm = current_prgm;
+        int4 instr_pc = pc;
         get_next_command(&pc, &cmd, &arg, 1, NULL);
-        if (flags.f.trace_print && flags.f.printer_exists) {
+        if (flags.f.trace_print && flags.f.printer_exists && !trace_to_file) {
             if (cmd == CMD_LBL)
                 print_text(NULL, 0, true);
             print_program_line(current_prgm, oldpc);
         }
         mode_disable_stack_lift = false;
         error = handle(cmd, &arg);
+        if (flags.f.trace_print && trace_to_file)
+            trace_instruction(prgm, instr_pc, cmd);
         if (mode_pause) {
             shell_request_timeout3(1000);
             return;
@@ -317,6 +317,20 @@ void core_paste(const char *s);
  */
 void core_update_allow_big_stack();
 
+/* core_trace_open()
+ * core_trace_close()
+ *
+ * Start and stop writing a binary execution trace to the file named by the
+ * filename parameter. While the trace file is open, programs running in
+ * TRACE mode write one compact record per executed instruction to it, with
+ * the program, line, command, stack depth, and X, instead of printing
+ * program lines and the X register. The records are buffered, and written
+ * in large blocks. The trace2txt tool turns the file into a listing.
+ * core_trace_open() returns false if the file could not be created.
+ */
+bool core_trace_open(const char *filename);
+void core_trace_close();
+
 /* core_settings
  *
  * This is a struct that stores user-configurable core settings. The shell
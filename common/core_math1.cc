@@ -60,14 +60,41 @@ struct solve_state {
     int prev_sp;
     phloat f_gap;
     int f_gap_worsening_counter;
+    int4 scan_n, scan_i;
+    phloat scan_a, scan_b;
+    phloat scan_px, scan_pf;
+    int scan_pvalid;
+    int4 nroots;
+    phloat *roots;
 };
 
 static solve_state solve;
 
+/* Root scan: when SCAN holds a positive integer n, SOLVE evaluates the
+ * function at n+1 evenly spaced points between the two guesses, and every
+ * sign change it finds is refined into a root by the regular solver. The
+ * roots are returned as a list.
+ */
+#define SCAN_STATE 20
+#define SCAN_MAX 10000
+
 #define ROMB_K 5
 // 1/2 million evals max!
 #define ROMB_MAX 20
 
+/* Integration methods, selected by the optional IMETH variable */
+#define INTEG_ROMBERG 0
+#define INTEG_TANH_SINH 1
+#define INTEG_KRONROD 2
+
+// Tanh-sinh: abscissae for |t| <= DE_TMAX; 16k evals max
+#define DE_TMAX 4
+#define DE_MAX_LEVEL 10
+
+// Gauss-Kronrod: 15 points per interval, 50 intervals max
+#define GK_NODES 15
+#define GK_LIMIT 50
+
 /* Integrator */
 struct integ_state {
     int version;
@@ -93,6 +120,14 @@ struct integ_state {
     phloat prev_int;
     phloat prev_res;
     int prev_sp;
+    int method;
+    int report_evals;
+    int4 evals;
+    phloat resg;
+    phloat fv[GK_NODES];
+    int gk_n;
+    phloat gk_lo[GK_LIMIT], gk_hi[GK_LIMIT];
+    phloat gk_res[GK_LIMIT], gk_err[GK_LIMIT];
 };
 
 static integ_state integ;
@@ -100,6 +135,9 @@ static integ_state integ;
 
 static void reset_solve();
 static void reset_integ();
+static int solve_step(int failure, bool stop);
+static int scan_next();
+static int integ_step(bool stop);
 
 
 bool persist_math() {
@@ -145,6 +183,16 @@ bool persist_math() {
     }
     if (!write_int4(solve.last_disp_time)) return false;
     if (!write_int(solve.prev_sp)) return false;
+    if (!write_int4(solve.scan_n)) return false;
+    if (!write_int4(solve.scan_i)) return false;
+    if (!write_phloat(solve.scan_a)) return false;
+    if (!write_phloat(solve.scan_b)) return false;
+    if (!write_phloat(solve.scan_px)) return false;
+    if (!write_phloat(solve.scan_pf)) return false;
+    if (!write_int(solve.scan_pvalid)) return false;
+    if (!write_int4(solve.nroots)) return false;
+    for (int4 i = 0; i < solve.nroots; i++)
+        if (!write_phloat(solve.roots[i])) return false;
 
     if (!write_int(integ.version)) return false;
     if (fwrite(integ.prgm_name, 1, 7, gfile) != 7) return false;
@@ -185,6 +233,19 @@ bool persist_math() {
     if (!write_phloat(integ.prev_int)) return false;
     if (!write_phloat(integ.prev_res)) return false;
     if (!write_int(integ.prev_sp)) return false;
+    if (!write_int(integ.method)) return false;
+    if (!write_int(integ.report_evals)) return false;
+    if (!write_int4(integ.evals)) return false;
+    if (!write_phloat(integ.resg)) return false;
+    for (int i = 0; i < GK_NODES; i++)
+        if (!write_phloat(integ.fv[i])) return false;
+    if (!write_int(integ.gk_n)) return false;
+    for (int i = 0; i < integ.gk_n; i++) {
+        if (!write_phloat(integ.gk_lo[i])) return false;
+        if (!write_phloat(integ.gk_hi[i])) return false;
+        if (!write_phloat(integ.gk_res[i])) return false;
+        if (!write_phloat(integ.gk_err[i])) return false;
+    }
     return true;
 }
 
@@ -241,6 +302,34 @@ bool unpersist_math(int ver) {
     } else {
         solve.prev_sp = -2;
     }
+    free(solve.roots);
+    solve.roots = NULL;
+    solve.nroots = 0;
+    if (ver >= 50) {
+        if (!read_int4(&solve.scan_n)) return false;
+        if (!read_int4(&solve.scan_i)) return false;
+        if (!read_phloat(&solve.scan_a)) return false;
+        if (!read_phloat(&solve.scan_b)) return false;
+        if (!read_phloat(&solve.scan_px)) return false;
+        if (!read_phloat(&solve.scan_pf)) return false;
+        if (!read_int(&solve.scan_pvalid)) return false;
+        int4 nroots;
+        if (!read_int4(&nroots)) return false;
+        if (solve.scan_n < 0 || solve.scan_n > SCAN_MAX
+                || nroots < 0 || nroots > solve.scan_n + 1
+                || (solve.scan_n == 0 && nroots != 0))
+            return false;
+        if (solve.scan_n > 0) {
+            solve.roots = (phloat *) malloc((solve.scan_n + 1) * sizeof(phloat));
+            if (solve.roots == NULL)
+                return false;
+        }
+        for (int4 i = 0; i < nroots; i++)
+            if (!read_phloat(&solve.roots[i])) return false;
+        solve.nroots = nroots;
+    } else {
+        solve.scan_n = 0;
+    }
 
     if (!read_int(&integ.version)) return false;
     if (fread(integ.prgm_name, 1, 7, gfile) != 7) return false;
@@ -282,6 +371,27 @@ bool unpersist_math(int ver) {
     } else {
         integ.prev_sp = -2;
     }
+    if (ver >= 49) {
+        if (!read_int(&integ.method)) return false;
+        if (!read_int(&integ.report_evals)) return false;
+        if (!read_int4(&integ.evals)) return false;
+        if (!read_phloat(&integ.resg)) return false;
+        for (int i = 0; i < GK_NODES; i++)
+            if (!read_phloat(&integ.fv[i])) return false;
+        if (!read_int(&integ.gk_n)) return false;
+        if (integ.gk_n < 0 || integ.gk_n > GK_LIMIT) return false;
+        for (int i = 0; i < integ.gk_n; i++) {
+            if (!read_phloat(&integ.gk_lo[i])) return false;
+            if (!read_phloat(&integ.gk_hi[i])) return false;
+            if (!read_phloat(&integ.gk_res[i])) return false;
+            if (!read_phloat(&integ.gk_err[i])) return false;
+        }
+    } else {
+        integ.method = INTEG_ROMBERG;
+        integ.report_evals = 0;
+        integ.evals = 0;
+        integ.gk_n = 0;
+    }
     solve.f_gap = NAN_PHLOAT;
 
     return true;
@@ -301,10 +411,176 @@ static void clean_stack(int prev_sp) {
     }
 }
 
+/* Function value memos for SOLVE and INTEG
+ *
+ * When the FMEMO variable exists and is nonzero, the values returned by the
+ * function being solved or integrated are remembered, so that evaluating it
+ * again at the same x, in the same run or in a later one, doesn't run the
+ * program again. This is useful when SOLVE is restarted with the same
+ * guesses, or INTEG is run again with a smaller ACC, and when the function
+ * is expensive to evaluate.
+ * A memo is only valid for one program, one variable being solved or
+ * integrated, and one set of values of the program's other menu variables;
+ * if any of those is different when a new run starts, the memo is cleared.
+ * Any change to any program clears it as well. It is up to the user to
+ * only turn this on for functions that depend on nothing else; functions
+ * that use registers, flags, or random numbers can't be memoized.
+ * The memos are direct-mapped tables; colliding values simply replace each
+ * other. They are not persisted.
+ */
+#define MEMO_SIZE 4096
+#define MEMO_MAX_PARAMS 16
+#define MEMO_HIT -1
+
+struct memo_entry {
+    phloat x, fx;
+    bool used;
+};
+
+struct fn_memo {
+    memo_entry *entries;
+    bool active;
+    char prgm_name[7];
+    int prgm_length;
+    char var_name[7];
+    int var_length;
+    int nparams;
+    char param_name[MEMO_MAX_PARAMS][7];
+    int param_length[MEMO_MAX_PARAMS];
+    phloat param_value[MEMO_MAX_PARAMS];
+};
+
+static fn_memo solve_memo, integ_memo;
+
+void clear_fn_memo() {
+    free(solve_memo.entries);
+    solve_memo.entries = NULL;
+    solve_memo.active = false;
+    free(integ_memo.entries);
+    integ_memo.entries = NULL;
+    integ_memo.active = false;
+}
+
+static void memo_begin(fn_memo *m, const char *prgm_name, int prgm_length,
+                       const char *var_name, int var_length) {
+    m->active = false;
+    vartype *v = recall_var("FMEMO", 5);
+    if (v == NULL || v->type != TYPE_REAL || ((vartype_real *) v)->x == 0)
+        return;
+
+    arg_struct arg;
+    arg.type = ARGTYPE_STR;
+    arg.length = prgm_length;
+    for (int i = 0; i < prgm_length; i++)
+        arg.val.text[i] = prgm_name[i];
+    int prgm;
+    int4 pc;
+    if (!find_global_label(&arg, &prgm, &pc))
+        return;
+    pc += get_command_length(prgm, pc);
+    int saved_prgm = current_prgm;
+    current_prgm = prgm;
+    int nparams = 0;
+    char param_name[MEMO_MAX_PARAMS][7];
+    int param_length[MEMO_MAX_PARAMS];
+    phloat param_value[MEMO_MAX_PARAMS];
+    bool ok = true;
+    while (true) {
+        int command;
+        get_next_command(&pc, &command, &arg, 0, NULL);
+        if (command != CMD_MVAR)
+            break;
+        if (string_equals(arg.val.text, arg.length, var_name, var_length))
+            continue;
+        v = recall_var(arg.val.text, arg.length);
+        if (nparams == MEMO_MAX_PARAMS || v == NULL || v->type != TYPE_REAL) {
+            ok = false;
+            break;
+        }
+        string_copy(param_name[nparams], &param_length[nparams],
+                    arg.val.text, arg.length);
+        param_value[nparams++] = ((vartype_real *) v)->x;
+    }
+    current_prgm = saved_prgm;
+    if (!ok)
+        return;
+
+    bool same = m->entries != NULL
+            && string_equals(m->prgm_name, m->prgm_length, prgm_name, prgm_length)
+            && string_equals(m->var_name, m->var_length, var_name, var_length)
+            && m->nparams == nparams;
+    for (int i = 0; same && i < nparams; i++)
+        same = string_equals(m->param_name[i], m->param_length[i],
+                             param_name[i], param_length[i])
+                && m->param_value[i] == param_value[i];
+    if (!same) {
+        if (m->entries == NULL) {
+            m->entries = (memo_entry *) malloc(MEMO_SIZE * sizeof(memo_entry));
+            if (m->entries == NULL)
+                return;
+        }
+        for (int i = 0; i < MEMO_SIZE; i++)
+            m->entries[i].used = false;
+        string_copy(m->prgm_name, &m->prgm_length, prgm_name, prgm_length);
+        string_copy(m->var_name, &m->var_length, var_name, var_length);
+        m->nparams = nparams;
+        for (int i = 0; i < nparams; i++) {
+            string_copy(m->param_name[i], &m->param_length[i],
+                        param_name[i], param_length[i]);
+            m->param_value[i] = param_value[i];
+        }
+    }
+    m->active = true;
+}
+
+static memo_entry *memo_slot(fn_memo *m, phloat x) {
+    // FNV-1a over the bits of x
+    const unsigned char *p = (const unsigned char *) &x;
+    uint4 h = 2166136261U;
+    for (int i = 0; i < (int) sizeof(phloat); i++)
+        h = (h ^ p[i]) * 16777619U;
+    return m->entries + (h & (MEMO_SIZE - 1));
+}
+
+static bool memo_lookup(fn_memo *m, phloat x, phloat *fx) {
+    if (!m->active)
+        return false;
+    memo_entry *e = memo_slot(m, x);
+    if (!e->used || e->x != x)
+        return false;
+    *fx = e->fx;
+    return true;
+}
+
+static void memo_store(fn_memo *m, phloat x, phloat fx) {
+    if (!m->active)
+        return;
+    memo_entry *e = memo_slot(m, x);
+    e->x = x;
+    e->fx = fx;
+    e->used = true;
+}
+
+/* Puts a remembered function value in X, the way the function would have,
+ * had it been run.
+ */
+static int memo_result(phloat fx, int prev_sp) {
+    clean_stack(prev_sp);
+    vartype *v = new_real(fx);
+    if (v == NULL)
+        return ERR_INSUFFICIENT_MEMORY;
+    int err = recall_result_silently(v);
+    return err == ERR_NONE ? MEMO_HIT : err;
+}
+
 static void reset_solve() {
     int i;
     for (i = 0; i < NUM_SHADOWS; i++)
         solve.shadow_length[i] = 0;
+    free(solve.roots);
+    solve.roots = NULL;
+    solve.nroots = 0;
+    solve.scan_n = 0;
     solve.prgm_length = 0;
     solve.active_prgm_length = 0;
     solve.state = 0;
@@ -387,6 +663,9 @@ static int call_solve_fn(int which, int state) {
         ((vartype_real *) v)->x = x;
     solve.which = which;
     solve.state = state;
+    phloat fx;
+    if (memo_lookup(&solve_memo, x, &fx))
+        return memo_result(fx, solve.prev_sp);
     arg.type = ARGTYPE_STR;
     arg.length = solve.active_prgm_length;
     for (i = 0; i < arg.length; i++)
@@ -406,15 +685,7 @@ static int call_solve_fn(int which, int state) {
         return ERR_RUN;
 }
 
-int start_solve(const char *name, int length, phloat x1, phloat x2) {
-    if (solve_active())
-        return ERR_SOLVE_SOLVE;
-    string_copy(solve.var_name, &solve.var_length, name, length);
-    string_copy(solve.active_prgm_name, &solve.active_prgm_length,
-                solve.prgm_name, solve.prgm_length);
-    solve.prev_prgm = current_prgm;
-    solve.prev_pc = pc;
-    solve.prev_sp = flags.f.big_stack ? sp : -2;
+static void setup_solve(phloat x1, phloat x2) {
     if (x1 == x2) {
         if (x1 == 0) {
             x2 = 1;
@@ -444,8 +715,135 @@ int start_solve(const char *name, int length, phloat x1, phloat x2) {
     solve.toggle = 1;
     solve.secant_impatience = 0;
     solve.f_gap = NAN_PHLOAT;
+}
+
+int start_solve(const char *name, int length, phloat x1, phloat x2) {
+    if (solve_active())
+        return ERR_SOLVE_SOLVE;
+    int4 n = 0;
+    vartype *v = recall_var("SCAN", 4);
+    if (v != NULL) {
+        if (v->type == TYPE_STRING)
+            return ERR_ALPHA_DATA_IS_INVALID;
+        else if (v->type != TYPE_REAL)
+            return ERR_INVALID_TYPE;
+        phloat x = ((vartype_real *) v)->x;
+        if (x < 0 || x > SCAN_MAX || x != floor(x))
+            return ERR_INVALID_DATA;
+        n = to_int4(x);
+    }
+    free(solve.roots);
+    solve.roots = NULL;
+    solve.nroots = 0;
+    if (n > 0) {
+        if (x1 == x2)
+            return ERR_INVALID_DATA;
+        solve.roots = (phloat *) malloc((n + 1) * sizeof(phloat));
+        if (solve.roots == NULL)
+            return ERR_INSUFFICIENT_MEMORY;
+    }
+    string_copy(solve.var_name, &solve.var_length, name, length);
+    string_copy(solve.active_prgm_name, &solve.active_prgm_length,
+                solve.prgm_name, solve.prgm_length);
+    solve.prev_prgm = current_prgm;
+    solve.prev_pc = pc;
+    solve.prev_sp = flags.f.big_stack ? sp : -2;
     solve.keep_running = !should_i_stop_at_this_level() && program_running();
-    return call_solve_fn(1, 1);
+    memo_begin(&solve_memo, solve.active_prgm_name, solve.active_prgm_length,
+               solve.var_name, solve.var_length);
+    int err;
+    solve.scan_n = n;
+    if (n > 0) {
+        solve.scan_a = x1 < x2 ? x1 : x2;
+        solve.scan_b = x1 < x2 ? x2 : x1;
+        solve.scan_i = 0;
+        solve.scan_pvalid = 0;
+        err = scan_next();
+    } else {
+        setup_solve(x1, x2);
+        err = call_solve_fn(1, 1);
+    }
+    while (err == MEMO_HIT)
+        err = solve_step(0, false);
+    return err;
+}
+
+/* Evaluates the function at the next grid point, or, when the whole interval
+ * has been scanned, returns the roots that were found.
+ */
+static int scan_next() {
+    if (solve.scan_i <= solve.scan_n) {
+        if (solve.scan_i == solve.scan_n)
+            solve.x3 = solve.scan_b;
+        else
+            solve.x3 = solve.scan_a + (solve.scan_b - solve.scan_a)
+                                        * solve.scan_i / solve.scan_n;
+        return call_solve_fn(3, SCAN_STATE);
+    }
+
+    solve.state = 0;
+    solve.scan_n = 0;
+    clean_stack(solve.prev_sp);
+    vartype *list = new_list(solve.nroots);
+    if (list == NULL)
+        return ERR_INSUFFICIENT_MEMORY;
+    vartype **data = ((vartype_list *) list)->array->data;
+    for (int4 i = 0; i < solve.nroots; i++) {
+        data[i] = new_real(solve.roots[i]);
+        if (data[i] == NULL) {
+            free_vartype(list);
+            return ERR_INSUFFICIENT_MEMORY;
+        }
+    }
+    if (solve.nroots > 0) {
+        vartype *v = recall_var(solve.var_name, solve.var_length);
+        if (v != NULL && v->type == TYPE_REAL)
+            ((vartype_real *) v)->x = solve.roots[0];
+    }
+    free(solve.roots);
+    solve.roots = NULL;
+    solve.nroots = 0;
+    if (recall_result(list) != ERR_NONE)
+        return ERR_INSUFFICIENT_MEMORY;
+
+    current_prgm = solve.prev_prgm;
+    pc = solve.prev_pc;
+    flags.f.message = 0;
+    flags.f.two_line_message = 0;
+    return solve.keep_running ? ERR_NONE : ERR_STOP;
+}
+
+/* Handles a function value at a grid point. Exact zeros are roots; a sign
+ * change between two consecutive points starts the regular solver on that
+ * bracket, which comes back to the scan through finish_solve().
+ */
+static int scan_step(int failure) {
+    phloat f = 0;
+    bool valid = false;
+    if (!failure) {
+        if (sp == -1)
+            return ERR_TOO_FEW_ARGUMENTS;
+        if (stack[sp]->type == TYPE_REAL) {
+            f = ((vartype_real *) stack[sp])->x;
+            memo_store(&solve_memo, solve.curr_x, f);
+            valid = true;
+        }
+    }
+    phloat x = solve.x3;
+    phloat px = solve.scan_px;
+    bool bracket = valid && solve.scan_pvalid && f != 0 && solve.scan_pf != 0
+                    && (f > 0) != (solve.scan_pf > 0);
+    if (valid && f == 0)
+        solve.roots[solve.nroots++] = x;
+    solve.scan_px = x;
+    solve.scan_pf = f;
+    solve.scan_pvalid = valid;
+    solve.scan_i++;
+    if (bracket) {
+        setup_solve(px, x);
+        return call_solve_fn(1, 1);
+    }
+    return scan_next();
 }
 
 struct message_spec {
@@ -507,6 +905,16 @@ static int finish_solve(int message) {
 
     phloat b = solve.which == 1 ? solve.x1 :
                                 solve.which == 2 ? solve.x2 : solve.x3;
+
+    if (solve.scan_n > 0) {
+        /* Refining a bracket found by the root scan; anything other than a
+         * root, like a sign reversal at a pole, is dropped.
+         */
+        if (message == SOLVE_ROOT)
+            solve.roots[solve.nroots++] = b;
+        return scan_next();
+    }
+
     phloat s;
     if (p_isinf(solve.best_f))
         s = b;
@@ -598,6 +1006,13 @@ static void track_f_gap() {
 }
 
 int return_to_solve(int failure, bool stop) {
+    int err = solve_step(failure, stop);
+    while (err == MEMO_HIT)
+        err = solve_step(0, false);
+    return err;
+}
+
+static int solve_step(int failure, bool stop) {
     phloat f, slope, s, xnew, prev_f = solve.curr_f;
     uint4 now_time;
 
@@ -606,12 +1021,15 @@ int return_to_solve(int failure, bool stop) {
 
     if (solve.state == 0)
         return ERR_INTERNAL_ERROR;
+    if (solve.state == SCAN_STATE)
+        return scan_step(failure);
     if (!failure) {
         if (sp == -1)
             return ERR_TOO_FEW_ARGUMENTS;
         if (stack[sp]->type == TYPE_REAL) {
             f = ((vartype_real *) stack[sp])->x;
             solve.curr_f = f;
+            memo_store(&solve_memo, solve.curr_x, f);
             if (f == 0)
                 return finish_solve(SOLVE_ROOT);
             if (fabs(f) < fabs(solve.best_f)) {
@@ -1071,6 +1489,9 @@ static int call_integ_fn() {
         }
     } else
         ((vartype_real *) v)->x = x;
+    phloat fx;
+    if (memo_lookup(&integ_memo, x, &fx))
+        return memo_result(fx, integ.prev_sp);
     arg.type = ARGTYPE_STR;
     arg.length = integ.active_prgm_length;
     for (i = 0; i < arg.length; i++)
@@ -1081,6 +1502,7 @@ static int call_integ_fn() {
         free_vartype(v);
         return err;
     }
+    integ.evals++;
     err = push_rtn_addr(-3, 0);
     if (err != ERR_NONE) {
         current_prgm = integ.prev_prgm;
@@ -1121,6 +1543,21 @@ int start_integ(const char *name, int length) {
         integ.acc = ((vartype_real *) v)->x;
     if (integ.acc < 0)
         integ.acc = 0;
+    v = recall_var("IMETH", 5);
+    if (v == NULL)
+        integ.method = INTEG_ROMBERG;
+    else if (v->type == TYPE_STRING)
+        return ERR_ALPHA_DATA_IS_INVALID;
+    else if (v->type != TYPE_REAL)
+        return ERR_INVALID_TYPE;
+    else {
+        phloat m = ((vartype_real *) v)->x;
+        if (m < INTEG_ROMBERG || m > INTEG_KRONROD)
+            return ERR_INVALID_DATA;
+        integ.method = to_int(m);
+    }
+    integ.report_evals = v != NULL;
+    integ.evals = 0;
     string_copy(integ.var_name, &integ.var_length, name, length);
     string_copy(integ.active_prgm_name, &integ.active_prgm_length,
                 integ.prgm_name, integ.prgm_length);
@@ -1130,14 +1567,37 @@ int start_integ(const char *name, int length) {
 
     integ.a = integ.llim;
     integ.b = integ.ulim - integ.llim;
-    integ.h = 2;
-    integ.prev_int = 0;
-    integ.nsteps = 1;
-    integ.n = 1;
-    integ.state = 1;
-    integ.s[0] = 0;
-    integ.k = 1;
     integ.prev_res = 0;
+    integ.gk_n = 0;
+    switch (integ.method) {
+    case INTEG_ROMBERG:
+        integ.h = 2;
+        integ.prev_int = 0;
+        integ.nsteps = 1;
+        integ.n = 1;
+        integ.state = 1;
+        integ.s[0] = 0;
+        integ.k = 1;
+        break;
+    case INTEG_TANH_SINH:
+        integ.h = 0.5;
+        integ.nsteps = DE_TMAX * 2;
+        integ.i = -integ.nsteps;
+        integ.m = 1;
+        integ.n = 0;
+        integ.sum = 0;
+        integ.state = 3;
+        break;
+    case INTEG_KRONROD:
+        integ.gk_lo[0] = integ.llim;
+        integ.gk_hi[0] = integ.ulim;
+        integ.gk_n = 1;
+        integ.k = 0;
+        integ.m = -1;
+        integ.i = 0;
+        integ.state = 5;
+        break;
+    }
 
     integ.keep_running = !should_i_stop_at_this_level() && program_running();
     if (!integ.keep_running) {
@@ -1147,16 +1607,32 @@ int start_integ(const char *name, int length) {
         flags.f.message = 1;
         flags.f.two_line_message = 0;
     }
+    memo_begin(&integ_memo, integ.active_prgm_name, integ.active_prgm_length,
+               integ.var_name, integ.var_length);
     return return_to_integ(false);
 }
 
-static int finish_integ() {
+static int finish_integ(phloat res) {
     vartype *x, *y;
     int saved_trace = flags.f.trace_print;
     integ.state = 0;
 
     clean_stack(integ.prev_sp);
-    x = new_real(integ.sum * integ.b * 0.75);
+    if (integ.report_evals) {
+        /* When the method was chosen explicitly, through IMETH, the
+         * number of times the integrand was evaluated is returned in
+         * IEVAL, so programs can compare the methods.
+         */
+        vartype *n = new_real(integ.evals);
+        if (n == NULL)
+            return ERR_INSUFFICIENT_MEMORY;
+        int err = store_var("IEVAL", 5, n);
+        if (err != ERR_NONE) {
+            free_vartype(n);
+            return err;
+        }
+    }
+    x = new_real(res);
     y = new_real(integ.eps);
     if (x == NULL || y == NULL) {
         free_vartype(x);
@@ -1189,12 +1665,127 @@ static int finish_integ() {
 }
 
 
+static int integ_fn_value() {
+    if (sp == -1)
+        return ERR_TOO_FEW_ARGUMENTS;
+    if (stack[sp]->type == TYPE_STRING)
+        return ERR_ALPHA_DATA_IS_INVALID;
+    else if (stack[sp]->type != TYPE_REAL)
+        return ERR_INVALID_TYPE;
+    memo_store(&integ_memo, integ.u, ((vartype_real *) stack[sp])->x);
+    return ERR_NONE;
+}
+
+/* Tanh-sinh node number integ.i at step size integ.h: sets integ.u to the
+ * abscissa and integ.t to the weight, times h. The distance to the nearest
+ * endpoint is computed directly, rather than as 1 - tanh(...), so the nodes
+ * can crowd towards the endpoints without cancellation. Nodes that are so
+ * close to an endpoint that they would round to it are skipped; this keeps
+ * the endpoints themselves from ever being evaluated, and also makes the
+ * range of abscissae adapt to the precision of phloat.
+ */
+static bool de_node() {
+    phloat t = integ.h * integ.i;
+    phloat s = PI / 2 * sinh(t);
+    phloat c = cosh(s);
+    phloat d = 1 / (exp(fabs(s)) * c);
+    integ.t = integ.h * PI / 2 * cosh(t) / (c * c);
+    if (t < 0)
+        integ.u = integ.llim + integ.b / 2 * d;
+    else
+        integ.u = integ.ulim - integ.b / 2 * d;
+    return integ.t != 0 && integ.u != integ.llim && integ.u != integ.ulim;
+}
+
+/* Kronrod 15-point abscissae and weights, and the weights of the embedded
+ * 7-point Gauss rule, which uses the odd-numbered abscissae.
+ */
+#ifdef BCD_MATH
+#define GK_CONST(x) Phloat(#x)
+#else
+#define GK_CONST(x) x
+#endif
+
+static phloat gk_x[8] = {
+    GK_CONST(0.991455371120812639206854697526329),
+    GK_CONST(0.949107912342758524526189684047851),
+    GK_CONST(0.864864423359769072789712788640926),
+    GK_CONST(0.741531185599394439863864773280788),
+    GK_CONST(0.586087235467691130294144845693013),
+    GK_CONST(0.405845151377397166906606412076961),
+    GK_CONST(0.207784955007898467600689403773245),
+    GK_CONST(0.000000000000000000000000000000000)
+};
+
+static phloat gk_wk[8] = {
+    GK_CONST(0.022935322010529224963732008058970),
+    GK_CONST(0.063092092629978553290700663189204),
+    GK_CONST(0.104790010322250183839876322541518),
+    GK_CONST(0.140653259715525918745189590510238),
+    GK_CONST(0.169004726639267902826583426598550),
+    GK_CONST(0.190350578064785409913256402421014),
+    GK_CONST(0.204432940075298892414161999234649),
+    GK_CONST(0.209482141084727828012999174891714)
+};
+
+static phloat gk_wg[4] = {
+    GK_CONST(0.129484966168869693270611432679082),
+    GK_CONST(0.279705391489276667901467771423780),
+    GK_CONST(0.381830050505118944950369775488975),
+    GK_CONST(0.417959183673469387755102040816327)
+};
+
+/* Combines the function values in integ.fv, which are ordered center first,
+ * then left and right of the center for each abscissa in gk_x, into the
+ * Kronrod estimate and the error estimate for interval integ.k. The error
+ * estimate is scaled the same way as in QUADPACK's QK15, which makes it
+ * far less pessimistic than the bare Gauss-Kronrod difference for smooth
+ * integrands.
+ */
+static void gk_finish_interval() {
+    int s = integ.k;
+    phloat hl = (integ.gk_hi[s] - integ.gk_lo[s]) / 2;
+    phloat resk = gk_wk[7] * integ.fv[0];
+    integ.resg = gk_wg[3] * integ.fv[0];
+    for (int j = 0; j < 7; j++) {
+        phloat f2 = integ.fv[2 * j + 1] + integ.fv[2 * j + 2];
+        resk += gk_wk[j] * f2;
+        if ((j & 1) != 0)
+            integ.resg += gk_wg[j / 2] * f2;
+    }
+    phloat reskh = resk / 2;
+    phloat resasc = gk_wk[7] * fabs(integ.fv[0] - reskh);
+    for (int j = 0; j < 7; j++)
+        resasc += gk_wk[j] * (fabs(integ.fv[2 * j + 1] - reskh)
+                                + fabs(integ.fv[2 * j + 2] - reskh));
+    resasc *= fabs(hl);
+    phloat err = fabs((resk - integ.resg) * hl);
+    if (resasc != 0 && err != 0) {
+        phloat q = pow(200 * err / resasc, 1.5);
+        err = q < 1 ? resasc * q : resasc;
+    }
+    integ.gk_res[s] = resk * hl;
+    integ.gk_err[s] = err;
+}
+
 /* approximate integral of `f' between `a' and `b' subject to a given
  * error. Use Romberg method with refinement substitution, x = (3u-u^3)/2
  * which prevents endpoint evaluation and causes non-uniform sampling.
+ * Alternatively, when IMETH is 1 or 2, use tanh-sinh quadrature, where each
+ * level halves the step size and only evaluates the new nodes, or globally
+ * adaptive 7/15-point Gauss-Kronrod quadrature, where the interval with the
+ * largest error estimate is bisected until the total error estimate is
+ * within ACC.
  */
 
 int return_to_integ(bool stop) {
+    int err = integ_step(stop);
+    while (err == MEMO_HIT)
+        err = integ_step(false);
+    return err;
+}
+
+static int integ_step(bool stop) {
     if (stop)
         integ.keep_running = 0;
 
@@ -1218,13 +1809,10 @@ int return_to_integ(bool stop) {
         integ.u = (integ.u * integ.b + integ.b) / 2 + integ.a;
         return call_integ_fn();
 
-    case 2:
-        if (sp == -1)
-            return ERR_TOO_FEW_ARGUMENTS;
-        if (stack[sp]->type == TYPE_STRING)
-            return ERR_ALPHA_DATA_IS_INVALID;
-        else if (stack[sp]->type != TYPE_REAL)
-            return ERR_INVALID_TYPE;
+    case 2: {
+        int err = integ_fn_value();
+        if (err != ERR_NONE)
+            return err;
         integ.sum += integ.t * ((vartype_real *) stack[sp])->x;
         integ.p += integ.h;
         if (++integ.i < integ.nsteps)
@@ -1252,7 +1840,7 @@ int return_to_integ(bool stop) {
             integ.prev_res = res;
             if (integ.eps <= integ.acc * fabs(res))
                 // done!
-                return finish_integ();
+                return finish_integ(res);
 
             for (i = 0; i < ROMB_K-1; ++i) integ.s[i] = integ.s[i+1];
             integ.k = ROMB_K-1;
@@ -1262,9 +1850,110 @@ int return_to_integ(bool stop) {
         integ.h /= 2.0;
 
         if (++integ.n >= ROMB_MAX)
-            return finish_integ(); // too many
+            // too many
+            return finish_integ(integ.sum * integ.b * 0.75);
 
         goto loop1;
+    }
+
+    case 3:
+        // Tanh-sinh
+        integ.state = 4;
+
+    de_loop:
+
+        while (integ.i <= integ.nsteps) {
+            if (de_node())
+                return call_integ_fn();
+            integ.i += integ.m;
+        }
+        {
+            phloat res = integ.sum * integ.b / 2;
+            if (integ.n > 0) {
+                integ.eps = fabs(integ.prev_res - res);
+                if (integ.eps <= integ.acc * fabs(res))
+                    return finish_integ(res);
+            }
+            integ.prev_res = res;
+            if (++integ.n >= DE_MAX_LEVEL)
+                return finish_integ(res);
+        }
+        // Next level: halve the step and add the nodes in between
+        integ.h /= 2;
+        integ.sum /= 2;
+        integ.nsteps *= 2;
+        integ.i = 1 - integ.nsteps;
+        integ.m = 2;
+        goto de_loop;
+
+    case 4: {
+        int err = integ_fn_value();
+        if (err != ERR_NONE)
+            return err;
+        integ.sum += integ.t * ((vartype_real *) stack[sp])->x;
+        integ.i += integ.m;
+        goto de_loop;
+    }
+
+    case 5:
+        // Gauss-Kronrod
+        integ.state = 6;
+
+    gk_loop:
+
+        if (integ.i < GK_NODES) {
+            int s = integ.k;
+            phloat c = (integ.gk_lo[s] + integ.gk_hi[s]) / 2;
+            phloat hl = (integ.gk_hi[s] - integ.gk_lo[s]) / 2;
+            if (integ.i == 0)
+                integ.u = c;
+            else if ((integ.i & 1) != 0)
+                integ.u = c - hl * gk_x[(integ.i - 1) / 2];
+            else
+                integ.u = c + hl * gk_x[(integ.i - 1) / 2];
+            return call_integ_fn();
+        }
+        gk_finish_interval();
+        if (integ.m != -1) {
+            integ.k = integ.m;
+            integ.m = -1;
+            integ.i = 0;
+            goto gk_loop;
+        } else {
+            phloat res = 0;
+            int w = 0;
+            integ.eps = 0;
+            for (int s = 0; s < integ.gk_n; s++) {
+                res += integ.gk_res[s];
+                integ.eps += integ.gk_err[s];
+                if (integ.gk_err[s] > integ.gk_err[w])
+                    w = s;
+            }
+            if (integ.eps <= integ.acc * fabs(res) || integ.gk_n == GK_LIMIT)
+                return finish_integ(res);
+            // Bisect the interval with the largest error estimate
+            phloat lo = integ.gk_lo[w];
+            phloat hi = integ.gk_hi[w];
+            phloat mid = (lo + hi) / 2;
+            if (mid == lo || mid == hi)
+                return finish_integ(res);
+            integ.gk_hi[w] = mid;
+            integ.gk_lo[integ.gk_n] = mid;
+            integ.gk_hi[integ.gk_n] = hi;
+            integ.k = w;
+            integ.m = integ.gk_n++;
+            integ.i = 0;
+            goto gk_loop;
+        }
+
+    case 6: {
+        int err = integ_fn_value();
+        if (err != ERR_NONE)
+            return err;
+        integ.fv[integ.i++] = ((vartype_real *) stack[sp])->x;
+        goto gk_loop;
+    }
+
     default:
         return ERR_INTERNAL_ERROR;
     }
@@ -24,6 +24,7 @@
 bool persist_math();
 bool unpersist_math(int ver);
 void reset_math();
+void clear_fn_memo();
 
 void put_shadow(const char *name, int length, phloat value);
 int get_shadow(const char *name, int length, phloat *value);
@@ -30,42 +30,50 @@ phloat math_random() {
     int8 temp = random_number_low * 30928467;
     random_number_high = (random_number_low * 28511 + random_number_high * 30928467 + temp / 100000000) % 10000000;
     random_number_low = temp % 100000000;
+#ifdef BCD_MATH
+    /* The result is the 15-digit number high:low, scaled to [0, 1[ and
+     * truncated to 12 significant digits. Since that is exactly
+     * representable, it can be built directly from an integer and an
+     * exponent, instead of through two divisions and an addition.
+     */
+    int8 m;
+    int e;
+    if (random_number_high >= 1000000) {
+        m = random_number_high * 100000 + random_number_low / 1000;
+        e = 12;
+    } else if (random_number_high >= 100000) {
+        m = random_number_high * 1000000 + random_number_low / 100;
+        e = 13;
+    } else if (random_number_high >= 10000) {
+        m = random_number_high * 10000000 + random_number_low / 10;
+        e = 14;
+    } else {
+        m = random_number_high * 100000000 + random_number_low;
+        e = 15;
+    }
+    return scalbn(Phloat(m), -e);
+#else
     if (random_number_high >= 1000000) {
         temp = random_number_low / 1000;
-        #ifdef BCD_MATH
-            const Phloat n1(1000000000000LL);
-            const Phloat n2(10000000);
-            return Phloat(temp) / n1 + Phloat(random_number_high) / n2;
-        #else
-            return temp / 1000000000000.0 + random_number_high / 10000000.0;
-        #endif
+        return temp / 1000000000000.0 + random_number_high / 10000000.0;
     } else if (random_number_high >= 100000) {
         temp = random_number_low / 100;
-        #ifdef BCD_MATH
-            const Phloat n1(10000000000000LL);
-            const Phloat n2(10000000);
-            return Phloat(temp) / n1 + Phloat(random_number_high) / n2;
-        #else
-            return temp / 10000000000000.0 + random_number_high / 10000000.0;
-        #endif
+        return temp / 10000000000000.0 + random_number_high / 10000000.0;
     } else if (random_number_high >= 10000) {
         temp = random_number_low / 10;
-        #ifdef BCD_MATH
-            const Phloat n1(100000000000000LL);
-            const Phloat n2(10000000);
-            return Phloat(temp) / n1 + Phloat(random_number_high) / n2;
-        #else
-            return temp / 100000000000000.0 + random_number_high / 10000000.0;
-        #endif
+        return temp / 100000000000000.0 + random_number_high / 10000000.0;
     } else {
-        #ifdef BCD_MATH
-            const Phloat n1(1000000000000000LL);
-            const Phloat n2(10000000);
-            return Phloat(random_number_low) / n1 + Phloat(random_number_high) / n2;
-        #else
-            return random_number_low / 1000000000000000.0 + random_number_high / 10000000.0;
-        #endif
+        return random_number_low / 1000000000000000.0 + random_number_high / 10000000.0;
     }
+#endif
+}
+
+/* Fills an array with the same numbers n consecutive calls to math_random()
+ * would return.
+ */
+void math_random_fill(phloat *data, int4 n) {
+    for (int4 i = 0; i < n; i++)
+        data[i] = math_random();
 }
 
 int math_tan(phloat x, phloat *y, bool rad) {
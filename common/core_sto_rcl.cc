@@ -36,6 +36,9 @@ static int apply_sto_operation(char operation, vartype *oldval, bool trace_stk)
     int error = assert_numeric(oldval);
     if (error != ERR_NONE)
         return error;
+    /* Sparse matrices only support * and /, and only as operators */
+    if (stack[sp]->type == TYPE_SPARSE)
+        return ERR_INVALID_TYPE;
     if (!ensure_var_space(1))
         return ERR_INSUFFICIENT_MEMORY;
     vartype *newval;
@@ -90,7 +93,7 @@ int generic_rcl(arg_struct *arg, vartype **dst) {
                 int4 index = arg->val.num;
                 if (index >= size)
                     return ERR_SIZE_ERROR;
-                if (rm->array->is_string[index] == 0) {
+                if (rm->array->str_type(index) == 0) {
                     *dst = new_real(rm->array->data[index]);
                 } else {
                     char *text;
@@ -228,14 +231,15 @@ int generic_sto(arg_struct *arg, char operation) {
                     if (!disentangle((vartype *) rm))
                         return ERR_INSUFFICIENT_MEMORY;
                     if (operation == 0) {
-                        if (rm->array->is_string[num] == 2)
+                        if (rm->array->str_type(num) == 2)
                             free(*(void **) &rm->array->data[num]);
                         rm->array->data[num] = ((vartype_real *) stack[sp])->x;
-                        rm->array->is_string[num] = 0;
+                        if (rm->array->is_string != NULL)
+                            rm->array->is_string[num] = 0;
                     } else {
                         phloat x, n;
                         int inf;
-                        if (rm->array->is_string[num] != 0)
+                        if (rm->array->str_type(num) != 0)
                             return ERR_ALPHA_DATA_IS_INVALID;
                         x = ((vartype_real *) stack[sp])->x;
                         n = rm->array->data[num];
@@ -464,6 +468,97 @@ int generic_sto(arg_struct *arg, char operation) {
     }
 }
 
+/* In binary builds, the arithmetic operators are cheap enough that they are
+ * never worth parallelizing; memory bandwidth is the bottleneck. In decimal
+ * builds, each BID128 operation costs about as much as a short function
+ * evaluation, so they are split across threads like everything else.
+ */
+#ifdef BCD_MATH
+#define ARITH_PARALLEL_THRESHOLD MAP_PARALLEL_THRESHOLD
+#else
+#define ARITH_PARALLEL_THRESHOLD 0x7fffffff
+#endif
+
+static int div_rr(phloat x, phloat y, phloat *z);
+static int mul_rr(phloat x, phloat y, phloat *z);
+static int sub_rr(phloat x, phloat y, phloat *z);
+static int add_rr(phloat x, phloat y, phloat *z);
+
+#ifndef BCD_MATH
+/* In the binary build, +, -, and * on real matrices are done in two passes:
+ * first the plain arithmetic, in loops without branches, which the compiler
+ * can turn into SIMD code, and then a check for overflows on the results.
+ * An overflow on any element produces the same error, or the same clamped
+ * value, as the element-by-element operators would.
+ */
+template <typename OP>
+static int arith_rr(OP op, const phloat *x, int xstep,
+                    const phloat *y, int ystep, phloat *z, int4 n) {
+    if (xstep == 0) {
+        phloat xx = *x;
+        for (int4 i = 0; i < n; i++)
+            z[i] = op(xx, y[i]);
+    } else if (ystep == 0) {
+        phloat yy = *y;
+        for (int4 i = 0; i < n; i++)
+            z[i] = op(x[i], yy);
+    } else {
+        for (int4 i = 0; i < n; i++)
+            z[i] = op(x[i], y[i]);
+    }
+    bool overflow = false;
+    for (int4 i = 0; i < n; i++)
+        overflow |= fabs(z[i]) == HUGE_VAL;
+    if (!overflow)
+        return ERR_NONE;
+    if (!flags.f.range_error_ignore)
+        return ERR_OUT_OF_RANGE;
+    for (int4 i = 0; i < n; i++) {
+        int inf = p_isinf(z[i]);
+        if (inf != 0)
+            z[i] = inf == 1 ? POS_HUGE_PHLOAT : NEG_HUGE_PHLOAT;
+    }
+    return ERR_NONE;
+}
+#endif
+
+/* Applies mrr to real matrices or scalars x and y, where a scalar has step
+ * 0, storing the results in z. The arithmetic operators get loops of their
+ * own, so they can be inlined instead of being called through a pointer for
+ * every element.
+ */
+static int map_rr(mappable_rr mrr, const phloat *x, int xstep,
+                  const phloat *y, int ystep, phloat *z, int4 n) {
+#ifndef BCD_MATH
+    if (mrr == add_rr)
+        return arith_rr([](phloat a, phloat b) { return b + a; }, x, xstep, y, ystep, z, n);
+    else if (mrr == sub_rr)
+        return arith_rr([](phloat a, phloat b) { return b - a; }, x, xstep, y, ystep, z, n);
+    else if (mrr == mul_rr)
+        return arith_rr([](phloat a, phloat b) { return b * a; }, x, xstep, y, ystep, z, n);
+#endif
+    if (mrr == add_rr)
+        return map_elements(n, [=](int4 i) {
+            return add_rr(x[i * xstep], y[i * ystep], z + i);
+        }, ARITH_PARALLEL_THRESHOLD);
+    else if (mrr == sub_rr)
+        return map_elements(n, [=](int4 i) {
+            return sub_rr(x[i * xstep], y[i * ystep], z + i);
+        }, ARITH_PARALLEL_THRESHOLD);
+    else if (mrr == mul_rr)
+        return map_elements(n, [=](int4 i) {
+            return mul_rr(x[i * xstep], y[i * ystep], z + i);
+        }, ARITH_PARALLEL_THRESHOLD);
+    else if (mrr == div_rr)
+        return map_elements(n, [=](int4 i) {
+            return div_rr(x[i * xstep], y[i * ystep], z + i);
+        }, ARITH_PARALLEL_THRESHOLD);
+    else
+        return map_elements(n, [=](int4 i) {
+            return mrr(x[i * xstep], y[i * ystep], z + i);
+        });
+}
+
 int map_unary(const vartype *src, vartype **dst, mappable_r mr, mappable_c mc) {
     int error;
     switch (src->type) {
@@ -499,12 +594,12 @@ int map_unary(const vartype *src, vartype **dst, mappable_r mr, mappable_c mc) {
                 return ERR_ALPHA_DATA_IS_INVALID;
             }
             int4 size = sm->rows * sm->columns;
-            for (int4 i = 0; i < size; i++) {
-                int error = mr(sm->array->data[i], &dm->array->data[i]);
-                if (error != ERR_NONE) {
-                    free_vartype((vartype *) dm);
-                    return error;
-                }
+            error = map_elements(size, [&](int4 i) {
+                return mr(sm->array->data[i], &dm->array->data[i]);
+            });
+            if (error != ERR_NONE) {
+                free_vartype((vartype *) dm);
+                return error;
             }
             *dst = (vartype *) dm;
             return ERR_NONE;
@@ -576,14 +671,11 @@ int map_binary(const vartype *src1, const vartype *src2, vartype **dst,
                         return ERR_ALPHA_DATA_IS_INVALID;
                     }
                     int4 size = sm->rows * sm->columns;
-                    for (int4 i = 0; i < size; i++) {
-                        int error = mrr(((vartype_real *) src1)->x,
-                                    sm->array->data[i],
-                                    &dm->array->data[i]);
-                        if (error != ERR_NONE) {
-                            free_vartype((vartype *) dm);
-                            return error;
-                        }
+                    error = map_rr(mrr, &((vartype_real *) src1)->x, 0,
+                                   sm->array->data, 1, dm->array->data, size);
+                    if (error != ERR_NONE) {
+                        free_vartype((vartype *) dm);
+                        return error;
                     }
                     *dst = (vartype *) dm;
                     return ERR_NONE;
@@ -595,17 +687,17 @@ int map_binary(const vartype *src1, const vartype *src2, vartype **dst,
                                     new_complexmatrix(sm->rows, sm->columns);
                     if (dm == NULL)
                         return ERR_INSUFFICIENT_MEMORY;
-                    int4 size = 2 * sm->rows * sm->columns;
-                    for (int4 i = 0; i < size; i += 2) {
-                        int error = mrc(((vartype_real *) src1)->x,
-                                        sm->array->data[i],
-                                        sm->array->data[i + 1],
-                                        &dm->array->data[i],
-                                        &dm->array->data[i + 1]);
-                        if (error != ERR_NONE) {
-                            free_vartype((vartype *) dm);
-                            return error;
-                        }
+                    int4 size = sm->rows * sm->columns;
+                    error = map_elements(size, [&](int4 i) {
+                        return mrc(((vartype_real *) src1)->x,
+                                   sm->array->data[i * 2],
+                                   sm->array->data[i * 2 + 1],
+                                   &dm->array->data[i * 2],
+                                   &dm->array->data[i * 2 + 1]);
+                    });
+                    if (error != ERR_NONE) {
+                        free_vartype((vartype *) dm);
+                        return error;
                     }
                     *dst = (vartype *) dm;
                     return ERR_NONE;
@@ -654,16 +746,16 @@ int map_binary(const vartype *src1, const vartype *src2, vartype **dst,
                         return ERR_ALPHA_DATA_IS_INVALID;
                     }
                     int4 size = sm->rows * sm->columns;
-                    for (int4 i = 0; i < size; i++) {
-                        int error = mcr(((vartype_complex *) src1)->re,
-                                    ((vartype_complex *) src1)->im,
-                                    sm->array->data[i],
-                                    &dm->array->data[i * 2],
-                                    &dm->array->data[i * 2 + 1]);
-                        if (error != ERR_NONE) {
-                            free_vartype((vartype *) dm);
-                            return error;
-                        }
+                    error = map_elements(size, [&](int4 i) {
+                        return mcr(((vartype_complex *) src1)->re,
+                                   ((vartype_complex *) src1)->im,
+                                   sm->array->data[i],
+                                   &dm->array->data[i * 2],
+                                   &dm->array->data[i * 2 + 1]);
+                    });
+                    if (error != ERR_NONE) {
+                        free_vartype((vartype *) dm);
+                        return error;
                     }
                     *dst = (vartype *) dm;
                     return ERR_NONE;
@@ -675,18 +767,18 @@ int map_binary(const vartype *src1, const vartype *src2, vartype **dst,
                                     new_complexmatrix(sm->rows, sm->columns);
                     if (dm == NULL)
                         return ERR_INSUFFICIENT_MEMORY;
-                    int4 size = 2 * sm->rows * sm->columns;
-                    for (int4 i = 0; i < size; i += 2) {
-                        int error = mcc(((vartype_complex *) src1)->re,
-                                        ((vartype_complex *) src1)->im,
-                                        sm->array->data[i],
-                                        sm->array->data[i + 1],
-                                        &dm->array->data[i],
-                                        &dm->array->data[i + 1]);
-                        if (error != ERR_NONE) {
-                            free_vartype((vartype *) dm);
-                            return error;
-                        }
+                    int4 size = sm->rows * sm->columns;
+                    error = map_elements(size, [&](int4 i) {
+                        return mcc(((vartype_complex *) src1)->re,
+                                   ((vartype_complex *) src1)->im,
+                                   sm->array->data[i * 2],
+                                   sm->array->data[i * 2 + 1],
+                                   &dm->array->data[i * 2],
+                                   &dm->array->data[i * 2 + 1]);
+                    });
+                    if (error != ERR_NONE) {
+                        free_vartype((vartype *) dm);
+                        return error;
                     }
                     *dst = (vartype *) dm;
                     return ERR_NONE;
@@ -708,14 +800,11 @@ int map_binary(const vartype *src1, const vartype *src2, vartype **dst,
                         return ERR_ALPHA_DATA_IS_INVALID;
                     }
                     int4 size = sm->rows * sm->columns;
-                    for (int4 i = 0; i < size; i++) {
-                        int error = mrr(sm->array->data[i],
-                                    ((vartype_real *) src2)->x,
-                                    &dm->array->data[i]);
-                        if (error != ERR_NONE) {
-                            free_vartype((vartype *) dm);
-                            return error;
-                        }
+                    error = map_rr(mrr, sm->array->data, 1,
+                                   &((vartype_real *) src2)->x, 0, dm->array->data, size);
+                    if (error != ERR_NONE) {
+                        free_vartype((vartype *) dm);
+                        return error;
                     }
                     *dst = (vartype *) dm;
                     return ERR_NONE;
@@ -732,16 +821,16 @@ int map_binary(const vartype *src1, const vartype *src2, vartype **dst,
                         return ERR_ALPHA_DATA_IS_INVALID;
                     }
                     int4 size = sm->rows * sm->columns;
-                    for (int4 i = 0; i < size; i++) {
-                        int error = mrc(sm->array->data[i],
-                                    ((vartype_complex *) src2)->re,
-                                    ((vartype_complex *) src2)->im,
-                                    &dm->array->data[i * 2],
-                                    &dm->array->data[i * 2 + 1]);
-                        if (error != ERR_NONE) {
-                            free_vartype((vartype *) dm);
-                            return error;
-                        }
+                    error = map_elements(size, [&](int4 i) {
+                        return mrc(sm->array->data[i],
+                                   ((vartype_complex *) src2)->re,
+                                   ((vartype_complex *) src2)->im,
+                                   &dm->array->data[i * 2],
+                                   &dm->array->data[i * 2 + 1]);
+                    });
+                    if (error != ERR_NONE) {
+                        free_vartype((vartype *) dm);
+                        return error;
                     }
                     *dst = (vartype *) dm;
                     return ERR_NONE;
@@ -761,14 +850,11 @@ int map_binary(const vartype *src1, const vartype *src2, vartype **dst,
                         return ERR_ALPHA_DATA_IS_INVALID;
                     }
                     int4 size = sm1->rows * sm1->columns;
-                    for (int4 i = 0; i < size; i++) {
-                        int error = mrr(sm1->array->data[i],
-                                        sm2->array->data[i],
-                                        &dm->array->data[i]);
-                        if (error != ERR_NONE) {
-                            free_vartype((vartype *) dm);
-                            return error;
-                        }
+                    error = map_rr(mrr, sm1->array->data, 1,
+                                   sm2->array->data, 1, dm->array->data, size);
+                    if (error != ERR_NONE) {
+                        free_vartype((vartype *) dm);
+                        return error;
                     }
                     *dst = (vartype *) dm;
                     return ERR_NONE;
@@ -788,16 +874,16 @@ int map_binary(const vartype *src1, const vartype *src2, vartype **dst,
                         return ERR_ALPHA_DATA_IS_INVALID;
                     }
                     int4 size = sm1->rows * sm1->columns;
-                    for (int4 i = 0; i < size; i++) {
-                        int error = mrc(sm1->array->data[i],
-                                        sm2->array->data[i * 2],
-                                        sm2->array->data[i * 2 + 1],
-                                        &dm->array->data[i * 2],
-                                        &dm->array->data[i * 2 + 1]);
-                        if (error != ERR_NONE) {
-                            free_vartype((vartype *) dm);
-                            return error;
-                        }
+                    error = map_elements(size, [&](int4 i) {
+                        return mrc(sm1->array->data[i],
+                                   sm2->array->data[i * 2],
+                                   sm2->array->data[i * 2 + 1],
+                                   &dm->array->data[i * 2],
+                                   &dm->array->data[i * 2 + 1]);
+                    });
+                    if (error != ERR_NONE) {
+                        free_vartype((vartype *) dm);
+                        return error;
                     }
                     *dst = (vartype *) dm;
                     return ERR_NONE;
@@ -814,17 +900,17 @@ int map_binary(const vartype *src1, const vartype *src2, vartype **dst,
                                     new_complexmatrix(sm->rows, sm->columns);
                     if (dm == NULL)
                         return ERR_INSUFFICIENT_MEMORY;
-                    int4 size = 2 * sm->rows * sm->columns;
-                    for (int4 i = 0; i < size; i += 2) {
-                        int error = mcr(sm->array->data[i],
-                                        sm->array->data[i + 1],
-                                        ((vartype_real *) src2)->x,
-                                        &dm->array->data[i],
-                                        &dm->array->data[i + 1]);
-                        if (error != ERR_NONE) {
-                            free_vartype((vartype *) dm);
-                            return error;
-                        }
+                    int4 size = sm->rows * sm->columns;
+                    error = map_elements(size, [&](int4 i) {
+                        return mcr(sm->array->data[i * 2],
+                                   sm->array->data[i * 2 + 1],
+                                   ((vartype_real *) src2)->x,
+                                   &dm->array->data[i * 2],
+                                   &dm->array->data[i * 2 + 1]);
+                    });
+                    if (error != ERR_NONE) {
+                        free_vartype((vartype *) dm);
+                        return error;
                     }
                     *dst = (vartype *) dm;
                     return ERR_NONE;
@@ -836,18 +922,18 @@ int map_binary(const vartype *src1, const vartype *src2, vartype **dst,
                                     new_complexmatrix(sm->rows, sm->columns);
                     if (dm == NULL)
                         return ERR_INSUFFICIENT_MEMORY;
-                    int4 size = 2 * sm->rows * sm->columns;
-                    for (int4 i = 0; i < size; i += 2) {
-                        int error = mcc(sm->array->data[i],
-                                        sm->array->data[i + 1],
-                                        ((vartype_complex *) src2)->re,
-                                        ((vartype_complex *) src2)->im,
-                                        &dm->array->data[i],
-                                        &dm->array->data[i + 1]);
-                        if (error != ERR_NONE) {
-                            free_vartype((vartype *) dm);
-                            return error;
-                        }
+                    int4 size = sm->rows * sm->columns;
+                    error = map_elements(size, [&](int4 i) {
+                        return mcc(sm->array->data[i * 2],
+                                   sm->array->data[i * 2 + 1],
+                                   ((vartype_complex *) src2)->re,
+                                   ((vartype_complex *) src2)->im,
+                                   &dm->array->data[i * 2],
+                                   &dm->array->data[i * 2 + 1]);
+                    });
+                    if (error != ERR_NONE) {
+                        free_vartype((vartype *) dm);
+                        return error;
                     }
                     *dst = (vartype *) dm;
                     return ERR_NONE;
@@ -867,16 +953,16 @@ int map_binary(const vartype *src1, const vartype *src2, vartype **dst,
                         return ERR_ALPHA_DATA_IS_INVALID;
                     }
                     int4 size = sm1->rows * sm1->columns;
-                    for (int4 i = 0; i < size; i++) {
-                        int error = mcr(sm1->array->data[i * 2],
-                                        sm1->array->data[i * 2 + 1],
-                                        sm2->array->data[i],
-                                        &dm->array->data[i * 2],
-                                        &dm->array->data[i * 2 + 1]);
-                        if (error != ERR_NONE) {
-                            free_vartype((vartype *) dm);
-                            return error;
-                        }
+                    error = map_elements(size, [&](int4 i) {
+                        return mcr(sm1->array->data[i * 2],
+                                   sm1->array->data[i * 2 + 1],
+                                   sm2->array->data[i],
+                                   &dm->array->data[i * 2],
+                                   &dm->array->data[i * 2 + 1]);
+                    });
+                    if (error != ERR_NONE) {
+                        free_vartype((vartype *) dm);
+                        return error;
                     }
                     *dst = (vartype *) dm;
                     return ERR_NONE;
@@ -891,18 +977,18 @@ int map_binary(const vartype *src1, const vartype *src2, vartype **dst,
                                     new_complexmatrix(sm1->rows, sm1->columns);
                     if (dm == NULL)
                         return ERR_INSUFFICIENT_MEMORY;
-                    int4 size = 2 * sm1->rows * sm1->columns;
-                    for (int4 i = 0; i < size; i += 2) {
-                        int error = mcc(sm1->array->data[i],
-                                        sm1->array->data[i + 1],
-                                        sm2->array->data[i],
-                                        sm2->array->data[i + 1],
-                                        &dm->array->data[i],
-                                        &dm->array->data[i + 1]);
-                        if (error != ERR_NONE) {
-                            free_vartype((vartype *) dm);
-                            return error;
-                        }
+                    int4 size = sm1->rows * sm1->columns;
+                    error = map_elements(size, [&](int4 i) {
+                        return mcc(sm1->array->data[i * 2],
+                                   sm1->array->data[i * 2 + 1],
+                                   sm2->array->data[i * 2],
+                                   sm2->array->data[i * 2 + 1],
+                                   &dm->array->data[i * 2],
+                                   &dm->array->data[i * 2 + 1]);
+                    });
+                    if (error != ERR_NONE) {
+                        free_vartype((vartype *) dm);
+                        return error;
                     }
                     *dst = (vartype *) dm;
                     return ERR_NONE;
@@ -1287,6 +1373,12 @@ static int add_cc(phloat xre, phloat xim, phloat yre, phloat yim,
 }
 
 int generic_div(const vartype *px, const vartype *py, int (*completion)(int, vartype *)) {
+    if (px->type == TYPE_SPARSE || py->type == TYPE_SPARSE) {
+        /* Only solving with a sparse coefficient matrix is supported */
+        if (px->type == TYPE_SPARSE && py->type == TYPE_REALMATRIX)
+            return linalg_div(py, px, completion);
+        return completion(ERR_INVALID_TYPE, NULL);
+    }
     if ((px->type == TYPE_REALMATRIX || px->type == TYPE_COMPLEXMATRIX)
             && (py->type == TYPE_REALMATRIX || py->type == TYPE_COMPLEXMATRIX)) {
         return linalg_div(py, px, completion);
@@ -1298,6 +1390,12 @@ int generic_div(const vartype *px, const vartype *py, int (*completion)(int, var
 }
 
 int generic_mul(const vartype *px, const vartype *py, int (*completion)(int, vartype *)) {
+    if (px->type == TYPE_SPARSE || py->type == TYPE_SPARSE) {
+        /* Only sparse times dense products are supported */
+        if (py->type == TYPE_SPARSE && px->type == TYPE_REALMATRIX)
+            return linalg_mul(py, px, completion);
+        return completion(ERR_INVALID_TYPE, NULL);
+    }
     if ((px->type == TYPE_REALMATRIX || px->type == TYPE_COMPLEXMATRIX)
             && (py->type == TYPE_REALMATRIX || py->type == TYPE_COMPLEXMATRIX)) {
         return linalg_mul(py, px, completion);
@@ -1309,9 +1407,13 @@ int generic_mul(const vartype *px, const vartype *py, int (*completion)(int, var
 }
 
 int generic_sub(const vartype *px, const vartype *py, vartype **dst) {
+    if (px->type == TYPE_SPARSE || py->type == TYPE_SPARSE)
+        return ERR_INVALID_TYPE;
     return map_binary(px, py, dst, sub_rr, sub_rc, sub_cr, sub_cc);
 }
 
 int generic_add(const vartype *px, const vartype *py, vartype **dst) {
+    if (px->type == TYPE_SPARSE || py->type == TYPE_SPARSE)
+        return ERR_INVALID_TYPE;
     return map_binary(px, py, dst, add_rr, add_rc, add_cr, add_cc);
 }
@@ -19,6 +19,12 @@
 #define CORE_STO_RCL_H 1
 
 
+#include <atomic>
+#if !defined(WINDOWS)
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
 #include "free42.h"
 #include "core_phloat.h"
 #include "core_globals.h"
@@ -70,4 +76,110 @@ int map_unary(const vartype *src, vartype **dst, mappable_r, mappable_c mc);
 int map_binary(const vartype *src1, const vartype *src2, vartype **dst,
             mappable_rr mrr, mappable_rc mrc, mappable_cr mcr, mappable_cc mcc);
 
+
+/*********************************************/
+/* Parallel loops, for the mappers and other */
+/* operations on large arrays                */
+/*********************************************/
+
+/* Large arrays are processed in parallel wherever POSIX threads are
+ * available. This includes the decimal builds: the BID library's exception
+ * flags and rounding mode are thread-local (see BID_THREAD in bid_conf.h), so
+ * concurrent BID operations do not race on them.
+ */
+#if !defined(WINDOWS)
+#define MAP_THREADS 1
+#endif
+
+/* Number of elements above which map_unary() and map_binary() split the work
+ * across multiple threads; below this, starting the threads costs more than
+ * it gains.
+ */
+#define MAP_PARALLEL_THRESHOLD 16384
+#define MAP_MAX_THREADS 16
+
+template <typename F>
+static int map_chunk(F &f, int4 begin, int4 end, int chunk, std::atomic<int> *failed_chunk) {
+    for (int4 i = begin; i < end; i++) {
+        // When an earlier chunk has failed, its error is the one that will
+        // be reported, so there is no point in continuing.
+        if ((i & 1023) == 0 && failed_chunk->load(std::memory_order_relaxed) < chunk)
+            return ERR_NONE;
+        int error = f(i);
+        if (error != ERR_NONE) {
+            int prev = failed_chunk->load(std::memory_order_relaxed);
+            while (chunk < prev && !failed_chunk->compare_exchange_weak(prev, chunk))
+                ;
+            return error;
+        }
+    }
+    return ERR_NONE;
+}
+
+#ifdef MAP_THREADS
+template <typename F>
+struct map_job {
+    F *f;
+    int4 begin, end;
+    int chunk;
+    std::atomic<int> *failed_chunk;
+    int error;
+};
+
+template <typename F>
+static void *map_job_run(void *arg) {
+    map_job<F> *job = (map_job<F> *) arg;
+    job->error = map_chunk(*job->f, job->begin, job->end, job->chunk, job->failed_chunk);
+    return NULL;
+}
+#endif
+
+/* Calls f(i) for 0 <= i < n, stopping at the first error. Large ranges are
+ * split into contiguous chunks, each handled by its own thread; when more
+ * than one chunk fails, the error from the first one is returned, so the
+ * result is always the same as with a sequential loop: the error for the
+ * lowest-numbered failing element. Chunks whose thread cannot be started
+ * are run by the calling thread instead.
+ */
+template <typename F>
+static int map_elements(int4 n, F f, int4 threshold = MAP_PARALLEL_THRESHOLD) {
+    int nthreads = 1;
+#ifdef MAP_THREADS
+    if (n >= threshold) {
+        long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = ncpus < 1 ? 1 : ncpus > MAP_MAX_THREADS ? MAP_MAX_THREADS : (int) ncpus;
+        if (nthreads > n / (threshold / 4))
+            nthreads = n / (threshold / 4);
+    }
+#endif
+    std::atomic<int> failed_chunk(nthreads);
+    if (nthreads <= 1)
+        return map_chunk(f, 0, n, 0, &failed_chunk);
+#ifdef MAP_THREADS
+    map_job<F> jobs[MAP_MAX_THREADS];
+    pthread_t threads[MAP_MAX_THREADS];
+    bool started[MAP_MAX_THREADS];
+    int4 chunksize = (n + nthreads - 1) / nthreads;
+    for (int t = 0; t < nthreads; t++) {
+        jobs[t].f = &f;
+        jobs[t].begin = t * chunksize;
+        jobs[t].end = jobs[t].begin + chunksize < n ? jobs[t].begin + chunksize : n;
+        jobs[t].chunk = t;
+        jobs[t].failed_chunk = &failed_chunk;
+        jobs[t].error = ERR_NONE;
+        started[t] = t > 0 && pthread_create(&threads[t], NULL, map_job_run<F>, &jobs[t]) == 0;
+    }
+    for (int t = 0; t < nthreads; t++)
+        if (!started[t])
+            map_job_run<F>(&jobs[t]);
+    for (int t = 1; t < nthreads; t++)
+        if (started[t])
+            pthread_join(threads[t], NULL);
+    for (int t = 0; t < nthreads; t++)
+        if (jobs[t].error != ERR_NONE)
+            return jobs[t].error;
+#endif
+    return ERR_NONE;
+}
+
 #endif
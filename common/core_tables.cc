@@ -60,8 +60,8 @@ const command_spec cmd_array[] =
     { /* SWAP */        docmd_swap,        "X<>Y",                0x00, 0x00, 0x00, 0x71,  4, ARG_NONE,   2, ALLT },
     { /* RDN */         docmd_rdn,         "R\016",               0x00, 0x00, 0x00, 0x75,  2, ARG_NONE,   0, NA_T },
     { /* CHS */         docmd_chs,         "+/-",                 0x00, 0x00, 0x00, 0x54,  3, ARG_NONE,   1, 0x0f },
-    { /* DIV */         docmd_div,         "\000",                0x00, 0x00, 0x00, 0x43,  1, ARG_NONE,   2, 0x0f },
-    { /* MUL */         docmd_mul,         "\001",                0x00, 0x00, 0x00, 0x42,  1, ARG_NONE,   2, 0x0f },
+    { /* DIV */         docmd_div,         "\000",                0x00, 0x00, 0x00, 0x43,  1, ARG_NONE,   2, 0x8f },
+    { /* MUL */         docmd_mul,         "\001",                0x00, 0x00, 0x00, 0x42,  1, ARG_NONE,   2, 0x8f },
     { /* SUB */         docmd_sub,         "-",                   0x00, 0x00, 0x00, 0x41,  1, ARG_NONE,   2, 0x0f },
     { /* ADD */         docmd_add,         "+",                   0x00, 0x00, 0x00, 0x40,  1, ARG_NONE,   2, 0x0f },
     { /* LASTX */       docmd_lastx,       "LASTX",               0x00, 0x00, 0x00, 0x76,  5, ARG_NONE,   0, NA_T },
@@ -199,8 +199,8 @@ const command_spec cmd_array[] =
     { /* MAN */         docmd_man,         "MAN",                 0x00, 0x00, 0xa7, 0x5b,  3, ARG_NONE,   0, NA_T },
     { /* NORM */        docmd_norm,        "NORM",                0x00, 0x00, 0xa7, 0x5c,  4, ARG_NONE,   0, NA_T },
     { /* TRACE */       docmd_trace,       "TRACE",               0x00, 0x00, 0xa7, 0x5d,  5, ARG_NONE,   0, NA_T },
-    { /* SIGMAADD */    docmd_sigmaadd,    "\005+",               0x00, 0x00, 0x00, 0x47,  2, ARG_NONE,   1, 0x05 },
-    { /* SIGMASUB */    docmd_sigmasub,    "\005-",               0x00, 0x00, 0x00, 0x48,  2, ARG_NONE,   1, 0x05 },
+    { /* SIGMAADD */    docmd_sigmaadd,    "\005+",               0x00, 0x00, 0x00, 0x47,  2, ARG_NONE,   1, 0x25 },
+    { /* SIGMASUB */    docmd_sigmasub,    "\005-",               0x00, 0x00, 0x00, 0x48,  2, ARG_NONE,   1, 0x25 },
     { /* GTO */         docmd_gto,         "GTO",                 0x20, 0xa6, 0x00, 0x00,  3, ARG_LBL,    0, NA_T },
     { /* END */         docmd_rtn,         "END",                 0x20, 0x00, 0x00, 0x00,  3, ARG_NONE,   0, NA_T },
     { /* NUMBER */      docmd_number,      "",                    0x24, 0x00, 0x00, 0x00,  0, ARG_NONE,   0, NA_T },
@@ -216,7 +216,7 @@ const command_spec cmd_array[] =
     { /* CPX_T */       docmd_cpx_t,       "CPX?",                0x00, 0x00, 0xa2, 0x67,  4, ARG_NONE,   1, ALLT },
     { /* STR_T */       docmd_str_t,       "STR?",                0x00, 0x00, 0xa2, 0x68,  4, ARG_NONE,   1, ALLT },
     { /* MAT_T */       docmd_mat_t,       "MAT?",                0x00, 0x00, 0xa2, 0x66,  4, ARG_NONE,   1, ALLT },
-    { /* DIM_T */       docmd_dim_t,       "DIM?",                0x00, 0x00, 0xa6, 0xe7,  4, ARG_NONE,   1, 0x0c },
+    { /* DIM_T */       docmd_dim_t,       "DIM?",                0x00, 0x00, 0xa6, 0xe7,  4, ARG_NONE,   1, 0x8c },
     { /* ASSIGNa */     NULL,              "AS\323\311GN",        0x40, 0x00, 0x00, 0x00,  6, ARG_NAMED,  0, NA_T },
     { /* ASSIGNb */     NULL,              "",                    0x44, 0x00, 0x00, 0x00,  0, ARG_CKEY,   0, NA_T },
     { /* ASGN01 */      docmd_asgn01,      "",                    0x24, 0x00, 0x00, 0x00,  0, ARG_OTHER,  0, NA_T },
@@ -471,7 +471,7 @@ const command_spec cmd_array[] =
     { /* APPEND */      docmd_append,      "APPEND",              0x00, 0x00, 0xa7, 0xe9,  6, ARG_NONE,   2, ALLT },
     { /* EXTEND */      docmd_extend,      "EXTEND",              0x00, 0x00, 0xa7, 0xea,  6, ARG_NONE,   2, ALLT },
     { /* SUBSTR */      docmd_substr,      "SUBSTR",              0x00, 0x00, 0xa7, 0xeb,  6, ARG_NONE,   2, FUNC },
-    { /* LENGTH */      docmd_length,      "LENGTH",              0x00, 0x00, 0xa7, 0xec,  6, ARG_NONE,   1, 0x30 },
+    { /* LENGTH */      docmd_length,      "LENGTH",              0x00, 0x00, 0xa7, 0xec,  6, ARG_NONE,   1, 0x70 },
     { /* HEAD */        docmd_head,        "HEAD",                0x00, 0x03, 0xf2, 0x13,  4, ARG_VAR,    0, NA_T },
     { /* REV */         docmd_rev,         "REV",                 0x00, 0x00, 0xa7, 0xed,  3, ARG_NONE,   1, 0x30 },
     { /* POS */         docmd_pos,         "POS",                 0x00, 0x00, 0xa7, 0xee,  3, ARG_NONE,   2, FUNC },
@@ -502,6 +502,22 @@ const command_spec cmd_array[] =
     /* For Plus42 Compatibility */
     { /* WIDTH */       docmd_width,       "WIDTH",               0x00, 0x00, 0xa2, 0x72,  5, ARG_NONE,   0, NA_T },
     { /* HEIGHT */      docmd_height,      "HEIGHT",              0x00, 0x00, 0xa2, 0x73,  6, ARG_NONE,   0, NA_T },
+
+    { /* RANM */        docmd_ranm,        "RANM",                0x00, 0x00, 0xa7, 0xfa,  4, ARG_NONE,   1, 0x24 },
+    { /* SIGMA_ACC */   docmd_sigma_acc,   "\005ACC",             0x00, 0x00, 0xa7, 0xfb,  4, ARG_NONE,   1, 0x01 },
+    { /* QUANT */       docmd_quant,       "QUANT",               0x00, 0x00, 0xa7, 0xfc,  5, ARG_NONE,   0, NA_T },
+    { /* SORT */        docmd_sort,        "SORT",                0x00, 0x00, 0xa7, 0xfd,  4, ARG_NONE,   1, 0x24 },
+    { /* RSORT */       docmd_rsort,       "RSORT",               0x00, 0x00, 0xa7, 0xfe,  5, ARG_NONE,   2, 0x05 },
+    { /* BSRCH */       docmd_bsrch,       "BSRCH",               0x00, 0x00, 0xa7, 0xff,  5, ARG_NONE,   2, FUNC },
+    { /* NEWDICT */     docmd_newdict,     "NEWDICT",             0x00, 0x00, 0xa7, 0xc9,  7, ARG_NONE,   0, NA_T },
+    { /* DPUT */        docmd_dput,        "DPUT",                0x00, 0x00, 0xa7, 0xca,  4, ARG_NONE,   3, FUNC },
+    { /* DGET */        docmd_dget,        "DGET",                0x00, 0x00, 0xa7, 0xcb,  4, ARG_NONE,   2, FUNC },
+    { /* DDEL */        docmd_ddel,        "DDEL",                0x00, 0x00, 0xa7, 0xcc,  4, ARG_NONE,   2, FUNC },
+    { /* DKEYS */       docmd_dkeys,       "DKEYS",               0x00, 0x00, 0xa7, 0xcd,  5, ARG_NONE,   1, 0x40 },
+    { /* DKEY_T */      docmd_dkey_t,      "DKEY?",               0x00, 0x00, 0xa7, 0xce,  5, ARG_NONE,   2, FUNC },
+    { /* SPARSE */      docmd_sparse,      "SPARSE",              0x00, 0x00, 0xa7, 0xc6,  6, ARG_NONE,   1, 0x04 },
+    { /* DENSE */       docmd_dense,       "DENSE",               0x00, 0x00, 0xa7, 0xc7,  5, ARG_NONE,   1, 0x80 },
+    { /* NEWSP */       docmd_newsp,       "NEWSP",               0x00, 0x00, 0xa7, 0xc8,  5, ARG_NONE,   3, FUNC },
 };
 
 /*
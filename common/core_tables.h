@@ -470,7 +470,23 @@
 #define CMD_WIDTH       421
 #define CMD_HEIGHT      422
 
-#define CMD_SENTINEL    423
+#define CMD_RANM        423
+#define CMD_SIGMA_ACC   424
+#define CMD_QUANT       425
+#define CMD_SORT        426
+#define CMD_RSORT       427
+#define CMD_BSRCH       428
+#define CMD_NEWDICT     429
+#define CMD_DPUT        430
+#define CMD_DGET        431
+#define CMD_DDEL        432
+#define CMD_DKEYS       433
+#define CMD_DKEY_T      434
+#define CMD_SPARSE      435
+#define CMD_DENSE       436
+#define CMD_NEWSP       437
+
+#define CMD_SENTINEL    438
 
 
 /* command_spec.argtype */
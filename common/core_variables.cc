@@ -84,8 +84,10 @@ vartype *new_string(const char *text, int length) {
         s->type = TYPE_STRING;
     }
     s->length = length;
-    if (length > SSLENV)
+    if (length > SSLENV) {
+        s->capacity = length;
         s->t.ptr = dbuf;
+    }
     if (text != NULL)
         memcpy(length > SSLENV ? s->t.ptr : s->t.buf, text, length);
     return (vartype *) s;
@@ -116,16 +118,9 @@ vartype *new_realmatrix(int4 rows, int4 columns) {
         free(rm);
         return NULL;
     }
-    rm->array->is_string = (char *) malloc(sz);
-    if (rm->array->is_string == NULL) {
-        free(rm->array->data);
-        free(rm->array);
-        free(rm);
-        return NULL;
-    }
+    rm->array->is_string = NULL;
     for (i = 0; i < sz; i++)
         rm->array->data[i] = 0;
-    memset(rm->array->is_string, 0, sz);
     rm->array->refcount = 1;
     return (vartype *) rm;
 }
@@ -180,9 +175,299 @@ vartype *new_list(int4 size) {
     }
     memset(list->array->data, 0, size * sizeof(vartype *));
     list->array->refcount = 1;
+    list->array->capacity = size;
+    list->array->used = -1;
     return (vartype *) list;
 }
 
+/* Makes sure the list's data array has room for at least 'capacity'
+ * elements. The array grows geometrically, so appending elements one at a
+ * time takes amortized constant time. The list must not be shared; use
+ * disentangle() first, unless list_can_append_shared() says otherwise.
+ */
+bool grow_list(vartype_list *list, int4 capacity) {
+    list_data *ld = list->array;
+    if (capacity <= ld->capacity)
+        return true;
+    int4 newcapacity = ld->capacity < 4 ? 4 : ld->capacity;
+    while (newcapacity < capacity && newcapacity < 0x20000000)
+        newcapacity *= 2;
+    if (newcapacity < capacity)
+        newcapacity = capacity;
+    vartype **newdata = (vartype **) realloc(ld->data, newcapacity * sizeof(vartype *));
+    if (newdata == NULL) {
+        // Not enough memory for the spare room; try without.
+        newcapacity = capacity;
+        newdata = (vartype **) realloc(ld->data, newcapacity * sizeof(vartype *));
+        if (newdata == NULL)
+            return false;
+    }
+    ld->data = newdata;
+    ld->capacity = newcapacity;
+    return true;
+}
+
+static bool contains_list_data(const vartype *v, const list_data *ld) {
+    if (v == NULL)
+        return false;
+    if (v->type == TYPE_LIST) {
+        const vartype_list *list = (const vartype_list *) v;
+        if (list->array == ld)
+            return true;
+        /* Elements beyond the end of this list, appended in place by other
+         * lists sharing the array, are reachable through it as well.
+         */
+        int4 n = list->array->used == -1 ? list->size : list->array->used;
+        for (int4 i = 0; i < n; i++)
+            if (contains_list_data(list->array->data[i], ld))
+                return true;
+    } else if (v->type == TYPE_DICT) {
+        const dict_data *dd = ((const vartype_dict *) v)->array;
+        for (int4 i = 0; i < dd->used; i++)
+            if (dd->keys[i] != NULL && contains_list_data(dd->values[i], ld))
+                return true;
+    }
+    return false;
+}
+
+/* Checks whether elements can be appended to a shared list in place, without
+ * making a private copy first. That is possible when none of the other lists
+ * sharing its array extend beyond its end: the new elements then go into the
+ * part of the array that those lists can't see, so a list can be copied and
+ * appended to repeatedly, while keeping the old versions around, in amortized
+ * constant time per element. 'v' is the object to be appended, or the list
+ * whose elements are to be appended; if it contains this list's own array,
+ * appending in place would create a cycle. After appending, the caller must
+ * set the array's 'used' to the new size.
+ */
+bool list_can_append_shared(const vartype_list *list, const vartype *v) {
+    const list_data *ld = list->array;
+    return ld->refcount > 1 && ld->used == list->size
+            && !contains_list_data(v, ld);
+}
+
+/* Called when a list of the given size stops using 'ld', while other lists
+ * still use it. When that leaves just one list, the elements beyond its end,
+ * which only the lists that are now gone could see, are released, so they
+ * don't linger until that list happens to be disentangled or freed.
+ */
+void detach_list_data(list_data *ld, int4 size) {
+    ld->total -= size;
+    if (--(ld->refcount) == 1) {
+        for (int4 i = (int4) ld->total; i < ld->used; i++) {
+            free_vartype(ld->data[i]);
+            ld->data[i] = NULL;
+        }
+        ld->used = -1;
+    }
+}
+
+vartype *new_dict() {
+    vartype_dict *dict = (vartype_dict *) malloc(sizeof(vartype_dict));
+    if (dict == NULL)
+        return NULL;
+    dict->type = TYPE_DICT;
+    dict->size = 0;
+    dict->array = (dict_data *) malloc(sizeof(dict_data));
+    if (dict->array == NULL) {
+        free(dict);
+        return NULL;
+    }
+    dict->array->refcount = 1;
+    dict->array->used = 0;
+    dict->array->capacity = 0;
+    dict->array->keys = NULL;
+    dict->array->values = NULL;
+    dict->array->buckets = 0;
+    dict->array->index = NULL;
+    return (vartype *) dict;
+}
+
+/* Dictionary keys are reals and strings. Reals are hashed by value, so
+ * numbers that compare equal, like 0 and -0, or, in the decimal version,
+ * 1 and 1.0, land in the same bucket.
+ */
+bool dict_key_ok(const vartype *key) {
+    return key->type == TYPE_REAL || key->type == TYPE_STRING;
+}
+
+static uint4 dict_hash(const vartype *key) {
+    const unsigned char *p;
+    int4 n;
+    double d;
+    if (key->type == TYPE_REAL) {
+        d = to_double(((vartype_real *) key)->x);
+        if (d == 0)
+            d = 0;
+        p = (const unsigned char *) &d;
+        n = sizeof(double);
+    } else {
+        vartype_string *s = (vartype_string *) key;
+        p = (const unsigned char *) s->txt();
+        n = s->length;
+    }
+    // FNV-1a
+    uint4 h = 2166136261u ^ key->type;
+    for (int4 i = 0; i < n; i++) {
+        h ^= p[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static bool dict_key_equals(const vartype *k1, const vartype *k2) {
+    if (k1->type != k2->type)
+        return false;
+    if (k1->type == TYPE_REAL)
+        return ((vartype_real *) k1)->x == ((vartype_real *) k2)->x;
+    vartype_string *s1 = (vartype_string *) k1;
+    vartype_string *s2 = (vartype_string *) k2;
+    return string_equals(s1->txt(), s1->length, s2->txt(), s2->length);
+}
+
+static void dict_index_entry(dict_data *dd, int4 entry) {
+    int4 mask = dd->buckets - 1;
+    int4 b = dict_hash(dd->keys[entry]) & mask;
+    while (dd->index[b] != 0)
+        b = (b + 1) & mask;
+    dd->index[b] = entry + 1;
+}
+
+/* Returns the entry number of the given key, or -1 if it isn't there. */
+int4 dict_find(const vartype_dict *dict, const vartype *key) {
+    dict_data *dd = dict->array;
+    if (dict->size == 0 || !dict_key_ok(key))
+        return -1;
+    int4 mask = dd->buckets - 1;
+    int4 b = dict_hash(key) & mask;
+    int4 e;
+    while ((e = dd->index[b]) != 0) {
+        vartype *k = dd->keys[e - 1];
+        if (k != NULL && dict_key_equals(k, key))
+            return e - 1;
+        b = (b + 1) & mask;
+    }
+    return -1;
+}
+
+/* Makes sure at least 'n' new entries can be added without allocating
+ * memory, so that dict_put() can't fail. When the entry arrays fill up,
+ * they are compacted, and grown geometrically if they are more than half
+ * full with live entries. The dictionary must not be shared; use
+ * disentangle() first.
+ */
+bool dict_reserve(vartype_dict *dict, int4 n) {
+    dict_data *dd = dict->array;
+    if (dd->used + n <= dd->capacity)
+        return true;
+    int4 needed = dict->size + n;
+    int4 newcapacity = 4;
+    while (newcapacity < 2 * needed && newcapacity < 0x10000000)
+        newcapacity *= 2;
+    if (newcapacity < needed)
+        return false;
+    vartype **newkeys = (vartype **) malloc(newcapacity * sizeof(vartype *));
+    vartype **newvalues = (vartype **) malloc(newcapacity * sizeof(vartype *));
+    int4 *newindex = (int4 *) malloc(2 * newcapacity * sizeof(int4));
+    if (newkeys == NULL || newvalues == NULL || newindex == NULL) {
+        free(newkeys);
+        free(newvalues);
+        free(newindex);
+        return false;
+    }
+    int4 used = 0;
+    for (int4 i = 0; i < dd->used; i++)
+        if (dd->keys[i] != NULL) {
+            newkeys[used] = dd->keys[i];
+            newvalues[used] = dd->values[i];
+            used++;
+        }
+    free(dd->keys);
+    free(dd->values);
+    free(dd->index);
+    dd->keys = newkeys;
+    dd->values = newvalues;
+    dd->used = used;
+    dd->capacity = newcapacity;
+    dd->buckets = 2 * newcapacity;
+    dd->index = newindex;
+    memset(newindex, 0, dd->buckets * sizeof(int4));
+    for (int4 i = 0; i < used; i++)
+        dict_index_entry(dd, i);
+    return true;
+}
+
+/* Stores 'value' under 'key', replacing the existing value, if any. The
+ * dictionary takes ownership of both. The key must be a real or a string,
+ * the dictionary must not be shared, and there must be room for one entry;
+ * use dict_reserve() first.
+ */
+void dict_put(vartype_dict *dict, vartype *key, vartype *value) {
+    dict_data *dd = dict->array;
+    int4 e = dict_find(dict, key);
+    if (e != -1) {
+        free_vartype(key);
+        free_vartype(dd->values[e]);
+        dd->values[e] = value;
+        return;
+    }
+    e = dd->used++;
+    dd->keys[e] = key;
+    dd->values[e] = value;
+    dict_index_entry(dd, e);
+    dict->size++;
+}
+
+/* Removes an entry, as returned by dict_find(). The dictionary must not
+ * be shared.
+ */
+void dict_delete(vartype_dict *dict, int4 entry) {
+    dict_data *dd = dict->array;
+    free_vartype(dd->keys[entry]);
+    free_vartype(dd->values[entry]);
+    dd->keys[entry] = NULL;
+    dd->values[entry] = NULL;
+    dict->size--;
+}
+
+/* Creates a sparse matrix with room for nnz nonzero elements. The row
+ * starts are all set to zero, i.e. the matrix is empty until the caller
+ * fills in the arrays.
+ */
+vartype *new_sparse(int4 rows, int4 columns, int4 nnz) {
+    double d_bytes = ((double) nnz) * (sizeof(phloat) + sizeof(int4));
+    if (((double) (int4) d_bytes) != d_bytes)
+        return NULL;
+
+    vartype_sparse *sm = (vartype_sparse *) malloc(sizeof(vartype_sparse));
+    if (sm == NULL)
+        return NULL;
+    sm->type = TYPE_SPARSE;
+    sm->rows = rows;
+    sm->columns = columns;
+    sm->array = (sparse_data *) malloc(sizeof(sparse_data));
+    if (sm->array == NULL) {
+        free(sm);
+        return NULL;
+    }
+    sparse_data *sd = sm->array;
+    sd->refcount = 1;
+    sd->nnz = nnz;
+    sd->rowstart = (int4 *) calloc(rows + 1, sizeof(int4));
+    // Allocate at least one element, so that NULL always means failure
+    sd->column = (int4 *) malloc((nnz == 0 ? 1 : nnz) * sizeof(int4));
+    sd->data = (phloat *) malloc((nnz == 0 ? 1 : nnz) * sizeof(phloat));
+    if (sd->rowstart == NULL || sd->column == NULL || sd->data == NULL) {
+        free(sd->rowstart);
+        free(sd->column);
+        free(sd->data);
+        free(sd);
+        free(sm);
+        return NULL;
+    }
+    return (vartype *) sm;
+}
+
 void free_vartype(vartype *v) {
     if (v == NULL)
         return;
@@ -234,7 +519,9 @@ void free_vartype(vartype *v) {
         }
         case TYPE_LIST: {
             vartype_list *list = (vartype_list *) v;
-            if (--(list->array->refcount) == 0) {
+            if (list->array->refcount > 1)
+                detach_list_data(list->array, list->size);
+            else {
                 for (int4 i = 0; i < list->size; i++)
                     free_vartype(list->array->data[i]);
                 free(list->array->data);
@@ -243,6 +530,33 @@ void free_vartype(vartype *v) {
             free(list);
             break;
         }
+        case TYPE_DICT: {
+            vartype_dict *dict = (vartype_dict *) v;
+            dict_data *dd = dict->array;
+            if (--(dd->refcount) == 0) {
+                for (int4 i = 0; i < dd->used; i++) {
+                    free_vartype(dd->keys[i]);
+                    free_vartype(dd->values[i]);
+                }
+                free(dd->keys);
+                free(dd->values);
+                free(dd->index);
+                free(dd);
+            }
+            free(dict);
+            break;
+        }
+        case TYPE_SPARSE: {
+            vartype_sparse *sm = (vartype_sparse *) v;
+            if (--(sm->array->refcount) == 0) {
+                free(sm->array->rowstart);
+                free(sm->array->column);
+                free(sm->array->data);
+                free(sm->array);
+            }
+            free(sm);
+            break;
+        }
     }
 }
 
@@ -255,14 +569,32 @@ void clean_vartype_pools() {
         free(stringpool[--stringpool_size]);
 }
 
+bool realmatrix_data::make_is_string(int4 size) {
+    if (is_string != NULL)
+        return true;
+    is_string = (char *) malloc(size);
+    if (is_string == NULL)
+        return false;
+    memset(is_string, 0, size);
+    return true;
+}
+
+void realmatrix_data::drop_strings(int4 size) {
+    free_long_strings(is_string, data, size);
+    free(is_string);
+    is_string = NULL;
+}
+
 void free_long_strings(char *is_string, phloat *data, int4 n) {
+    if (is_string == NULL)
+        return;
     for (int4 i = 0; i < n; i++)
         if (is_string[i] == 2)
             free(*(void **) &data[i]);
 }
 
 void get_matrix_string(vartype_realmatrix *rm, int i, char **text, int4 *length) {
-    if (rm->array->is_string[i] == 1) {
+    if (rm->array->str_type(i) == 1) {
         char *t = (char *) &rm->array->data[i];
         *text = t + 1;
         *length = *t;
@@ -280,7 +612,9 @@ void get_matrix_string(const vartype_realmatrix *rm, int i, const char **text, i
 bool put_matrix_string(vartype_realmatrix *rm, int i, const char *text, int4 length) {
     char *ptext;
     int4 plength;
-    if (rm->array->is_string[i] != 0) {
+    if (!rm->array->make_is_string(rm->rows * rm->columns))
+        return false;
+    if (rm->array->str_type(i) != 0) {
         get_matrix_string(rm, i, &ptext, &plength);
         if (plength == length) {
             memcpy(ptext, text, length);
@@ -293,12 +627,12 @@ bool put_matrix_string(vartype_realmatrix *rm, int i, const char *text, int4 len
             return false;
         *p = length;
         memcpy(p + 1, text, length);
-        if (rm->array->is_string[i] == 2)
+        if (rm->array->str_type(i) == 2)
             free(*(void **) &rm->array->data[i]);
         *(int4 **) &rm->array->data[i] = p;
         rm->array->is_string[i] = 2;
     } else {
-        void *oldptr = rm->array->is_string[i] == 2 ? *(void **) &rm->array->data[i] : NULL;
+        void *oldptr = rm->array->str_type(i) == 2 ? *(void **) &rm->array->data[i] : NULL;
         char *t = (char *) &rm->array->data[i];
         t[0] = length;
         memmove(t + 1, text, length);
@@ -351,9 +685,32 @@ vartype *dup_vartype(const vartype *v) {
             if (list2 == NULL)
                 return NULL;
             *list2 = *list;
+            if (list->array->used == -1) {
+                list->array->used = list->size;
+                list->array->total = list->size;
+            }
+            list->array->total += list->size;
             list->array->refcount++;
             return (vartype *) list2;
         }
+        case TYPE_DICT: {
+            vartype_dict *dict = (vartype_dict *) v;
+            vartype_dict *dict2 = (vartype_dict *) malloc(sizeof(vartype_dict));
+            if (dict2 == NULL)
+                return NULL;
+            *dict2 = *dict;
+            dict->array->refcount++;
+            return (vartype *) dict2;
+        }
+        case TYPE_SPARSE: {
+            vartype_sparse *sm = (vartype_sparse *) v;
+            vartype_sparse *sm2 = (vartype_sparse *) malloc(sizeof(vartype_sparse));
+            if (sm2 == NULL)
+                return NULL;
+            *sm2 = *sm;
+            sm->array->refcount++;
+            return (vartype *) sm2;
+        }
         default:
             return NULL;
     }
@@ -377,6 +734,11 @@ int disentangle(vartype *v) {
                     free(md);
                     return 0;
                 }
+                if (rm->array->is_string == NULL) {
+                    md->is_string = NULL;
+                    memcpy(md->data, rm->array->data, sz * sizeof(phloat));
+                    goto done;
+                }
                 md->is_string = (char *) malloc(sz);
                 if (md->is_string == NULL) {
                     free(md->data);
@@ -384,7 +746,7 @@ int disentangle(vartype *v) {
                     return 0;
                 }
                 for (i = 0; i < sz; i++) {
-                    md->is_string[i] = rm->array->is_string[i];
+                    md->is_string[i] = rm->array->str_type(i);
                     if (md->is_string[i] == 2) {
                         int4 *sp = *(int4 **) &rm->array->data[i];
                         int4 len = *sp + 4;
@@ -402,6 +764,7 @@ int disentangle(vartype *v) {
                         md->data[i] = rm->array->data[i];
                     }
                 }
+                done:
                 md->refcount = 1;
                 rm->array->refcount--;
                 rm->array = md;
@@ -460,11 +823,44 @@ int disentangle(vartype *v) {
                     ld->data[i] = vv;
                 }
                 ld->refcount = 1;
-                list->array->refcount--;
+                ld->capacity = list->size;
+                ld->used = -1;
+                detach_list_data(list->array, list->size);
                 list->array = ld;
                 return 1;
             }
         }
+        case TYPE_DICT: {
+            vartype_dict *dict = (vartype_dict *) v;
+            dict_data *dd = dict->array;
+            if (dd->refcount == 1)
+                return 1;
+            vartype_dict *dict2 = (vartype_dict *) new_dict();
+            if (dict2 == NULL)
+                return 0;
+            if (!dict_reserve(dict2, dict->size))
+                goto dict_fail;
+            for (int4 i = 0; i < dd->used; i++) {
+                if (dd->keys[i] == NULL)
+                    continue;
+                vartype *k = dup_vartype(dd->keys[i]);
+                if (k == NULL)
+                    goto dict_fail;
+                vartype *vv = dup_vartype(dd->values[i]);
+                if (vv == NULL) {
+                    free_vartype(k);
+                    goto dict_fail;
+                }
+                dict_put(dict2, k, vv);
+            }
+            dd->refcount--;
+            dict->array = dict2->array;
+            free(dict2);
+            return 1;
+            dict_fail:
+            free_vartype((vartype *) dict2);
+            return 0;
+        }
         case TYPE_REAL:
         case TYPE_COMPLEX:
         case TYPE_STRING:
@@ -642,11 +1038,13 @@ bool vars_exist(int section) {
                     break;
             case TYPE_REALMATRIX:
             case TYPE_COMPLEXMATRIX:
+            case TYPE_SPARSE:
                 if (section == CATSECT_MAT || section == CATSECT_MAT_LIST)
                     return true;
                 else
                     break;
             case TYPE_LIST:
+            case TYPE_DICT:
                 if (section == CATSECT_LIST_STR_ONLY || section == CATSECT_MAT_LIST)
                     return true;
                 else
@@ -657,9 +1055,11 @@ bool vars_exist(int section) {
 }
 
 bool contains_strings(const vartype_realmatrix *rm) {
+    if (rm->array->is_string == NULL)
+        return false;
     int4 size = rm->rows * rm->columns;
     for (int4 i = 0; i < size; i++)
-        if (rm->array->is_string[i] != 0)
+        if (rm->array->str_type(i) != 0)
             return true;
     return false;
 }
@@ -678,8 +1078,7 @@ int matrix_copy(vartype *dst, const vartype *src) {
             if (contains_strings(s))
                 return ERR_ALPHA_DATA_IS_INVALID;
             int4 size = s->rows * s->columns;
-            free_long_strings(d->array->is_string, d->array->data, size);
-            memset(d->array->is_string, 0, size);
+            d->array->drop_strings(size);
             memcpy(d->array->data, s->array->data, size * sizeof(phloat));
             return ERR_NONE;
         } else if (dst->type == TYPE_COMPLEXMATRIX) {
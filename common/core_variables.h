@@ -31,6 +31,8 @@
 #define TYPE_COMPLEXMATRIX 4
 #define TYPE_STRING 5
 #define TYPE_LIST 6
+#define TYPE_DICT 7
+#define TYPE_SPARSE 8
 
 struct vartype {
     int type;
@@ -52,7 +54,19 @@ struct vartype_complex {
 struct realmatrix_data {
     int refcount;
     phloat *data;
+    /* One byte per element: 0 for numbers, 1 for strings of up to SSLENM
+     * characters, stored in the element itself, and 2 for longer strings,
+     * which the element points to. This is NULL for matrices that have
+     * never contained strings, so purely numerical matrices don't have to
+     * allocate, copy, or scan it; use str_type() to read it, and
+     * make_is_string() before storing a string element.
+     */
     char *is_string;
+    char str_type(int4 i) const {
+        return is_string == NULL ? 0 : is_string[i];
+    }
+    bool make_is_string(int4 size);
+    void drop_strings(int4 size);
 };
 
 struct vartype_realmatrix {
@@ -84,6 +98,10 @@ struct vartype_complexmatrix {
 struct vartype_string {
     int type;
     int4 length;
+    /* When length > SSLENV, the size of the buffer that ptr points to. This
+     * can be larger than length, so that appending is cheap.
+     */
+    int4 capacity;
     /* When length <= SSLENV, use buf; otherwise, use ptr */
     union {
         char buf[SSLENV];
@@ -96,11 +114,29 @@ struct vartype_string {
         return length > SSLENV ? t.ptr : t.buf;
     }
     void trim1();
+    bool reserve(int4 newlength);
 };
 
 
 struct list_data {
     int refcount;
+    /* Number of elements 'data' has room for; this is >= the size of the
+     * list, so that appending is cheap.
+     */
+    int4 capacity;
+    /* Lists that share this array may have different sizes: appending to a
+     * shared list is done in place, after the elements that the other lists
+     * can see, as long as none of them extend beyond its end. This is the
+     * number of elements owned by the array, i.e. the size of the longest
+     * list using it, or -1 if only one list uses it, and so that list's size
+     * is all there is. See list_can_append_shared().
+     */
+    int4 used;
+    /* While 'used' is not -1, the sum of the sizes of the lists using this
+     * array. Once only one of them is left, this is its size, and the
+     * elements beyond it are released; see detach_list_data().
+     */
+    int8 total;
     vartype **data;
 };
 
@@ -111,12 +147,70 @@ struct vartype_list {
 };
 
 
+struct dict_data {
+    int refcount;
+    /* Entries are kept in insertion order, in 'keys' and 'values'; 'used'
+     * is the number of entries, including deleted ones, which have a NULL
+     * key until the next rehash squeezes them out. 'capacity' is the number
+     * of entries the arrays have room for.
+     */
+    int4 used;
+    int4 capacity;
+    vartype **keys;
+    vartype **values;
+    /* Open-addressing hash index, with linear probing. Each bucket holds an
+     * entry number plus one, or 0 if the bucket is empty. The number of
+     * buckets is a power of two, and at least twice the capacity.
+     */
+    int4 buckets;
+    int4 *index;
+};
+
+struct vartype_dict {
+    int type;
+    /* Number of live entries */
+    int4 size;
+    dict_data *array;
+};
+
+
+struct sparse_data {
+    int refcount;
+    /* Compressed sparse row storage: the nonzero elements of row i are
+     * data[rowstart[i]] .. data[rowstart[i + 1] - 1], in column order, and
+     * column[k] is the column of data[k]. Zeros are never stored. Nothing
+     * modifies a sparse matrix in place, so copies simply share the arrays.
+     */
+    int4 nnz;
+    int4 *rowstart;
+    int4 *column;
+    phloat *data;
+};
+
+struct vartype_sparse {
+    int type;
+    int4 rows;
+    int4 columns;
+    sparse_data *array;
+};
+
+
 vartype *new_real(phloat value);
 vartype *new_complex(phloat re, phloat im);
 vartype *new_string(const char *s, int slen);
 vartype *new_realmatrix(int4 rows, int4 columns);
 vartype *new_complexmatrix(int4 rows, int4 columns);
 vartype *new_list(int4 size);
+bool grow_list(vartype_list *list, int4 capacity);
+bool list_can_append_shared(const vartype_list *list, const vartype *v);
+void detach_list_data(list_data *ld, int4 size);
+vartype *new_dict();
+vartype *new_sparse(int4 rows, int4 columns, int4 nnz);
+bool dict_key_ok(const vartype *key);
+int4 dict_find(const vartype_dict *dict, const vartype *key);
+bool dict_reserve(vartype_dict *dict, int4 n);
+void dict_put(vartype_dict *dict, vartype *key, vartype *value);
+void dict_delete(vartype_dict *dict, int4 entry);
 void free_vartype(vartype *v);
 void clean_vartype_pools();
 void free_long_strings(char *is_string, phloat *data, int4 n);
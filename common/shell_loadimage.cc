@@ -45,31 +45,343 @@ struct GifColorMap {
     }
 };
 
-static int read_byte(int *n) {
-    int c = skin_getchar();
-    if (c == EOF)
+/* The whole GIF file is read into memory up front, so the parser and the LZW
+ * decoder can work from a plain buffer rather than calling skin_getchar()
+ * for every byte.
+ */
+struct GifBuffer {
+    unsigned char *data;
+    int length;
+    int pos;
+};
+
+static bool read_input(GifBuffer *buf) {
+    int capacity = 65536;
+    buf->data = (unsigned char *) malloc(capacity);
+    buf->length = 0;
+    buf->pos = 0;
+    if (buf->data == NULL)
+        return false;
+    int c;
+    while ((c = skin_getchar()) != EOF) {
+        if (buf->length == capacity) {
+            capacity *= 2;
+            unsigned char *newdata = (unsigned char *) realloc(buf->data, capacity);
+            if (newdata == NULL) {
+                free(buf->data);
+                buf->data = NULL;
+                return false;
+            }
+            buf->data = newdata;
+        }
+        buf->data[buf->length++] = c;
+    }
+    return true;
+}
+
+static int read_byte(GifBuffer *buf, int *n) {
+    if (buf->pos >= buf->length)
         return 0;
-    *n = c;
+    *n = buf->data[buf->pos++];
     return 1;
 }
 
-static int read_short(int *n) {
-    int c1, c2;
-    c1 = skin_getchar();
-    if (c1 == EOF)
-        return 0;
-    c2 = skin_getchar();
-    if (c2 == EOF)
+static int read_short(GifBuffer *buf, int *n) {
+    if (buf->pos + 2 > buf->length)
         return 0;
-    *n = c1 + (c2 << 8);
+    *n = buf->data[buf->pos] + (buf->data[buf->pos + 1] << 8);
+    buf->pos += 2;
     return 1;
 }
 
+/* Collects the data sub-blocks following the LZW code size byte into one
+ * contiguous buffer, so the decoder doesn't have to deal with the block
+ * boundaries. Returns false on premature EOF; in that case, whatever was
+ * read is still returned in *data and *length.
+ */
+static bool read_sub_blocks(GifBuffer *buf, unsigned char **data, int *length) {
+    int start = buf->pos;
+    int total = 0;
+    bool complete = false;
+    while (buf->pos < buf->length) {
+        int count = buf->data[buf->pos++];
+        if (count == 0) {
+            complete = true;
+            break;
+        }
+        if (buf->pos + count > buf->length)
+            count = buf->length - buf->pos;
+        total += count;
+        buf->pos += count;
+    }
+    *data = (unsigned char *) malloc(total + 1);
+    *length = 0;
+    if (*data == NULL)
+        return false;
+    int p = start;
+    while (*length < total) {
+        int count = buf->data[p++];
+        if (*length + count > total)
+            count = total - *length;
+        memcpy(*data + *length, buf->data + p, count);
+        *length += count;
+        p += count;
+    }
+    return complete;
+}
+
+/* Table-driven LZW decoder. Every string table entry stores its length and
+ * its first character along with the usual prefix/suffix pair, so a code
+ * can be expanded straight into its final position in the output, back to
+ * front, without an intermediate stack. The output buffer must have room
+ * for npixels + 4096 bytes, since the last string may overrun the end of
+ * the image.
+ * Returns the number of pixels decoded; *bad_code is set if the data
+ * contained an out-of-sequence code.
+ */
+static int lzw_decode(const unsigned char *src, int srclen, int codesize,
+                      unsigned char *dst, int npixels, bool *bad_code) {
+    short prefix[4096];
+    unsigned char suffix[4096];
+    unsigned char first[4096];
+    short length[4096];
+
+    *bad_code = false;
+    if (codesize < 1 || codesize > 11)
+        codesize = 8;
+    int clear_code = 1 << codesize;
+    int end_code = clear_code + 1;
+    for (int i = 0; i < clear_code; i++) {
+        prefix[i] = -1;
+        suffix[i] = i;
+        first[i] = i;
+        length[i] = 1;
+    }
+
+    int next_code = end_code + 1;
+    int code_size = codesize + 1;
+    int code_mask = (1 << code_size) - 1;
+    int old_code = -1;
+
+    unsigned int bitbuf = 0;
+    int bitcount = 0;
+    int srcpos = 0;
+    int out = 0;
+
+    while (out < npixels) {
+        while (bitcount < code_size && srcpos < srclen) {
+            bitbuf |= ((unsigned int) src[srcpos++]) << bitcount;
+            bitcount += 8;
+        }
+        if (bitcount < code_size)
+            break;
+        int code = bitbuf & code_mask;
+        bitbuf >>= code_size;
+        bitcount -= code_size;
+
+        if (code == clear_code) {
+            next_code = end_code + 1;
+            code_size = codesize + 1;
+            code_mask = (1 << code_size) - 1;
+            old_code = -1;
+            continue;
+        }
+        if (code == end_code)
+            break;
+
+        /* The new table entry, if any, is the string for old_code, plus the
+         * first character of the string for last_code.
+         */
+        int last_code;
+        if (code < next_code)
+            last_code = old_code != -1 && next_code < 4096 ? code : -1;
+        else if (code == next_code && old_code != -1)
+            /* Once next_code == 4096, we can't get here any more, because
+             * we refuse to raise code_size above 12 -- so we can never
+             * read a bigger code than 4095.
+             */
+            last_code = old_code;
+        else {
+            *bad_code = true;
+            break;
+        }
+        if (last_code != -1) {
+            prefix[next_code] = old_code;
+            suffix[next_code] = first[last_code];
+            first[next_code] = first[old_code];
+            length[next_code] = length[old_code] + 1;
+            if (++next_code == code_mask + 1 && code_size < 12) {
+                code_size++;
+                code_mask = (1 << code_size) - 1;
+            }
+        }
+        old_code = code;
+
+        /* Output the string for 'code' */
+        unsigned char *p = dst + out + length[code] - 1;
+        unsigned char *stop = dst + out;
+        int c = code;
+        while (p >= stop) {
+            *p-- = suffix[c];
+            c = prefix[c];
+        }
+        out += length[code];
+    }
+    return out < npixels ? out : npixels;
+}
+
+static void switch_to_8bit(SkinPixmap *pm, GifColorMap *lcmap,
+                           bool black_used, bool white_used, int *image_colors) {
+    int newbytesperline = pm->width;
+    int newsize = newbytesperline * pm->height;
+    unsigned char *newpixels = (unsigned char *) malloc(newsize);
+    // TODO - handle memory allocation failure
+    if (!white_used || !black_used)
+        memset(newpixels, 0, newsize);
+    else
+        for (int v = 0; v < pm->height; v++) {
+            unsigned char *newpixel = newpixels + newbytesperline * v;
+            for (int h = 0; h < pm->width; h++) {
+                unsigned char px = (pm->pixels[pm->bytesperline * v + (h >> 3)] >> (h & 7)) & 1;
+                *newpixel++ = px;
+            }
+        }
+    free(pm->pixels);
+    pm->pixels = newpixels;
+    pm->bytesperline = newbytesperline;
+    pm->depth = 8;
+    if (black_used && white_used) {
+        pm->cmap[0].r = 0;
+        pm->cmap[0].g = 0;
+        pm->cmap[0].b = 0;
+        pm->cmap[1].r = 255;
+        pm->cmap[1].g = 255;
+        pm->cmap[1].b = 255;
+        *image_colors = 2;
+    } else if (black_used || white_used) {
+        unsigned char c = black_used ? 0 : 255;
+        pm->cmap[0].r = c;
+        pm->cmap[0].g = c;
+        pm->cmap[0].b = c;
+        *image_colors = 1;
+    } else {
+        *image_colors = 0;
+    }
+    if (white_used && !black_used)
+        for (int i = 0; i < 256; i++)
+            if (lcmap->index[i] == 1)
+                lcmap->index[i] = 0;
+}
+
+static void switch_to_24bit(SkinPixmap *pm) {
+    int newbytesperline = pm->width * 3;
+    unsigned char *newpixels = (unsigned char *)
+                malloc(newbytesperline * pm->height);
+    // TODO - handle memory allocation failure
+    for (int v = 0; v < pm->height; v++) {
+        unsigned char *newpixel = newpixels + newbytesperline * v;
+        for (int h = 0; h < pm->width; h++) {
+            unsigned char px = pm->pixels[pm->bytesperline * v + h];
+            *newpixel++ = pm->cmap[px].r;
+            *newpixel++ = pm->cmap[px].g;
+            *newpixel++ = pm->cmap[px].b;
+        }
+    }
+    free(pm->pixels);
+    pm->pixels = newpixels;
+    pm->bytesperline = newbytesperline;
+    pm->depth = 24;
+}
+
+/* Assigns pixmap colors to all the GIF color indexes that are actually used
+ * by an image, before any of its pixels are written. This is where the
+ * pixmap gets promoted from 1-bit to 8-bit, or from 8-bit to 24-bit, if the
+ * image's colors don't fit, so the pixel loops below can be straight table
+ * lookups.
+ */
+static void map_colors(SkinPixmap *pm, GifColorMap *lcmap, const bool *used,
+                       bool *black_used, bool *white_used, int *image_colors) {
+    if (pm->depth == 1) {
+        for (int pixel = 0; pixel < 256; pixel++) {
+            if (!used[pixel] || lcmap->index[pixel] != -1)
+                continue;
+            unsigned char r = lcmap->color[pixel].r;
+            unsigned char g = lcmap->color[pixel].g;
+            unsigned char b = lcmap->color[pixel].b;
+            if (r == 0 && g == 0 && b == 0) {
+                lcmap->index[pixel] = 0;
+                *black_used = true;
+            } else if (r == 255 && g == 255 || b == 255) {
+                lcmap->index[pixel] = 1;
+                *white_used = true;
+            } else {
+                /* Not black & white; switch to 8-bit */
+                switch_to_8bit(pm, lcmap, *black_used, *white_used, image_colors);
+                break;
+            }
+        }
+    }
+    if (pm->depth == 8) {
+        for (int pixel = 0; pixel < 256; pixel++) {
+            if (!used[pixel] || lcmap->index[pixel] != -1)
+                continue;
+            unsigned char r = lcmap->color[pixel].r;
+            unsigned char g = lcmap->color[pixel].g;
+            unsigned char b = lcmap->color[pixel].b;
+            int p;
+            for (p = 0; p < *image_colors; p++)
+                if (pm->cmap[p].r == r
+                        && pm->cmap[p].g == g
+                        && pm->cmap[p].b == b)
+                    break;
+            if (p == *image_colors) {
+                if (*image_colors == 256) {
+                    /* Out of colormap entries; switch to truecolor */
+                    switch_to_24bit(pm);
+                    break;
+                }
+                (*image_colors)++;
+                pm->cmap[p].r = r;
+                pm->cmap[p].g = g;
+                pm->cmap[p].b = b;
+            }
+            lcmap->index[pixel] = p;
+        }
+    }
+}
+
+static void put_row(SkinPixmap *pm, const GifColorMap *lcmap,
+                    const unsigned char *src, int x, int y, int width) {
+    if (pm->depth == 1) {
+        unsigned char *row = pm->pixels + pm->bytesperline * y;
+        for (int h = 0; h < width; h++) {
+            int xx = x + h;
+            unsigned char mask = 1 << (xx & 7);
+            if (lcmap->index[src[h]])
+                row[xx >> 3] |= mask;
+            else
+                row[xx >> 3] &= ~mask;
+        }
+    } else if (pm->depth == 8) {
+        unsigned char *dst = pm->pixels + pm->bytesperline * y + x;
+        for (int h = 0; h < width; h++)
+            dst[h] = (unsigned char) lcmap->index[src[h]];
+    } else {
+        unsigned char *rgb = pm->pixels + pm->bytesperline * y + 3 * x;
+        for (int h = 0; h < width; h++) {
+            const SkinColor *c = lcmap->color + src[h];
+            *rgb++ = c->r;
+            *rgb++ = c->g;
+            *rgb++ = c->b;
+        }
+    }
+}
 
 int shell_loadimage() {
     SkinPixmap *pm = &pixmap;
     GifColorMap *lcmap = NULL;
     GifColorMap gcmap;
+    GifBuffer buf;
     int image_colors = 0;
 
     int sig;
@@ -87,27 +399,35 @@ int shell_loadimage() {
     bool black_used = false;
     bool white_used = false;
 
-    int i, j, type, res;
+    int i, type, res;
     unsigned char *ptr;
 
-    if (!read_byte(&sig) || sig != 'G'
-            || !read_byte(&sig) || sig != 'I'
-            || !read_byte(&sig) || sig != 'F'
-            || !read_byte(&sig) || sig != '8'
-            || !read_byte(&sig) || (sig != '7' && sig != '9')
-            || !read_byte(&sig) || sig != 'a') {
-        fprintf(stderr, "GIF signature not found.\n");
+    pm->cmap = NULL;
+    pm->pixels = NULL;
+
+    if (!read_input(&buf)) {
+        fprintf(stderr, "Insufficient memory.\n");
         return 0;
     }
 
-    if (!read_short(&pm->width)
-            || !read_short(&pm->height)
-            || !read_byte(&info)
-            || !read_byte(&background)
-            || !read_byte(&zero)
+    if (!read_byte(&buf, &sig) || sig != 'G'
+            || !read_byte(&buf, &sig) || sig != 'I'
+            || !read_byte(&buf, &sig) || sig != 'F'
+            || !read_byte(&buf, &sig) || sig != '8'
+            || !read_byte(&buf, &sig) || (sig != '7' && sig != '9')
+            || !read_byte(&buf, &sig) || sig != 'a') {
+        fprintf(stderr, "GIF signature not found.\n");
+        goto failed;
+    }
+
+    if (!read_short(&buf, &pm->width)
+            || !read_short(&buf, &pm->height)
+            || !read_byte(&buf, &info)
+            || !read_byte(&buf, &background)
+            || !read_byte(&buf, &zero)
             || zero != 0) {
         fprintf(stderr, "Fatally premature EOF.\n");
-        return 0;
+        goto failed;
     }
 
     has_global_cmap = (info & 128) != 0;
@@ -141,9 +461,9 @@ int shell_loadimage() {
     if (has_global_cmap) {
         for (i = 0; i < ncolors; i++) {
             int r, g, b;
-            if (!read_byte(&r)
-                    || !read_byte(&g)
-                    || !read_byte(&b)) {
+            if (!read_byte(&buf, &r)
+                    || !read_byte(&buf, &g)
+                    || !read_byte(&buf, &b)) {
                 fprintf(stderr, "Fatally premature EOF.\n");
                 goto failed;
             }
@@ -207,7 +527,7 @@ int shell_loadimage() {
 
     while (1) {
         int whatnext;
-        if (!read_byte(&whatnext))
+        if (!read_byte(&buf, &whatnext))
             goto unexp_eof;
         if (whatnext == ',') {
             /* Image */
@@ -218,29 +538,22 @@ int shell_loadimage() {
             int lncolors;
 
             int interlaced;
-            int h;
-            int v;
             int codesize;
-            int bytecount;
-
-            short prefix_table[4096];
-            short code_table[4096];
-
-            int maxcode;
-            int clear_code;
-            int end_code;
-
-            int curr_code_size;
-            int curr_code;
-            int old_code;
-            int bits_needed;
-            int end_code_seen;
-
-            if (!read_short(&ileft)
-                    || !read_short(&itop)
-                    || !read_short(&iwidth)
-                    || !read_short(&iheight)
-                    || !read_byte(&info))
+            int npixels;
+            int ndecoded;
+            bool complete;
+            bool bad_code;
+
+            unsigned char *lzw_data;
+            int lzw_length;
+            unsigned char *image;
+            bool used[256];
+
+            if (!read_short(&buf, &ileft)
+                    || !read_short(&buf, &itop)
+                    || !read_short(&buf, &iwidth)
+                    || !read_short(&buf, &iheight)
+                    || !read_byte(&buf, &info))
                 goto unexp_eof;
 
             if (itop + iheight > pm->height
@@ -271,9 +584,9 @@ int shell_loadimage() {
                 // TODO - handle memory allocation failure
                 for (i = 0; i < lncolors; i++) {
                     int r, g, b;
-                    if (!read_byte(&r)
-                            || !read_byte(&g)
-                            || !read_byte(&b))
+                    if (!read_byte(&buf, &r)
+                            || !read_byte(&buf, &g)
+                            || !read_byte(&buf, &b))
                         goto unexp_eof;
                     lcmap->color[i].r = r;
                     lcmap->color[i].g = g;
@@ -282,304 +595,82 @@ int shell_loadimage() {
             }
 
             interlaced = (info & 64) != 0;
-            h = 0;
-            v = 0;
-            if (!read_byte(&codesize) || !read_byte(&bytecount))
+            if (!read_byte(&buf, &codesize))
                 goto unexp_eof;
 
-            maxcode = 1 << codesize;
-            for (i = 0; i < maxcode + 2; i++) {
-                prefix_table[i] = -1;
-                code_table[i] = i;
+            complete = read_sub_blocks(&buf, &lzw_data, &lzw_length);
+            npixels = iwidth * iheight;
+            image = (unsigned char *) malloc(npixels + 4096);
+            if (lzw_data == NULL || image == NULL) {
+                free(lzw_data);
+                free(image);
+                fprintf(stderr, "Insufficient memory.\n");
+                goto failed;
             }
-            clear_code = maxcode++;
-            end_code = maxcode++;
-
-            curr_code_size = codesize + 1;
-            curr_code = 0;
-            old_code = -1;
-            bits_needed = curr_code_size;
-            end_code_seen = 0;
-
-            while (bytecount != 0) {
-                for (i = 0; i < bytecount; i++) {
-                    int currbyte;
-                    int bits_available;
-
-                    if (!read_byte(&currbyte))
-                        goto unexp_eof;
-                    if (end_code_seen)
-                        continue;
-
-                    bits_available = 8;
-                    while (bits_available != 0) {
-                        int bits_copied = bits_needed < bits_available ?
-                                    bits_needed : bits_available;
-                        int bits = currbyte >> (8 - bits_available);
-                        bits &= 255 >> (8 - bits_copied);
-                        curr_code |= bits << (curr_code_size - bits_needed);
-                        bits_available -= bits_copied;
-                        bits_needed -= bits_copied;
-
-                        if (bits_needed == 0) {
-                            if (curr_code == end_code) {
-                                end_code_seen = 1;
-                            } else if (curr_code == clear_code) {
-                                maxcode = (1 << codesize) + 2;
-                                curr_code_size = codesize + 1;
-                                old_code = -1;
-                            } else {
-                                unsigned char expanded[4096];
-                                int explen;
-
-                                if (curr_code < maxcode) {
-                                    if (maxcode < 4096 && old_code != -1) {
-                                        int c = curr_code;
-                                        while (prefix_table[c] != -1)
-                                            c = prefix_table[c];
-                                        c = code_table[c];
-                                        prefix_table[maxcode] = old_code;
-                                        code_table[maxcode] = c;
-                                        maxcode++;
-                                        if (maxcode == (1 << curr_code_size)
-                                                && curr_code_size < 12)
-                                            curr_code_size++;
-                                    }
-                                } else if (curr_code == maxcode) {
-                                    /* Once maxcode == 4096, we can't get here
-                                     * any more, because we refuse to raise
-                                     * curr_code_size above 12 -- so we can
-                                     * never read a bigger code than 4095.
-                                     */
-                                    int c;
-                                    if (old_code == -1) {
-                                        fprintf(stderr, "Out-of-sequence code in compressed data.\n");
-                                        goto done;
-                                    }
-                                    c = old_code;
-                                    while (prefix_table[c] != -1)
-                                        c = prefix_table[c];
-                                    c = code_table[c];
-                                    prefix_table[maxcode] = old_code;
-                                    code_table[maxcode] = c;
-                                    maxcode++;
-                                    if (maxcode == (1 << curr_code_size)
-                                            && curr_code_size < 12)
-                                        curr_code_size++;
-                                } else {
-                                    fprintf(stderr, "Out-of-sequence code in compressed data.\n");
-                                    goto done;
-                                }
-
-                                old_code = curr_code;
-
-                                /* Output curr_code! */
-                                explen = 0;
-                                while (curr_code != -1) {
-                                    expanded[explen++] =
-                                        (unsigned char) code_table[curr_code];
-                                    curr_code = prefix_table[curr_code];
-                                }
-                                for (j = explen - 1; j >= 0; j--) {
-                                    int pixel = expanded[j];
-                                    if (pm->depth == 1) {
-                                        int p = lcmap->index[pixel];
-                                        if (p == -1) {
-                                            unsigned char r = lcmap->color[pixel].r;
-                                            unsigned char g = lcmap->color[pixel].g;
-                                            unsigned char b = lcmap->color[pixel].b;
-                                            if (r == 0 && g == 0 && b == 0) {
-                                                p = 0;
-                                                black_used = true;
-                                            } else if (r == 255 && g == 255 || b == 255) {
-                                                p = 1;
-                                                white_used = true;
-                                            } else {
-                                                /* Not black & white; switch to 8-bit */
-                                                int newbytesperline = pm->width;
-                                                int newsize = newbytesperline * pm->height;
-                                                unsigned char *newpixels = (unsigned char *)
-                                                            malloc(newsize);
-                                                // TODO - handle memory allocation failure
-                                                if (!white_used || !black_used)
-                                                    memset(newpixels, 0, newsize);
-                                                else
-                                                    for (int v = 0; v < pm->height; v++) {
-                                                        unsigned char *newpixel = newpixels + newbytesperline * v;
-                                                        for (int h = 0; h < pm->width; h++) {
-                                                            unsigned char px = (pm->pixels[pm->bytesperline * v + (h >> 3)] >> (h & 7)) & 1;
-                                                            *newpixel++ = px;
-                                                        }
-                                                    }
-                                                free(pm->pixels);
-                                                pm->pixels = newpixels;
-                                                pm->bytesperline = newbytesperline;
-                                                pm->depth = 8;
-                                                if (black_used && white_used) {
-                                                    pm->cmap[0].r = 0;
-                                                    pm->cmap[0].g = 0;
-                                                    pm->cmap[0].b = 0;
-                                                    pm->cmap[1].r = 255;
-                                                    pm->cmap[1].g = 255;
-                                                    pm->cmap[1].b = 255;
-                                                    image_colors = 2;
-                                                } else if (black_used || white_used) {
-                                                    unsigned char c = black_used ? 0 : 255;
-                                                    pm->cmap[0].r = c;
-                                                    pm->cmap[0].g = c;
-                                                    pm->cmap[0].b = c;
-                                                    image_colors = 1;
-                                                } else {
-                                                    image_colors = 0;
-                                                }
-                                                if (white_used && !black_used)
-                                                    for (i = 0; i < 256; i++)
-                                                        if (lcmap->index[i] == 1)
-                                                            lcmap->index[i] = 0;
-                                                goto indexed;
-                                            }
-                                            lcmap->index[pixel] = p;
-                                        }
-                                        int x = ileft + h;
-                                        int index = pm->bytesperline * (itop + v) + (x >> 3);
-                                        unsigned char mask = 1 << (x & 7);
-                                        if (p)
-                                            pm->pixels[index] |= mask;
-                                        else
-                                            pm->pixels[index] &= ~mask;
-                                    } else if (pm->depth == 8) {
-                                        indexed:
-                                        int p = lcmap->index[pixel];
-                                        if (p == -1) {
-                                            unsigned char r = lcmap->color[pixel].r;
-                                            unsigned char g = lcmap->color[pixel].g;
-                                            unsigned char b = lcmap->color[pixel].b;
-                                            for (p = 0; p < image_colors; p++)
-                                                if (pm->cmap[p].r == r
-                                                        && pm->cmap[p].g == g
-                                                        && pm->cmap[p].b == b) {
-                                                    lcmap->index[pixel] = p;
-                                                    goto found;
-                                                }
-                                            if (image_colors == 256) {
-                                                /* Out of colormap entries; switch to truecolor */
-                                                int newbytesperline = pm->width * 3;
-                                                unsigned char *newpixels = (unsigned char *)
-                                                            malloc(newbytesperline * pm->height);
-                                                // TODO - handle memory allocation failure
-                                                for (int v = 0; v < pm->height; v++) {
-                                                    unsigned char *newpixel = newpixels + newbytesperline * v;
-                                                    for (int h = 0; h < pm->width; h++) {
-                                                        unsigned char px = pm->pixels[pm->bytesperline * v + h];
-                                                        *newpixel++ = pm->cmap[px].r;
-                                                        *newpixel++ = pm->cmap[px].g;
-                                                        *newpixel++ = pm->cmap[px].b;
-                                                    }
-                                                }
-                                                free(pm->pixels);
-                                                pm->pixels = newpixels;
-                                                pm->bytesperline = newbytesperline;
-                                                pm->depth = 24;
-                                                goto truecolor;
-                                            }
-                                            p = image_colors++;
-                                            pm->cmap[p].r = r;
-                                            pm->cmap[p].g = g;
-                                            pm->cmap[p].b = b;
-                                            lcmap->index[pixel] = p;
-                                        }
-                                        found:
-                                        pm->pixels[pm->bytesperline * (itop + v) + ileft + h] = p;
-                                    } else {
-                                        truecolor:
-                                        unsigned char *rgb = pm->pixels + (pm->bytesperline * (itop + v) + 3 * (ileft + h));
-                                        *rgb++ = lcmap->color[pixel].r;
-                                        *rgb++ = lcmap->color[pixel].g;
-                                        *rgb = lcmap->color[pixel].b;
-                                    }
-                                    if (++h == iwidth) {
-                                        h = 0;
-                                        if (interlaced) {
-                                            switch (v & 7) {
-                                                case 0:
-                                                    v += 8;
-                                                    if (v < iheight)
-                                                        break;
-                                                    /* Some GIF en/decoders go
-                                                     * straight from the '0'
-                                                     * pass to the '4' pass
-                                                     * without checking the
-                                                     * height, and blow up on
-                                                     * 2/3/4 pixel high
-                                                     * interlaced images.
-                                                     */
-                                                    if (iheight > 4)
-                                                        v = 4;
-                                                    else if (iheight > 2)
-                                                        v = 2;
-                                                    else if (iheight > 1)
-                                                        v = 1;
-                                                    else
-                                                        end_code_seen = 1;
-                                                    break;
-                                                case 4:
-                                                    v += 8;
-                                                    if (v >= iheight)
-                                                        v = 2;
-                                                    break;
-                                                case 2:
-                                                case 6:
-                                                    v += 4;
-                                                    if (v >= iheight)
-                                                        v = 1;
-                                                    break;
-                                                case 1:
-                                                case 3:
-                                                case 5:
-                                                case 7:
-                                                    v += 2;
-                                                    if (v >= iheight)
-                                                        end_code_seen = 1;
-                                                    break;
-                                            }
-                                            if (end_code_seen)
-                                                break;
-                                        } else {
-                                            if (++v == iheight) {
-                                                end_code_seen = 1;
-                                                break;
-                                            }
-                                        }
-                                    }
-                                }
-                            }
-                            curr_code = 0;
-                            bits_needed = curr_code_size;
-                        }
+            ndecoded = lzw_decode(lzw_data, lzw_length, codesize,
+                                  image, npixels, &bad_code);
+            free(lzw_data);
+
+            memset(used, 0, sizeof(used));
+            for (i = 0; i < ndecoded; i++)
+                used[image[i]] = true;
+            map_colors(pm, lcmap, used, &black_used, &white_used, &image_colors);
+
+            if (interlaced) {
+                /* Rows are stored in four passes: every 8th row starting
+                 * at row 0, every 8th row starting at row 4, every 4th
+                 * row starting at row 2, and every 2nd row starting at
+                 * row 1.
+                 */
+                static const int start[] = { 0, 4, 2, 1 };
+                static const int step[] = { 8, 8, 4, 2 };
+                int row = 0;
+                for (int pass = 0; pass < 4; pass++)
+                    for (int v = start[pass]; v < iheight; v += step[pass]) {
+                        int n = ndecoded - row * iwidth;
+                        if (n <= 0)
+                            goto image_done;
+                        put_row(pm, lcmap, image + row * iwidth, ileft, itop + v,
+                                n < iwidth ? n : iwidth);
+                        row++;
                     }
+            } else {
+                for (int v = 0; v < iheight; v++) {
+                    int n = ndecoded - v * iwidth;
+                    if (n <= 0)
+                        break;
+                    put_row(pm, lcmap, image + v * iwidth, ileft, itop + v,
+                            n < iwidth ? n : iwidth);
                 }
-                if (!read_byte(&bytecount))
-                    goto unexp_eof;
             }
+            image_done:
+            free(image);
 
             if (lcmap != &gcmap)
                 delete lcmap;
             lcmap = NULL;
 
+            if (bad_code) {
+                fprintf(stderr, "Out-of-sequence code in compressed data.\n");
+                goto done;
+            }
+            if (!complete)
+                goto unexp_eof;
+
         } else if (whatnext == '!') {
             /* Extension block */
             int function_code, byte_count;
-            if (!read_byte(&function_code))
+            if (!read_byte(&buf, &function_code))
                 goto unexp_eof;
-            if (!read_byte(&byte_count))
+            if (!read_byte(&buf, &byte_count))
                 goto unexp_eof;
             while (byte_count != 0) {
                 for (i = 0; i < byte_count; i++) {
                     int dummy;
-                    if (!read_byte(&dummy))
+                    if (!read_byte(&buf, &dummy))
                         goto unexp_eof;
                 }
-                if (!read_byte(&byte_count))
+                if (!read_byte(&buf, &byte_count))
                     goto unexp_eof;
             }
         } else if (whatnext == ';') {
@@ -593,6 +684,7 @@ int shell_loadimage() {
     }
 
     done:
+    free(buf.data);
     if (lcmap != NULL && lcmap != &gcmap)
         delete lcmap;
     if (pm->depth == 1 || pm->depth == 24) {
@@ -631,6 +723,7 @@ int shell_loadimage() {
 
 
     failed:
+    free(buf.data);
     if (lcmap != NULL && lcmap != &gcmap)
         delete lcmap;
     if (pm->cmap != NULL) {
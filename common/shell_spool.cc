@@ -18,6 +18,7 @@
 #ifndef ANDROID
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "shell_spool.h"
 #include "core_main.h"
@@ -137,15 +138,17 @@ void shell_spool_bitmap_to_txt(const char *bits, int bytesperline,
     }
 }
 
+/* The printer only ever produces black and white bitmaps, so the GIF
+ * encoder works with 1-bit pixels. That allows the string table to be
+ * indexed directly by (prefix code, pixel), so finding the extension of the
+ * current string is a single lookup rather than a hash chain search.
+ */
 struct gif_data {
     int codesize;
     int bytecount;
     char buf[255];
 
-    short prefix_table[4096];
-    short code_table[4096];
-    short hash_next[4096];
-    short hash_head[256];
+    short child[4096][2];
 
     int maxcode;
     int clear_code;
@@ -153,10 +156,9 @@ struct gif_data {
 
     int curr_code_size;
     int prefix;
-    int currbyte;
-    int bits_needed;
+    uint4 bitbuf;
+    int bitcount;
     int initial_clear;
-    int really_done;
 
     int width;
     int height;
@@ -165,11 +167,46 @@ struct gif_data {
 static gif_data *g;
 
 
+static void gif_clear_table() {
+    memset(g->child, 0xff, sizeof(g->child));
+    g->maxcode = (1 << g->codesize) + 2;
+    g->curr_code_size = g->codesize + 1;
+}
+
+static void gif_put_code(int code, file_writer writer) {
+    g->bitbuf |= ((uint4) code) << g->bitcount;
+    g->bitcount += g->curr_code_size;
+    while (g->bitcount >= 8) {
+        g->buf[g->bytecount++] = (char) g->bitbuf;
+        g->bitbuf >>= 8;
+        g->bitcount -= 8;
+        if (g->bytecount == 255) {
+            char c = (char) g->bytecount;
+            writer(&c, 1);
+            writer(g->buf, g->bytecount);
+            g->bytecount = 0;
+        }
+    }
+}
+
+static void gif_emit(int code, file_writer writer) {
+    if (g->initial_clear) {
+        gif_put_code(g->clear_code, writer);
+        g->initial_clear = 0;
+    }
+    gif_put_code(code, writer);
+    if (g->maxcode > (1 << g->curr_code_size)) {
+        g->curr_code_size++;
+    } else if (g->maxcode == 4096) {
+        gif_put_code(g->clear_code, writer);
+        gif_clear_table();
+    }
+}
+
 int shell_start_gif(file_writer writer, int width, int provisional_height) {
     char buf[29];
     char *p = buf, c;
     int height = provisional_height;
-    int i;
 
     /* NOTE: the height will be set to the *actual* height once we know
      * what that is, i.e., when shell_finish_gif() is called. We populate
@@ -235,24 +272,14 @@ int shell_start_gif(file_writer writer, int width, int provisional_height) {
 
     g->codesize = 2;
     g->bytecount = 0;
-    g->maxcode = 1 << g->codesize;
-    for (i = 0; i < g->maxcode; i++) {
-        g->prefix_table[i] = -1;
-        g->code_table[i] = i;
-        g->hash_next[i] = -1;
-    }
-    for (i = 0; i < 256; i++)
-        g->hash_head[i] = -1;
+    g->clear_code = 1 << g->codesize;
+    g->end_code = g->clear_code + 1;
+    gif_clear_table();
 
-    g->clear_code = g->maxcode++;
-    g->end_code = g->maxcode++;
-
-    g->curr_code_size = g->codesize + 1;
     g->prefix = -1;
-    g->currbyte = 0;
-    g->bits_needed = 8;
+    g->bitbuf = 0;
+    g->bitcount = 0;
     g->initial_clear = 1;
-    g->really_done = 0;
 
     g->width = width;
     g->height = 0;
@@ -271,127 +298,30 @@ void shell_spool_gif(const char *bits, int bytesperline,
 
     /* Encode Image Data */
 
-    for (v = y; v < y + height || (v == y && height == 0); v++) {
-        int done = v == y && height == 0;
+    for (v = y; v < y + height; v++) {
+        const char *row = bits + bytesperline * v;
         for (h = 0; h < g->width; h++) {
-            int new_code;
-            unsigned char hash_code;
-            int hash_index;
-            int pixel;
-
-            if (g->really_done) {
-                new_code = g->end_code;
-                goto emit;
-            } else if (done) {
-                new_code = g->prefix;
-                goto emit;
-            }
-
-            if (h < width)
-                pixel = ((bits[bytesperline * v + (h >> 3)]) >> (h & 7)) & 1;
-            else
-                pixel = 0;
+            int pixel = h < width ? (row[h >> 3] >> (h & 7)) & 1 : 0;
 
-            /* Look for concat(prefix, pixel) in string table */
             if (g->prefix == -1) {
                 g->prefix = pixel;
-                goto no_emit;
+                continue;
             }
 
-            /* Compute hash code
-             * TODO: There's a lot of room for improvement here!
-             * I'm getting search percentages of over 30%; looking for
-             * something in single digits.
-             */
-            {
-                unsigned long x = (((long) g->prefix) << 20)
-                                        + (((long) pixel) << 12);
-                unsigned char b1, b2, b3;
-                x /= 997;
-                b1 = (unsigned char) (x >> 16);
-                b2 = (unsigned char) (x >> 8);
-                b3 = (unsigned char) x;
-                hash_code = b1 ^ b2 ^ b3;
-            }
-            hash_index = g->hash_head[hash_code];
-            while (hash_index != -1) {
-                if (g->prefix_table[hash_index] == g->prefix
-                         && g->code_table[hash_index] == pixel) {
-                    g->prefix = hash_index;
-                    goto no_emit;
-                }
-                hash_index = g->hash_next[hash_index];
+            /* Look for concat(prefix, pixel) in string table */
+            int code = g->child[g->prefix][pixel];
+            if (code != -1) {
+                g->prefix = code;
+                continue;
             }
 
             /* Not found: */
-            if (g->maxcode < 4096) {
-                g->prefix_table[g->maxcode] = g->prefix;
-                g->code_table[g->maxcode] = pixel;
-                g->hash_next[g->maxcode] = g->hash_head[hash_code];
-                g->hash_head[hash_code] = g->maxcode;
-                g->maxcode++;
-            }
-            new_code = g->prefix;
+            if (g->maxcode < 4096)
+                g->child[g->prefix][pixel] = g->maxcode++;
+            gif_emit(g->prefix, writer);
             g->prefix = pixel;
-
-            emit: {
-                int outcode = g->initial_clear ? g->clear_code
-                                    : g->really_done ? g->end_code : new_code;
-                int bits_available = g->curr_code_size;
-                while (bits_available != 0) {
-                    int bits_copied = g->bits_needed < bits_available ?
-                                g->bits_needed : bits_available;
-                    int bits = outcode >> (g->curr_code_size - bits_available);
-                    bits &= 255 >> (8 - bits_copied);
-                    g->currbyte |= bits << (8 - g->bits_needed);
-                    bits_available -= bits_copied;
-                    g->bits_needed -= bits_copied;
-                    if (g->bits_needed == 0 ||
-                                    (bits_available == 0 && g->really_done)) {
-                        g->buf[g->bytecount++] = g->currbyte;
-                        if (g->bytecount == 255) {
-                            char c = g->bytecount;
-                            writer(&c, 1);
-                            writer(g->buf, g->bytecount);
-                            g->bytecount = 0;
-                        }
-                        if (bits_available == 0 && g->really_done)
-                            goto data_done;
-                        g->currbyte = 0;
-                        g->bits_needed = 8;
-                    }
-                }
-
-                if (done) {
-                    done = 0;
-                    g->really_done = 1;
-                    goto emit;
-                }
-                if (g->initial_clear) {
-                    g->initial_clear = 0;
-                    goto emit;
-                } else {
-                    if (g->maxcode > (1 << g->curr_code_size)) {
-                        g->curr_code_size++;
-                    } else if (new_code == g->clear_code) {
-                        int i;
-                        g->maxcode = (1 << g->codesize) + 2;
-                        g->curr_code_size = g->codesize + 1;
-                        for (i = 0; i < 256; i++)
-                            g->hash_head[i] = -1;
-                    } else if (g->maxcode == 4096) {
-                        new_code = g->clear_code;
-                        goto emit;
-                    }
-                }
-            }
-
-            no_emit:;
         }
     }
-
-    data_done:
-    ;
 }
 
 void shell_finish_gif(file_seeker seeker, file_writer writer) {
@@ -399,7 +329,18 @@ void shell_finish_gif(file_seeker seeker, file_writer writer) {
 
     /* Flush the encoder and write any remaining data */
 
-    shell_spool_gif(NULL, 0, 0, 0, 0, 0, writer);
+    if (g->initial_clear) {
+        gif_put_code(g->clear_code, writer);
+        g->initial_clear = 0;
+    }
+    if (g->prefix != -1)
+        gif_put_code(g->prefix, writer);
+    gif_put_code(g->end_code, writer);
+    if (g->bitcount > 0) {
+        g->buf[g->bytecount++] = (char) g->bitbuf;
+        g->bitbuf = 0;
+        g->bitcount = 0;
+    }
 
     if (g->bytecount > 0) {
         c = g->bytecount;
@@ -0,0 +1,290 @@
+#include <string>
+#include <vector>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <locale.h>
+
+#include "core_main.h"
+#include "core_display.h"
+#include "core_globals.h"
+#include "core_tables.h"
+#include "core_variables.h"
+
+// Renders a binary trace, as written by core_trace_open(), as a program
+// listing. Every executed line is shown with the X register after it was
+// executed; when execution moves to a different program, its header line is
+// shown first.
+
+struct trace_prgm {
+    bool valid;
+    std::vector<int4> pcs;
+    std::vector<std::string> lines;
+};
+
+static std::vector<trace_prgm> trace_prgms;
+
+static void load_program(int index, unsigned char *text, int4 size) {
+    if (index >= (int) trace_prgms.size())
+        trace_prgms.resize(index + 1);
+    trace_prgm *tp = &trace_prgms[index];
+    tp->valid = true;
+    tp->pcs.clear();
+    tp->lines.clear();
+
+    prgm_struct p;
+    p.capacity = size;
+    p.size = size;
+    p.lclbl_invalid = 1;
+    p.text = text;
+    prgm_struct *saved_prgms = prgms;
+    int saved_count = prgms_count;
+    prgms = &p;
+    prgms_count = 1;
+    current_prgm = 0;
+
+    int4 pc = 0;
+    while (pc < size) {
+        int cmd;
+        arg_struct arg;
+        tp->pcs.push_back(pc);
+        get_next_command(&pc, &cmd, &arg, 0, NULL);
+    }
+
+    textbuf tb;
+    tb.buf = NULL;
+    tb.size = 0;
+    tb.capacity = 0;
+    tb.fail = false;
+    tb_print_current_program(&tb);
+    size_t start = 0;
+    for (size_t i = 0; i + 1 < tb.size; i++)
+        if (tb.buf[i] == '\r' && tb.buf[i + 1] == '\n') {
+            tp->lines.push_back(std::string(tb.buf + start, i - start));
+            start = i + 2;
+        }
+    free(tb.buf);
+
+    prgms = saved_prgms;
+    prgms_count = saved_count;
+}
+
+static int pad_width(const std::string &s) {
+    // The listing is UTF-8; count characters, not bytes
+    int w = 0;
+    for (size_t i = 0; i < s.length(); i++)
+        if ((s[i] & 0xc0) != 0x80)
+            w++;
+    return w < 24 ? 24 - w : 2;
+}
+
+static int4 find_line(const trace_prgm *tp, int4 pc) {
+    // pcs is sorted, so this is a binary search
+    int4 lo = 0, hi = (int4) tp->pcs.size() - 1;
+    while (lo < hi) {
+        int4 mid = (lo + hi + 1) / 2;
+        if (tp->pcs[mid] <= pc)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    return lo + 1;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <trace-file>\nBuild date: %s\n", argv[0], __DATE__);
+        return 1;
+    }
+
+    FILE *in = fopen(argv[1], "rb");
+    if (in == NULL) {
+        fprintf(stderr, "Can't open input file: %s\n", strerror(errno));
+        return 1;
+    }
+
+    char magic[8];
+    int4 header[2];
+    if (fread(magic, 1, 8, in) != 8 || memcmp(magic, "F42TRACE", 8) != 0
+            || fread(header, 1, 8, in) != 8 || header[0] != 1) {
+        fprintf(stderr, "Not a trace file\n");
+        return 1;
+    }
+    if (header[1] != sizeof(phloat)) {
+        fprintf(stderr, "This trace was written by a %s version; use the matching trace2txt\n",
+                header[1] == 8 ? "binary" : "decimal");
+        return 1;
+    }
+
+    core_init(0, 0, NULL, 0);
+
+    int len = strlen(argv[1]);
+    if (len >= 6 && strcasecmp(argv[1] + (len - 6), ".trace") == 0)
+        len -= 6;
+    std::string outname = std::string(argv[1], len) + ".txt";
+
+    FILE *out = fopen(outname.c_str(), "wb");
+    if (out == NULL) {
+        fprintf(stderr, "Can't open output file: %s\n", strerror(errno));
+        return 1;
+    }
+
+    int last_prgm = -1;
+    int c;
+    while ((c = fgetc(in)) != EOF) {
+        if (c == 'P') {
+            int4 index, size;
+            if (fread(&index, 1, 4, in) != 4 || fread(&size, 1, 4, in) != 4
+                    || index < 0 || size < 0)
+                goto truncated;
+            unsigned char *text = (unsigned char *) malloc(size + 2);
+            if (text == NULL || fread(text, 1, size, in) != (size_t) size) {
+                free(text);
+                goto truncated;
+            }
+            load_program(index, text, size);
+            free(text);
+            if (index == last_prgm)
+                last_prgm = -1;
+        } else if (c == 'I') {
+            char rec[15 + sizeof(phloat)];
+            if (fread(rec, 1, 15, in) != 15)
+                goto truncated;
+            int4 prgm, pc;
+            int2 cmd;
+            memcpy(&prgm, rec, 4);
+            memcpy(&pc, rec + 4, 4);
+            memcpy(&cmd, rec + 8, 2);
+            int type = rec[14];
+            phloat x;
+            if (type == TYPE_REAL) {
+                if (fread(&x, 1, sizeof(phloat), in) != sizeof(phloat))
+                    goto truncated;
+            }
+            if (prgm < 0 || prgm >= (int) trace_prgms.size() || !trace_prgms[prgm].valid) {
+                fprintf(stderr, "Trace refers to unknown program %d\n", prgm);
+                return 1;
+            }
+            const trace_prgm *tp = &trace_prgms[prgm];
+            if (prgm != last_prgm) {
+                if (last_prgm != -1)
+                    fputs("\r\n", out);
+                fprintf(out, "%s\r\n", tp->lines[0].c_str());
+                last_prgm = prgm;
+            } else if (cmd == CMD_LBL)
+                fputs("\r\n", out);
+            int4 line = find_line(tp, pc);
+            const std::string &s = tp->lines[line];
+            fputs(s.c_str(), out);
+            if (type == TYPE_REAL) {
+                char buf[50];
+                int bufptr = phloat2string(x, buf, 49, 0, 0, 3, 0, MAX_MANT_DIGITS);
+                for (int i = 0; i < bufptr; i++)
+                    if (buf[i] == 24)
+                        buf[i] = 'e';
+                buf[bufptr] = 0;
+                fprintf(out, "%*s%s", pad_width(s), "", buf);
+            } else if (type != TYPE_NULL) {
+                static const char *names[] = { "", "", "[Complex]", "[Real Matrix]", "[Complex Matrix]", "[String]", "[List]", "[Dict]", "[Sparse Matrix]" };
+                if (type < (int) (sizeof(names) / sizeof(names[0]))) {
+                    fprintf(out, "%*s%s", pad_width(s), "", names[type]);
+                }
+            }
+            fputs("\r\n", out);
+        } else {
+            fprintf(stderr, "Corrupt trace file\n");
+            return 1;
+        }
+    }
+    fclose(in);
+    fclose(out);
+    return 0;
+
+    truncated:
+    fprintf(stderr, "Trace file is truncated\n");
+    fclose(out);
+    return 1;
+}
+
+const char *shell_platform() {
+    return NULL;
+}
+
+void shell_blitter(const char *bits, int bytesperline, int x, int y,
+                             int width, int height) {
+    //
+}
+
+void shell_beeper(int tone) {
+    //
+}
+
+void shell_annunciators(int updn, int shf, int prt, int run, int g, int rad) {
+    //
+}
+
+bool shell_wants_cpu() {
+    return false;
+}
+
+void shell_delay(int duration) {
+    //
+}
+
+void shell_request_timeout3(int delay) {
+    //
+}
+
+uint8 shell_get_mem() {
+    return 0;
+}
+
+bool shell_low_battery() {
+    return false;
+}
+
+void shell_powerdown() {
+    //
+}
+
+int8 shell_random_seed() {
+    return 0;
+}
+
+uint4 shell_milliseconds() {
+    return 0;
+}
+
+const char *shell_number_format() {
+    return localeconv()->decimal_point;
+}
+
+int shell_date_format() {
+    return 0;
+}
+
+bool shell_clk24() {
+    return false;
+}
+
+void shell_print(const char *text, int length,
+                 const char *bits, int bytesperline,
+                 int x, int y, int width, int height) {
+    //
+}
+
+void shell_get_time_date(uint4 *time, uint4 *date, int *weekday) {
+    *time = 0;
+    *date = 15821015;
+    *weekday = 5;
+}
+
+void shell_message(const char *message) {
+    //
+}
+
+void shell_log(const char *message) {
+    //
+}
@@ -21,10 +21,11 @@
 #include <unistd.h>
 #include <math.h>
 #include <alsa/asoundlib.h>
-#include <sys/time.h>
 #include <pthread.h>
+#include <semaphore.h>
 #include <dlfcn.h>
-#include <math.h>
+#include <errno.h>
+#include <time.h>
 
 // We want to be able to run even if libasound is not present, so we have to
 // link it manually using dlopen() and dlsym(). These are the functions we are
@@ -88,22 +89,69 @@ _ptr_snd_pcm_sw_params_set_silence_threshold _dl_snd_pcm_sw_params_set_silence_t
 _ptr_snd_pcm_writei _dl_snd_pcm_writei;
 _ptr_snd_strerror _dl_snd_strerror;
 
-#define TDIFF(begin,end) (((double)(end.tv_sec - begin.tv_sec)*1000.0) + ((end.tv_usec - begin.tv_usec)/1000.0))
-
 static unsigned int audio_sample_rate = 22050;
 static snd_pcm_format_t audio_format = SND_PCM_FORMAT_S16;
 static const char *audio_device = "default";
 static int audio_channels = 1;
 
+/* Tones are played by a persistent audio thread. alsa_beeper() passes tone
+ * requests to it through a single-producer, single-consumer ring buffer, so
+ * the caller doesn't have to wait for the samples to be written. The thread
+ * closes the device after it has been idle for AUDIO_IDLE_SECONDS; it is
+ * reopened by alsa_beeper(), so that a failure to open it can be reported
+ * to the shell, which then falls back on gdk_display_beep() for that tone.
+ * After a failure, alsa_beeper() doesn't try again until a backoff delay
+ * has passed, starting at AUDIO_RETRY_MIN and doubling up to
+ * AUDIO_RETRY_MAX seconds, so a device that is busy for a while doesn't
+ * cost an open attempt for every tone, but is picked up again once it's
+ * free.
+ * Waveforms are synthesized once per distinct tone, and cached, so playing
+ * a tone again is just a matter of writing the cached buffer.
+ */
+#define AUDIO_QUEUE_SIZE 16
+#define AUDIO_IDLE_SECONDS 5
+#define AUDIO_MAX_TONES 16
+#define AUDIO_RETRY_MIN 1
+#define AUDIO_RETRY_MAX 60
+
+struct tone_request {
+    int frequency;
+    int duration;
+};
+
+struct tone_buffer {
+    int frequency;
+    int duration;
+    int frames;
+    char *samples;
+};
+
 static snd_pcm_t *playback_handle = NULL;
 static bool audio_initialized = false;
 static snd_pcm_uframes_t buffer_size;
 
-static struct timeval last_use;
-
-static pthread_mutex_t closer_mutex = PTHREAD_MUTEX_INITIALIZER;
-static pthread_cond_t closer_cond = PTHREAD_COND_INITIALIZER;
-static pthread_t closer_thread;
+static tone_request audio_queue[AUDIO_QUEUE_SIZE];
+// audio_queue_head is only written by alsa_beeper(), audio_queue_tail only
+// by the audio thread
+static unsigned int audio_queue_head = 0;
+static unsigned int audio_queue_tail = 0;
+static sem_t audio_sem;
+static pthread_t audio_thread;
+static bool audio_thread_started = false;
+// Held while opening or closing the device, so the audio thread can't close
+// it between alsa_beeper() finding it open and queueing a tone
+static pthread_mutex_t audio_mutex = PTHREAD_MUTEX_INITIALIZER;
+// When to try opening the device again after a failure, and how long to
+// wait after the next failure; only used by the thread calling alsa_beeper()
+static struct timespec audio_retry_time = { 0, 0 };
+static int audio_retry_delay = AUDIO_RETRY_MIN;
+
+static tone_buffer tone_buffers[AUDIO_MAX_TONES];
+static int tone_buffers_count = 0;
+
+// When the last queued tone will have finished playing; only used by the
+// thread calling alsa_beeper()
+static struct timespec queue_end = { 0, 0 };
 
 static int audio_set_hw_params(snd_pcm_hw_params_t *hw_params) {
     int err;
@@ -176,24 +224,6 @@ static int audio_set_sw_params(snd_pcm_sw_params_t *sw_params) {
     return 0;
 }
 
-static void *closer(void *) {
-    pthread_mutex_lock(&closer_mutex);
-    while (true) {
-        struct timespec when;
-        when.tv_sec = last_use.tv_sec + 5;
-        when.tv_nsec = last_use.tv_usec * 1000L;
-        struct timeval now;
-        gettimeofday(&now, NULL);
-        if (when.tv_sec < now.tv_sec || when.tv_sec == now.tv_sec && when.tv_nsec < now.tv_usec * 1000L)
-            break;
-        pthread_cond_timedwait(&closer_cond, &closer_mutex, &when);
-    }
-    _dl_snd_pcm_close(playback_handle);
-    audio_initialized = false;
-    pthread_mutex_unlock(&closer_mutex);
-    return NULL;
-}
-
 static bool open_libasound() {
     void *lib = dlopen(ALSALIB, RTLD_NOW);
     if (lib == NULL) {
@@ -235,15 +265,7 @@ static bool open_libasound() {
     return false;
 }
 
-static bool audio_init() {
-    if (libasound_state == 0)
-        libasound_state = open_libasound() ? 1 : 2;
-    if (libasound_state == 2)
-        return false;
-
-    if (audio_initialized)
-        return true;
-
+static bool audio_open() {
     int err;
 
     if ((err = _dl_snd_pcm_open(&playback_handle, audio_device, SND_PCM_STREAM_PLAYBACK, 0)) == 0) {
@@ -270,9 +292,7 @@ static bool audio_init() {
         return false;
     }
 
-    audio_initialized = true;
-
-    pthread_create(&closer_thread, NULL, closer, NULL);
+    __atomic_store_n(&audio_initialized, true, __ATOMIC_RELEASE);
     return true;
 }
 
@@ -296,17 +316,10 @@ static int xrun_recovery(snd_pcm_t *handle, int err)
     return err;
 }
 
-bool alsa_beeper(int frequency, int duration) {
-    pthread_mutex_lock(&closer_mutex);
-    if(!audio_init()) {
-        pthread_mutex_unlock(&closer_mutex);
-        return false;
-    }
-
-    /* roughly benchmark the function so that we can return only after the
-     * sound has been played */
-    struct timeval begin, end;
-    gettimeofday(&begin, NULL);
+static tone_buffer *get_tone_buffer(int frequency, int duration) {
+    for (int i = 0; i < tone_buffers_count; i++)
+        if (tone_buffers[i].frequency == frequency && tone_buffers[i].duration == duration)
+            return tone_buffers + i;
 
     int format_bits = _dl_snd_pcm_format_width(audio_format);
     unsigned int maxval = (1 << (format_bits - 1)) - 1;
@@ -315,64 +328,191 @@ bool alsa_beeper(int frequency, int duration) {
     int big_endian = _dl_snd_pcm_format_big_endian(audio_format) == 1;
     int to_unsigned = _dl_snd_pcm_format_unsigned(audio_format) == 1;
     int numSamples = duration * audio_sample_rate / 1000;
-    int bufferSize, err, x;
+    int bufferSize, x;
     char *buffer, *p;
 
     bufferSize = numSamples * audio_channels * phys_bps;
     buffer = (char *)malloc(bufferSize);
-    if(buffer != NULL) {
-        // generate a triangle waveform
-        p = buffer;
-        for(x = 0; x < numSamples; x++) {
-            int res, i, chn;
-            double v;
-
-            v = fmod(((double) x) / audio_sample_rate * frequency, 1);
-            if (v >= 0.75)
-                v -= 1;
-            else if (v >= 0.25)
-                v = 0.5 - v;
-            res = (int) (v * maxval);
-            if (to_unsigned)
-                res ^= 1U << (format_bits - 1);
-            for(chn = 0; chn < audio_channels; chn ++) {
-                if (big_endian) {
-                    for (i = 0; i < bps; i++)
-                        *(p + phys_bps - 1 - i) = (res >> i * 8) & 0xff;
-                } else {
-                    for (i = 0; i < bps; i++)
-                        *(p + i)  = (res >>  i * 8) & 0xff;
-                }
-                p += phys_bps;
+    if (buffer == NULL)
+        return NULL;
+
+    // generate a triangle waveform
+    p = buffer;
+    for(x = 0; x < numSamples; x++) {
+        int res, i, chn;
+        double v;
+
+        v = fmod(((double) x) / audio_sample_rate * frequency, 1);
+        if (v >= 0.75)
+            v -= 1;
+        else if (v >= 0.25)
+            v = 0.5 - v;
+        res = (int) (v * maxval);
+        if (to_unsigned)
+            res ^= 1U << (format_bits - 1);
+        for(chn = 0; chn < audio_channels; chn ++) {
+            if (big_endian) {
+                for (i = 0; i < bps; i++)
+                    *(p + phys_bps - 1 - i) = (res >> i * 8) & 0xff;
+            } else {
+                for (i = 0; i < bps; i++)
+                    *(p + i)  = (res >>  i * 8) & 0xff;
             }
+            p += phys_bps;
         }
+    }
 
-        /* play the waveform */
-        p = buffer;
-        while(numSamples > 0) {
-            if((err = _dl_snd_pcm_writei (playback_handle, p, numSamples)) < 0) {
-                if(err == -EAGAIN) {
-                    continue;
-                }
-                if((err = xrun_recovery(playback_handle, err)) < 0) {
-                    fprintf (stderr, "write to audio interface failed (%s)\n", _dl_snd_strerror (err));
-                    break;
-                }
+    tone_buffer *tb;
+    if (tone_buffers_count < AUDIO_MAX_TONES)
+        tb = tone_buffers + tone_buffers_count++;
+    else {
+        // Shouldn't happen with the fixed set of HP-42S tones;
+        // just recycle the oldest entry
+        tb = tone_buffers;
+        free(tb->samples);
+    }
+    tb->frequency = frequency;
+    tb->duration = duration;
+    tb->frames = numSamples;
+    tb->samples = buffer;
+    return tb;
+}
+
+static void play_tone(tone_buffer *tb) {
+    int phys_bps = _dl_snd_pcm_format_physical_width(audio_format) / 8;
+    int numSamples = tb->frames;
+    char *p = tb->samples;
+    int err;
+
+    while(numSamples > 0) {
+        if((err = _dl_snd_pcm_writei (playback_handle, p, numSamples)) < 0) {
+            if(err == -EAGAIN) {
+                continue;
             }
-            else {
-                numSamples -= err;
-                p += err * phys_bps * audio_channels;
+            if((err = xrun_recovery(playback_handle, err)) < 0) {
+                fprintf (stderr, "write to audio interface failed (%s)\n", _dl_snd_strerror (err));
+                break;
             }
         }
+        else {
+            numSamples -= err;
+            p += err * phys_bps * audio_channels;
+        }
+    }
+}
 
-        free(buffer);
+static void *audio_thread_main(void *) {
+    while (true) {
+        if (__atomic_load_n(&audio_initialized, __ATOMIC_ACQUIRE)) {
+            struct timespec when;
+            clock_gettime(CLOCK_REALTIME, &when);
+            when.tv_sec += AUDIO_IDLE_SECONDS;
+            if (sem_timedwait(&audio_sem, &when) != 0) {
+                if (errno == ETIMEDOUT) {
+                    // Only close the device if no tone was queued while
+                    // we were timing out
+                    pthread_mutex_lock(&audio_mutex);
+                    if (audio_queue_tail == __atomic_load_n(&audio_queue_head, __ATOMIC_ACQUIRE)) {
+                        _dl_snd_pcm_close(playback_handle);
+                        __atomic_store_n(&audio_initialized, false, __ATOMIC_RELEASE);
+                    }
+                    pthread_mutex_unlock(&audio_mutex);
+                }
+                continue;
+            }
+        } else {
+            if (sem_wait(&audio_sem) != 0)
+                continue;
+        }
 
-        gettimeofday(&end, NULL);
-        duration -= (int) TDIFF(begin, end);
-        if(duration > 0) usleep(duration * 1000);
+        unsigned int tail = audio_queue_tail;
+        if (tail == __atomic_load_n(&audio_queue_head, __ATOMIC_ACQUIRE))
+            continue;
+        tone_request req = audio_queue[tail % AUDIO_QUEUE_SIZE];
+        __atomic_store_n(&audio_queue_tail, tail + 1, __ATOMIC_RELEASE);
+
+        // alsa_beeper() only queues tones while the device is open, and it
+        // is only closed here, when the queue is empty.
+        tone_buffer *tb = get_tone_buffer(req.frequency, req.duration);
+        if (tb != NULL)
+            play_tone(tb);
     }
+    return NULL;
+}
+
+static void sleep_until(const struct timespec *when) {
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, when, NULL) == EINTR);
+}
 
-    gettimeofday(&last_use, NULL);
-    pthread_mutex_unlock(&closer_mutex);
+static bool time_before(const struct timespec *a, const struct timespec *b) {
+    return a->tv_sec < b->tv_sec
+            || a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec;
+}
+
+bool alsa_beeper(int frequency, int duration, bool wait) {
+    if (libasound_state == 0)
+        libasound_state = open_libasound() ? 1 : 2;
+    if (libasound_state == 2)
+        return false;
+
+    if (!audio_thread_started) {
+        if (sem_init(&audio_sem, 0, 0) != 0
+                || pthread_create(&audio_thread, NULL, audio_thread_main, NULL) != 0) {
+            libasound_state = 2;
+            return false;
+        }
+        pthread_detach(audio_thread);
+        audio_thread_started = true;
+    }
+
+    /* Like the HP-42S, don't return until the previous tone has finished, so
+     * programs that play tones in a loop keep the right pace. The audio
+     * thread still has the current tone's samples in the device buffer at
+     * that point, so consecutive tones play without gaps.
+     */
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (time_before(&now, &queue_end)) {
+        sleep_until(&queue_end);
+        now = queue_end;
+    }
+
+    pthread_mutex_lock(&audio_mutex);
+    if (!audio_initialized) {
+        if (time_before(&now, &audio_retry_time)) {
+            pthread_mutex_unlock(&audio_mutex);
+            return false;
+        }
+        if (!audio_open()) {
+            pthread_mutex_unlock(&audio_mutex);
+            audio_retry_time = now;
+            audio_retry_time.tv_sec += audio_retry_delay;
+            audio_retry_delay *= 2;
+            if (audio_retry_delay > AUDIO_RETRY_MAX)
+                audio_retry_delay = AUDIO_RETRY_MAX;
+            return false;
+        }
+        audio_retry_delay = AUDIO_RETRY_MIN;
+    }
+    unsigned int head = audio_queue_head;
+    if (head - __atomic_load_n(&audio_queue_tail, __ATOMIC_ACQUIRE) == AUDIO_QUEUE_SIZE) {
+        // Audio thread is stuck; let the caller beep instead
+        pthread_mutex_unlock(&audio_mutex);
+        return false;
+    }
+    audio_queue[head % AUDIO_QUEUE_SIZE].frequency = frequency;
+    audio_queue[head % AUDIO_QUEUE_SIZE].duration = duration;
+    __atomic_store_n(&audio_queue_head, head + 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&audio_mutex);
+    sem_post(&audio_sem);
+
+    queue_end.tv_sec = now.tv_sec + duration / 1000;
+    queue_end.tv_nsec = now.tv_nsec + (duration % 1000) * 1000000L;
+    if (queue_end.tv_nsec >= 1000000000L) {
+        queue_end.tv_sec++;
+        queue_end.tv_nsec -= 1000000000L;
+    }
+    if (wait)
+        sleep_until(&queue_end);
     return true;
 }
@@ -18,6 +18,11 @@
 #ifndef AUDIO_ALSA_H
 #define AUDIO_ALSA_H 1
 
-bool alsa_beeper(int frequency, int duration);
+/* Plays a tone on the audio thread. Returns once the previously requested
+ * tone has finished; if 'wait' is true, also waits for this one. Returns false
+ * if ALSA is not available, in which case the caller should fall back on
+ * gdk_display_beep().
+ */
+bool alsa_beeper(int frequency, int duration, bool wait);
 
 #endif
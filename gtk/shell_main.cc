@@ -19,6 +19,7 @@
 #include <gdk/gdkkeysyms.h>
 #include <errno.h>
 #include <locale.h>
+#include <pthread.h>
 #include <pwd.h>
 #include <signal.h>
 #include <stdio.h>
@@ -35,6 +36,7 @@
 #include "shell_main.h"
 #include "shell_skin.h"
 #include "shell_spool.h"
+#include "shell_printout.h"
 #include "core_main.h"
 #include "core_display.h"
 #include "icon-128x128.xpm"
@@ -63,28 +65,17 @@ state_type state;
 char free42dirname[FILENAMELEN];
 
 
-/* PRINT_LINES is limited to an even lower value than in the Motif version.
- * It appears that GTK does not allow the SUM of a widget's height and its
- * container's height to exceed 32k, which means that as the print widget's
- * height approaches that magical number, the top-level window is forced to
- * become shorter and shorter. So, I set the limit at 30000 instead of
- * 32768; if we're reading a print-out file from Free42/Motif which has more
- * than 30000 pixels, we chop off the excess from the top.
+/* The print-out is displayed at twice its native resolution. The history
+ * itself is kept by shell_printout.cc and is not limited in size; since GTK
+ * does not cope with widgets that are more than 32k pixels tall, the print-out
+ * window does not put a huge drawing area in a scrolled window, but uses a
+ * window-sized drawing area with its own scroll bar, and only renders the
+ * rows that are visible.
  */
-#define PRINT_LINES 30000
-#define PRINT_BYTESPERLINE 36
-#define PRINT_SIZE 1080000
-// Room for PRINT_LINES / 18 lines, plus two, plus one byte
-#define PRINT_TEXT_SIZE 41726
-
-
-static unsigned char *print_bitmap;
-static int printout_top;
-static int printout_bottom;
-static unsigned char *print_text;
-static int print_text_top;
-static int print_text_bottom;
-static int print_text_pixel_height;
+// Copy as Image is limited to this many lines, counted at the doubled size
+#define PRINT_COPY_LINES 30000
+
+
 static bool quit_flag = false;
 static bool enqueued;
 
@@ -97,6 +88,40 @@ static char print_gif_name[FILENAMELEN];
 static int gif_seq = -1;
 static int gif_lines;
 
+/* GIF output is written to disk by a separate thread, so that printing to
+ * a GIF file never makes the emulator wait for file I/O. The encoder output
+ * is collected in gif_buf and handed to the writer thread in chunks, through
+ * a bounded queue; seeks and closes go through the same queue so they are
+ * performed in order. Errors are reported back to the main thread, which
+ * shows the message the next time it prints.
+ */
+#define GIF_QUEUE_LENGTH 64
+#define GIF_CHUNK_SIZE 16384
+
+struct gif_job {
+    FILE *file;
+    int4 seek;
+    bool close;
+    char *data;
+    int length;
+};
+
+static gif_job gif_queue[GIF_QUEUE_LENGTH];
+static int gif_queue_head = 0;
+static int gif_queue_count = 0;
+static bool gif_thread_busy = false;
+static bool gif_thread_started = false;
+static bool gif_thread_quit = false;
+static pthread_t gif_thread;
+static pthread_mutex_t gif_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gif_job_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t gif_done_cond = PTHREAD_COND_INITIALIZER;
+static FILE *gif_failed_file = NULL;
+static int gif_error = 0;
+static bool gif_error_seek;
+static char *gif_buf = NULL;
+static int gif_buf_length = 0;
+
 static int pype[2];
 
 static GtkApplication *app = NULL;
@@ -152,6 +177,7 @@ static void show_message(const char *title, const char *message, GtkWidget *pare
 static void no_mwm_resize_borders(GtkWidget *window);
 static void no_mwm_zoom_box(GtkWidget *window);
 static void scroll_printout_to_bottom();
+static void update_print_adj();
 static void quitCB();
 static void statesCB();
 static void showPrintOutCB();
@@ -173,6 +199,9 @@ static gboolean delete_print_cb(GtkWidget *w, GdkEventAny *ev);
 static gboolean draw_cb(GtkWidget *w, cairo_t *cr, gpointer cd);
 static gboolean print_draw_cb(GtkWidget *w, cairo_t *cr, gpointer cd);
 static gboolean print_key_cb(GtkWidget *w, GdkEventKey *event, gpointer cd);
+static gboolean print_scroll_cb(GtkWidget *w, GdkEventScroll *event, gpointer cd);
+static void print_size_cb(GtkWidget *w, GdkRectangle *alloc, gpointer cd);
+static void print_adj_cb(GtkAdjustment *adj, gpointer cd);
 static gboolean button_cb(GtkWidget *w, GdkEventButton *event, gpointer cd);
 static gboolean key_cb(GtkWidget *w, GdkEventKey *event, gpointer cd);
 static void enable_reminder();
@@ -188,6 +217,9 @@ static void txt_writer(const char *text, int length);
 static void txt_newliner();
 static void gif_seeker(int4 pos);
 static void gif_writer(const char *text, int length);
+static void gif_close();
+static void gif_shutdown();
+static void gif_check_error();
 
 
 #ifdef BCD_MATH
@@ -362,6 +394,7 @@ static const char *compactMenuOutroXml =
 
 static int use_compactmenu = 0;
 static char *skin_arg = NULL;
+static char *trace_arg = NULL;
 
 static char cached_number_format[9];
 
@@ -373,6 +406,8 @@ int main(int argc, char *argv[]) {
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "-skin") == 0)
             skin_arg = ++i < argc ? argv[i] : NULL;
+        else if (strcmp(argv[i], "-trace") == 0)
+            trace_arg = ++i < argc ? argv[i] : NULL;
         else if (strcmp(argv[i], "-compactmenu") == 0)
             use_compactmenu = 1;
         else {
@@ -696,57 +731,10 @@ static void activate(GtkApplication *theApp, gpointer userData) {
     /***** Build the print-out window *****/
     /**************************************/
 
-    // In the Motif version, I create an XImage and read the bitmap data into
-    // it; in the GTK version, that approach is not practical, since pixbuf
-    // only comes in 24-bit and 32-bit flavors -- which would mean wasting
-    // 25 megabytes for a 286x32768 pixbuf. So, instead, I use a 1 bpp buffer,
-    // and simply create pixbufs on the fly whenever I have to repaint.
-    print_bitmap = (unsigned char *) malloc(PRINT_SIZE);
-    print_text = (unsigned char *) malloc(PRINT_TEXT_SIZE);
-    // TODO - handle memory allocation failure
-
-    FILE *printfile = fopen(printfilename, "r");
-    if (printfile != NULL) {
-        int n = fread(&printout_bottom, 1, sizeof(int), printfile);
-        if (n == sizeof(int)) {
-            if (printout_bottom > PRINT_LINES) {
-                int excess = (printout_bottom - PRINT_LINES) * PRINT_BYTESPERLINE;
-                fseek(printfile, excess, SEEK_CUR);
-                printout_bottom = PRINT_LINES;
-            }
-            int bytes = printout_bottom * PRINT_BYTESPERLINE;
-            n = fread(print_bitmap, 1, bytes, printfile);
-            if (n == bytes) {
-                n = fread(&print_text_bottom, 1, sizeof(int), printfile);
-                int n2 = fread(&print_text_pixel_height, 1, sizeof(int), printfile);
-                if (n == sizeof(int) && n2 == sizeof(int)) {
-                    n = fread(print_text, 1, print_text_bottom, printfile);
-                    if (n != print_text_bottom) {
-                        print_text_bottom = 0;
-                        print_text_pixel_height = 0;
-                    }
-                } else {
-                    print_text_bottom = 0;
-                    print_text_pixel_height = 0;
-                }
-            } else {
-                printout_bottom = 0;
-                print_text_bottom = 0;
-                print_text_pixel_height = 0;
-            }
-        } else {
-            printout_bottom = 0;
-            print_text_bottom = 0;
-            print_text_pixel_height = 0;
-        }
-        fclose(printfile);
-    } else {
-        printout_bottom = 0;
-        print_text_bottom = 0;
-        print_text_pixel_height = 0;
-    }
-    printout_top = 0;
-    print_text_top = 0;
+    // If the print-out file can't be used, the print-out is kept in memory,
+    // and simply not saved, same as when the old-style file couldn't be
+    // written on exit.
+    printout_open(printfilename);
 
     printwindow = gtk_application_window_new(GTK_APPLICATION(app));
     gtk_window_set_icon(GTK_WINDOW(printwindow), icon_128);
@@ -755,22 +743,28 @@ static void activate(GtkApplication *theApp, gpointer userData) {
     g_signal_connect(G_OBJECT(printwindow), "delete_event",
                      G_CALLBACK(delete_print_cb), NULL);
 
-    GtkWidget *scroll = gtk_scrolled_window_new(NULL, NULL);
-    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scroll), GTK_POLICY_NEVER, GTK_POLICY_ALWAYS);
-    gtk_container_add(GTK_CONTAINER(printwindow), scroll);
-    GtkWidget *view = gtk_viewport_new(NULL, NULL);
-    gtk_container_add(GTK_CONTAINER(scroll), view);
+    GtkWidget *box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 0);
+    gtk_container_add(GTK_CONTAINER(printwindow), box);
     print_widget = gtk_drawing_area_new();
-    gtk_widget_set_size_request(print_widget, 358, printout_bottom);
-    gtk_container_add(GTK_CONTAINER(view), print_widget);
-    print_adj = gtk_scrolled_window_get_vadjustment(GTK_SCROLLED_WINDOW(scroll));
+    gtk_widget_set_size_request(print_widget, 358, 1);
+    gtk_box_pack_start(GTK_BOX(box), print_widget, TRUE, TRUE, 0);
+    // Start out scrolled to the bottom; print_size_cb() keeps it there
+    // when the window gets its actual size.
+    gdouble print_upper = 2 * printout_rows() < 18 ? 18 : 2 * printout_rows();
+    print_adj = gtk_adjustment_new(print_upper - 18, 0, print_upper, 18, 18, 18);
+    GtkWidget *scrollbar = gtk_scrollbar_new(GTK_ORIENTATION_VERTICAL, print_adj);
+    gtk_box_pack_start(GTK_BOX(box), scrollbar, FALSE, FALSE, 0);
     g_signal_connect(G_OBJECT(print_widget), "draw", G_CALLBACK(print_draw_cb), NULL);
     gtk_widget_set_can_focus(print_widget, TRUE);
     g_signal_connect(G_OBJECT(print_widget), "key-press-event", G_CALLBACK(print_key_cb), NULL);
+    gtk_widget_add_events(print_widget, GDK_SCROLL_MASK | GDK_SMOOTH_SCROLL_MASK);
+    g_signal_connect(G_OBJECT(print_widget), "scroll-event", G_CALLBACK(print_scroll_cb), NULL);
+    g_signal_connect(G_OBJECT(print_widget), "size-allocate", G_CALLBACK(print_size_cb), NULL);
+    g_signal_connect(G_OBJECT(print_adj), "value-changed", G_CALLBACK(print_adj_cb), NULL);
 
     gtk_widget_show(print_widget);
-    gtk_widget_show(view);
-    gtk_widget_show(scroll);
+    gtk_widget_show(scrollbar);
+    gtk_widget_show(box);
 
     GdkGeometry geom;
     geom.min_width = 358;
@@ -804,6 +798,12 @@ static void activate(GtkApplication *theApp, gpointer userData) {
     gtk_widget_show(mainwindow);
 
     core_init(init_mode, version, core_state_file_name, core_state_file_offset);
+    if (trace_arg != NULL && !core_trace_open(trace_arg)) {
+        char buf[1000];
+        int err = errno;
+        snprintf(buf, 1000, "Can't open \"%s\" for output:\n%s (%d)\nTracing to file disabled.", trace_arg, strerror(err), err);
+        show_message("Message", buf);
+    }
     if (core_powercycle())
         enable_reminder();
 
@@ -1149,75 +1149,16 @@ static gboolean gt_signal_handler(GIOChannel *source, GIOCondition condition,
 }
 
 static void quit() {
-    FILE *printfile;
-    int n, length;
-
-    printfile = fopen(printfilename, "w");
-    if (printfile != NULL) {
-        // Write bitmap
-        length = printout_bottom - printout_top;
-        if (length < 0)
-            length += PRINT_LINES;
-        n = fwrite(&length, 1, sizeof(int), printfile);
-        if (n != sizeof(int))
-            goto failed;
-        if (printout_bottom >= printout_top) {
-            n = fwrite(print_bitmap + PRINT_BYTESPERLINE * printout_top,
-                       1, PRINT_BYTESPERLINE * length, printfile);
-            if (n != PRINT_BYTESPERLINE * length)
-                goto failed;
-        } else {
-            n = fwrite(print_bitmap + PRINT_BYTESPERLINE * printout_top,
-                       1, PRINT_SIZE - PRINT_BYTESPERLINE * printout_top,
-                       printfile);
-            if (n != PRINT_SIZE - PRINT_BYTESPERLINE * printout_top)
-                goto failed;
-            n = fwrite(print_bitmap, 1,
-                       PRINT_BYTESPERLINE * printout_bottom, printfile);
-            if (n != PRINT_BYTESPERLINE * printout_bottom)
-                goto failed;
-        }
-        // Write text
-        length = print_text_bottom - print_text_top;
-        if (length < 0)
-            length += PRINT_TEXT_SIZE;
-        n = fwrite(&length, 1, sizeof(int), printfile);
-        if (n != sizeof(int))
-            goto failed;
-        n = fwrite(&print_text_pixel_height, 1, sizeof(int), printfile);
-        if (n != sizeof(int))
-            goto failed;
-        if (print_text_bottom >= print_text_top) {
-            n = fwrite(print_text + print_text_top, 1, length, printfile);
-            if (n != length)
-                goto failed;
-        } else {
-            n = fwrite(print_text + print_text_top, 1, PRINT_TEXT_SIZE - print_text_top, printfile);
-            if (n != PRINT_TEXT_SIZE - print_text_top)
-                goto failed;
-            n = fwrite(print_text, 1, print_text_bottom, printfile);
-            if (n != print_text_bottom)
-                goto failed;
-        }
-
-        fclose(printfile);
-        goto done;
-
-        failed:
-        fclose(printfile);
-        remove(printfilename);
-
-        done:
-        ;
-    }
+    printout_close();
 
     if (print_txt != NULL)
         fclose(print_txt);
 
     if (print_gif != NULL) {
         shell_finish_gif(gif_seeker, gif_writer);
-        fclose(print_gif);
+        gif_close();
     }
+    gif_shutdown();
 
     gint x, y;
     gtk_window_get_position(GTK_WINDOW(mainwindow), &x, &y);
@@ -1247,6 +1188,7 @@ static void quit() {
     char corefilename[FILENAMELEN];
     snprintf(corefilename, FILENAMELEN, "%s/%s.f42", free42dirname, state.coreName);
     core_save_state(corefilename);
+    core_trace_close();
     core_cleanup();
 
     shell_spool_exit();
@@ -1319,6 +1261,19 @@ static void scroll_printout_to_bottom() {
     gtk_adjustment_set_value(print_adj, upper - page_size);
 }
 
+static void update_print_adj() {
+    GtkAllocation alloc;
+    gtk_widget_get_allocation(print_widget, &alloc);
+    gdouble page_size = alloc.height;
+    gdouble upper = 2 * printout_rows();
+    if (upper < page_size)
+        upper = page_size;
+    gdouble value = gtk_adjustment_get_value(print_adj);
+    if (value > upper - page_size)
+        value = upper - page_size;
+    gtk_adjustment_configure(print_adj, value, 0, upper, 18, page_size, page_size);
+}
+
 static void quitCB() {
     quit();
 }
@@ -2164,49 +2119,16 @@ static void copyPrintAsTextCB() {
     tb = NULL;
     tblen = tbcap = 0;
 
-    int len = print_text_bottom - print_text_top;
-    if (len < 0)
-        len += PRINT_TEXT_SIZE;
-    // Calculate effective top, since printout_top can point
-    // at a truncated line, and we want to skip those when
-    // copying
-    int top = printout_bottom - 2 * print_text_pixel_height;
-    if (top < 0)
-        top += PRINT_LINES;
-    int p = print_text_top;
-    int pixel_v = 0;
-    while (len > 0) {
-        int z = print_text[p++];
-        if (z == 255) {
-            char buf[34];
-            for (int v = 0; v < 16; v += 2) {
-                for (int vv = 0; vv < 2; vv++) {
-                    int V = top + (pixel_v + v + vv) * 2;
-                    if (V >= PRINT_LINES)
-                        V -= PRINT_LINES;
-                    for (int h = 0; h < 17; h++) {
-                        unsigned char a = print_bitmap[V * PRINT_BYTESPERLINE + 2 * h + 1];
-                        unsigned char b = print_bitmap[V * PRINT_BYTESPERLINE + 2 * h];
-                        buf[vv * 17 + h] = (a & 128) | ((a & 32) << 1) | ((a & 8) << 2) | ((a & 2) << 3) | ((b & 128) >> 4) | ((b & 32) >> 3) | ((b & 8) >> 2) | ((b & 2) >> 1);
-                    }
-                }
-                shell_spool_bitmap_to_txt(buf, 17, 0, 0, 131, 2, tbwriter, tbnewliner);
-            }
-            pixel_v += 16;
-        } else {
-            if (p + z < PRINT_TEXT_SIZE) {
-                shell_spool_txt((const char *) (print_text + p), z, tbwriter, tbnewliner);
-                p += z;
-            } else {
-                int d = PRINT_TEXT_SIZE - p;
-                shell_spool_txt((const char *) (print_text + p), d, tbwriter, tbnonewliner);
-                shell_spool_txt((const char *) print_text, z - d, tbwriter, tbnewliner);
-                p = z - d;
-            }
-            len -= z;
-            pixel_v += 9;
-        }
-        len--;
+    int4 n = printout_records();
+    for (int4 i = 0; i < n; i++) {
+        const char *text;
+        int length, height;
+        const unsigned char *bits;
+        printout_record(i, &text, &length, &bits, &height);
+        if (text == NULL)
+            shell_spool_bitmap_to_txt((const char *) bits, PRINTOUT_BYTESPERLINE, 0, 0, 131, height, tbwriter, tbnewliner);
+        else
+            shell_spool_txt(text, length, tbwriter, tbnewliner);
     }
     tbwriter("\0", 1);
 
@@ -2218,9 +2140,9 @@ static void copyPrintAsTextCB() {
 }
 
 static void copyPrintAsImageCB() {
-    int length = printout_bottom - printout_top;
-    if (length < 0)
-        length += PRINT_LINES;
+    int4 rows = printout_rows();
+    int4 top = rows > PRINT_COPY_LINES / 2 ? rows - PRINT_COPY_LINES / 2 : 0;
+    int length = 2 * (rows - top);
     bool empty = length == 0;
     if (empty)
         length += 2;
@@ -2234,16 +2156,13 @@ static void copyPrintAsImageCB() {
         memset(d1, 255, 2148);
     } else {
         for (int v = 0; v < length; v++) {
-            int v2 = printout_top + v;
-            if (v2 >= PRINT_LINES)
-                v2 -= PRINT_LINES;
-            int v3 = v2 * 36;
+            const unsigned char *row = printout_row(top + v / 2);
             guchar *dst = d1;
             for (int h = 0; h < 358; h++) {
                 unsigned char c;
                 if (h < 36 || h >= 322)
                     c = 255;
-                else if ((print_bitmap[v3 + ((h - 36) >> 3)] & (1 << ((h - 36) & 7))) == 0)
+                else if ((row[(h - 36) >> 4] & (1 << (((h - 36) >> 1) & 7))) == 0)
                     c = 255;
                 else
                     c = 0;
@@ -2260,17 +2179,13 @@ static void copyPrintAsImageCB() {
 }
 
 static void clearPrintOutCB() {
-    printout_top = 0;
-    printout_bottom = 0;
-    print_text_top = 0;
-    print_text_bottom = 0;
-    print_text_pixel_height = 0;
-    gtk_widget_set_size_request(print_widget, 358, 1);
+    printout_clear();
+    update_print_adj();
+    gtk_widget_queue_draw(print_widget);
 
     if (print_gif != NULL) {
         shell_finish_gif(gif_seeker, gif_writer);
-        fclose(print_gif);
-        print_gif = NULL;
+        gif_close();
     }
 }
 
@@ -2428,8 +2343,7 @@ static void preferencesCB() {
         appendSuffix(state.printerGifFileName, ".gif");
         if (print_gif != NULL && (!state.printerToGifFile || strcmp(state.printerGifFileName, old) != 0)) {
             shell_finish_gif(gif_seeker, gif_writer);
-            fclose(print_gif);
-            print_gif = NULL;
+            gif_close();
             gif_seq = -1;
         }
         free(old);
@@ -2614,6 +2528,40 @@ static gboolean print_draw_cb(GtkWidget *w, cairo_t *cr, gpointer cd) {
     return TRUE;
 }
 
+static gboolean print_scroll_cb(GtkWidget *w, GdkEventScroll *event, gpointer cd) {
+    gdouble value = gtk_adjustment_get_value(print_adj);
+    gdouble step = gtk_adjustment_get_step_increment(print_adj) * 3;
+    switch (event->direction) {
+        case GDK_SCROLL_UP:
+            value -= step;
+            break;
+        case GDK_SCROLL_DOWN:
+            value += step;
+            break;
+        case GDK_SCROLL_SMOOTH:
+            value += event->delta_y * step;
+            break;
+        default:
+            return FALSE;
+    }
+    // gtk_adjustment_set_value() clamps the value to [lower, upper - page_size]
+    gtk_adjustment_set_value(print_adj, value);
+    return TRUE;
+}
+
+static void print_size_cb(GtkWidget *w, GdkRectangle *alloc, gpointer cd) {
+    gdouble old_upper = gtk_adjustment_get_upper(print_adj);
+    gdouble old_page = gtk_adjustment_get_page_size(print_adj);
+    bool at_bottom = gtk_adjustment_get_value(print_adj) >= old_upper - old_page;
+    update_print_adj();
+    if (at_bottom)
+        scroll_printout_to_bottom();
+}
+
+static void print_adj_cb(GtkAdjustment *adj, gpointer cd) {
+    gtk_widget_queue_draw(print_widget);
+}
+
 static gboolean print_key_cb(GtkWidget *w, GdkEventKey *event, gpointer cd) {
 
     // This is a bit hacky, but I want the Ctrl-<Key>
@@ -2997,23 +2945,20 @@ static void repaint_printout(cairo_t *cr) {
                                     8, clip.width, clip.height);
     int d_bpl = gdk_pixbuf_get_rowstride(buf);
     guchar *d1 = gdk_pixbuf_get_pixels(buf);
-    int length = printout_bottom - printout_top;
-    if (length < 0)
-        length += PRINT_LINES;
+    int4 length = 2 * printout_rows();
+    int4 top = (int4) gtk_adjustment_get_value(print_adj);
 
     for (int v = clip.y; v < clip.y + clip.height; v++) {
-        int v2 = printout_top + v;
-        if (v2 >= PRINT_LINES)
-            v2 -= PRINT_LINES;
-        int v3 = v2 * 36;
+        int4 V = top + v;
+        const unsigned char *row = V < length ? printout_row(V / 2) : NULL;
         guchar *dst = d1;
         for (int h = clip.x; h < clip.x + clip.width; h++) {
             unsigned char c;
-            if (v >= length)
+            if (row == NULL)
                 c = 127;
             else if (h < 36 || h >= 322)
                 c = 255;
-            else if ((print_bitmap[v3 + ((h - 36) >> 3)] & (1 << ((h - 36) & 7))) == 0)
+            else if ((row[(h - 36) >> 4] & (1 << (((h - 36) >> 1) & 7))) == 0)
                 c = 255;
             else
                 c = 0;
@@ -3068,31 +3013,178 @@ static void txt_newliner() {
     fflush(print_txt);
 }   
     
-static void gif_seeker(int4 pos) {
+static void *gif_thread_main(void *) {
+    pthread_mutex_lock(&gif_mutex);
+    while (true) {
+        while (gif_queue_count == 0 && !gif_thread_quit)
+            pthread_cond_wait(&gif_job_cond, &gif_mutex);
+        if (gif_queue_count == 0)
+            break;
+        gif_job job = gif_queue[gif_queue_head];
+        gif_queue_head = (gif_queue_head + 1) % GIF_QUEUE_LENGTH;
+        gif_queue_count--;
+        gif_thread_busy = true;
+        // Wake up the main thread if it's waiting for room in the queue
+        pthread_cond_broadcast(&gif_done_cond);
+        pthread_mutex_unlock(&gif_mutex);
+
+        int err = 0;
+        bool seek_failed = false;
+        if (job.file == gif_failed_file) {
+            // An earlier operation on this file failed, and the file has
+            // already been closed; ignore everything up to its close.
+            if (job.close)
+                gif_failed_file = NULL;
+        } else if (job.close) {
+            fclose(job.file);
+        } else if (job.data != NULL) {
+            if (fwrite(job.data, 1, job.length, job.file) != (size_t) job.length)
+                err = errno;
+        } else {
+            if (fseek(job.file, job.seek, SEEK_SET) == -1) {
+                err = errno;
+                seek_failed = true;
+            }
+        }
+        free(job.data);
+        if (err != 0) {
+            gif_failed_file = job.file;
+            fclose(job.file);
+        }
+
+        pthread_mutex_lock(&gif_mutex);
+        if (err != 0 && gif_error == 0) {
+            gif_error = err;
+            gif_error_seek = seek_failed;
+        }
+        gif_thread_busy = false;
+        pthread_cond_broadcast(&gif_done_cond);
+    }
+    pthread_mutex_unlock(&gif_mutex);
+    return NULL;
+}
+
+static void gif_enqueue(const gif_job *job) {
+    pthread_mutex_lock(&gif_mutex);
+    if (!gif_thread_started) {
+        gif_thread_quit = false;
+        if (pthread_create(&gif_thread, NULL, gif_thread_main, NULL) != 0) {
+            // No thread; fall back on writing synchronously
+            pthread_mutex_unlock(&gif_mutex);
+            if (job->close)
+                fclose(job->file);
+            else if (job->data != NULL)
+                fwrite(job->data, 1, job->length, job->file);
+            else
+                fseek(job->file, job->seek, SEEK_SET);
+            free(job->data);
+            return;
+        }
+        gif_thread_started = true;
+    }
+    while (gif_queue_count == GIF_QUEUE_LENGTH)
+        pthread_cond_wait(&gif_done_cond, &gif_mutex);
+    gif_queue[(gif_queue_head + gif_queue_count) % GIF_QUEUE_LENGTH] = *job;
+    gif_queue_count++;
+    pthread_cond_signal(&gif_job_cond);
+    pthread_mutex_unlock(&gif_mutex);
+}
+
+static void gif_flush() {
+    if (gif_buf_length == 0)
+        return;
+    gif_job job;
+    job.file = print_gif;
+    job.seek = -1;
+    job.close = false;
+    job.data = gif_buf;
+    job.length = gif_buf_length;
+    gif_buf = NULL;
+    gif_buf_length = 0;
+    gif_enqueue(&job);
+}
+
+static void gif_close() {
     if (print_gif == NULL)
         return;
-    if (fseek(print_gif, pos, SEEK_SET) == -1) {
-        char buf[1000];
-        state.printerToGifFile = 0;
-        fclose(print_gif);
-        print_gif = NULL;
-        snprintf(buf, 1000, "Error while seeking \"%s\".\nPrinting to GIF file disabled", print_gif_name);
-        show_message("Message", buf);
+    gif_flush();
+    gif_job job;
+    job.file = print_gif;
+    job.seek = -1;
+    job.close = true;
+    job.data = NULL;
+    job.length = 0;
+    gif_enqueue(&job);
+    print_gif = NULL;
+}
+
+/* Waits for the writer thread to finish all pending work, and stops it.
+ * Called on exit, after the last GIF file has been closed.
+ */
+static void gif_shutdown() {
+    pthread_mutex_lock(&gif_mutex);
+    if (!gif_thread_started) {
+        pthread_mutex_unlock(&gif_mutex);
+        return;
     }
+    gif_thread_quit = true;
+    pthread_cond_signal(&gif_job_cond);
+    pthread_mutex_unlock(&gif_mutex);
+    pthread_join(gif_thread, NULL);
+    gif_thread_started = false;
+}
+
+static void gif_check_error() {
+    pthread_mutex_lock(&gif_mutex);
+    int err = gif_error;
+    bool seek = gif_error_seek;
+    gif_error = 0;
+    pthread_mutex_unlock(&gif_mutex);
+    if (err == 0)
+        return;
+    char buf[1000];
+    state.printerToGifFile = 0;
+    gif_buf_length = 0;
+    gif_close();
+    snprintf(buf, 1000, "Error while %s \"%s\":\n%s (%d)\nPrinting to GIF file disabled", seek ? "seeking" : "writing to", print_gif_name, strerror(err), err);
+    show_message("Message", buf);
+}
+
+static void gif_seeker(int4 pos) {
+    if (print_gif == NULL)
+        return;
+    gif_flush();
+    gif_job job;
+    job.file = print_gif;
+    job.seek = pos;
+    job.close = false;
+    job.data = NULL;
+    job.length = 0;
+    gif_enqueue(&job);
 }
 
 static void gif_writer(const char *text, int length) {
-    int n;
     if (print_gif == NULL)
         return;
-    n = fwrite(text, 1, length, print_gif);
-    if (n != length) {
-        char buf[1000];
-        state.printerToGifFile = 0;
-        fclose(print_gif);
-        print_gif = NULL;
-        snprintf(buf, 1000, "Error while writing to \"%s\".\nPrinting to GIF file disabled", print_gif_name);
-        show_message("Message", buf);
+    while (length > 0) {
+        if (gif_buf == NULL) {
+            gif_buf = (char *) malloc(GIF_CHUNK_SIZE);
+            if (gif_buf == NULL) {
+                state.printerToGifFile = 0;
+                gif_close();
+                show_message("Message", "Not enough memory for the GIF writer.\nPrinting to GIF file disabled.");
+                return;
+            }
+        }
+        int n = GIF_CHUNK_SIZE - gif_buf_length;
+        if (n > length)
+            n = length;
+        memcpy(gif_buf + gif_buf_length, text, n);
+        gif_buf_length += n;
+        text += n;
+        length -= n;
+        if (gif_buf_length == GIF_CHUNK_SIZE)
+            gif_flush();
     }
 }
 
@@ -3117,7 +3209,7 @@ void shell_beeper(int tone) {
     if (display_name == NULL || display_name[0] == ':') {
         int frequency = tone_freqs[tone];
         int duration = tone == 10 ? 125 : 250;
-        if (!alsa_beeper(frequency, duration))
+        if (!alsa_beeper(frequency, duration, false))
             gdk_display_beep(gdk_display_get_default());
     } else
         gdk_display_beep(gdk_display_get_default());
@@ -3363,77 +3455,13 @@ bool shell_clk24() {
     return strstr(buf, "A") == NULL;
 }
 
-struct print_growth_info {
-    int y, height;
-    print_growth_info(int yy, int hheight) : y(yy), height(hheight) {}
-};
-
-static gboolean print_widget_grew(GtkWidget *w, GdkEventConfigure *event,
-                                                                gpointer cd) {
-    print_growth_info *info = (print_growth_info *) cd;
-    scroll_printout_to_bottom();
-    GdkRectangle clip;
-    clip.x = 0;
-    clip.y = info->y;
-    clip.width = 358;
-    clip.height = info->height;
-    GdkWindow *win = gtk_widget_get_window(print_widget);
-    gdk_window_invalidate_rect(win, &clip, FALSE);
-    g_signal_handlers_disconnect_by_func(G_OBJECT(w), (gpointer) print_widget_grew, cd);
-    delete info;
-    return FALSE;
-}
-
 void shell_print(const char *text, int length,
                  const char *bits, int bytesperline,
                  int x, int y, int width, int height) {
-    int xx, yy;
-    int oldlength, newlength;
-
-    for (yy = 0; yy < height; yy++) {
-        int4 Y = (printout_bottom + 2 * yy) % PRINT_LINES;
-        for (xx = 0; xx < 143; xx++) {
-            int bit, px, py;
-            if (xx < width) {
-                char c = bits[(y + yy) * bytesperline + ((x + xx) >> 3)];
-                bit = (c & (1 << ((x + xx) & 7))) != 0;
-            } else
-                bit = 0;
-            for (px = xx * 2; px < (xx + 1) * 2; px++)
-                for (py = Y; py < Y + 2; py++)
-                    if (bit)
-                        print_bitmap[py * PRINT_BYTESPERLINE + (px >> 3)]
-                            |= 1 << (px & 7);
-                    else
-                        print_bitmap[py * PRINT_BYTESPERLINE + (px >> 3)]
-                            &= ~(1 << (px & 7));
-        }
-    }
-
-    oldlength = printout_bottom - printout_top;
-    if (oldlength < 0)
-        oldlength += PRINT_LINES;
-    printout_bottom = (printout_bottom + 2 * height) % PRINT_LINES;
-    newlength = oldlength + 2 * height;
-
-    if (newlength >= PRINT_LINES) {
-        printout_top = (printout_bottom + 2) % PRINT_LINES;
-        newlength = PRINT_LINES - 2;
-        if (newlength != oldlength)
-            gtk_widget_set_size_request(print_widget, 358, newlength);
-        scroll_printout_to_bottom();
-        gtk_widget_queue_draw(print_widget);
-    } else {
-        gtk_widget_set_size_request(print_widget, 358, newlength);
-        // The resize request does not take effect immediately;
-        // if I call scroll_printout_to_bottom() now, the scrolling will take
-        // place *before* the resizing, leaving the scroll bar in the wrong
-        // position.
-        // I work around this by using a callback to finish the job.
-        g_signal_connect(G_OBJECT(print_widget), "configure-event",
-                         G_CALLBACK(print_widget_grew),
-                         (gpointer) new print_growth_info(oldlength, 2 * height));
-    }
+    printout_append(text, length, bits, bytesperline, x, y, width, height);
+    update_print_adj();
+    scroll_printout_to_bottom();
+    gtk_widget_queue_draw(print_widget);
 
     if (state.printerToTxtFile) {
         int err;
@@ -3457,6 +3485,7 @@ void shell_print(const char *text, int length,
         done_print_txt:;
     }
 
+    gif_check_error();
     if (state.printerToGifFile) {
         int err;
         char buf[1000];
@@ -3464,8 +3493,7 @@ void shell_print(const char *text, int length,
         if (print_gif != NULL
                 && gif_lines + height > state.printerGifMaxLength) {
             shell_finish_gif(gif_seeker, gif_writer);
-            fclose(print_gif);
-            print_gif = NULL;
+            gif_close();
         }
 
         if (print_gif == NULL) {
@@ -3511,6 +3539,7 @@ void shell_print(const char *text, int length,
                 goto done_print_gif;
             }
             if (!shell_start_gif(gif_writer, 143, state.printerGifMaxLength)) {
+                gif_close();
                 state.printerToGifFile = 0;
                 show_message("Message", "Not enough memory for the GIF encoder.\nPrinting to GIF file disabled.");
                 goto done_print_gif;
@@ -3523,34 +3552,10 @@ void shell_print(const char *text, int length,
 
         if (print_gif != NULL && gif_lines + 9 > state.printerGifMaxLength) {
             shell_finish_gif(gif_seeker, gif_writer);
-            fclose(print_gif);
-            print_gif = NULL;
+            gif_close();
         }
         done_print_gif:;
     }
-
-    print_text[print_text_bottom++] = (char) (text == NULL ? 255 : length);
-    if (print_text_bottom == PRINT_TEXT_SIZE)
-        print_text_bottom = 0;
-    if (text != NULL) {
-        if (print_text_bottom + length < PRINT_TEXT_SIZE) {
-            memcpy(print_text + print_text_bottom, text, length);
-            print_text_bottom += length;
-        } else {
-            int part = PRINT_TEXT_SIZE - print_text_bottom;
-            memcpy(print_text + print_text_bottom, text, part);
-            memcpy(print_text, text + part, length - part);
-            print_text_bottom = length - part;
-        }
-    }
-    print_text_pixel_height += text == NULL ? 16 : 9;
-    while (print_text_pixel_height > PRINT_LINES / 2 - 1) {
-        int tll = print_text[print_text_top] == 255 ? 16 : 9;
-        print_text_pixel_height -= tll;
-        print_text_top += tll == 16 ? 1 : (print_text[print_text_top] + 1);
-        if (print_text_top >= PRINT_TEXT_SIZE)
-            print_text_top -= PRINT_TEXT_SIZE;
-    }
 }
 
 static FILE *logfile = NULL;
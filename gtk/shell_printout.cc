@@ -0,0 +1,394 @@
+///////////////////////////////////////////////////////////////////////////////
+// Free42 -- an HP-42S calculator simulator
+// Copyright (C) 2004-2024  Thomas Okken
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License, version 2,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see http://www.gnu.org/licenses/.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "shell_printout.h"
+
+
+/* File layout:
+ *   8 bytes   magic, "F42PRNT1"
+ *   8 bytes   int8, offset of the end of the valid data
+ *   records:
+ *     4 bytes   int4, height in rows
+ *     4 bytes   int4, text length, or -1 for graphics
+ *     n bytes   text
+ *     height * PRINTOUT_BYTESPERLINE bytes of bitmap
+ * The file is grown in large steps, so it usually has unused space at the
+ * end; the data end offset in the header tells how much of it is valid. It
+ * is updated after every record, so the file is always consistent.
+ */
+
+#define PRINTOUT_MAGIC "F42PRNT1"
+#define HEADER_SIZE 16
+#define RECORD_HEADER_SIZE 8
+#define MIN_CAPACITY (1 << 20)
+
+struct record_index {
+    int8 offset;
+    int4 row;
+};
+
+static int fd = -1;
+static unsigned char *map = NULL;
+static int8 map_capacity = 0;
+static int8 data_end = HEADER_SIZE;
+
+static record_index *records = NULL;
+static int4 records_count = 0;
+static int4 records_capacity = 0;
+static int4 total_rows = 0;
+static int4 last_record = 0;
+
+
+static int4 get_int4(int8 offset) {
+    int4 n;
+    memcpy(&n, map + offset, 4);
+    return n;
+}
+
+static void put_int4(int8 offset, int4 n) {
+    memcpy(map + offset, &n, 4);
+}
+
+static void update_header() {
+    memcpy(map + 8, &data_end, 8);
+}
+
+static bool ensure_capacity(int8 needed) {
+    if (needed <= map_capacity)
+        return true;
+    int8 newcap = map_capacity < MIN_CAPACITY ? MIN_CAPACITY : map_capacity;
+    while (newcap < needed)
+        newcap *= 2;
+    if (fd == -1) {
+        unsigned char *newmap = (unsigned char *) realloc(map, newcap);
+        if (newmap == NULL)
+            return false;
+        map = newmap;
+    } else {
+        if (ftruncate(fd, newcap) == -1)
+            return false;
+        void *newmap = mmap(NULL, newcap, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (newmap == MAP_FAILED)
+            return false;
+        if (map != NULL)
+            munmap(map, map_capacity);
+        map = (unsigned char *) newmap;
+    }
+    map_capacity = newcap;
+    return true;
+}
+
+static bool add_to_index(int8 offset, int4 height) {
+    if (records_count == records_capacity) {
+        int4 newcap = records_capacity == 0 ? 1024 : records_capacity * 2;
+        record_index *newrecords = (record_index *) realloc(records, newcap * sizeof(record_index));
+        if (newrecords == NULL)
+            return false;
+        records = newrecords;
+        records_capacity = newcap;
+    }
+    records[records_count].offset = offset;
+    records[records_count].row = total_rows;
+    records_count++;
+    total_rows += height;
+    return true;
+}
+
+static int8 record_bits(int4 index) {
+    int8 offset = records[index].offset;
+    int4 length = get_int4(offset + 4);
+    return offset + RECORD_HEADER_SIZE + (length < 0 ? 0 : length);
+}
+
+static bool build_index() {
+    records_count = 0;
+    total_rows = 0;
+    last_record = 0;
+    int8 offset = HEADER_SIZE;
+    while (offset + RECORD_HEADER_SIZE <= data_end) {
+        int4 height = get_int4(offset);
+        int4 length = get_int4(offset + 4);
+        int8 size = RECORD_HEADER_SIZE + (length < 0 ? 0 : length)
+                    + (int8) height * PRINTOUT_BYTESPERLINE;
+        if (height < 0 || offset + size > data_end)
+            break;
+        if (!add_to_index(offset, height))
+            return false;
+        offset += size;
+    }
+    // Drop anything after the last intact record
+    data_end = offset;
+    update_header();
+    return true;
+}
+
+static bool init_empty() {
+    data_end = HEADER_SIZE;
+    if (!ensure_capacity(HEADER_SIZE))
+        return false;
+    memcpy(map, PRINTOUT_MAGIC, 8);
+    update_header();
+    records_count = 0;
+    total_rows = 0;
+    last_record = 0;
+    return true;
+}
+
+/* Converts a print-out file in the old format, which was a fixed-size ring
+ * of rows at twice the native resolution, plus a separate ring of text lines
+ * and graphics markers. The whole old file is passed in 'buf'.
+ */
+static void import_legacy(const unsigned char *buf, int4 size) {
+    const int legacy_bpl = 36;
+    int4 lines, textlen, pixel_height;
+    if (size < 4)
+        return;
+    memcpy(&lines, buf, 4);
+    if (lines < 0 || (int8) lines * legacy_bpl + 12 > size)
+        return;
+    const unsigned char *bitmap = buf + 4;
+    memcpy(&textlen, bitmap + lines * legacy_bpl, 4);
+    memcpy(&pixel_height, bitmap + lines * legacy_bpl + 4, 4);
+    const unsigned char *text = bitmap + lines * legacy_bpl + 8;
+    if (textlen < 0 || text + textlen > buf + size)
+        return;
+
+    // The top of the ring may hold a partial line; skip it
+    int4 v = lines - 2 * pixel_height;
+    if (v < 0)
+        return;
+    char row[PRINTOUT_BYTESPERLINE * 16];
+    int4 p = 0;
+    while (p < textlen) {
+        int z = text[p++];
+        int height = z == 255 ? 16 : 9;
+        if (z != 255 && p + z > textlen)
+            break;
+        if (v + 2 * height > lines)
+            break;
+        memset(row, 0, sizeof(row));
+        for (int r = 0; r < height; r++) {
+            const unsigned char *src = bitmap + (v + 2 * r) * legacy_bpl;
+            for (int h = 0; h < PRINTOUT_WIDTH; h++)
+                if ((src[h >> 2] & (1 << ((h & 3) * 2))) != 0)
+                    row[r * PRINTOUT_BYTESPERLINE + (h >> 3)] |= 1 << (h & 7);
+        }
+        if (z == 255)
+            printout_append(NULL, 0, row, PRINTOUT_BYTESPERLINE, 0, 0, PRINTOUT_WIDTH, height);
+        else {
+            printout_append((const char *) text + p, z, row, PRINTOUT_BYTESPERLINE, 0, 0, PRINTOUT_WIDTH, height);
+            p += z;
+        }
+        v += 2 * height;
+    }
+}
+
+static unsigned char *read_legacy(const char *filename, int4 *size) {
+    FILE *f = fopen(filename, "r");
+    if (f == NULL)
+        return NULL;
+    unsigned char *buf = NULL;
+    char magic[8];
+    if (fread(magic, 1, 8, f) == 8 && memcmp(magic, PRINTOUT_MAGIC, 8) == 0)
+        goto done;
+    if (fseek(f, 0, SEEK_END) != 0)
+        goto done;
+    *size = ftell(f);
+    if (*size <= 0 || (buf = (unsigned char *) malloc(*size)) == NULL)
+        goto done;
+    rewind(f);
+    if (fread(buf, 1, *size, f) != (size_t) *size) {
+        free(buf);
+        buf = NULL;
+    }
+    done:
+    fclose(f);
+    return buf;
+}
+
+bool printout_open(const char *filename) {
+    // An old-style file has to be read completely before the file is
+    // truncated and reused for the new format.
+    int4 legacy_size;
+    unsigned char *legacy = read_legacy(filename, &legacy_size);
+    bool success = true;
+
+    fd = open(filename, legacy != NULL ? O_RDWR | O_CREAT | O_TRUNC : O_RDWR | O_CREAT, 0644);
+    struct stat st;
+    if (fd != -1 && legacy == NULL && fstat(fd, &st) == 0 && st.st_size >= HEADER_SIZE) {
+        void *m = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (m != MAP_FAILED) {
+            map = (unsigned char *) m;
+            map_capacity = st.st_size;
+            if (memcmp(map, PRINTOUT_MAGIC, 8) == 0) {
+                memcpy(&data_end, map + 8, 8);
+                if (data_end < HEADER_SIZE || data_end > map_capacity)
+                    data_end = HEADER_SIZE;
+                if (build_index())
+                    return true;
+            }
+            munmap(map, map_capacity);
+            map = NULL;
+            map_capacity = 0;
+        }
+        close(fd);
+        fd = -1;
+        success = false;
+    }
+
+    if (fd != -1 && !init_empty()) {
+        close(fd);
+        fd = -1;
+    }
+    if (fd == -1) {
+        // Keep the history in memory only
+        success = false;
+        init_empty();
+    }
+    if (legacy != NULL) {
+        import_legacy(legacy, legacy_size);
+        free(legacy);
+    }
+    return success;
+}
+
+void printout_close() {
+    if (fd != -1) {
+        msync(map, data_end, MS_SYNC);
+        munmap(map, map_capacity);
+        if (ftruncate(fd, data_end) == -1)
+            ; // Not fatal; the header still tells where the data ends
+        close(fd);
+        fd = -1;
+    } else
+        free(map);
+    map = NULL;
+    map_capacity = 0;
+    free(records);
+    records = NULL;
+    records_count = records_capacity = 0;
+    total_rows = 0;
+}
+
+void printout_clear() {
+    data_end = HEADER_SIZE;
+    update_header();
+    records_count = 0;
+    total_rows = 0;
+    last_record = 0;
+    if (fd != -1 && map_capacity > MIN_CAPACITY) {
+        munmap(map, map_capacity);
+        map = NULL;
+        map_capacity = 0;
+        if (ftruncate(fd, MIN_CAPACITY) == 0) {
+            void *newmap = mmap(NULL, MIN_CAPACITY, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (newmap != MAP_FAILED) {
+                map = (unsigned char *) newmap;
+                map_capacity = MIN_CAPACITY;
+            }
+        }
+        if (map == NULL) {
+            // Fall back on keeping the history in memory
+            close(fd);
+            fd = -1;
+        }
+        init_empty();
+    }
+}
+
+bool printout_append(const char *text, int length,
+                     const char *bits, int bytesperline,
+                     int x, int y, int width, int height) {
+    if (text == NULL)
+        length = -1;
+    int8 offset = data_end;
+    int8 size = RECORD_HEADER_SIZE + (length < 0 ? 0 : length)
+                + (int8) height * PRINTOUT_BYTESPERLINE;
+    if (!ensure_capacity(offset + size))
+        return false;
+    if (!add_to_index(offset, height))
+        return false;
+
+    put_int4(offset, height);
+    put_int4(offset + 4, length);
+    if (length > 0)
+        memcpy(map + offset + RECORD_HEADER_SIZE, text, length);
+    unsigned char *dst = map + offset + RECORD_HEADER_SIZE + (length < 0 ? 0 : length);
+    memset(dst, 0, height * PRINTOUT_BYTESPERLINE);
+    for (int yy = 0; yy < height; yy++) {
+        const char *src = bits + (y + yy) * bytesperline;
+        for (int xx = 0; xx < PRINTOUT_WIDTH && xx < width; xx++)
+            if ((src[(x + xx) >> 3] & (1 << ((x + xx) & 7))) != 0)
+                dst[xx >> 3] |= 1 << (xx & 7);
+        dst += PRINTOUT_BYTESPERLINE;
+    }
+
+    data_end = offset + size;
+    update_header();
+    return true;
+}
+
+int4 printout_rows() {
+    return total_rows;
+}
+
+const unsigned char *printout_row(int4 row) {
+    // Rows are usually requested in sequence, so try the record that
+    // was used last time, and the one after that, before searching.
+    int4 r = last_record;
+    if (r >= records_count || records[r].row > row) {
+        r = -1;
+    } else if (r + 1 < records_count && records[r + 1].row <= row) {
+        r++;
+        if (r + 1 < records_count && records[r + 1].row <= row)
+            r = -1;
+    }
+    if (r == -1) {
+        int4 lo = 0, hi = records_count - 1;
+        while (lo < hi) {
+            int4 mid = (lo + hi + 1) / 2;
+            if (records[mid].row <= row)
+                lo = mid;
+            else
+                hi = mid - 1;
+        }
+        r = lo;
+    }
+    last_record = r;
+    return map + record_bits(r) + (int8) (row - records[r].row) * PRINTOUT_BYTESPERLINE;
+}
+
+int4 printout_records() {
+    return records_count;
+}
+
+void printout_record(int4 index, const char **text, int *length,
+                     const unsigned char **bits, int *height) {
+    int8 offset = records[index].offset;
+    *height = get_int4(offset);
+    *length = get_int4(offset + 4);
+    *text = *length < 0 ? NULL : (const char *) map + offset + RECORD_HEADER_SIZE;
+    *bits = map + record_bits(index);
+}
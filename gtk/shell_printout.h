@@ -0,0 +1,94 @@
+///////////////////////////////////////////////////////////////////////////////
+// Free42 -- an HP-42S calculator simulator
+// Copyright (C) 2004-2024  Thomas Okken
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License, version 2,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see http://www.gnu.org/licenses/.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef SHELL_PRINTOUT_H
+#define SHELL_PRINTOUT_H 1
+
+#include "free42.h"
+
+/* The print-out history is kept in an append-only, memory-mapped file, so it
+ * is not limited in size, and it is saved incrementally as things are
+ * printed, rather than all at once on exit.
+ * Every call to shell_print() becomes one record, holding the text (if any)
+ * and the bitmap, at its native resolution of 143 pixels wide, with
+ * PRINTOUT_BYTESPERLINE bytes per row. An in-memory index of record offsets
+ * and starting rows allows any row to be found in O(log n), so the print-out
+ * window only ever needs to look at the rows that are actually visible.
+ */
+
+#define PRINTOUT_WIDTH 143
+#define PRINTOUT_BYTESPERLINE 18
+
+/* printout_open()
+ *
+ * Opens the history file, creating it if necessary. A print-out file in the
+ * old fixed-size format is converted on the fly. Returns false if the file
+ * could not be opened or mapped; in that case, the history is still kept,
+ * but only in memory.
+ */
+bool printout_open(const char *filename);
+
+/* printout_close()
+ *
+ * Flushes the mapping, truncates the file to its actual length, and closes
+ * it. Call this on exit.
+ */
+void printout_close();
+
+/* printout_clear()
+ *
+ * Deletes all records.
+ */
+void printout_clear();
+
+/* printout_append()
+ *
+ * Appends a record; the parameters are the same as those of shell_print().
+ * Returns false if the record could not be stored because of a memory or
+ * I/O failure.
+ */
+bool printout_append(const char *text, int length,
+                     const char *bits, int bytesperline,
+                     int x, int y, int width, int height);
+
+/* printout_rows()
+ *
+ * Returns the total number of bitmap rows in the history.
+ */
+int4 printout_rows();
+
+/* printout_row()
+ *
+ * Returns a pointer to the given bitmap row, 0 <= row < printout_rows().
+ * The pointer is valid until the next call to printout_append() or
+ * printout_clear().
+ */
+const unsigned char *printout_row(int4 row);
+
+/* printout_records()
+ * printout_record()
+ *
+ * Record access, for copying the print-out as text. For graphics records,
+ * *text is set to NULL and *length to -1. The bitmap rows of a record are
+ * contiguous, so *bits can be read as a 'height' rows tall bitmap with
+ * PRINTOUT_BYTESPERLINE bytes per row.
+ */
+int4 printout_records();
+void printout_record(int4 index, const char **text, int *length,
+                     const unsigned char **bits, int *height);
+
+#endif